@@ -12,7 +12,10 @@ pub mod abi {
 }
 
 pub mod syscall {
-    pub const ABI_REVISION: u16 = 2;
+    use core::cell::UnsafeCell;
+    use core::sync::atomic::{AtomicU32, Ordering};
+
+    pub const ABI_REVISION: u16 = 4;
 
     pub const SYS_WRITE: u64 = 1;
     pub const SYS_READ: u64 = 2;
@@ -22,11 +25,23 @@ pub mod syscall {
     pub const SYS_SOCKET: u64 = 6;
     pub const SYS_SENDTO: u64 = 7;
     pub const SYS_RECVFROM: u64 = 8;
+    pub const SYS_CONNECT: u64 = 9;
+    pub const SYS_SEND: u64 = 10;
+    pub const SYS_RECV: u64 = 11;
+    pub const SYS_CLOSE: u64 = 12;
+    pub const SYS_RING_SETUP: u64 = 13;
+    pub const SYS_RING_ENTER: u64 = 14;
+    pub const SYS_FS_READ: u64 = 15;
+    pub const SYS_PRESENT: u64 = 16;
 
     pub const AF_INET: u64 = 2;
     pub const SOCK_DGRAM: u64 = 2;
     pub const IPPROTO_UDP: u64 = 17;
     pub const UDP_SOCKET_FD: u64 = 1;
+    pub const SOCK_STREAM: u64 = 1;
+    pub const IPPROTO_TCP: u64 = 6;
+    /// TCP sockets are `TCP_SOCKET_FD_BASE + slot`.
+    pub const TCP_SOCKET_FD_BASE: u64 = 16;
 
     #[repr(C)]
     #[derive(Clone, Copy)]
@@ -78,6 +93,201 @@ pub mod syscall {
         }
     }
 
+    #[repr(C)]
+    #[derive(Clone, Copy)]
+    pub struct TcpConnectReq {
+        pub dst_ip: [u8; 4],
+        pub dst_port: u16,
+        pub reserved: u16,
+    }
+
+    impl TcpConnectReq {
+        pub const fn new(dst_ip: [u8; 4], dst_port: u16) -> Self {
+            Self {
+                dst_ip,
+                dst_port,
+                reserved: 0,
+            }
+        }
+    }
+
+    #[repr(C)]
+    #[derive(Clone, Copy)]
+    pub struct FsReadReq {
+        pub path_ptr: u64,
+        pub path_len: u64,
+        pub offset: u64,
+        pub buf_ptr: u64,
+        pub buf_cap: u64,
+    }
+
+    impl FsReadReq {
+        pub const fn new(
+            path_ptr: u64,
+            path_len: u64,
+            offset: u64,
+            buf_ptr: u64,
+            buf_cap: u64,
+        ) -> Self {
+            Self {
+                path_ptr,
+                path_len,
+                offset,
+                buf_ptr,
+                buf_cap,
+            }
+        }
+    }
+
+    /// A frame of `width * height` XRGB pixels, row-major, for the Doom view; `pixels_len`
+    /// counts pixels, not bytes.
+    #[repr(C)]
+    #[derive(Clone, Copy)]
+    pub struct PresentReq {
+        pub width: u32,
+        pub height: u32,
+        pub pixels_ptr: u64,
+        pub pixels_len: u64,
+    }
+
+    impl PresentReq {
+        pub const fn new(width: u32, height: u32, pixels_ptr: u64, pixels_len: u64) -> Self {
+            Self {
+                width,
+                height,
+                pixels_ptr,
+                pixels_len,
+            }
+        }
+    }
+
+    /// Submission and completion slots per ring; a power of two so the free-running u32
+    /// positions index it across wraparound.
+    pub const RING_ENTRIES: usize = 64;
+
+    /// One queued syscall: the same number and arguments as a direct call.
+    #[repr(C)]
+    #[derive(Clone, Copy)]
+    pub struct RingSqe {
+        pub number: u64,
+        pub args: [u64; 3],
+        pub user_data: u64,
+    }
+
+    impl RingSqe {
+        pub const fn new(number: u64, args: [u64; 3], user_data: u64) -> Self {
+            Self {
+                number,
+                args,
+                user_data,
+            }
+        }
+    }
+
+    /// Result of one submission, tagged with its `user_data`.
+    #[repr(C)]
+    #[derive(Clone, Copy)]
+    pub struct RingCqe {
+        pub user_data: u64,
+        pub result: i64,
+    }
+
+    /// Submission/completion ring registered with `SYS_RING_SETUP`. The task is the only
+    /// submitter (`submit`) and completion reaper (`reap`); the kernel is the only consumer of
+    /// submissions and producer of completions. The kernel takes a submission only while a
+    /// completion slot is free for it, so the completion queue never overflows.
+    #[repr(C)]
+    pub struct SyscallRing {
+        sq_head: AtomicU32,
+        sq_tail: AtomicU32,
+        cq_head: AtomicU32,
+        cq_tail: AtomicU32,
+        sq: UnsafeCell<[RingSqe; RING_ENTRIES]>,
+        cq: UnsafeCell<[RingCqe; RING_ENTRIES]>,
+    }
+
+    // SAFETY: each slot is written only by its queue's producer while outside `head..tail`
+    // and read only by its consumer while inside it; the Release store of a position hands
+    // the slots over to the other side's Acquire load.
+    unsafe impl Sync for SyscallRing {}
+
+    impl SyscallRing {
+        pub const fn new() -> Self {
+            Self {
+                sq_head: AtomicU32::new(0),
+                sq_tail: AtomicU32::new(0),
+                cq_head: AtomicU32::new(0),
+                cq_tail: AtomicU32::new(0),
+                sq: UnsafeCell::new([RingSqe::new(0, [0; 3], 0); RING_ENTRIES]),
+                cq: UnsafeCell::new(
+                    [RingCqe {
+                        user_data: 0,
+                        result: 0,
+                    }; RING_ENTRIES],
+                ),
+            }
+        }
+
+        /// Task: queues `sqe`, or returns false when the submission queue is full.
+        pub fn submit(&self, sqe: RingSqe) -> bool {
+            let tail = self.sq_tail.load(Ordering::Relaxed);
+            if tail.wrapping_sub(self.sq_head.load(Ordering::Acquire)) as usize >= RING_ENTRIES {
+                return false;
+            }
+            // SAFETY: the slot at `tail` is outside `head..tail`, so the kernel does not read
+            // it until the store below publishes it.
+            unsafe { (*self.sq.get())[tail as usize % RING_ENTRIES] = sqe };
+            self.sq_tail.store(tail.wrapping_add(1), Ordering::Release);
+            true
+        }
+
+        /// Task: takes the oldest completion, without entering the kernel.
+        pub fn reap(&self) -> Option<RingCqe> {
+            let head = self.cq_head.load(Ordering::Relaxed);
+            if self.cq_tail.load(Ordering::Acquire) == head {
+                return None;
+            }
+            // SAFETY: the slot at `head` is inside `head..tail`, so it holds a published
+            // completion the kernel will not overwrite until `head` moves past it.
+            let cqe = unsafe { (*self.cq.get())[head as usize % RING_ENTRIES] };
+            self.cq_head.store(head.wrapping_add(1), Ordering::Release);
+            Some(cqe)
+        }
+
+        /// Kernel: takes the oldest submission if a completion slot is free for its result.
+        pub fn next_submission(&self) -> Option<RingSqe> {
+            let cq_used = self
+                .cq_tail
+                .load(Ordering::Relaxed)
+                .wrapping_sub(self.cq_head.load(Ordering::Acquire));
+            let head = self.sq_head.load(Ordering::Relaxed);
+            if cq_used as usize >= RING_ENTRIES || self.sq_tail.load(Ordering::Acquire) == head {
+                return None;
+            }
+            // SAFETY: the slot at `head` is inside `head..tail`, so the task has published it
+            // and will not reuse it until `head` moves past it.
+            let sqe = unsafe { (*self.sq.get())[head as usize % RING_ENTRIES] };
+            self.sq_head.store(head.wrapping_add(1), Ordering::Release);
+            Some(sqe)
+        }
+
+        /// Kernel: posts the result of a submission taken with `next_submission`, which
+        /// reserved the slot.
+        pub fn complete(&self, cqe: RingCqe) {
+            let tail = self.cq_tail.load(Ordering::Relaxed);
+            // SAFETY: `next_submission` checked this slot is outside `head..tail`, so the task
+            // does not read it until the store below publishes it.
+            unsafe { (*self.cq.get())[tail as usize % RING_ENTRIES] = cqe };
+            self.cq_tail.store(tail.wrapping_add(1), Ordering::Release);
+        }
+    }
+
+    impl Default for SyscallRing {
+        fn default() -> Self {
+            Self::new()
+        }
+    }
+
     pub const fn name(number: u64) -> &'static str {
         match number {
             SYS_WRITE => "write",
@@ -88,6 +298,14 @@ pub mod syscall {
             SYS_SOCKET => "socket",
             SYS_SENDTO => "sendto",
             SYS_RECVFROM => "recvfrom",
+            SYS_CONNECT => "connect",
+            SYS_SEND => "send",
+            SYS_RECV => "recv",
+            SYS_CLOSE => "close",
+            SYS_RING_SETUP => "ring_setup",
+            SYS_RING_ENTER => "ring_enter",
+            SYS_FS_READ => "fs_read",
+            SYS_PRESENT => "present",
             _ => "unknown",
         }
     }
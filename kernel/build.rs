@@ -13,6 +13,7 @@ fn main() {
         .parent()
         .expect("kernel crate must live inside workspace root");
     emit_wad_embed(repo_root);
+    emit_link_map(repo_root);
 
     let doomgeneric_ready = env::var("ARROST_DOOM_GENERIC_READY")
         .map(|value| value == "true")
@@ -38,6 +39,7 @@ fn main() {
         .flag("-fdata-sections")
         .flag("-Wall")
         .flag("-Wextra")
+        .flag("-fno-omit-frame-pointer")
         .define("NORMALUNIX", None)
         .define("LINUX", None)
         .define("D_DEFAULT_SOURCE", None)
@@ -47,6 +49,7 @@ fn main() {
     let runner = c_dir.join("doomgeneric_runner.c");
     let platform = c_dir.join("doomgeneric_arrost.c");
     let audio_stub = c_dir.join("doomgeneric_audio_stub.c");
+    let wad_file = c_dir.join("doomgeneric_wad_arrost.c");
     let libc_shim = c_dir.join("freestanding_libc.c");
     let stub = c_dir.join("doomgeneric_runner_stub.c");
     let shim_include = c_dir.join("freestanding_include");
@@ -64,6 +67,8 @@ fn main() {
                 && !path.ends_with("doomgeneric_win.c")
                 && !path.ends_with("doomgeneric_allegro.c")
                 && !path.ends_with("doomgeneric_emscripten.c")
+                // Replaced by the zero-copy class in doomgeneric_wad_arrost.c.
+                && !path.ends_with("w_file_stdc.c")
         });
 
         build
@@ -76,6 +81,7 @@ fn main() {
             .file(&libc_shim)
             .file(&runner)
             .file(&audio_stub)
+            .file(&wad_file)
             .file(&platform);
         for file in &core_files {
             build.file(file);
@@ -95,6 +101,7 @@ fn main() {
     println!("cargo:rerun-if-changed={}", runner.display());
     println!("cargo:rerun-if-changed={}", platform.display());
     println!("cargo:rerun-if-changed={}", audio_stub.display());
+    println!("cargo:rerun-if-changed={}", wad_file.display());
     println!("cargo:rerun-if-changed={}", libc_shim.display());
     println!("cargo:rerun-if-changed={}", stub.display());
     println!("cargo:rerun-if-changed={}", core_source.display());
@@ -124,6 +131,10 @@ fn main() {
         "cargo:rerun-if-changed={}",
         shim_include.join("SDL_mixer.h").display()
     );
+    println!(
+        "cargo:rerun-if-changed={}",
+        shim_include.join("sys/mman.h").display()
+    );
     println!(
         "cargo:rerun-if-changed={}",
         include_dir.join("doomgeneric.h").display()
@@ -158,6 +169,31 @@ fn parse_makefile_sources(makefile: &Path, source_root: &Path) -> Vec<PathBuf> {
         .collect()
 }
 
+/// Has the linker write a symbol map next to the kernel binary, which
+/// `cargo xtask symbolize-profile` reads to name sampled addresses. `CARGO_TARGET_DIR` replaces
+/// `target` when set; a relative one is taken from the workspace root, where cargo runs.
+fn emit_link_map(repo_root: &Path) {
+    let target = env::var("TARGET").expect("TARGET must be set by cargo");
+    let profile = env::var("PROFILE").expect("PROFILE must be set by cargo");
+    let target_dir = env::var("CARGO_TARGET_DIR")
+        .map(PathBuf::from)
+        .map(|path| {
+            if path.is_absolute() {
+                path
+            } else {
+                repo_root.join(path)
+            }
+        })
+        .unwrap_or_else(|_| repo_root.join("target"));
+    println!("cargo:rerun-if-env-changed=CARGO_TARGET_DIR");
+    let out_dir = target_dir.join(target).join(profile);
+    fs::create_dir_all(&out_dir).expect("failed to create kernel output directory");
+    println!(
+        "cargo:rustc-link-arg-bins=-Map={}",
+        out_dir.join("arrost-kernel.map").display()
+    );
+}
+
 fn emit_wad_embed(repo_root: &Path) {
     let out_dir =
         PathBuf::from(env::var("OUT_DIR").expect("OUT_DIR must be set by cargo for build scripts"));
@@ -0,0 +1,132 @@
+// kernel/src/arch/x86_64/acpi.rs: ACPI RSDP/XSDT walk to the MADT, listing the local APICs.
+use crate::mem;
+use core::ptr::read_unaligned;
+
+const RSDP_SIGNATURE: &[u8; 8] = b"RSD PTR ";
+const MADT_SIGNATURE: &[u8; 4] = b"APIC";
+const RSDP_V1_LEN: usize = 20;
+const RSDP_V2_LEN: usize = 36;
+const SDT_HEADER_LEN: usize = 36;
+/// MADT fields after the header: local APIC address (u32) and flags (u32).
+const MADT_ENTRIES_OFFSET: usize = SDT_HEADER_LEN + 8;
+const MADT_LOCAL_APIC: u8 = 0;
+const LAPIC_ENABLED: u32 = 1 << 0;
+/// Upper bound on any table this walk reads, against corrupt length fields.
+const MAX_TABLE_LEN: usize = 64 * 1024;
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum AcpiError {
+    NoRsdp,
+    NotMapped,
+    BadChecksum,
+    BadTable,
+    NoMadt,
+}
+
+impl AcpiError {
+    pub const fn as_str(self) -> &'static str {
+        match self {
+            Self::NoRsdp => "no_rsdp",
+            Self::NotMapped => "not_mapped",
+            Self::BadChecksum => "bad_checksum",
+            Self::BadTable => "bad_table",
+            Self::NoMadt => "no_madt",
+        }
+    }
+}
+
+/// Fills `apic_ids` with the local APIC ID of every enabled processor in the MADT, in table
+/// order, and returns how many there were (capped at the slice length).
+pub fn local_apic_ids(rsdp_phys: Option<u64>, apic_ids: &mut [u8]) -> Result<usize, AcpiError> {
+    let madt = find_madt(rsdp_phys.ok_or(AcpiError::NoRsdp)?)?;
+    let mut count = 0usize;
+    let mut offset = MADT_ENTRIES_OFFSET;
+    while offset + 2 <= madt.len() {
+        let kind = madt[offset];
+        let len = usize::from(madt[offset + 1]);
+        if len < 2 || offset + len > madt.len() {
+            return Err(AcpiError::BadTable);
+        }
+        if kind == MADT_LOCAL_APIC && len >= 8 {
+            let flags = u32::from_le_bytes([
+                madt[offset + 4],
+                madt[offset + 5],
+                madt[offset + 6],
+                madt[offset + 7],
+            ]);
+            if flags & LAPIC_ENABLED != 0 && count < apic_ids.len() {
+                apic_ids[count] = madt[offset + 3];
+                count += 1;
+            }
+        }
+        offset += len;
+    }
+    Ok(count)
+}
+
+fn find_madt(rsdp_phys: u64) -> Result<&'static [u8], AcpiError> {
+    let rsdp = phys_bytes(rsdp_phys, RSDP_V1_LEN)?;
+    if &rsdp[..8] != RSDP_SIGNATURE {
+        return Err(AcpiError::BadTable);
+    }
+    if !checksum_ok(rsdp) {
+        return Err(AcpiError::BadChecksum);
+    }
+    let revision = rsdp[15];
+    let (root_phys, entry_size) = if revision >= 2 {
+        let rsdp = phys_bytes(rsdp_phys, RSDP_V2_LEN)?;
+        if !checksum_ok(rsdp) {
+            return Err(AcpiError::BadChecksum);
+        }
+        // SAFETY: `rsdp` spans the 36-byte v2 structure; the XSDT address sits at byte 24.
+        (
+            unsafe { read_unaligned(rsdp.as_ptr().add(24).cast::<u64>()) },
+            8,
+        )
+    } else {
+        // SAFETY: `rsdp` spans the 20-byte v1 structure; the RSDT address sits at byte 16.
+        let rsdt = unsafe { read_unaligned(rsdp.as_ptr().add(16).cast::<u32>()) };
+        (u64::from(rsdt), 4)
+    };
+
+    let root = sdt(root_phys)?;
+    for entry in root[SDT_HEADER_LEN..].chunks_exact(entry_size) {
+        let table_phys = if entry_size == 8 {
+            u64::from_le_bytes(entry.try_into().map_err(|_| AcpiError::BadTable)?)
+        } else {
+            u64::from(u32::from_le_bytes(
+                entry.try_into().map_err(|_| AcpiError::BadTable)?,
+            ))
+        };
+        let header = phys_bytes(table_phys, SDT_HEADER_LEN)?;
+        if &header[..4] == MADT_SIGNATURE {
+            return sdt(table_phys);
+        }
+    }
+    Err(AcpiError::NoMadt)
+}
+
+/// A whole system description table, length taken from its header and checksum verified.
+fn sdt(phys: u64) -> Result<&'static [u8], AcpiError> {
+    let header = phys_bytes(phys, SDT_HEADER_LEN)?;
+    let len = u32::from_le_bytes([header[4], header[5], header[6], header[7]]) as usize;
+    if !(SDT_HEADER_LEN..=MAX_TABLE_LEN).contains(&len) {
+        return Err(AcpiError::BadTable);
+    }
+    let table = phys_bytes(phys, len)?;
+    if !checksum_ok(table) {
+        return Err(AcpiError::BadChecksum);
+    }
+    Ok(table)
+}
+
+fn phys_bytes(phys: u64, len: usize) -> Result<&'static [u8], AcpiError> {
+    let virt = mem::phys_to_virt(phys).ok_or(AcpiError::NotMapped)?;
+    // SAFETY: the bootloader maps all physical memory at the offset `phys_to_virt` applies,
+    // and firmware keeps ACPI tables reserved and unchanged for the kernel's lifetime.
+    Ok(unsafe { core::slice::from_raw_parts(virt as *const u8, len) })
+}
+
+fn checksum_ok(bytes: &[u8]) -> bool {
+    bytes.iter().fold(0u8, |sum, byte| sum.wrapping_add(*byte)) == 0
+}
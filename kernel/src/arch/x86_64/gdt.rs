@@ -1,4 +1,5 @@
-// kernel/src/arch/x86_64/gdt.rs: GDT/TSS setup with dedicated IST stack for double faults.
+// kernel/src/arch/x86_64/gdt.rs: GDT/TSS setup with dedicated IST stack for double faults, one
+// set for the BSP and one per application processor.
 use core::sync::atomic::{AtomicBool, Ordering};
 use x86_64::VirtAddr;
 use x86_64::instructions::segmentation::{CS, SS, Segment};
@@ -8,6 +9,9 @@ use x86_64::structures::gdt::{Descriptor, GlobalDescriptorTable};
 use x86_64::structures::tss::TaskStateSegment;
 
 pub const DOUBLE_FAULT_IST_INDEX: u16 = 0;
+/// Application processors that can get their own GDT and TSS; a TSS is marked busy when
+/// loaded, so CPUs cannot share one.
+pub const AP_SLOTS: usize = 7;
 
 const DOUBLE_FAULT_STACK_SIZE: usize = 5 * 4096;
 
@@ -20,6 +24,11 @@ static mut GDT: GlobalDescriptorTable = GlobalDescriptorTable::new();
 static mut CODE_SELECTOR: SegmentSelector = SegmentSelector::NULL;
 static mut DATA_SELECTOR: SegmentSelector = SegmentSelector::NULL;
 static mut TSS_SELECTOR: SegmentSelector = SegmentSelector::NULL;
+static mut AP_DOUBLE_FAULT_STACKS: [[u8; DOUBLE_FAULT_STACK_SIZE]; AP_SLOTS] =
+    [[0; DOUBLE_FAULT_STACK_SIZE]; AP_SLOTS];
+static mut AP_TSS: [TaskStateSegment; AP_SLOTS] = [TaskStateSegment::new(); AP_SLOTS];
+static mut AP_GDT: [GlobalDescriptorTable; AP_SLOTS] =
+    [const { GlobalDescriptorTable::new() }; AP_SLOTS];
 
 #[derive(Clone, Copy)]
 pub struct GdtInitReport {
@@ -68,3 +77,29 @@ pub fn init() -> GdtInitReport {
         }
     }
 }
+
+/// Loads a GDT and TSS of the same layout as the BSP's on the calling application processor.
+///
+/// # Safety
+/// Must run once per `slot`, on the AP that owns it, after `init` has run on the BSP.
+pub unsafe fn init_ap(slot: usize) {
+    // SAFETY: the caller guarantees this AP is the only user of `slot`, so its statics are
+    // not aliased; they live for the kernel lifetime as `load` requires.
+    unsafe {
+        let stack_start = VirtAddr::from_ptr(core::ptr::addr_of!(AP_DOUBLE_FAULT_STACKS[slot]));
+        let tss = &mut *core::ptr::addr_of_mut!(AP_TSS[slot]);
+        tss.interrupt_stack_table[DOUBLE_FAULT_IST_INDEX as usize] =
+            stack_start + DOUBLE_FAULT_STACK_SIZE as u64;
+
+        let gdt = &mut *core::ptr::addr_of_mut!(AP_GDT[slot]);
+        gdt.append(Descriptor::kernel_code_segment());
+        gdt.append(Descriptor::kernel_data_segment());
+        gdt.append(Descriptor::tss_segment(&*core::ptr::addr_of!(AP_TSS[slot])));
+
+        let gdt: &'static GlobalDescriptorTable = &*core::ptr::addr_of!(AP_GDT[slot]);
+        gdt.load();
+        CS::set_reg(CODE_SELECTOR);
+        SS::set_reg(DATA_SELECTOR);
+        load_tss(TSS_SELECTOR);
+    }
+}
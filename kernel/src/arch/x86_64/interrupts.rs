@@ -1,12 +1,23 @@
 // kernel/src/arch/x86_64/interrupts.rs: IDT and interrupt handlers for M3.
-use crate::arch::x86_64::{gdt, pic, pit, port};
-use crate::{keyboard, mouse, serial, time};
+use crate::arch::x86_64::{gdt, lapic, pic, pit, port, smp, switch};
+use crate::proc::sched;
+use crate::{audio, keyboard, mouse, net, profile, serial, time};
 use core::mem::MaybeUninit;
-use core::sync::atomic::{AtomicBool, Ordering};
+use core::sync::atomic::{AtomicBool, AtomicU8, AtomicU32, Ordering};
+use x86_64::VirtAddr;
 use x86_64::instructions::{hlt, interrupts};
 use x86_64::structures::idt::{InterruptDescriptorTable, InterruptStackFrame};
 
 static IDT_READY: AtomicBool = AtomicBool::new(false);
+static NET_VECTOR: AtomicU8 = AtomicU8::new(0);
+static NET_UNCLAIMED: AtomicU32 = AtomicU32::new(0);
+static SOUND_VECTOR: AtomicU8 = AtomicU8::new(0);
+static SOUND_UNCLAIMED: AtomicU32 = AtomicU32::new(0);
+
+/// PCI lines can be shared with devices that are only polled and never acknowledge their
+/// own interrupt; after this many back-to-back interrupts that no routed virtio device
+/// claimed the line is masked and its drivers fall back to polling.
+const PCI_UNCLAIMED_LIMIT: u32 = 256;
 static mut IDT: MaybeUninit<InterruptDescriptorTable> = MaybeUninit::uninit();
 
 #[derive(Clone, Copy)]
@@ -14,6 +25,7 @@ static mut IDT: MaybeUninit<InterruptDescriptorTable> = MaybeUninit::uninit();
 enum InterruptIndex {
     Timer = pic::MASTER_OFFSET,
     Keyboard,
+    Serial = pic::MASTER_OFFSET + 4,
     Mouse = pic::SLAVE_OFFSET + 4,
 }
 
@@ -34,6 +46,7 @@ pub struct InterruptInitReport {
     pub pic_slave_mask: u8,
     pub pit_hz: u32,
     pub pit_divisor: u16,
+    pub clock: time::ClockReport,
     pub mouse_backend: &'static str,
     pub mouse_ready: bool,
     pub mouse_ack_defaults: u8,
@@ -54,7 +67,17 @@ pub fn init() -> InterruptInitReport {
             idt.double_fault
                 .set_handler_fn(double_fault_handler)
                 .set_stack_index(gdt::DOUBLE_FAULT_IST_INDEX);
-            idt[InterruptIndex::Timer.as_u8()].set_handler_fn(timer_interrupt_handler);
+            // IRQ0 and the yield vector go through the register-saving stubs so the
+            // scheduler can resume a different thread's stack.
+            idt[InterruptIndex::Timer.as_u8()]
+                .set_handler_addr(VirtAddr::new(switch::timer_stub_addr()));
+            idt[switch::YIELD_VECTOR].set_handler_addr(VirtAddr::new(switch::yield_stub_addr()));
+            idt[lapic::TIMER_VECTOR]
+                .set_handler_addr(VirtAddr::new(switch::lapic_timer_stub_addr()));
+            idt[smp::WAKE_VECTOR].set_handler_addr(VirtAddr::new(switch::wake_stub_addr()));
+            idt[smp::PROFILE_VECTOR].set_handler_addr(VirtAddr::new(switch::profile_stub_addr()));
+            idt[lapic::SPURIOUS_VECTOR].set_handler_fn(spurious_interrupt_handler);
+            idt[InterruptIndex::Serial.as_u8()].set_handler_fn(serial_interrupt_handler);
             idt[InterruptIndex::Keyboard.as_u8()].set_handler_fn(keyboard_interrupt_handler);
             idt[InterruptIndex::Mouse.as_u8()].set_handler_fn(mouse_interrupt_handler);
 
@@ -67,7 +90,15 @@ pub fn init() -> InterruptInitReport {
 
     let pic_report = pic::init();
     let mouse_report = mouse::init();
+    let clock = time::init_clocksource();
     let pit_divisor = pit::init(time::PIT_HZ);
+    if time::one_shot() {
+        // The local APIC timer is armed on demand; the periodic tick would only wake idle.
+        pic::mask(0);
+    }
+    if serial::enable_rx_interrupt() {
+        pic::unmask(4);
+    }
     interrupts::enable();
 
     InterruptInitReport {
@@ -80,6 +111,7 @@ pub fn init() -> InterruptInitReport {
         pic_slave_mask: pic_report.slave_mask,
         pit_hz: time::PIT_HZ,
         pit_divisor,
+        clock,
         mouse_backend: mouse_report.backend,
         mouse_ready: mouse_report.ready,
         mouse_ack_defaults: mouse_report.ack_defaults,
@@ -87,6 +119,48 @@ pub fn init() -> InterruptInitReport {
     }
 }
 
+/// Loads the shared IDT on an application processor. Its GDT and TSS must already be loaded,
+/// since the double-fault entry switches to an IST stack.
+pub fn init_ap() {
+    if !IDT_READY.load(Ordering::Acquire) {
+        return;
+    }
+    // SAFETY: the BSP built and loaded the IDT before starting any AP; it is never freed.
+    unsafe { (&*core::ptr::addr_of!(IDT).cast::<InterruptDescriptorTable>()).load() };
+}
+
+/// Routes the virtio-net PCI interrupt line through the PIC. Lines already owned by the
+/// timer, keyboard, cascade, COM1, or mouse are refused and the driver stays in polling mode.
+pub fn enable_net_irq(line: u8) -> bool {
+    route_pci_line(line, &NET_VECTOR, net_interrupt_handler)
+}
+
+/// Routes the virtio-sound PCI interrupt line, under the same rules as `enable_net_irq`.
+pub fn enable_sound_irq(line: u8) -> bool {
+    route_pci_line(line, &SOUND_VECTOR, sound_interrupt_handler)
+}
+
+fn route_pci_line(
+    line: u8,
+    vector_slot: &AtomicU8,
+    handler: extern "x86-interrupt" fn(InterruptStackFrame),
+) -> bool {
+    if line >= 16 || matches!(line, 0 | 1 | 2 | 4 | 12) || !IDT_READY.load(Ordering::Acquire) {
+        return false;
+    }
+    let vector = pic::MASTER_OFFSET + line;
+    vector_slot.store(vector, Ordering::Release);
+    // SAFETY: the IDT is initialized and loaded. A line not yet routed is still masked; on
+    // one already routed the old handler also serves this device, so either is correct
+    // while the entry changes.
+    unsafe {
+        let idt = &mut *core::ptr::addr_of_mut!(IDT).cast::<InterruptDescriptorTable>();
+        idt[vector].set_handler_fn(handler);
+    }
+    pic::unmask(line);
+    true
+}
+
 extern "x86-interrupt" fn breakpoint_handler(stack_frame: InterruptStackFrame) {
     serial::write_line("EXCEPTION: BREAKPOINT");
     serial::write_fmt(format_args!("{stack_frame:#?}\n"));
@@ -103,15 +177,56 @@ extern "x86-interrupt" fn double_fault_handler(
     }
 }
 
-extern "x86-interrupt" fn timer_interrupt_handler(_stack_frame: InterruptStackFrame) {
+/// IRQ0 body, called from the timer stub with the interrupted thread's saved stack pointer;
+/// returns the stack pointer to resume.
+pub extern "C" fn timer_switch(rsp: u64) -> u64 {
     time::on_timer_tick();
+    profile::on_timer(rsp);
     pic::end_of_interrupt(InterruptIndex::Timer.as_u8());
+    sched::preempt(rsp)
+}
+
+/// Local APIC one-shot timer body; the scheduler re-arms it for the next deadline.
+pub extern "C" fn lapic_timer_switch(rsp: u64) -> u64 {
+    time::on_timer_event();
+    profile::on_timer(rsp);
+    lapic::end_of_interrupt();
+    sched::preempt(rsp)
+}
+
+/// `smp::PROFILE_VECTOR` body on an AP: one profiler sample of whatever it interrupted.
+pub extern "C" fn profile_switch(rsp: u64) -> u64 {
+    lapic::end_of_interrupt();
+    profile::sample(rsp);
+    rsp
+}
+
+/// `smp::WAKE_VECTOR` body. On an AP the interrupt only ends a `hlt`; on the BSP a thread
+/// woken by the sender's `sched::notify` may preempt the running one right away.
+pub extern "C" fn wake_switch(rsp: u64) -> u64 {
+    lapic::end_of_interrupt();
+    if smp::is_bsp() {
+        sched::preempt(rsp)
+    } else {
+        rsp
+    }
+}
+
+extern "x86-interrupt" fn spurious_interrupt_handler(_stack_frame: InterruptStackFrame) {
+    // Spurious APIC interrupts are not acknowledged.
+}
+
+/// COM1 received data. The byte stays in the UART for `shell::poll`; this only wakes threads.
+extern "x86-interrupt" fn serial_interrupt_handler(_stack_frame: InterruptStackFrame) {
+    sched::note_irq();
+    pic::end_of_interrupt(InterruptIndex::Serial.as_u8());
 }
 
 extern "x86-interrupt" fn keyboard_interrupt_handler(_stack_frame: InterruptStackFrame) {
     // SAFETY: reading port 0x60 acknowledges and consumes the current PS/2 scancode byte.
     let scancode = unsafe { port::inb(0x60) };
     keyboard::handle_scancode(scancode);
+    sched::note_irq();
     pic::end_of_interrupt(InterruptIndex::Keyboard.as_u8());
 }
 
@@ -119,5 +234,34 @@ extern "x86-interrupt" fn mouse_interrupt_handler(_stack_frame: InterruptStackFr
     // SAFETY: reading port 0x60 acknowledges and consumes the current PS/2 mouse data byte.
     let byte = unsafe { port::inb(0x60) };
     mouse::handle_data_byte(byte);
+    sched::note_irq();
     pic::end_of_interrupt(InterruptIndex::Mouse.as_u8());
 }
+
+extern "x86-interrupt" fn net_interrupt_handler(_stack_frame: InterruptStackFrame) {
+    pci_interrupt(NET_VECTOR.load(Ordering::Acquire), &NET_UNCLAIMED);
+}
+
+extern "x86-interrupt" fn sound_interrupt_handler(_stack_frame: InterruptStackFrame) {
+    pci_interrupt(SOUND_VECTOR.load(Ordering::Acquire), &SOUND_UNCLAIMED);
+}
+
+/// Shared body of the PCI line handlers. Virtio devices often share a line, so every routed
+/// device is asked; each acknowledges only its own interrupt.
+fn pci_interrupt(vector: u8, unclaimed: &AtomicU32) {
+    let net = net::handle_interrupt();
+    let sound = audio::handle_interrupt();
+    if net || sound {
+        unclaimed.store(0, Ordering::Relaxed);
+    } else if unclaimed.fetch_add(1, Ordering::Relaxed) + 1 >= PCI_UNCLAIMED_LIMIT {
+        pic::mask(vector - pic::MASTER_OFFSET);
+        if NET_VECTOR.load(Ordering::Acquire) == vector {
+            net::on_irq_disabled();
+        }
+        if SOUND_VECTOR.load(Ordering::Acquire) == vector {
+            audio::on_irq_disabled();
+        }
+    }
+    sched::note_irq();
+    pic::end_of_interrupt(vector);
+}
@@ -0,0 +1,194 @@
+// kernel/src/arch/x86_64/lapic.rs: local APIC timer in one-shot mode, the tickless event source,
+// and inter-processor interrupts for SMP bring-up and wakeups.
+use crate::mem;
+use core::arch::x86_64::__cpuid;
+use core::ptr::{read_volatile, write_volatile};
+use core::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use x86_64::registers::model_specific::Msr;
+
+pub const TIMER_VECTOR: u8 = 0x30;
+pub const SPURIOUS_VECTOR: u8 = 0xFF;
+
+const IA32_APIC_BASE: u32 = 0x1B;
+const APIC_BASE_ENABLE: u64 = 1 << 11;
+const APIC_BASE_X2APIC: u64 = 1 << 10;
+const APIC_BASE_ADDR_MASK: u64 = 0x000F_FFFF_FFFF_F000;
+const CPUID_EDX_APIC: u32 = 1 << 9;
+
+const REG_ID: usize = 0x20;
+const REG_EOI: usize = 0xB0;
+const REG_SVR: usize = 0xF0;
+const REG_ICR_LOW: usize = 0x300;
+const REG_ICR_HIGH: usize = 0x310;
+const REG_LVT_TIMER: usize = 0x320;
+const REG_LVT_LINT0: usize = 0x350;
+const REG_LVT_LINT1: usize = 0x360;
+const REG_TIMER_INITIAL: usize = 0x380;
+const REG_TIMER_CURRENT: usize = 0x390;
+const REG_TIMER_DIVIDE: usize = 0x3E0;
+
+const SVR_ENABLE: u32 = 1 << 8;
+const LVT_MASKED: u32 = 1 << 16;
+const LVT_EXTINT: u32 = 0x700;
+const LVT_NMI: u32 = 0x400;
+const DIVIDE_BY_16: u32 = 0x3;
+const ICR_INIT: u32 = 0x500;
+const ICR_STARTUP: u32 = 0x600;
+const ICR_LEVEL_ASSERT: u32 = 1 << 14;
+const ICR_DELIVERY_PENDING: u32 = 1 << 12;
+/// Polls of the delivery-status bit before an IPI is reported as stuck.
+const ICR_SPIN_LIMIT: u32 = 1_000_000;
+/// TSC cycles per second divided by this is the timer calibration window (10 ms).
+const CALIBRATE_DIV: u64 = 100;
+
+static MMIO_BASE: AtomicUsize = AtomicUsize::new(0);
+static TIMER_HZ: AtomicU64 = AtomicU64::new(0);
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum LapicError {
+    Unsupported,
+    Disabled,
+    X2ApicMode,
+    NotMapped,
+    Calibration,
+}
+
+impl LapicError {
+    pub const fn as_str(self) -> &'static str {
+        match self {
+            Self::Unsupported => "unsupported",
+            Self::Disabled => "disabled",
+            Self::X2ApicMode => "x2apic_mode",
+            Self::NotMapped => "not_mapped",
+            Self::Calibration => "calibration",
+        }
+    }
+}
+
+/// Enables the local APIC in virtual-wire mode (the 8259 keeps delivering through LINT0),
+/// calibrates its timer against the already-calibrated TSC and leaves it idle in one-shot
+/// mode on `TIMER_VECTOR`. Returns the timer's count rate.
+pub fn init(tsc_hz: u64) -> Result<u64, LapicError> {
+    // SAFETY: CPUID leaf 1 exists on every x86_64 CPU.
+    if unsafe { __cpuid(1) }.edx & CPUID_EDX_APIC == 0 {
+        return Err(LapicError::Unsupported);
+    }
+    // SAFETY: IA32_APIC_BASE is architectural whenever CPUID reports an APIC.
+    let base = unsafe { Msr::new(IA32_APIC_BASE).read() };
+    if base & APIC_BASE_ENABLE == 0 {
+        return Err(LapicError::Disabled);
+    }
+    if base & APIC_BASE_X2APIC != 0 {
+        return Err(LapicError::X2ApicMode);
+    }
+    let mmio = mem::phys_to_virt(base & APIC_BASE_ADDR_MASK).ok_or(LapicError::NotMapped)?;
+    MMIO_BASE.store(mmio, Ordering::Release);
+
+    write(REG_LVT_LINT0, LVT_EXTINT);
+    write(REG_LVT_LINT1, LVT_NMI);
+    write(REG_SVR, SVR_ENABLE | u32::from(SPURIOUS_VECTOR));
+    write(REG_TIMER_DIVIDE, DIVIDE_BY_16);
+    write(REG_LVT_TIMER, LVT_MASKED | u32::from(TIMER_VECTOR));
+
+    write(REG_TIMER_INITIAL, u32::MAX);
+    let start = crate::time::read_tsc();
+    let window = tsc_hz / CALIBRATE_DIV;
+    while crate::time::read_tsc().saturating_sub(start) < window {
+        core::hint::spin_loop();
+    }
+    let elapsed = u32::MAX - read(REG_TIMER_CURRENT);
+    write(REG_TIMER_INITIAL, 0);
+    let hz = u64::from(elapsed) * CALIBRATE_DIV;
+    if hz == 0 {
+        MMIO_BASE.store(0, Ordering::Release);
+        return Err(LapicError::Calibration);
+    }
+    TIMER_HZ.store(hz, Ordering::Relaxed);
+    write(REG_LVT_TIMER, u32::from(TIMER_VECTOR));
+    Ok(hz)
+}
+
+/// Enables an application processor's local APIC for IPIs. Its timer and LINT pins stay
+/// masked: device interrupts and timekeeping remain on the BSP.
+pub fn init_ap() {
+    write(REG_LVT_TIMER, LVT_MASKED | u32::from(TIMER_VECTOR));
+    write(REG_LVT_LINT0, LVT_MASKED);
+    write(REG_LVT_LINT1, LVT_MASKED);
+    write(REG_SVR, SVR_ENABLE | u32::from(SPURIOUS_VECTOR));
+}
+
+/// Whether `init` mapped the local APIC, so IPIs can be sent.
+pub fn ready() -> bool {
+    MMIO_BASE.load(Ordering::Acquire) != 0
+}
+
+/// The executing CPU's local APIC ID.
+pub fn id() -> u8 {
+    (read(REG_ID) >> 24) as u8
+}
+
+/// Sends INIT to `apic_id`, the first step of starting an application processor.
+pub fn send_init(apic_id: u8) -> bool {
+    send_ipi_raw(apic_id, ICR_INIT | ICR_LEVEL_ASSERT)
+}
+
+/// Sends a STARTUP IPI; the target begins in real mode at `page << 12`.
+pub fn send_startup(apic_id: u8, page: u8) -> bool {
+    send_ipi_raw(apic_id, ICR_STARTUP | ICR_LEVEL_ASSERT | u32::from(page))
+}
+
+/// Raises `vector` on the CPU with `apic_id`.
+pub fn send_ipi(apic_id: u8, vector: u8) -> bool {
+    send_ipi_raw(apic_id, ICR_LEVEL_ASSERT | u32::from(vector))
+}
+
+/// Writes the ICR (destination first; the low write sends) with interrupts off, so a handler
+/// on this CPU cannot interleave its own IPI, then waits for delivery.
+fn send_ipi_raw(apic_id: u8, command: u32) -> bool {
+    if !ready() {
+        return false;
+    }
+    x86_64::instructions::interrupts::without_interrupts(|| {
+        write(REG_ICR_HIGH, u32::from(apic_id) << 24);
+        write(REG_ICR_LOW, command);
+        (0..ICR_SPIN_LIMIT).any(|_| {
+            core::hint::spin_loop();
+            read(REG_ICR_LOW) & ICR_DELIVERY_PENDING == 0
+        })
+    })
+}
+
+/// Fires `TIMER_VECTOR` once, `delay_ns` from now (at least one timer count).
+pub fn arm(delay_ns: u64) {
+    let hz = TIMER_HZ.load(Ordering::Relaxed);
+    let counts = (u128::from(delay_ns) * u128::from(hz) / 1_000_000_000).clamp(1, u32::MAX as u128);
+    write(REG_TIMER_INITIAL, counts as u32);
+}
+
+pub fn disarm() {
+    write(REG_TIMER_INITIAL, 0);
+}
+
+pub fn end_of_interrupt() {
+    write(REG_EOI, 0);
+}
+
+fn write(reg: usize, value: u32) {
+    let base = MMIO_BASE.load(Ordering::Acquire);
+    if base == 0 {
+        return;
+    }
+    // SAFETY: `base` maps the local APIC register page and `reg` is an aligned register
+    // offset inside it.
+    unsafe { write_volatile((base + reg) as *mut u32, value) }
+}
+
+fn read(reg: usize) -> u32 {
+    let base = MMIO_BASE.load(Ordering::Acquire);
+    if base == 0 {
+        return 0;
+    }
+    // SAFETY: `base` maps the local APIC register page and `reg` is an aligned register
+    // offset inside it.
+    unsafe { read_volatile((base + reg) as *const u32) }
+}
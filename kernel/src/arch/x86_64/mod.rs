@@ -1,6 +1,10 @@
 // kernel/src/arch/x86_64/mod.rs: x86_64-specific boot/runtime support.
+pub mod acpi;
 pub mod gdt;
 pub mod interrupts;
+pub mod lapic;
 pub mod pic;
 pub mod pit;
 pub mod port;
+pub mod smp;
+pub mod switch;
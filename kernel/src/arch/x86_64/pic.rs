@@ -60,6 +60,34 @@ pub fn init() -> PicInitReport {
     }
 }
 
+/// Unmasks one legacy IRQ line (0..16) after boot-time setup; slave lines also need the
+/// cascade, which `MASTER_IRQ_MASK` already leaves open.
+pub fn unmask(irq: u8) {
+    update_mask(irq, false);
+}
+
+pub fn mask(irq: u8) {
+    update_mask(irq, true);
+}
+
+fn update_mask(irq: u8, masked: bool) {
+    let (data_port, bit) = if irq < 8 {
+        (PIC_1_DATA, irq)
+    } else {
+        (PIC_2_DATA, irq - 8)
+    };
+    // SAFETY: read-modify-write of the PIC mask register only touches the requested line.
+    unsafe {
+        let current = port::inb(data_port);
+        let next = if masked {
+            current | (1u8 << bit)
+        } else {
+            current & !(1u8 << bit)
+        };
+        port::outb(data_port, next);
+    }
+}
+
 pub fn end_of_interrupt(vector: u8) {
     // SAFETY: EOI writes target command registers for cascaded PIC setup.
     unsafe {
@@ -1,10 +1,21 @@
-// kernel/src/arch/x86_64/pit.rs: 8253/8254 PIT timer setup for periodic IRQ0 ticks.
+// kernel/src/arch/x86_64/pit.rs: 8253/8254 PIT timer setup for periodic IRQ0 ticks and TSC
+// calibration.
 use crate::arch::x86_64::port;
 
 const PIT_COMMAND: u16 = 0x43;
 const PIT_CHANNEL_0: u16 = 0x40;
+const PIT_CHANNEL_2: u16 = 0x42;
+const SPEAKER_PORT: u16 = 0x61;
 const PIT_INPUT_HZ: u32 = 1_193_182;
 const PIT_MODE_RATE_GENERATOR: u8 = 0x36; // channel 0, low/high byte, mode 2, binary
+const PIT_MODE_CH2_ONESHOT: u8 = 0xB0; // channel 2, low/high byte, mode 0, binary
+const SPEAKER_GATE: u8 = 0x01;
+const SPEAKER_DATA: u8 = 0x02;
+const CH2_OUT: u8 = 0x20;
+/// Calibration window; channel 2 counts it down while the TSC runs.
+const CALIBRATE_MS: u32 = 10;
+/// Port reads before giving up on a channel 2 that never fires (a few hundred ms in a VM).
+const CALIBRATE_SPIN_LIMIT: u32 = 1_000_000;
 
 pub fn init(hz: u32) -> u16 {
     let requested_hz = if hz == 0 { 1 } else { hz };
@@ -20,3 +31,31 @@ pub fn init(hz: u32) -> u16 {
 
     divisor
 }
+
+/// Measures the TSC frequency against a one-shot count on PIT channel 2 (the speaker
+/// channel, with the speaker itself kept off). Returns `None` if the count never expires.
+pub fn calibrate_tsc_hz() -> Option<u64> {
+    let count = PIT_INPUT_HZ * CALIBRATE_MS / 1000;
+    // SAFETY: channel 2 and the speaker gate are fixed legacy ports; the gate byte is restored
+    // before returning and audio has not claimed channel 2 yet during early boot.
+    unsafe {
+        let saved_gate = port::inb(SPEAKER_PORT);
+        port::outb(SPEAKER_PORT, (saved_gate & !SPEAKER_DATA) | SPEAKER_GATE);
+        port::outb(PIT_COMMAND, PIT_MODE_CH2_ONESHOT);
+        port::outb(PIT_CHANNEL_2, (count & 0xff) as u8);
+        port::outb(PIT_CHANNEL_2, ((count >> 8) & 0xff) as u8);
+        let start = crate::time::read_tsc();
+        let mut spins = 0;
+        while port::inb(SPEAKER_PORT) & CH2_OUT == 0 {
+            spins += 1;
+            if spins >= CALIBRATE_SPIN_LIMIT {
+                port::outb(SPEAKER_PORT, saved_gate);
+                return None;
+            }
+        }
+        let cycles = crate::time::read_tsc().saturating_sub(start);
+        port::outb(SPEAKER_PORT, saved_gate);
+        let hz = cycles.saturating_mul(u64::from(PIT_INPUT_HZ)) / u64::from(count);
+        (hz > 0).then_some(hz)
+    }
+}
@@ -0,0 +1,443 @@
+// kernel/src/arch/x86_64/smp.rs: application processor start-up (ACPI MADT, INIT/SIPI) and
+// per-CPU data.
+use crate::arch::x86_64::{acpi, gdt, interrupts, lapic};
+use crate::proc::work;
+use crate::{mem, serial, time};
+use alloc::alloc::{Layout, alloc};
+use bootloader_api::{BootInfo, info::MemoryRegionKind};
+use core::arch::{asm, global_asm};
+use core::hint::spin_loop;
+use core::sync::atomic::{AtomicBool, AtomicU8, AtomicU64, AtomicUsize, Ordering};
+use x86_64::registers::model_specific::Msr;
+
+/// The BSP plus one CPU per AP GDT slot.
+pub const MAX_CPUS: usize = gdt::AP_SLOTS + 1;
+/// IPI that wakes a halted CPU: an AP with new work, or the BSP after an AP's `notify`.
+pub const WAKE_VECTOR: u8 = 0x31;
+/// IPI the BSP sends each sampling period while `profile` runs, so APs sample themselves.
+pub const PROFILE_VECTOR: u8 = 0x32;
+
+const IA32_EFER: u32 = 0xC000_0080;
+const IA32_GS_BASE: u32 = 0xC000_0101;
+const EFER_LMA: u64 = 1 << 10;
+const PAGE_SIZE: u64 = 4096;
+/// Trampoline code, then the temporary PML4, PDPT and PD it runs on.
+const LOW_PAGES: u64 = 4;
+/// SIPI vectors address the first MiB; page 0 holds the real-mode IVT and BIOS data.
+const LOW_SEARCH_START: u64 = 0x1000;
+const LOW_SEARCH_END: u64 = 0x10_0000;
+const PTE_PRESENT: u64 = 1 << 0;
+const PTE_WRITABLE: u64 = 1 << 1;
+const PTE_HUGE: u64 = 1 << 7;
+const CR3_ADDR_MASK: u64 = 0x000F_FFFF_FFFF_F000;
+/// Sized like the Doom thread's stack, since the Doom tick may be pinned to an AP.
+const AP_STACK_BYTES: usize = 256 * 1024;
+const INIT_SETTLE_NS: u64 = 10_000_000;
+const STARTUP_GAP_NS: u64 = 200_000;
+const AP_ONLINE_TIMEOUT_NS: u64 = 100_000_000;
+
+/// Parameter block at the end of the trampoline, as 8-byte words; offsets must match the
+/// assembly below. The GDT base and both far-jump targets are assembled relative to the
+/// trampoline start and rebased by the BSP; the rest is filled in per AP.
+const PARAM_GDT_BASE: usize = 2;
+const PARAM_PM32_JUMP: usize = 8;
+const PARAM_LM64_JUMP: usize = 16;
+const PARAM_CR3: usize = 24;
+const PARAM_EFER: usize = 32;
+const PARAM_STACK: usize = 40;
+const PARAM_ENTRY: usize = 48;
+const PARAM_CPU: usize = 56;
+const PARAM_BYTES: usize = 64;
+
+// Real-mode entry for application processors. The SIPI starts it at `base:0`; it derives
+// `base` from CS into EBX, switches to protected mode on its own GDT, enables PAE, long mode
+// and paging on the temporary page tables, then calls `ap_entry(cpu)` on the AP's stack.
+// Everything is addressed relative to EBX, so the copy can sit in any low page.
+global_asm!(
+    ".balign 16",
+    ".global arrost_ap_trampoline_start",
+    ".global arrost_ap_trampoline_end",
+    "arrost_ap_trampoline_start:",
+    ".code16",
+    "cli",
+    "cld",
+    "mov %cs, %ax",
+    "mov %ax, %ds",
+    "movzwl %ax, %ebx",
+    "shl $4, %ebx",
+    "lgdtl (arrost_ap_params - arrost_ap_trampoline_start)",
+    "mov %cr0, %eax",
+    "or $1, %eax",
+    "mov %eax, %cr0",
+    "ljmpl *(arrost_ap_params + 8 - arrost_ap_trampoline_start)",
+    ".code32",
+    "arrost_ap_pm32:",
+    "mov $0x10, %ax",
+    "mov %ax, %ds",
+    "mov %ax, %es",
+    "mov %ax, %ss",
+    "mov %cr4, %eax",
+    "or $0x20, %eax",
+    "mov %eax, %cr4",
+    "mov (arrost_ap_params + 24 - arrost_ap_trampoline_start)(%ebx), %eax",
+    "mov %eax, %cr3",
+    "mov $0xC0000080, %ecx",
+    "mov (arrost_ap_params + 32 - arrost_ap_trampoline_start)(%ebx), %eax",
+    "mov (arrost_ap_params + 36 - arrost_ap_trampoline_start)(%ebx), %edx",
+    "wrmsr",
+    "mov %cr0, %eax",
+    "or $0x80000000, %eax",
+    "mov %eax, %cr0",
+    "ljmp *(arrost_ap_params + 16 - arrost_ap_trampoline_start)(%ebx)",
+    ".code64",
+    "arrost_ap_lm64:",
+    "mov $0x10, %ax",
+    "mov %ax, %ds",
+    "mov %ax, %es",
+    "mov %ax, %ss",
+    "mov %ebx, %ebx",
+    "mov (arrost_ap_params + 40 - arrost_ap_trampoline_start)(%rbx), %rsp",
+    "mov (arrost_ap_params + 56 - arrost_ap_trampoline_start)(%rbx), %rdi",
+    "mov (arrost_ap_params + 48 - arrost_ap_trampoline_start)(%rbx), %rax",
+    "call *%rax",
+    "ud2",
+    ".balign 8",
+    "arrost_ap_gdt:",
+    ".quad 0",
+    ".quad 0x00209A0000000000",
+    ".quad 0x00CF92000000FFFF",
+    ".quad 0x00CF9A000000FFFF",
+    "arrost_ap_params:",
+    ".word 31",
+    ".long arrost_ap_gdt - arrost_ap_trampoline_start",
+    ".word 0",
+    ".long arrost_ap_pm32 - arrost_ap_trampoline_start",
+    ".word 0x18, 0",
+    ".long arrost_ap_lm64 - arrost_ap_trampoline_start",
+    ".word 0x08, 0",
+    ".fill 40, 1, 0",
+    "arrost_ap_trampoline_end:",
+    options(att_syntax)
+);
+
+unsafe extern "C" {
+    static arrost_ap_trampoline_start: u8;
+    static arrost_ap_trampoline_end: u8;
+}
+
+/// Per-CPU state. `gs:[0]` reads `index` on the owning CPU, so it must stay first.
+#[repr(C)]
+struct PerCpu {
+    index: AtomicUsize,
+    apic_id: AtomicU8,
+    online: AtomicBool,
+    wake_ipis: AtomicU64,
+}
+
+impl PerCpu {
+    const fn new() -> Self {
+        Self {
+            index: AtomicUsize::new(0),
+            apic_id: AtomicU8::new(0),
+            online: AtomicBool::new(false),
+            wake_ipis: AtomicU64::new(0),
+        }
+    }
+}
+
+static PER_CPU: [PerCpu; MAX_CPUS] = [const { PerCpu::new() }; MAX_CPUS];
+/// Set once the BSP's GS base points at its `PerCpu`; until then every caller is the BSP.
+static GS_READY: AtomicBool = AtomicBool::new(false);
+static BSP_CR0: AtomicU64 = AtomicU64::new(0);
+static BSP_CR3: AtomicU64 = AtomicU64::new(0);
+static BSP_CR4: AtomicU64 = AtomicU64::new(0);
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum SmpError {
+    NoLapic,
+    Acpi(acpi::AcpiError),
+    NoLowMemory,
+}
+
+impl SmpError {
+    pub const fn as_str(self) -> &'static str {
+        match self {
+            Self::NoLapic => "no_lapic",
+            Self::Acpi(err) => err.as_str(),
+            Self::NoLowMemory => "no_low_memory",
+        }
+    }
+}
+
+#[derive(Clone, Copy)]
+pub struct SmpReport {
+    pub cpus_listed: usize,
+    pub cpus_online: usize,
+    pub start_failures: usize,
+    pub bsp_apic_id: u8,
+    pub trampoline_phys: u64,
+    pub detail: &'static str,
+}
+
+/// Sets up the BSP's per-CPU data and starts every other enabled processor in the MADT.
+/// Each AP loads its own GDT/TSS and the shared IDT, then runs `work::run_worker`. Needs the
+/// heap and an initialized local APIC.
+pub fn init(boot_info: &BootInfo) -> SmpReport {
+    let bsp_apic_id = lapic::id();
+    PER_CPU[0].apic_id.store(bsp_apic_id, Ordering::Relaxed);
+    PER_CPU[0].online.store(true, Ordering::Release);
+    set_gs_base(0);
+    GS_READY.store(true, Ordering::Release);
+
+    let mut report = SmpReport {
+        cpus_listed: 1,
+        cpus_online: 1,
+        start_failures: 0,
+        bsp_apic_id,
+        trampoline_phys: 0,
+        detail: "ok",
+    };
+    if let Err(err) = start_aps(boot_info, &mut report) {
+        report.detail = err.as_str();
+    }
+    report
+}
+
+fn start_aps(boot_info: &BootInfo, report: &mut SmpReport) -> Result<(), SmpError> {
+    if !lapic::ready() {
+        return Err(SmpError::NoLapic);
+    }
+    let mut apic_ids = [0u8; 32];
+    let listed = acpi::local_apic_ids(boot_info.rsdp_addr.into_option(), &mut apic_ids)
+        .map_err(SmpError::Acpi)?;
+    report.cpus_listed = listed.max(1);
+    if listed <= 1 {
+        return Ok(());
+    }
+    let base = find_low_window(boot_info).ok_or(SmpError::NoLowMemory)?;
+    report.trampoline_phys = base;
+    let params = install_trampoline(base)?;
+
+    let mut next_cpu = 1usize;
+    for &apic_id in apic_ids[..listed]
+        .iter()
+        .filter(|&&apic_id| apic_id != report.bsp_apic_id)
+    {
+        if next_cpu >= MAX_CPUS {
+            break;
+        }
+        let cpu = next_cpu;
+        next_cpu += 1;
+        if start_ap(cpu, apic_id, base, params) {
+            report.cpus_online += 1;
+        } else {
+            report.start_failures += 1;
+        }
+    }
+    Ok(())
+}
+
+/// Finds `LOW_PAGES` free, page-aligned pages below 1 MiB. The frame allocator never hands
+/// out memory there, so usable low pages stay free for the trampoline.
+fn find_low_window(boot_info: &BootInfo) -> Option<u64> {
+    let bytes = LOW_PAGES * PAGE_SIZE;
+    boot_info
+        .memory_regions
+        .iter()
+        .filter(|region| region.kind == MemoryRegionKind::Usable)
+        .find_map(|region| {
+            let start = region
+                .start
+                .max(LOW_SEARCH_START)
+                .next_multiple_of(PAGE_SIZE);
+            let end = region.end.min(LOW_SEARCH_END);
+            (start.checked_add(bytes)? <= end).then_some(start)
+        })
+}
+
+/// Copies the trampoline to `base` and builds its temporary page tables: the BSP's PML4 with
+/// entry 0 replaced by an identity map of the first 2 MiB, so the trampoline keeps running
+/// when paging comes on and can still reach the kernel. Returns the parameter block address.
+fn install_trampoline(base: u64) -> Result<usize, SmpError> {
+    let low = mem::phys_to_virt(base).ok_or(SmpError::NoLowMemory)?;
+    // Both symbols come from the `global_asm!` block above and bound its bytes.
+    let start = core::ptr::addr_of!(arrost_ap_trampoline_start) as usize;
+    let end = core::ptr::addr_of!(arrost_ap_trampoline_end) as usize;
+    let len = end - start;
+    let pml4 = base + PAGE_SIZE;
+    let pdpt = base + 2 * PAGE_SIZE;
+    let pd = base + 3 * PAGE_SIZE;
+
+    let (cr0, cr3, cr4): (u64, u64, u64);
+    // SAFETY: reading control registers has no side effects.
+    unsafe {
+        asm!("mov {}, cr0", out(reg) cr0, options(nomem, nostack, preserves_flags));
+        asm!("mov {}, cr3", out(reg) cr3, options(nomem, nostack, preserves_flags));
+        asm!("mov {}, cr4", out(reg) cr4, options(nomem, nostack, preserves_flags));
+    }
+    BSP_CR0.store(cr0, Ordering::Relaxed);
+    BSP_CR3.store(cr3, Ordering::Relaxed);
+    BSP_CR4.store(cr4, Ordering::Relaxed);
+    let bsp_pml4 = mem::phys_to_virt(cr3 & CR3_ADDR_MASK).ok_or(SmpError::NoLowMemory)?;
+    // SAFETY: IA32_EFER exists on every x86_64 CPU.
+    let efer = unsafe { Msr::new(IA32_EFER).read() } & !EFER_LMA;
+
+    let params = low + len - PARAM_BYTES;
+    let page = PAGE_SIZE as usize;
+    let (pml4_virt, pdpt_virt, pd_virt) = (low + page, low + 2 * page, low + 3 * page);
+    // SAFETY: `find_low_window` picked four usable pages nothing else allocates, mapped at
+    // `low`; the trampoline fits its first page, and the BSP's PML4 is a live page-table
+    // page readable through the physical-memory map.
+    unsafe {
+        core::ptr::copy_nonoverlapping(start as *const u8, low as *mut u8, len);
+        core::ptr::copy_nonoverlapping(bsp_pml4 as *const u8, pml4_virt as *mut u8, page);
+        core::ptr::write_bytes(pdpt_virt as *mut u8, 0, 2 * page);
+        (pml4_virt as *mut u64).write(pdpt | PTE_PRESENT | PTE_WRITABLE);
+        (pdpt_virt as *mut u64).write(pd | PTE_PRESENT | PTE_WRITABLE);
+        (pd_virt as *mut u64).write(PTE_PRESENT | PTE_WRITABLE | PTE_HUGE);
+
+        for offset in [PARAM_GDT_BASE, PARAM_PM32_JUMP, PARAM_LM64_JUMP] {
+            let field = (params + offset) as *mut u32;
+            field.write_unaligned(field.read_unaligned() + base as u32);
+        }
+        ((params + PARAM_CR3) as *mut u64).write_unaligned(pml4);
+        ((params + PARAM_EFER) as *mut u64).write_unaligned(efer);
+        ((params + PARAM_ENTRY) as *mut u64).write_unaligned(ap_entry as usize as u64);
+    }
+    Ok(params)
+}
+
+/// INIT, then two STARTUP IPIs, then waits for the AP to mark itself online.
+fn start_ap(cpu: usize, apic_id: u8, base: u64, params: usize) -> bool {
+    let Ok(layout) = Layout::from_size_align(AP_STACK_BYTES, 16) else {
+        return false;
+    };
+    // SAFETY: the layout has a non-zero size. APs never stop, so the stack is never freed;
+    // one that times out may still come up later and use it.
+    let stack = unsafe { alloc(layout) };
+    if stack.is_null() {
+        return false;
+    }
+    PER_CPU[cpu].index.store(cpu, Ordering::Relaxed);
+    PER_CPU[cpu].apic_id.store(apic_id, Ordering::Relaxed);
+    // SAFETY: `params` is the patched block in low memory; no AP is running the trampoline,
+    // since the previous one either came online or timed out and is reported as failed.
+    unsafe {
+        ((params + PARAM_STACK) as *mut u64).write_unaligned(stack as u64 + AP_STACK_BYTES as u64);
+        ((params + PARAM_CPU) as *mut u64).write_unaligned(cpu as u64);
+    }
+
+    if !lapic::send_init(apic_id) {
+        return false;
+    }
+    spin_ns(INIT_SETTLE_NS);
+    for _ in 0..2 {
+        if !lapic::send_startup(apic_id, (base / PAGE_SIZE) as u8) {
+            return false;
+        }
+        spin_ns(STARTUP_GAP_NS);
+    }
+    let deadline = time::monotonic_ns().saturating_add(AP_ONLINE_TIMEOUT_NS);
+    while time::monotonic_ns() < deadline {
+        if PER_CPU[cpu].online.load(Ordering::Acquire) {
+            return true;
+        }
+        spin_loop();
+    }
+    false
+}
+
+/// First Rust code on an AP, running on the temporary page tables.
+extern "C" fn ap_entry(cpu: usize) -> ! {
+    // SAFETY: adopts the BSP's paging, FPU and SSE configuration; the kernel mappings this
+    // code runs from are shared by both page tables.
+    unsafe {
+        asm!(
+            "mov cr0, {cr0}",
+            "mov cr4, {cr4}",
+            "mov cr3, {cr3}",
+            "fninit",
+            cr0 = in(reg) BSP_CR0.load(Ordering::Relaxed),
+            cr3 = in(reg) BSP_CR3.load(Ordering::Relaxed),
+            cr4 = in(reg) BSP_CR4.load(Ordering::Relaxed),
+            options(nostack)
+        );
+        gdt::init_ap(cpu - 1);
+    }
+    // `GS_READY` is already set, so `cpu_index` reads through GS from here on.
+    set_gs_base(cpu);
+    interrupts::init_ap();
+    lapic::init_ap();
+    PER_CPU[cpu].online.store(true, Ordering::Release);
+    work::run_worker(cpu)
+}
+
+fn set_gs_base(cpu: usize) {
+    // SAFETY: GS is otherwise unused by the kernel; pointing it at this CPU's static
+    // `PerCpu` is what `cpu_index` relies on.
+    unsafe { Msr::new(IA32_GS_BASE).write(core::ptr::addr_of!(PER_CPU[cpu]) as u64) };
+}
+
+fn spin_ns(ns: u64) {
+    let deadline = time::monotonic_ns().saturating_add(ns);
+    while time::monotonic_ns() < deadline {
+        spin_loop();
+    }
+}
+
+/// Index of the executing CPU: 0 for the BSP, then APs in start order.
+pub fn cpu_index() -> usize {
+    if !GS_READY.load(Ordering::Acquire) {
+        return 0;
+    }
+    let index: usize;
+    // SAFETY: once `GS_READY` is set, every running CPU's GS base points at its `PerCpu`,
+    // whose first field is the index.
+    unsafe {
+        asm!("mov {}, qword ptr gs:[0]", out(reg) index, options(nostack, readonly, preserves_flags));
+    }
+    index
+}
+
+pub fn is_bsp() -> bool {
+    cpu_index() == 0
+}
+
+pub fn online(cpu: usize) -> bool {
+    cpu < MAX_CPUS && PER_CPU[cpu].online.load(Ordering::Acquire)
+}
+
+/// Sends `WAKE_VECTOR` to `cpu` unless it is the caller or not online.
+pub fn kick(cpu: usize) {
+    if cpu == cpu_index() || !online(cpu) {
+        return;
+    }
+    PER_CPU[cpu].wake_ipis.fetch_add(1, Ordering::Relaxed);
+    lapic::send_ipi(PER_CPU[cpu].apic_id.load(Ordering::Relaxed), WAKE_VECTOR);
+}
+
+/// Sends `vector` to every online CPU except the caller.
+pub fn broadcast(vector: u8) {
+    let own = cpu_index();
+    for (cpu, per_cpu) in PER_CPU.iter().enumerate() {
+        if cpu != own && per_cpu.online.load(Ordering::Acquire) {
+            lapic::send_ipi(per_cpu.apic_id.load(Ordering::Relaxed), vector);
+        }
+    }
+}
+
+pub fn log_info() {
+    for (cpu, per_cpu) in PER_CPU.iter().enumerate() {
+        if !per_cpu.online.load(Ordering::Acquire) {
+            continue;
+        }
+        serial::write_fmt(format_args!(
+            "smp: cpu={} apic_id={} role={} wake_ipis={}\n",
+            cpu,
+            per_cpu.apic_id.load(Ordering::Relaxed),
+            if cpu == 0 { "bsp" } else { "worker" },
+            per_cpu.wake_ipis.load(Ordering::Relaxed)
+        ));
+    }
+    work::log_stats();
+}
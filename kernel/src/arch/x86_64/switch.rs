@@ -0,0 +1,155 @@
+// kernel/src/arch/x86_64/switch.rs: register save/restore stubs for preemptive thread switches.
+use core::arch::global_asm;
+use core::mem::size_of;
+use x86_64::instructions::segmentation::{CS, SS, Segment};
+
+/// Software interrupt a thread raises to give up the CPU (blocking or yielding).
+pub const YIELD_VECTOR: u8 = 0x81;
+
+/// RFLAGS for a fresh thread: interrupts enabled plus the always-set reserved bit 1.
+const INITIAL_RFLAGS: u64 = 0x202;
+
+/// Words the stubs leave on the interrupted thread's stack: r15..r8, rbp, rdi, rsi, rdx,
+/// rcx, rbx and rax pushed by the stub (lowest address first), then the CPU's rip, cs,
+/// rflags, rsp and ss. A thread's saved stack pointer points at the first of these.
+const FRAME_WORDS: usize = 20;
+const FRAME_RBP: usize = 8;
+const FRAME_RDI: usize = 9;
+const FRAME_RIP: usize = 15;
+const FRAME_CS: usize = 16;
+const FRAME_RFLAGS: usize = 17;
+const FRAME_RSP: usize = 18;
+const FRAME_SS: usize = 19;
+
+// Both stubs save every general register, hand the stack pointer to Rust, and resume
+// whichever stack pointer Rust returns. The CPU aligns RSP to 16 before pushing its 5-word
+// frame and the stub pushes 15 words, so the call below sees an aligned stack.
+global_asm!(
+    ".macro ARROST_SWITCH_STUB name, target",
+    ".global \\name",
+    "\\name:",
+    "push rax",
+    "push rbx",
+    "push rcx",
+    "push rdx",
+    "push rsi",
+    "push rdi",
+    "push rbp",
+    "push r8",
+    "push r9",
+    "push r10",
+    "push r11",
+    "push r12",
+    "push r13",
+    "push r14",
+    "push r15",
+    "mov rdi, rsp",
+    "cld",
+    "call \\target",
+    "mov rsp, rax",
+    "pop r15",
+    "pop r14",
+    "pop r13",
+    "pop r12",
+    "pop r11",
+    "pop r10",
+    "pop r9",
+    "pop r8",
+    "pop rbp",
+    "pop rdi",
+    "pop rsi",
+    "pop rdx",
+    "pop rcx",
+    "pop rbx",
+    "pop rax",
+    "iretq",
+    ".endm",
+    "ARROST_SWITCH_STUB arrost_timer_stub, {timer}",
+    "ARROST_SWITCH_STUB arrost_lapic_timer_stub, {lapic_timer}",
+    "ARROST_SWITCH_STUB arrost_yield_stub, {yield_}",
+    "ARROST_SWITCH_STUB arrost_wake_stub, {wake}",
+    "ARROST_SWITCH_STUB arrost_profile_stub, {profile}",
+    timer = sym super::interrupts::timer_switch,
+    lapic_timer = sym super::interrupts::lapic_timer_switch,
+    wake = sym super::interrupts::wake_switch,
+    profile = sym super::interrupts::profile_switch,
+    yield_ = sym crate::proc::sched::yield_switch,
+);
+
+unsafe extern "C" {
+    fn arrost_timer_stub();
+    fn arrost_lapic_timer_stub();
+    fn arrost_yield_stub();
+    fn arrost_wake_stub();
+    fn arrost_profile_stub();
+}
+
+/// IDT entry point for IRQ0.
+pub fn timer_stub_addr() -> u64 {
+    arrost_timer_stub as usize as u64
+}
+
+/// IDT entry point for the local APIC one-shot timer.
+pub fn lapic_timer_stub_addr() -> u64 {
+    arrost_lapic_timer_stub as usize as u64
+}
+
+/// IDT entry point for `YIELD_VECTOR`.
+pub fn yield_stub_addr() -> u64 {
+    arrost_yield_stub as usize as u64
+}
+
+/// IDT entry point for `smp::WAKE_VECTOR`.
+pub fn wake_stub_addr() -> u64 {
+    arrost_wake_stub as usize as u64
+}
+
+/// IDT entry point for `smp::PROFILE_VECTOR`.
+pub fn profile_stub_addr() -> u64 {
+    arrost_profile_stub as usize as u64
+}
+
+/// Instruction and frame pointers of the code a stub interrupted.
+///
+/// # Safety
+/// `rsp` must be the stack pointer a stub passed to its Rust target, while that call runs.
+pub unsafe fn interrupted_context(rsp: u64) -> (u64, u64) {
+    let frame = rsp as *const u64;
+    // SAFETY: the caller guarantees `rsp` points at a live `FRAME_WORDS`-word stub frame.
+    unsafe { (frame.add(FRAME_RIP).read(), frame.add(FRAME_RBP).read()) }
+}
+
+/// Raises `YIELD_VECTOR`; returns once the scheduler resumes this thread.
+pub fn yield_to_scheduler() {
+    // SAFETY: the vector is installed with an interrupt gate before the scheduler starts;
+    // its stub preserves every general register and returns here through iretq.
+    unsafe {
+        core::arch::asm!("int {vector}", vector = const YIELD_VECTOR);
+    }
+}
+
+/// Builds the first saved frame of a thread whose stack ends at `stack_top` (16-byte aligned)
+/// so that resuming it calls `entry(arg)` with interrupts enabled. Returns the saved stack
+/// pointer to store for the thread.
+///
+/// # Safety
+/// `stack_top` must be the end of a writable, otherwise unused stack larger than one frame.
+pub unsafe fn initial_frame(stack_top: u64, entry: extern "C" fn(usize) -> !, arg: usize) -> u64 {
+    // The entry sees RSP = top - 8, as if `call` had pushed a (null) return address.
+    let entry_rsp = stack_top - 8;
+    let frame_addr = stack_top - 16 - size_of::<[u64; FRAME_WORDS]>() as u64;
+    let mut frame = [0u64; FRAME_WORDS];
+    frame[FRAME_RDI] = arg as u64;
+    frame[FRAME_RIP] = entry as usize as u64;
+    frame[FRAME_CS] = u64::from(CS::get_reg().0);
+    frame[FRAME_RFLAGS] = INITIAL_RFLAGS;
+    frame[FRAME_RSP] = entry_rsp;
+    frame[FRAME_SS] = u64::from(SS::get_reg().0);
+    // SAFETY: the caller guarantees the stack is writable and unused; both addresses lie
+    // inside it and are 8-byte aligned.
+    unsafe {
+        (entry_rsp as *mut u64).write(0);
+        (frame_addr as *mut [u64; FRAME_WORDS]).write(frame);
+    }
+    frame_addr
+}
@@ -1,7 +1,10 @@
 // kernel/src/audio.rs: audio runtime (virtio-sound PCM preferred, pc-speaker fallback).
 use crate::arch::x86_64::port;
+use crate::proc::sched;
+use crate::sync::SpinLock;
 use core::cell::UnsafeCell;
 
+mod resample;
 mod virtio_sound;
 
 const PIT_INPUT_HZ: u32 = 1_193_182;
@@ -24,9 +27,11 @@ const PCM_ENERGY_FALLBACK_REF: u64 = 14_000;
 
 struct AudioCell(UnsafeCell<AudioState>);
 
-// SAFETY: audio state is mutated only on the kernel main loop thread in current milestones.
+// SAFETY: access is serialized through `AUDIO_LOCK`.
 unsafe impl Sync for AudioCell {}
 
+/// Held for every audio call, including the virtio-sound driver calls made under it.
+static AUDIO_LOCK: SpinLock = SpinLock::new();
 static AUDIO_STATE: AudioCell = AudioCell(UnsafeCell::new(AudioState::new()));
 
 #[derive(Clone, Copy, PartialEq, Eq)]
@@ -72,9 +77,18 @@ pub struct AudioStatus {
     pub pcm_frames_completed: u64,
     pub pcm_frames_dropped: u64,
     pub pcm_rate_hz: u32,
+    pub pcm_resampler: &'static str,
     pub pcm_channels: u8,
     pub pcm_stream_id: u32,
     pub pcm_last_ctrl_status: u32,
+    pub pcm_period_frames: u16,
+    pub pcm_buffer_periods: u8,
+    pub pcm_irq_driven: bool,
+    pub pcm_irqs: u64,
+    pub pcm_underruns: u64,
+    pub pcm_xruns: u64,
+    pub pcm_latency_us: u64,
+    pub pcm_latency_max_us: u64,
 }
 
 struct AudioState {
@@ -177,9 +191,18 @@ pub fn status() -> AudioStatus {
             pcm_frames_completed: virtio.completed_frames,
             pcm_frames_dropped: virtio.dropped_frames,
             pcm_rate_hz: virtio.sample_rate_hz,
+            pcm_resampler: virtio.resampler,
             pcm_channels: virtio.channels,
             pcm_stream_id: virtio.stream_id,
             pcm_last_ctrl_status: virtio.last_ctrl_status,
+            pcm_period_frames: virtio.period_frames,
+            pcm_buffer_periods: virtio.buffer_periods,
+            pcm_irq_driven: virtio.irq_driven,
+            pcm_irqs: virtio.irqs,
+            pcm_underruns: virtio.underruns,
+            pcm_xruns: virtio.xruns,
+            pcm_latency_us: virtio.latency_last_us,
+            pcm_latency_max_us: virtio.latency_max_us,
         }
     })
 }
@@ -283,7 +306,7 @@ pub fn submit_pcm_i16(samples: &[i16], sample_rate: u32, channels: u8) -> usize
     }
     let src_channels = channels.clamp(1, 2);
 
-    with_state_mut(|state| {
+    let accepted = with_state_mut(|state| {
         state.pcm_mix_events = state.pcm_mix_events.saturating_add(1);
         state.pcm_samples = state.pcm_samples.saturating_add(samples.len() as u64);
 
@@ -323,30 +346,52 @@ pub fn submit_pcm_i16(samples: &[i16], sample_rate: u32, channels: u8) -> usize
                 samples.len()
             }
         }
-    })
+    });
+    // Wake the audio thread, which may be waiting for an event rather than polling.
+    sched::notify();
+    accepted
 }
 
-pub fn poll(now_ticks: u64) {
+/// Reaps finished output and stops expired tones. Returns whether playback is still in
+/// progress without an interrupt to report it, so the caller knows to poll again soon
+/// rather than wait for the next event.
+pub fn poll(now_ticks: u64) -> bool {
     with_state_mut(|state| {
         virtio_sound::poll();
         if state.mode == AudioMode::Virtio {
             let virt = virtio_sound::status();
             state.active = virt.ready;
-            return;
+            return virt.ready && virt.pending_packets > 0 && !virt.irq_driven;
         }
         if state.mode == AudioMode::Off && state.active {
             disable_speaker();
             state.active = false;
             state.tone_hz = 0;
             state.next_tone_update_tick = 0;
-            return;
+            return false;
         }
         if state.active && now_ticks >= state.stop_tick {
             disable_speaker();
             state.active = false;
             state.tone_hz = 0;
         }
-    });
+        state.active
+    })
+}
+
+/// Renegotiates the virtio-sound stream with `period_frames` per packet and `periods` packets
+/// in flight.
+pub fn set_buffering(period_frames: u16, periods: u8) -> Result<(), &'static str> {
+    with_state_mut(|_| virtio_sound::set_buffering(period_frames, periods))
+}
+
+/// virtio-sound interrupt; runs in IRQ context without `AUDIO_LOCK`.
+pub fn handle_interrupt() -> bool {
+    virtio_sound::handle_interrupt()
+}
+
+pub fn on_irq_disabled() {
+    virtio_sound::on_irq_disabled();
 }
 
 fn estimate_tone_from_pcm(samples: &[i16], sample_rate: u32, channels: u8) -> Option<u16> {
@@ -478,6 +523,7 @@ fn disable_speaker() {
 }
 
 fn with_state_mut<R>(f: impl FnOnce(&mut AudioState) -> R) -> R {
-    // SAFETY: audio state is accessed from the single-threaded kernel main loop.
+    let _guard = AUDIO_LOCK.lock();
+    // SAFETY: `AUDIO_LOCK` serializes mutable access to audio state.
     unsafe { f(&mut *AUDIO_STATE.0.get()) }
 }
@@ -0,0 +1,230 @@
+// kernel/src/audio/resample.rs: stream-rate conversion for mixed PCM (polyphase sinc, linear).
+use core::f64::consts::PI;
+use core::mem::MaybeUninit;
+
+/// Filter length in source frames; the output lags the input by a little over half of it.
+const TAPS: usize = 16;
+/// Sub-frame positions the filter is tabulated at. Every pair Doom and `choose_rate` produce
+/// lands exactly on one: 11025/22050 -> 44100 step by 160/320 and -> 48000 by 147/294.
+const PHASES: usize = 640;
+/// Coefficients are Q14, so the centre tap of any phase stays below `i16::MAX`.
+const COEFF_BITS: u32 = 14;
+/// Passband edge as a fraction of the source Nyquist rate; the rest is transition band.
+const CUTOFF: f64 = 0.9;
+const MAX_CHANNELS: usize = 2;
+
+/// One windowed-sinc kernel per phase, built at compile time.
+static SINC_TABLE: [[i16; TAPS]; PHASES] = sinc_table();
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum Kind {
+    /// Band-limited interpolation; used whenever the stream rate is at least the source rate.
+    Polyphase,
+    /// Two-point interpolation, kept for downsampling where the sinc cutoff would alias.
+    Linear,
+}
+
+/// Converts interleaved i16 PCM from one rate to another, carrying its filter history and
+/// position across calls so consecutive slices join without a seam.
+pub struct Resampler {
+    kind: Kind,
+    src_rate: u32,
+    dst_rate: u32,
+    /// Position of the next output between `history` frames `TAPS / 2 - 1` and `TAPS / 2`,
+    /// in units of 1 / `dst_rate` source frames.
+    phase: u32,
+    /// Last `TAPS` source frames per channel, stored twice so the window ending at `cursor`
+    /// is always one contiguous slice.
+    history: [[i16; 2 * TAPS]; MAX_CHANNELS],
+    cursor: usize,
+}
+
+impl Resampler {
+    pub const fn new() -> Self {
+        Self {
+            kind: Kind::Linear,
+            src_rate: 0,
+            dst_rate: 0,
+            phase: 0,
+            history: [[0; 2 * TAPS]; MAX_CHANNELS],
+            cursor: 0,
+        }
+    }
+
+    /// Selects the conversion for `src_rate` -> `dst_rate`, starting afresh if it changed.
+    pub fn configure(&mut self, src_rate: u32, dst_rate: u32) {
+        if (src_rate, dst_rate) == (self.src_rate, self.dst_rate) {
+            return;
+        }
+        self.src_rate = src_rate;
+        self.dst_rate = dst_rate;
+        self.kind = if src_rate <= dst_rate {
+            Kind::Polyphase
+        } else {
+            Kind::Linear
+        };
+        self.reset();
+    }
+
+    /// Forgets buffered history, as after a stream stop, so old audio cannot leak in.
+    pub fn reset(&mut self) {
+        self.phase = 0;
+        self.history = [[0; 2 * TAPS]; MAX_CHANNELS];
+        self.cursor = 0;
+    }
+
+    pub const fn name(&self) -> &'static str {
+        match self.kind {
+            Kind::Polyphase => "polyphase",
+            Kind::Linear => "linear",
+        }
+    }
+
+    /// Upper bound on the frames `process` emits for `src_frames` input frames.
+    pub fn max_output_frames(&self, src_frames: usize) -> usize {
+        let step = self.src_rate.max(1) as usize;
+        (src_frames * self.dst_rate as usize).div_ceil(step) + 1
+    }
+
+    /// Reads whole frames from `input` and writes converted frames into `out` until either
+    /// runs out. `out` may be uninitialized ring storage. Returns (input frames consumed,
+    /// samples written).
+    pub fn process(
+        &mut self,
+        input: &[i16],
+        in_channels: usize,
+        out: &mut [MaybeUninit<i16>],
+        out_channels: usize,
+    ) -> (usize, usize) {
+        let dst = self.dst_rate.max(1);
+        let step = self.src_rate.max(1);
+        let in_frames = input.len() / in_channels;
+        let mut consumed = 0usize;
+        let mut written = 0usize;
+        loop {
+            while self.phase >= dst {
+                if consumed == in_frames {
+                    return (consumed, written);
+                }
+                let frame = &input[consumed * in_channels..][..in_channels];
+                self.load(frame[0], frame[in_channels - 1]);
+                consumed += 1;
+                self.phase -= dst;
+            }
+            if out.len() - written < out_channels {
+                return (consumed, written);
+            }
+            for channel in 0..out_channels {
+                out[written + channel].write(self.interpolate(channel, dst));
+            }
+            written += out_channels;
+            self.phase += step;
+        }
+    }
+
+    fn load(&mut self, left: i16, right: i16) {
+        self.cursor = (self.cursor + 1) % TAPS;
+        for (history, sample) in self.history.iter_mut().zip([left, right]) {
+            history[self.cursor] = sample;
+            history[self.cursor + TAPS] = sample;
+        }
+    }
+
+    fn interpolate(&self, channel: usize, dst: u32) -> i16 {
+        let window: &[i16; TAPS] = self.history[channel][self.cursor + 1..][..TAPS]
+            .try_into()
+            .unwrap_or(&[0; TAPS]);
+        match self.kind {
+            Kind::Polyphase => {
+                let index = (u64::from(self.phase) * PHASES as u64 / u64::from(dst)) as usize;
+                dot(window, &SINC_TABLE[index])
+            }
+            Kind::Linear => {
+                let a = i64::from(window[TAPS / 2 - 1]);
+                let b = i64::from(window[TAPS / 2]);
+                (a + (b - a) * i64::from(self.phase) / i64::from(dst)) as i16
+            }
+        }
+    }
+}
+
+/// Fixed-length multiply-accumulate the compiler fully unrolls. Q14 taps sum to at most
+/// about 1.8 in magnitude, so the i32 accumulator cannot overflow for any input.
+fn dot(window: &[i16; TAPS], coeffs: &[i16; TAPS]) -> i16 {
+    let acc = window
+        .iter()
+        .zip(coeffs)
+        .fold(0i32, |acc, (&sample, &coeff)| {
+            acc + i32::from(sample) * i32::from(coeff)
+        });
+    let rounded = (acc + (1 << (COEFF_BITS - 1))) >> COEFF_BITS;
+    rounded.clamp(i32::from(i16::MIN), i32::from(i16::MAX)) as i16
+}
+
+/// Blackman-windowed sinc low-pass at `CUTOFF`, sampled at each phase offset and normalized
+/// to unity DC gain after rounding, so a constant input passes through unchanged.
+const fn sinc_table() -> [[i16; TAPS]; PHASES] {
+    let unity = 1i32 << COEFF_BITS;
+    let half = (TAPS / 2) as f64;
+    let mut table = [[0i16; TAPS]; PHASES];
+    let mut phase = 0;
+    while phase < PHASES {
+        let frac = phase as f64 / PHASES as f64;
+        let mut taps = [0f64; TAPS];
+        let mut sum = 0f64;
+        let mut k = 0;
+        while k < TAPS {
+            let t = k as f64 - (half - 1.0) - frac;
+            let x = PI * CUTOFF * t;
+            let sinc = if t == 0.0 { 1.0 } else { sin(x) / x };
+            let window = 0.42 + 0.5 * cos(PI * t / half) + 0.08 * cos(2.0 * PI * t / half);
+            taps[k] = sinc * window;
+            sum += taps[k];
+            k += 1;
+        }
+        let mut total = 0i32;
+        let mut peak = 0;
+        k = 0;
+        while k < TAPS {
+            let scaled = taps[k] / sum * unity as f64;
+            let rounded = if scaled < 0.0 {
+                scaled - 0.5
+            } else {
+                scaled + 0.5
+            } as i32;
+            table[phase][k] = rounded as i16;
+            total += rounded;
+            if rounded > table[phase][peak] as i32 {
+                peak = k;
+            }
+            k += 1;
+        }
+        table[phase][peak] += (unity - total) as i16;
+        phase += 1;
+    }
+    table
+}
+
+/// Taylor sine after reducing `x` to [-pi, pi]; accurate far beyond Q14 resolution.
+const fn sin(x: f64) -> f64 {
+    let turns = x / (2.0 * PI);
+    let whole = if turns < 0.0 {
+        turns - 0.5
+    } else {
+        turns + 0.5
+    } as i64;
+    let x = x - whole as f64 * 2.0 * PI;
+    let mut term = x;
+    let mut sum = x;
+    let mut n = 1;
+    while n < 12 {
+        term = -term * x * x / ((2 * n) as f64 * (2 * n + 1) as f64);
+        sum += term;
+        n += 1;
+    }
+    sum
+}
+
+const fn cos(x: f64) -> f64 {
+    sin(x + PI / 2.0)
+}
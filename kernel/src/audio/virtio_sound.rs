@@ -1,11 +1,13 @@
 // kernel/src/audio/virtio_sound.rs: modern virtio-sound playback backend (PCM TX queue).
-use crate::arch::x86_64::port;
-use crate::mem;
+use super::resample::Resampler;
+use crate::arch::x86_64::{interrupts, port};
+use crate::sync::spsc::SpscRing;
+use crate::{mem, time};
 use core::cell::UnsafeCell;
 use core::hint::spin_loop;
 use core::mem::size_of;
 use core::ptr::{addr_of, addr_of_mut, read_volatile, write_volatile};
-use core::sync::atomic::{Ordering, fence};
+use core::sync::atomic::{AtomicBool, AtomicPtr, AtomicU64, Ordering, fence};
 
 const VIRTIO_VENDOR_ID: u16 = 0x1AF4;
 const VIRTIO_SOUND_MODERN_ID: u16 = 0x1059;
@@ -41,25 +43,30 @@ const TX_DESC_PER_SLOT: usize = 3;
 
 const MAX_CONTROL_SPINS: usize = 2_000_000;
 const MAX_TX_CHUNK_FRAMES: usize = 1024;
-const MAX_RESAMPLE_FRAMES: usize = 2048;
 const MAX_STREAM_CHANNELS: usize = 2;
-const MAX_RESAMPLE_SAMPLES: usize = MAX_RESAMPLE_FRAMES * MAX_STREAM_CHANNELS;
+/// Largest period, and so the size of each TX packet buffer.
 const TX_PACKET_FRAMES: usize = 1024;
 const TX_PACKET_SAMPLES: usize = TX_PACKET_FRAMES * 2;
-const PCM_BUFFER_PERIODS: u32 = 8;
+const MIN_PERIOD_FRAMES: u16 = 64;
+const DEFAULT_PERIOD_FRAMES: u16 = TX_PACKET_FRAMES as u16;
+/// Periods in flight at once; each needs its own TX slot.
+const MIN_BUFFER_PERIODS: u8 = 2;
+const DEFAULT_BUFFER_PERIODS: u8 = 8;
 const PCM_FIFO_FRAMES: usize = TX_PACKET_FRAMES * 24;
 const PCM_FIFO_SAMPLES: usize = PCM_FIFO_FRAMES * MAX_STREAM_CHANNELS;
-const PCM_FIFO_TARGET_FRAMES: u32 = TX_PACKET_FRAMES as u32 * 6;
-const PCM_FIFO_HIGH_WATER_FRAMES: u32 = TX_PACKET_FRAMES as u32 * 10;
 
 const VIRTIO_SND_R_PCM_INFO: u32 = 0x0100;
 const VIRTIO_SND_R_PCM_SET_PARAMS: u32 = 0x0101;
 const VIRTIO_SND_R_PCM_PREPARE: u32 = 0x0102;
+const VIRTIO_SND_R_PCM_RELEASE: u32 = 0x0103;
 const VIRTIO_SND_R_PCM_START: u32 = 0x0104;
 const VIRTIO_SND_R_PCM_STOP: u32 = 0x0105;
 
 const VIRTIO_SND_S_OK: u32 = 0x8000;
 
+const PCI_INTERRUPT_LINE: u8 = 0x3C;
+const VIRTIO_ISR_QUEUE: u8 = 1;
+
 const VIRTIO_SND_D_OUTPUT: u8 = 0;
 
 const VIRTIO_SND_PCM_FMT_S16: u8 = 5;
@@ -166,7 +173,7 @@ impl<const N: usize> QueueMemory<N> {
 
 struct QueueMemoryCell<const N: usize>(UnsafeCell<QueueMemory<N>>);
 
-// SAFETY: access is serialized by the single-threaded kernel main loop.
+// SAFETY: the driver is only entered from `audio` with `AUDIO_LOCK` held.
 unsafe impl<const N: usize> Sync for QueueMemoryCell<N> {}
 
 static CTRL_QUEUE_MEMORY: QueueMemoryCell<CTRL_QUEUE_SIZE> =
@@ -300,7 +307,7 @@ impl TxPacket {
 
 struct TxPacketsCell(UnsafeCell<[TxPacket; TX_SLOT_COUNT]>);
 
-// SAFETY: access is serialized by the single-threaded kernel main loop.
+// SAFETY: the driver is only entered from `audio` with `AUDIO_LOCK` held.
 unsafe impl Sync for TxPacketsCell {}
 
 static TX_PACKETS: TxPacketsCell = TxPacketsCell(UnsafeCell::new([
@@ -362,6 +369,7 @@ pub struct VirtioSoundStatus {
     pub ready: bool,
     pub stream_id: u32,
     pub sample_rate_hz: u32,
+    pub resampler: &'static str,
     pub channels: u8,
     pub pending_packets: u16,
     pub buffered_frames: u32,
@@ -371,15 +379,33 @@ pub struct VirtioSoundStatus {
     pub completed_frames: u64,
     pub dropped_frames: u64,
     pub last_ctrl_status: u32,
+    pub period_frames: u16,
+    pub buffer_periods: u8,
+    /// TX completions arrive by interrupt rather than by polling.
+    pub irq_driven: bool,
+    pub irqs: u64,
+    /// Device queue ran dry while the stream was playing.
+    pub underruns: u64,
+    /// Underruns plus every time queued audio had to be dropped to bound latency.
+    pub xruns: u64,
+    /// Submit-to-completion time of the most recent probed frame, and the worst seen.
+    pub latency_last_us: u64,
+    pub latency_max_us: u64,
 }
 
 struct DriverCell(UnsafeCell<DriverState>);
 
-// SAFETY: this module is used from the single-threaded kernel runtime loop.
+// SAFETY: the driver is only entered from `audio` with `AUDIO_LOCK` held.
 unsafe impl Sync for DriverCell {}
 
 static DRIVER_STATE: DriverCell = DriverCell(UnsafeCell::new(DriverState::new()));
 
+/// The device's ISR status byte, published for the interrupt handler, which must not take
+/// `AUDIO_LOCK`: the audio thread may hold it when the IRQ arrives.
+static SND_IRQ_ISR: AtomicPtr<u8> = AtomicPtr::new(core::ptr::null_mut());
+static SND_IRQ_COUNT: AtomicU64 = AtomicU64::new(0);
+static SND_IRQ_MASKED: AtomicBool = AtomicBool::new(false);
+
 struct DriverState {
     initialized: bool,
     ready: bool,
@@ -396,14 +422,26 @@ struct DriverState {
     stream_rate_enum: u8,
     channels: u8,
     started: bool,
-    resample_phase_fp: u64,
+    resampler: Resampler,
+    irq_line: Option<u8>,
+    period_frames: u16,
+    buffer_periods: u8,
     tx_slot_busy: [bool; TX_SLOT_COUNT],
     tx_slot_frames: [u16; TX_SLOT_COUNT],
-    resample_tmp: [i16; MAX_RESAMPLE_SAMPLES],
-    pcm_fifo: [i16; PCM_FIFO_SAMPLES],
-    pcm_fifo_read: usize,
-    pcm_fifo_write: usize,
-    pcm_fifo_samples: usize,
+    /// Sequence number of the first frame in each in-flight packet.
+    tx_slot_seq: [u64; TX_SLOT_COUNT],
+    /// Mixed PCM waiting for a free TX slot. Holds at most `fifo_capacity_samples` for the
+    /// current channel count; the ring itself is sized for stereo.
+    pcm_fifo: SpscRing<i16, PCM_FIFO_SAMPLES>,
+    /// Sequence number of the oldest frame in `pcm_fifo`; every frame that enters the FIFO
+    /// gets the next number, whether it is later sent or dropped.
+    fifo_seq: u64,
+    /// One frame being timed from submit to TX completion: (sequence, submit time in ns).
+    latency_probe: Option<(u64, u64)>,
+    latency_last_ns: u64,
+    latency_max_ns: u64,
+    underruns: u64,
+    xruns: u64,
     pending_hw_frames: u32,
     ctrl_status: VirtioSndHdr,
     pcm_infos: [VirtioSndPcmInfo; TX_SLOT_COUNT],
@@ -442,14 +480,20 @@ impl DriverState {
             stream_rate_enum: 0,
             channels: 0,
             started: false,
-            resample_phase_fp: 0,
+            resampler: Resampler::new(),
+            irq_line: None,
+            period_frames: DEFAULT_PERIOD_FRAMES,
+            buffer_periods: DEFAULT_BUFFER_PERIODS,
             tx_slot_busy: [false; TX_SLOT_COUNT],
             tx_slot_frames: [0; TX_SLOT_COUNT],
-            resample_tmp: [0; MAX_RESAMPLE_SAMPLES],
-            pcm_fifo: [0; PCM_FIFO_SAMPLES],
-            pcm_fifo_read: 0,
-            pcm_fifo_write: 0,
-            pcm_fifo_samples: 0,
+            tx_slot_seq: [0; TX_SLOT_COUNT],
+            pcm_fifo: SpscRing::new(),
+            fifo_seq: 0,
+            latency_probe: None,
+            latency_last_ns: 0,
+            latency_max_ns: 0,
+            underruns: 0,
+            xruns: 0,
             pending_hw_frames: 0,
             ctrl_status: VirtioSndHdr { code: 0 },
             pcm_infos: [VirtioSndPcmInfo::EMPTY; TX_SLOT_COUNT],
@@ -479,6 +523,7 @@ impl DriverState {
             ready: self.ready,
             stream_id: self.stream_id,
             sample_rate_hz: self.stream_rate_hz,
+            resampler: self.resampler.name(),
             channels: self.channels,
             pending_packets: self.pending_packets,
             buffered_frames: self.total_buffered_frames(),
@@ -488,6 +533,14 @@ impl DriverState {
             completed_frames: self.completed_frames,
             dropped_frames: self.dropped_frames,
             last_ctrl_status: self.last_ctrl_status,
+            period_frames: self.period_frames,
+            buffer_periods: self.buffer_periods,
+            irq_driven: self.irq_driven(),
+            irqs: SND_IRQ_COUNT.load(Ordering::Relaxed),
+            underruns: self.underruns,
+            xruns: self.xruns,
+            latency_last_us: self.latency_last_ns / 1_000,
+            latency_max_us: self.latency_max_ns / 1_000,
         }
     }
 
@@ -514,12 +567,17 @@ impl DriverState {
         self.dropped_packets = 0;
         self.completed_frames = 0;
         self.dropped_frames = 0;
-        self.resample_phase_fp = 0;
+        self.underruns = 0;
+        self.xruns = 0;
+        self.latency_last_ns = 0;
+        self.latency_max_ns = 0;
+        self.resampler.reset();
         self.pending_hw_frames = 0;
-        self.pcm_fifo_read = 0;
-        self.pcm_fifo_write = 0;
-        self.pcm_fifo_samples = 0;
-        self.pcm_fifo.fill(0);
+        self.clear_fifo();
+    }
+
+    fn irq_driven(&self) -> bool {
+        self.irq_line.is_some() && !SND_IRQ_MASKED.load(Ordering::Acquire)
     }
 
     fn try_init(&mut self) -> Result<(), &'static str> {
@@ -529,7 +587,8 @@ impl DriverState {
         let common_cfg_ptr = map_cap_region(&pci, caps.common).ok_or("virtio_snd_common_map")?;
         let notify_ptr = map_cap_region(&pci, caps.notify).ok_or("virtio_snd_notify_map")?;
         let device_cfg_ptr = map_cap_region(&pci, caps.device).ok_or("virtio_snd_device_map")?;
-        let _isr_ptr = caps.isr.and_then(|region| map_cap_region(&pci, region));
+        let isr_ptr = caps.isr.and_then(|region| map_cap_region(&pci, region));
+        let irq_line = pci_read_u8(pci.bus, pci.device, pci.function, PCI_INTERRUPT_LINE);
 
         self.common_cfg = common_cfg_ptr as *mut VirtioPciCommonCfg;
         self.notify_base = notify_ptr;
@@ -612,6 +671,19 @@ impl DriverState {
             );
         }
 
+        if let Some(isr) = isr_ptr
+            && irq_line != 0
+            && irq_line < 16
+        {
+            // SAFETY: `isr` maps the device's ISR status byte; reading it clears any
+            // interrupt raised during setup before the line is unmasked.
+            let _ = unsafe { read_volatile(isr) };
+            SND_IRQ_ISR.store(isr, Ordering::Release);
+            if interrupts::enable_sound_irq(irq_line) {
+                self.irq_line = Some(irq_line);
+            }
+        }
+
         Ok(())
     }
 
@@ -703,7 +775,7 @@ impl DriverState {
             return Err("virtio_snd_ctrl_req_empty");
         }
 
-        // SAFETY: queue memory is private to this driver and serialized by the main loop.
+        // SAFETY: queue memory is private to this driver and serialized by `AUDIO_LOCK`.
         let queue = unsafe { &mut *CTRL_QUEUE_MEMORY.0.get() };
         let queue_size = usize::from(self.ctrl_queue.size);
         if queue_size < 3 {
@@ -849,8 +921,8 @@ impl DriverState {
 
     fn send_set_params(&mut self) -> Result<(), &'static str> {
         let frame_bytes = usize::from(self.channels).saturating_mul(size_of::<i16>());
-        let period_bytes = TX_PACKET_FRAMES.saturating_mul(frame_bytes) as u32;
-        let buffer_bytes = period_bytes.saturating_mul(PCM_BUFFER_PERIODS);
+        let period_bytes = usize::from(self.period_frames).saturating_mul(frame_bytes) as u32;
+        let buffer_bytes = period_bytes.saturating_mul(u32::from(self.buffer_periods));
         let params = VirtioSndPcmSetParams {
             hdr: VirtioSndHdr {
                 code: VIRTIO_SND_R_PCM_SET_PARAMS,
@@ -887,12 +959,14 @@ impl DriverState {
         Ok(())
     }
 
-    fn poll_tx_used(&mut self) {
+    /// Reaps completed TX packets; returns how many.
+    fn poll_tx_used(&mut self) -> usize {
         if !self.ready {
-            return;
+            return 0;
         }
         // SAFETY: queue memory is private to this driver and polling is serialized.
         let queue = unsafe { &mut *TX_QUEUE_MEMORY.0.get() };
+        let mut reaped = 0usize;
         loop {
             // SAFETY: `used.idx` belongs to TX queue memory.
             let used_idx = unsafe { read_volatile(addr_of!(queue.used.idx)) };
@@ -912,6 +986,8 @@ impl DriverState {
                 self.completed_frames =
                     self.completed_frames.saturating_add(u64::from(frame_count));
                 self.tx_slot_frames[slot] = 0;
+                self.note_played(self.tx_slot_seq[slot], u64::from(frame_count));
+                reaped += 1;
                 // SAFETY: TX packet slot belongs to this driver and is only accessed while serialized.
                 let packet = unsafe { &(*TX_PACKETS.0.get())[slot] };
                 if packet.status.status != VIRTIO_SND_S_OK && packet.status.status != 0 {
@@ -922,6 +998,76 @@ impl DriverState {
 
             self.tx_queue.last_used_idx = self.tx_queue.last_used_idx.wrapping_add(1);
         }
+        reaped
+    }
+
+    /// Completes the latency probe if its frame was in the packet `start..start + frames`.
+    fn note_played(&mut self, start: u64, frames: u64) {
+        let Some((seq, submitted_ns)) = self.latency_probe else {
+            return;
+        };
+        if seq >= start + frames {
+            return;
+        }
+        // A probe older than the packet was dropped from the FIFO; start a fresh one.
+        if seq >= start {
+            let latency = time::monotonic_ns().saturating_sub(submitted_ns);
+            self.latency_last_ns = latency;
+            self.latency_max_ns = self.latency_max_ns.max(latency);
+        }
+        self.latency_probe = None;
+    }
+
+    /// Stops, reconfigures and restarts the stream with `period_frames` per packet and
+    /// `periods` packets in flight. Whatever was queued is discarded.
+    fn set_buffering(&mut self, period_frames: u16, periods: u8) -> Result<(), &'static str> {
+        if !self.ready {
+            return Err("virtio_snd_not_ready");
+        }
+        if !(MIN_PERIOD_FRAMES..=DEFAULT_PERIOD_FRAMES).contains(&period_frames)
+            || !(MIN_BUFFER_PERIODS..=TX_SLOT_COUNT as u8).contains(&periods)
+        {
+            return Err("virtio_snd_bad_buffering");
+        }
+        let restart = self.started;
+        let result = self.reconfigure(period_frames, periods, restart);
+        if let Err(reason) = result {
+            // The stream is in an unknown state; stop using it rather than guess.
+            self.reason = self.ctrl_error_reason(reason);
+            self.ready = false;
+            self.fail_device();
+            return Err(self.reason);
+        }
+        Ok(())
+    }
+
+    fn reconfigure(
+        &mut self,
+        period_frames: u16,
+        periods: u8,
+        restart: bool,
+    ) -> Result<(), &'static str> {
+        if self.started {
+            self.send_pcm_cmd(VIRTIO_SND_R_PCM_STOP)?;
+            self.started = false;
+        }
+        // RELEASE makes the device complete every pending TX packet first.
+        self.send_pcm_cmd(VIRTIO_SND_R_PCM_RELEASE)?;
+        self.poll_tx_used();
+        if self.pending_packets != 0 {
+            return Err("virtio_snd_tx_busy");
+        }
+        self.clear_fifo();
+        self.resampler.reset();
+        self.period_frames = period_frames;
+        self.buffer_periods = periods;
+        self.send_set_params()?;
+        self.send_pcm_cmd(VIRTIO_SND_R_PCM_PREPARE)?;
+        if restart {
+            self.send_pcm_cmd(VIRTIO_SND_R_PCM_START)?;
+            self.started = true;
+        }
+        Ok(())
     }
 
     fn set_started(&mut self, enabled: bool) {
@@ -939,10 +1085,8 @@ impl DriverState {
         if result.is_ok() {
             self.started = enabled;
             if !enabled {
-                self.pcm_fifo_read = 0;
-                self.pcm_fifo_write = 0;
-                self.pcm_fifo_samples = 0;
-                self.resample_phase_fp = 0;
+                self.clear_fifo();
+                self.resampler.reset();
             } else {
                 self.pump_fifo_to_tx();
             }
@@ -960,66 +1104,53 @@ impl DriverState {
         }
         self.pump_fifo_to_tx();
 
-        let mut consumed_frames = 0usize;
-        let src_step_fp = ((u64::from(src_rate)) << 32) / u64::from(self.stream_rate_hz.max(1));
-        let mut phase = self.resample_phase_fp;
         let output_channels = usize::from(self.channels.clamp(1, 2));
-        let source_samples = &samples[..src_frames.saturating_mul(input_channels)];
-
-        for chunk in source_samples.chunks(MAX_TX_CHUNK_FRAMES.saturating_mul(input_channels)) {
-            if chunk.is_empty() {
-                continue;
-            }
-            let chunk_frames = chunk.len() / input_channels;
-            if chunk_frames == 0 {
-                continue;
-            }
-
-            let mut produced_frames = 0usize;
-            while produced_frames < MAX_RESAMPLE_FRAMES {
-                let src_idx = (phase >> 32) as usize;
-                if src_idx >= chunk_frames {
-                    break;
-                }
-
-                let next_idx = (src_idx + 1).min(chunk_frames.saturating_sub(1));
-                let src_base = src_idx.saturating_mul(input_channels);
-                let next_base = next_idx.saturating_mul(input_channels);
-                let frac = ((phase & 0xFFFF_FFFF) >> 16) as u32;
-
-                let src_l = lerp_i16(chunk[src_base], chunk[next_base], frac);
-                let src_r = if input_channels > 1 {
-                    lerp_i16(chunk[src_base + 1], chunk[next_base + 1], frac)
-                } else {
-                    src_l
-                };
-                let out_base = produced_frames.saturating_mul(output_channels);
-                self.resample_tmp[out_base] = src_l;
-                if output_channels > 1 {
-                    self.resample_tmp[out_base + 1] = src_r;
-                }
+        let capacity = Self::fifo_capacity_samples(output_channels);
+        self.resampler
+            .configure(src_rate, self.stream_rate_hz.max(1));
+        let source_samples = &samples[..src_frames * input_channels];
+        if self.latency_probe.is_none() {
+            let next_seq = self.fifo_seq + (self.pcm_fifo.len() / output_channels) as u64;
+            self.latency_probe = Some((next_seq, time::monotonic_ns()));
+        }
 
-                produced_frames += 1;
-                phase = phase.saturating_add(src_step_fp.max(1));
-            }
-            let chunk_limit = (chunk_frames as u64) << 32;
-            if phase >= chunk_limit {
-                phase = phase.saturating_sub(chunk_limit);
+        let mut consumed_frames = 0usize;
+        while consumed_frames < src_frames {
+            let chunk_frames = (src_frames - consumed_frames).min(MAX_TX_CHUNK_FRAMES);
+            let chunk = &source_samples[consumed_frames * input_channels..]
+                [..chunk_frames * input_channels];
+            let wanted = self
+                .resampler
+                .max_output_frames(chunk_frames)
+                .saturating_mul(output_channels)
+                .min(capacity);
+            let free = capacity.saturating_sub(self.pcm_fifo.len());
+            if wanted > free {
+                self.fifo_drop_oldest_samples(wanted - free, output_channels);
             }
 
-            consumed_frames = consumed_frames.saturating_add(chunk_frames);
-            let produced_samples = produced_frames.saturating_mul(output_channels);
-            if produced_samples > 0 {
-                let mut local = [0i16; MAX_RESAMPLE_SAMPLES];
-                local[..produced_samples].copy_from_slice(&self.resample_tmp[..produced_samples]);
-                self.push_fifo_samples(&local[..produced_samples], output_channels);
-                self.trim_fifo_if_needed(output_channels);
-                self.pump_fifo_to_tx();
+            // The resampler writes straight into the FIFO's free slots.
+            let resampler = &mut self.resampler;
+            let mut used_frames = 0usize;
+            self.pcm_fifo.push_with(wanted, |slots| {
+                let (frames, written) = resampler.process(
+                    &chunk[used_frames * input_channels..],
+                    input_channels,
+                    slots,
+                    output_channels,
+                );
+                used_frames += frames;
+                written
+            });
+            if used_frames == 0 {
+                break;
             }
+            consumed_frames += used_frames;
+            self.trim_fifo_if_needed(output_channels);
+            self.pump_fifo_to_tx();
         }
 
-        self.resample_phase_fp = phase;
-        consumed_frames.saturating_mul(input_channels)
+        consumed_frames * input_channels
     }
 
     fn enqueue_tx_packet(
@@ -1102,7 +1233,7 @@ impl DriverState {
             None => return false,
         };
 
-        // SAFETY: queue memory is private to this driver and serialized by main loop.
+        // SAFETY: queue memory is private to this driver and serialized by `AUDIO_LOCK`.
         let queue = unsafe { &mut *TX_QUEUE_MEMORY.0.get() };
         queue.desc[head] = VirtqDesc {
             addr: xfer_phys,
@@ -1131,6 +1262,7 @@ impl DriverState {
 
         self.tx_slot_busy[slot] = true;
         self.tx_slot_frames[slot] = frame_count as u16;
+        self.tx_slot_seq[slot] = self.fifo_seq;
         self.pending_packets = self.pending_packets.saturating_add(1);
         self.pending_hw_frames = self.pending_hw_frames.saturating_add(frame_count as u32);
         self.submitted_packets = self.submitted_packets.saturating_add(1);
@@ -1138,7 +1270,11 @@ impl DriverState {
     }
 
     fn next_free_slot(&self) -> Option<usize> {
-        (0..TX_SLOT_COUNT).find(|&slot| !self.tx_slot_busy[slot])
+        (0..usize::from(self.buffer_periods)).find(|&slot| !self.tx_slot_busy[slot])
+    }
+
+    fn buffer_frames(&self) -> u32 {
+        u32::from(self.period_frames) * u32::from(self.buffer_periods)
     }
 
     fn total_buffered_frames(&self) -> u32 {
@@ -1146,7 +1282,7 @@ impl DriverState {
         if channels == 0 {
             return self.pending_hw_frames;
         }
-        let fifo_frames = (self.pcm_fifo_samples / channels).min(u32::MAX as usize) as u32;
+        let fifo_frames = (self.pcm_fifo.len() / channels).min(u32::MAX as usize) as u32;
         self.pending_hw_frames.saturating_add(fifo_frames)
     }
 
@@ -1155,122 +1291,48 @@ impl DriverState {
     }
 
     fn fifo_drop_oldest_samples(&mut self, drop_samples: usize, channels: usize) {
-        if drop_samples == 0 || self.pcm_fifo_samples == 0 {
-            return;
-        }
         let channels = channels.clamp(1, 2);
-        let capacity = Self::fifo_capacity_samples(channels);
-        if capacity == 0 {
-            return;
-        }
-
         let aligned_drop = drop_samples - (drop_samples % channels);
-        if aligned_drop == 0 {
-            return;
+        let dropped = self.pcm_fifo.skip(aligned_drop) / channels;
+        if dropped > 0 {
+            self.xruns = self.xruns.saturating_add(1);
         }
-        let dropped = aligned_drop.min(self.pcm_fifo_samples);
-        self.pcm_fifo_read = (self.pcm_fifo_read + dropped) % capacity;
-        self.pcm_fifo_samples = self.pcm_fifo_samples.saturating_sub(dropped);
-        self.dropped_frames = self
-            .dropped_frames
-            .saturating_add((dropped / channels) as u64);
+        self.fifo_seq += dropped as u64;
+        self.dropped_frames = self.dropped_frames.saturating_add(dropped as u64);
     }
 
-    fn push_fifo_samples(&mut self, samples: &[i16], channels: usize) {
-        if samples.is_empty() {
-            return;
-        }
-        let channels = channels.clamp(1, 2);
-        let capacity = Self::fifo_capacity_samples(channels);
-        if capacity == 0 {
-            return;
-        }
-
-        let mut sample_count = samples.len() - (samples.len() % channels);
-        if sample_count == 0 {
-            return;
-        }
-
-        let mut source_start = 0usize;
-        if sample_count > capacity {
-            let overflow = sample_count - capacity;
-            self.dropped_frames = self
-                .dropped_frames
-                .saturating_add((overflow / channels) as u64);
-            source_start = overflow;
-            sample_count = capacity;
-        }
-
-        let free = capacity.saturating_sub(self.pcm_fifo_samples);
-        if sample_count > free {
-            self.fifo_drop_oldest_samples(sample_count - free, channels);
-        }
-
-        let mut remaining = sample_count;
-        let mut input_offset = source_start;
-        while remaining > 0 {
-            let contiguous = capacity.saturating_sub(self.pcm_fifo_write);
-            let write_now = remaining.min(contiguous);
-            let write_end = self.pcm_fifo_write + write_now;
-            self.pcm_fifo[self.pcm_fifo_write..write_end]
-                .copy_from_slice(&samples[input_offset..input_offset + write_now]);
-            self.pcm_fifo_write = (self.pcm_fifo_write + write_now) % capacity;
-            self.pcm_fifo_samples = self.pcm_fifo_samples.saturating_add(write_now);
-            input_offset += write_now;
-            remaining -= write_now;
-        }
+    fn clear_fifo(&mut self) {
+        let channels = usize::from(self.channels.clamp(1, 2));
+        self.fifo_seq += (self.pcm_fifo.len() / channels) as u64;
+        self.pcm_fifo.clear();
+        self.latency_probe = None;
     }
 
-    fn copy_fifo_prefix(&self, target: &mut [i16], sample_count: usize, channels: usize) -> bool {
-        if sample_count == 0 || sample_count > target.len() || sample_count > self.pcm_fifo_samples
-        {
-            return false;
-        }
-        let channels = channels.clamp(1, 2);
-        let capacity = Self::fifo_capacity_samples(channels);
-        if capacity == 0 {
-            return false;
-        }
-
-        let mut copied = 0usize;
-        let mut read = self.pcm_fifo_read;
-        while copied < sample_count {
-            let contiguous = capacity.saturating_sub(read);
-            let copy_now = (sample_count - copied).min(contiguous);
-            target[copied..copied + copy_now]
-                .copy_from_slice(&self.pcm_fifo[read..read + copy_now]);
-            read = (read + copy_now) % capacity;
-            copied += copy_now;
-        }
-        true
+    fn copy_fifo_prefix(&self, target: &mut [i16], sample_count: usize) -> bool {
+        sample_count != 0
+            && sample_count <= target.len()
+            && self.pcm_fifo.peek_slice(&mut target[..sample_count]) == sample_count
     }
 
     fn consume_fifo_samples(&mut self, sample_count: usize, channels: usize) {
-        if sample_count == 0 {
-            return;
-        }
         let channels = channels.clamp(1, 2);
-        let capacity = Self::fifo_capacity_samples(channels);
-        if capacity == 0 {
-            return;
-        }
-        let aligned = sample_count - (sample_count % channels);
-        let consumed = aligned.min(self.pcm_fifo_samples);
-        self.pcm_fifo_read = (self.pcm_fifo_read + consumed) % capacity;
-        self.pcm_fifo_samples = self.pcm_fifo_samples.saturating_sub(consumed);
+        let consumed = self.pcm_fifo.skip(sample_count - (sample_count % channels));
+        self.fifo_seq += (consumed / channels) as u64;
     }
 
     fn trim_fifo_if_needed(&mut self, channels: usize) {
         let channels = channels.clamp(1, 2);
+        // Let the backlog reach 5/4 of the device buffer, then cut it back to 3/4.
+        let buffer = self.buffer_frames();
         let total = self.total_buffered_frames();
-        if total <= PCM_FIFO_HIGH_WATER_FRAMES {
+        if total <= buffer + buffer / 4 {
             return;
         }
-        let fifo_frames = (self.pcm_fifo_samples / channels).min(u32::MAX as usize) as u32;
+        let fifo_frames = (self.pcm_fifo.len() / channels).min(u32::MAX as usize) as u32;
         if fifo_frames == 0 {
             return;
         }
-        let mut drop_frames = total.saturating_sub(PCM_FIFO_TARGET_FRAMES);
+        let mut drop_frames = total.saturating_sub(buffer - buffer / 4);
         drop_frames = drop_frames.min(fifo_frames);
         let drop_samples = (drop_frames as usize).saturating_mul(channels);
         self.fifo_drop_oldest_samples(drop_samples, channels);
@@ -1280,7 +1342,7 @@ impl DriverState {
         if !self.ready || !self.started {
             return;
         }
-        self.poll_tx_used();
+        let reaped = self.poll_tx_used();
 
         let channels = usize::from(self.channels.clamp(1, 2));
         if channels == 0 {
@@ -1292,17 +1354,17 @@ impl DriverState {
             if self.next_free_slot().is_none() {
                 break;
             }
-            let available_frames = self.pcm_fifo_samples / channels;
+            let available_frames = self.pcm_fifo.len() / channels;
             if available_frames == 0 {
                 break;
             }
 
-            let frame_count = available_frames.min(TX_PACKET_FRAMES);
+            let frame_count = available_frames.min(usize::from(self.period_frames));
             let sample_count = frame_count.saturating_mul(channels);
             if sample_count == 0 || sample_count > local.len() {
                 break;
             }
-            if !self.copy_fifo_prefix(&mut local, sample_count, channels) {
+            if !self.copy_fifo_prefix(&mut local, sample_count) {
                 break;
             }
             if !self.enqueue_tx_packet(&local[..sample_count], frame_count, channels) {
@@ -1310,6 +1372,10 @@ impl DriverState {
             }
             self.consume_fifo_samples(sample_count, channels);
         }
+        if reaped > 0 && self.pending_packets == 0 {
+            self.underruns = self.underruns.saturating_add(1);
+            self.xruns = self.xruns.saturating_add(1);
+        }
     }
 
     fn poll(&mut self) {
@@ -1337,25 +1403,43 @@ pub fn set_enabled(enabled: bool) {
     with_state_mut(|state| state.set_started(enabled));
 }
 
+pub fn set_buffering(period_frames: u16, periods: u8) -> Result<(), &'static str> {
+    with_state_mut(|state| state.set_buffering(period_frames, periods))
+}
+
+/// virtio-sound IRQ handler body; returns whether the device had raised the interrupt.
+/// Reading ISR acknowledges the line. TX completions are reaped by the audio thread, which
+/// the interrupt wakes, because that thread may hold `AUDIO_LOCK` here.
+pub fn handle_interrupt() -> bool {
+    let isr = SND_IRQ_ISR.load(Ordering::Acquire);
+    if isr.is_null() {
+        return false;
+    }
+    // SAFETY: `isr` maps the device's ISR status byte; reading it only acknowledges.
+    let status = unsafe { read_volatile(isr) };
+    if status == 0 {
+        return false;
+    }
+    if status & VIRTIO_ISR_QUEUE != 0 {
+        SND_IRQ_COUNT.fetch_add(1, Ordering::Relaxed);
+    }
+    true
+}
+
+/// Called from interrupt context when the shared line had to be masked.
+pub fn on_irq_disabled() {
+    SND_IRQ_MASKED.store(true, Ordering::Release);
+}
+
 pub fn submit_pcm_i16(samples: &[i16], sample_rate: u32, channels: u8) -> usize {
     with_state_mut(|state| state.submit_pcm_i16(samples, sample_rate, channels))
 }
 
 fn with_state_mut<R>(f: impl FnOnce(&mut DriverState) -> R) -> R {
-    // SAFETY: ArrOSt runtime is single-threaded in current milestones.
+    // SAFETY: the driver is only entered from `audio` with `AUDIO_LOCK` held.
     unsafe { f(&mut *DRIVER_STATE.0.get()) }
 }
 
-fn lerp_i16(a: i16, b: i16, frac: u32) -> i16 {
-    let start = i32::from(a);
-    let delta = i32::from(b).saturating_sub(start);
-    let scaled =
-        ((i64::from(delta).saturating_mul(i64::from(frac))).saturating_add(1i64 << 15)) >> 16;
-    start
-        .saturating_add(scaled.clamp(i64::from(i32::MIN), i64::from(i32::MAX)) as i32)
-        .clamp(i32::from(i16::MIN), i32::from(i16::MAX)) as i16
-}
-
 fn choose_rate(rates_mask: u64) -> Option<(u8, u32)> {
     let candidates: &[(u8, u32)] = &[
         (RATE_ENUM_44100, 44_100),
@@ -3,10 +3,12 @@ use crate::audio;
 use crate::doom_bridge;
 use crate::gfx;
 use crate::serial;
+use crate::sync::SpinLock;
 use crate::time;
 use alloc::string::String;
 use core::cell::UnsafeCell;
 use core::fmt::Write;
+use x86_64::instructions::interrupts;
 
 const DOOM_APP: &str = match option_env!("ARROST_DOOM_APP") {
     Some(value) => value,
@@ -107,10 +109,25 @@ const DOOM_GENERIC_BRIDGE_MODE: &str = if cfg!(arrost_doomgeneric_bridge) {
 
 struct DoomCell(UnsafeCell<DoomState>);
 
-// SAFETY: current kernel milestones run this state only from the main loop thread.
+// SAFETY: Doom state is only touched with `DOOM_LOCK` held.
 unsafe impl Sync for DoomCell {}
 
 static DOOM_STATE: DoomCell = DoomCell(UnsafeCell::new(DoomState::new()));
+/// Held for each tick and command, and so around every call into the C engine. Lock order:
+/// Doom, then graphics, then Doom input.
+static DOOM_LOCK: SpinLock = SpinLock::new();
+
+struct DoomInputCell(UnsafeCell<DoomInput>);
+
+// SAFETY: Doom input state is only touched with `INPUT_LOCK` held.
+unsafe impl Sync for DoomInputCell {}
+
+static DOOM_INPUT: DoomInputCell = DoomInputCell(UnsafeCell::new(DoomInput::new()));
+/// Held only while one input event is forwarded or the tick samples input, never across a
+/// tick, so the shell and the compositor never wait out a Doom frame. It is held with
+/// interrupts off: locks have no priority inheritance, and a holder that cannot be
+/// preempted keeps the high-priority shell thread from waiting behind a descheduled one.
+static INPUT_LOCK: SpinLock = SpinLock::new();
 
 fn doomgeneric_ready() -> bool {
     DOOM_GENERIC_READY == "true"
@@ -181,16 +198,13 @@ struct DoomState {
     ui_remainder: u64,
     frames: u64,
     audio_mixes: u64,
-    keyboard_events: u64,
     shell_commands: u64,
     ui_updates: u64,
-    control_inputs: u64,
     collisions: u64,
     player_x: i16,
     player_y: i16,
     velocity_x: i16,
     velocity_y: i16,
-    last_key: u8,
     dg_frames: u64,
     dg_draw_calls: u64,
     dg_nonzero_pixels: u32,
@@ -205,15 +219,6 @@ struct DoomState {
     dg_audio_dropped_samples: u64,
     dg_has_frame: bool,
     play_pace_clamps: u64,
-    capture_mode: bool,
-    mouse_events: u64,
-    mouse_left_button: bool,
-    mouse_right_button: bool,
-    mouse_motion_x_acc: i16,
-    mouse_motion_y_acc: i16,
-    mouse_turn_threshold: i16,
-    mouse_move_threshold: i16,
-    mouse_y_enabled: bool,
     viewport_rgb: [u32; VIEWPORT_PIXELS],
     fallback_indexed: [u8; VIEWPORT_PIXELS],
 }
@@ -234,16 +239,13 @@ impl DoomState {
             ui_remainder: 0,
             frames: 0,
             audio_mixes: 0,
-            keyboard_events: 0,
             shell_commands: 0,
             ui_updates: 0,
-            control_inputs: 0,
             collisions: 0,
             player_x: START_X,
             player_y: START_Y,
             velocity_x: 1,
             velocity_y: 0,
-            last_key: 0,
             dg_frames: 0,
             dg_draw_calls: 0,
             dg_nonzero_pixels: 0,
@@ -258,15 +260,6 @@ impl DoomState {
             dg_audio_dropped_samples: 0,
             dg_has_frame: false,
             play_pace_clamps: 0,
-            capture_mode: false,
-            mouse_events: 0,
-            mouse_left_button: false,
-            mouse_right_button: false,
-            mouse_motion_x_acc: 0,
-            mouse_motion_y_acc: 0,
-            mouse_turn_threshold: DEFAULT_MOUSE_TURN_THRESHOLD,
-            mouse_move_threshold: DEFAULT_MOUSE_MOVE_THRESHOLD,
-            mouse_y_enabled: false,
             viewport_rgb: [0; VIEWPORT_PIXELS],
             fallback_indexed: [0; VIEWPORT_PIXELS],
         }
@@ -285,14 +278,11 @@ impl DoomState {
         self.ui_remainder = 0;
         self.frames = 0;
         self.audio_mixes = 0;
-        self.keyboard_events = 0;
-        self.control_inputs = 0;
         self.collisions = 0;
         self.player_x = START_X;
         self.player_y = START_Y;
         self.velocity_x = 1;
         self.velocity_y = 0;
-        self.last_key = 0;
         self.dg_frames = 0;
         self.dg_draw_calls = 0;
         self.dg_nonzero_pixels = 0;
@@ -307,17 +297,17 @@ impl DoomState {
         self.dg_audio_dropped_samples = 0;
         self.dg_has_frame = false;
         self.play_pace_clamps = 0;
-        self.capture_mode = false;
-        self.mouse_events = 0;
-        self.mouse_left_button = false;
-        self.mouse_right_button = false;
-        self.mouse_motion_x_acc = 0;
-        self.mouse_motion_y_acc = 0;
         self.viewport_rgb = [0; VIEWPORT_PIXELS];
         self.fallback_indexed = [0; VIEWPORT_PIXELS];
+        with_input_mut(DoomInput::reset_runtime);
         doom_bridge::reset();
     }
 
+    /// Copies `running` and `play_mode` to the input state; call after changing either.
+    fn publish_mode(&self) {
+        with_input_mut(|input| input.set_mode(self.running, self.play_mode));
+    }
+
     fn poll(&mut self, now_ticks: u64) {
         if !self.running {
             self.last_poll_tick = now_ticks;
@@ -397,6 +387,10 @@ impl DoomState {
             .saturating_add(audio_acc / AUDIO_STEP_TICKS);
         self.audio_remainder = audio_acc % AUDIO_STEP_TICKS;
 
+        if let Some((velocity_x, velocity_y)) = with_input_mut(|input| input.velocity.take()) {
+            self.velocity_x = velocity_x;
+            self.velocity_y = velocity_y;
+        }
         let mut physics_acc = self.physics_remainder.saturating_add(delta);
         while physics_acc >= PHYSICS_STEP_TICKS {
             self.step_physics();
@@ -457,165 +451,6 @@ impl DoomState {
         Self::enemy_position_for(self.frames, self.audio_mixes)
     }
 
-    fn register_input(&mut self, byte: u8) -> bool {
-        self.keyboard_events = self.keyboard_events.saturating_add(1);
-        self.last_key = byte;
-
-        let recognized = if self.play_mode {
-            self.enqueue_bridge_key(byte, true)
-        } else {
-            self.apply_input(byte)
-        };
-        if recognized {
-            self.control_inputs = self.control_inputs.saturating_add(1);
-        }
-        recognized
-    }
-
-    fn enqueue_bridge_key(&mut self, byte: u8, pressed: bool) -> bool {
-        let queued = if pressed {
-            doom_bridge::enqueue_key_press(byte)
-        } else {
-            doom_bridge::enqueue_key_release(byte)
-        };
-        if queued {
-            self.control_inputs = self.control_inputs.saturating_add(1);
-            self.last_key = byte;
-        }
-        queued
-    }
-
-    fn release_capture_buttons(&mut self) {
-        if self.mouse_left_button {
-            let _ = self.enqueue_bridge_key(b' ', false);
-            self.mouse_left_button = false;
-        }
-        if self.mouse_right_button {
-            let _ = self.enqueue_bridge_key(b'e', false);
-            self.mouse_right_button = false;
-        }
-        self.mouse_motion_x_acc = 0;
-        self.mouse_motion_y_acc = 0;
-    }
-
-    fn set_capture_mode(&mut self, enabled: bool) -> bool {
-        if enabled {
-            if !self.running || !self.play_mode {
-                return false;
-            }
-            self.capture_mode = true;
-            return true;
-        }
-
-        self.capture_mode = false;
-        self.release_capture_buttons();
-        true
-    }
-
-    fn inject_mouse_event(
-        &mut self,
-        dx: i16,
-        dy: i16,
-        left_button: bool,
-        right_button: bool,
-        _middle_button: bool,
-    ) -> bool {
-        if !self.running || !self.play_mode || !self.capture_mode {
-            return false;
-        }
-
-        self.mouse_events = self.mouse_events.saturating_add(1);
-
-        if left_button != self.mouse_left_button {
-            let _ = self.enqueue_bridge_key(b' ', left_button);
-            self.mouse_left_button = left_button;
-        }
-        if right_button != self.mouse_right_button {
-            let _ = self.enqueue_bridge_key(b'e', right_button);
-            self.mouse_right_button = right_button;
-        }
-
-        self.mouse_motion_x_acc = self.mouse_motion_x_acc.saturating_add(dx);
-        while self.mouse_motion_x_acc >= self.mouse_turn_threshold {
-            let _ = self.enqueue_bridge_key(b'd', true);
-            let _ = self.enqueue_bridge_key(b'd', false);
-            self.mouse_motion_x_acc -= self.mouse_turn_threshold;
-        }
-        while self.mouse_motion_x_acc <= -self.mouse_turn_threshold {
-            let _ = self.enqueue_bridge_key(b'a', true);
-            let _ = self.enqueue_bridge_key(b'a', false);
-            self.mouse_motion_x_acc += self.mouse_turn_threshold;
-        }
-
-        if self.mouse_y_enabled {
-            self.mouse_motion_y_acc = self.mouse_motion_y_acc.saturating_add(dy);
-            while self.mouse_motion_y_acc >= self.mouse_move_threshold {
-                let _ = self.enqueue_bridge_key(b'w', true);
-                let _ = self.enqueue_bridge_key(b'w', false);
-                self.mouse_motion_y_acc -= self.mouse_move_threshold;
-            }
-            while self.mouse_motion_y_acc <= -self.mouse_move_threshold {
-                let _ = self.enqueue_bridge_key(b's', true);
-                let _ = self.enqueue_bridge_key(b's', false);
-                self.mouse_motion_y_acc += self.mouse_move_threshold;
-            }
-        }
-
-        true
-    }
-
-    fn set_mouse_turn_threshold(&mut self, threshold: i16) -> bool {
-        if !(1..=64).contains(&threshold) {
-            return false;
-        }
-        self.mouse_turn_threshold = threshold;
-        true
-    }
-
-    fn set_mouse_move_threshold(&mut self, threshold: i16) -> bool {
-        if !(1..=64).contains(&threshold) {
-            return false;
-        }
-        self.mouse_move_threshold = threshold;
-        true
-    }
-
-    fn set_mouse_y_enabled(&mut self, enabled: bool) {
-        self.mouse_y_enabled = enabled;
-        self.mouse_motion_y_acc = 0;
-    }
-
-    fn apply_input(&mut self, byte: u8) -> bool {
-        match byte {
-            b'w' | b'W' | b'k' | b'K' => {
-                self.velocity_x = 0;
-                self.velocity_y = -1;
-                true
-            }
-            b's' | b'S' | b'j' | b'J' => {
-                self.velocity_x = 0;
-                self.velocity_y = 1;
-                true
-            }
-            b'a' | b'A' | b'h' | b'H' => {
-                self.velocity_x = -1;
-                self.velocity_y = 0;
-                true
-            }
-            b'd' | b'D' | b'l' | b'L' => {
-                self.velocity_x = 1;
-                self.velocity_y = 0;
-                true
-            }
-            b'x' | b'X' | b' ' => {
-                self.velocity_x = 0;
-                self.velocity_y = 0;
-                true
-            }
-            _ => false,
-        }
-    }
-
     fn status_text(&self) -> String {
         let snapshot = self.status();
         let mut text = String::new();
@@ -686,18 +521,21 @@ impl DoomState {
         text
     }
 
-    fn refresh_viewport_rgb(&mut self) {
-        let has_bridge_frame = self.play_mode && doom_bridge::copy_pixels(&mut self.viewport_rgb);
-        if !has_bridge_frame {
-            self.render_viewport_pixels();
-            self.convert_fallback_view_to_rgb();
+    /// Engine frames reach the compositor through the bridge's frame slots, so this only
+    /// binds the view to them; only the fallback renderer goes through `viewport_rgb`.
+    fn refresh_viewport_frame(&mut self) -> gfx::DoomFrame<'_> {
+        if self.play_mode && doom_bridge::has_frame() {
+            return gfx::DoomFrame::Bridge;
         }
+        self.render_viewport_pixels();
+        self.convert_fallback_view_to_rgb();
+        gfx::DoomFrame::Pixels(&self.viewport_rgb)
     }
 
     fn render_viewport_locked(&mut self) {
         self.ui_updates = self.ui_updates.saturating_add(1);
-        self.refresh_viewport_rgb();
-        gfx::set_file_manager_doom_view(VIEWPORT_W, VIEWPORT_H, &self.viewport_rgb);
+        let frame = self.refresh_viewport_frame();
+        gfx::set_file_manager_doom_view(VIEWPORT_W, VIEWPORT_H, frame);
     }
 
     fn render_status_text_locked(&mut self) {
@@ -709,8 +547,8 @@ impl DoomState {
     fn render_ui_status_locked(&mut self) {
         self.ui_updates = self.ui_updates.saturating_add(1);
         let text = self.status_text();
-        self.refresh_viewport_rgb();
-        gfx::set_file_manager_doom_overlay(&text, VIEWPORT_W, VIEWPORT_H, &self.viewport_rgb);
+        let frame = self.refresh_viewport_frame();
+        gfx::set_file_manager_doom_overlay(&text, VIEWPORT_W, VIEWPORT_H, frame);
     }
 
     fn render_viewport_pixels(&mut self) {
@@ -905,7 +743,7 @@ impl DoomState {
     }
 
     fn status(&self) -> DoomStatus {
-        DoomStatus {
+        with_input_mut(|input| DoomStatus {
             app: DOOM_APP,
             engine: if self.play_mode {
                 "doomgeneric-loop"
@@ -920,16 +758,16 @@ impl DoomState {
             runtime_ticks: self.runtime_ticks,
             frames: self.frames,
             audio_mixes: self.audio_mixes,
-            keyboard_events: self.keyboard_events,
+            keyboard_events: input.keyboard_events,
             shell_commands: self.shell_commands,
             ui_updates: self.ui_updates,
-            control_inputs: self.control_inputs,
+            control_inputs: input.control_inputs,
             collisions: self.collisions,
             player_x: self.player_x,
             player_y: self.player_y,
             velocity_x: self.velocity_x,
             velocity_y: self.velocity_y,
-            last_key: self.last_key,
+            last_key: input.last_key,
             dg_bridge: DOOM_GENERIC_BRIDGE_MODE,
             dg_frames: self.dg_frames,
             dg_draw_calls: self.dg_draw_calls,
@@ -945,47 +783,256 @@ impl DoomState {
             dg_audio_dropped_samples: self.dg_audio_dropped_samples,
             dg_has_frame: self.dg_has_frame,
             play_pace_clamps: self.play_pace_clamps,
-            capture_mode: self.capture_mode,
-            mouse_events: self.mouse_events,
-            mouse_turn_threshold: self.mouse_turn_threshold,
-            mouse_move_threshold: self.mouse_move_threshold,
-            mouse_y_enabled: self.mouse_y_enabled,
+            capture_mode: input.capture_mode,
+            mouse_events: input.mouse_events,
+            mouse_turn_threshold: input.mouse_turn_threshold,
+            mouse_move_threshold: input.mouse_move_threshold,
+            mouse_y_enabled: input.mouse_y_enabled,
+        })
+    }
+}
+
+/// Input forwarding state, kept apart from `DoomState` so the shell and the compositor can
+/// hand keys and mouse motion to the engine without waiting for a tick to finish.
+struct DoomInput {
+    /// Copies of the runtime's flags, published under the Doom lock whenever they change.
+    running: bool,
+    play_mode: bool,
+    capture_mode: bool,
+    keyboard_events: u64,
+    control_inputs: u64,
+    last_key: u8,
+    mouse_events: u64,
+    mouse_left_button: bool,
+    mouse_right_button: bool,
+    mouse_motion_x_acc: i16,
+    mouse_motion_y_acc: i16,
+    mouse_turn_threshold: i16,
+    mouse_move_threshold: i16,
+    mouse_y_enabled: bool,
+    /// Fallback-runtime velocity from the newest control key, applied by the next tick.
+    velocity: Option<(i16, i16)>,
+}
+
+impl DoomInput {
+    const fn new() -> Self {
+        Self {
+            running: false,
+            play_mode: false,
+            capture_mode: false,
+            keyboard_events: 0,
+            control_inputs: 0,
+            last_key: 0,
+            mouse_events: 0,
+            mouse_left_button: false,
+            mouse_right_button: false,
+            mouse_motion_x_acc: 0,
+            mouse_motion_y_acc: 0,
+            mouse_turn_threshold: DEFAULT_MOUSE_TURN_THRESHOLD,
+            mouse_move_threshold: DEFAULT_MOUSE_MOVE_THRESHOLD,
+            mouse_y_enabled: false,
+            velocity: None,
         }
     }
+
+    fn reset_runtime(&mut self) {
+        self.capture_mode = false;
+        self.keyboard_events = 0;
+        self.control_inputs = 0;
+        self.last_key = 0;
+        self.mouse_events = 0;
+        self.mouse_left_button = false;
+        self.mouse_right_button = false;
+        self.mouse_motion_x_acc = 0;
+        self.mouse_motion_y_acc = 0;
+        self.velocity = None;
+    }
+
+    fn set_mode(&mut self, running: bool, play_mode: bool) {
+        self.running = running;
+        self.play_mode = play_mode;
+    }
+
+    fn register_input(&mut self, byte: u8) -> bool {
+        self.keyboard_events = self.keyboard_events.saturating_add(1);
+        self.last_key = byte;
+
+        let recognized = if self.play_mode {
+            self.enqueue_bridge_key(byte, true)
+        } else if let Some(velocity) = fallback_velocity(byte) {
+            self.velocity = Some(velocity);
+            true
+        } else {
+            false
+        };
+        if recognized {
+            self.control_inputs = self.control_inputs.saturating_add(1);
+        }
+        recognized
+    }
+
+    fn enqueue_bridge_key(&mut self, byte: u8, pressed: bool) -> bool {
+        let queued = if pressed {
+            doom_bridge::enqueue_key_press(byte)
+        } else {
+            doom_bridge::enqueue_key_release(byte)
+        };
+        if queued {
+            self.control_inputs = self.control_inputs.saturating_add(1);
+            self.last_key = byte;
+        }
+        queued
+    }
+
+    fn release_capture_buttons(&mut self) {
+        if self.mouse_left_button {
+            let _ = self.enqueue_bridge_key(b' ', false);
+            self.mouse_left_button = false;
+        }
+        if self.mouse_right_button {
+            let _ = self.enqueue_bridge_key(b'e', false);
+            self.mouse_right_button = false;
+        }
+        self.mouse_motion_x_acc = 0;
+        self.mouse_motion_y_acc = 0;
+    }
+
+    fn set_capture_mode(&mut self, enabled: bool) -> bool {
+        if enabled {
+            if !self.running || !self.play_mode {
+                return false;
+            }
+            self.capture_mode = true;
+            return true;
+        }
+
+        self.capture_mode = false;
+        self.release_capture_buttons();
+        true
+    }
+
+    fn inject_mouse_event(
+        &mut self,
+        dx: i16,
+        dy: i16,
+        left_button: bool,
+        right_button: bool,
+        _middle_button: bool,
+    ) -> bool {
+        if !self.running || !self.play_mode || !self.capture_mode {
+            return false;
+        }
+
+        self.mouse_events = self.mouse_events.saturating_add(1);
+
+        if left_button != self.mouse_left_button {
+            let _ = self.enqueue_bridge_key(b' ', left_button);
+            self.mouse_left_button = left_button;
+        }
+        if right_button != self.mouse_right_button {
+            let _ = self.enqueue_bridge_key(b'e', right_button);
+            self.mouse_right_button = right_button;
+        }
+
+        self.mouse_motion_x_acc = self.mouse_motion_x_acc.saturating_add(dx);
+        while self.mouse_motion_x_acc >= self.mouse_turn_threshold {
+            let _ = self.enqueue_bridge_key(b'd', true);
+            let _ = self.enqueue_bridge_key(b'd', false);
+            self.mouse_motion_x_acc -= self.mouse_turn_threshold;
+        }
+        while self.mouse_motion_x_acc <= -self.mouse_turn_threshold {
+            let _ = self.enqueue_bridge_key(b'a', true);
+            let _ = self.enqueue_bridge_key(b'a', false);
+            self.mouse_motion_x_acc += self.mouse_turn_threshold;
+        }
+
+        if self.mouse_y_enabled {
+            self.mouse_motion_y_acc = self.mouse_motion_y_acc.saturating_add(dy);
+            while self.mouse_motion_y_acc >= self.mouse_move_threshold {
+                let _ = self.enqueue_bridge_key(b'w', true);
+                let _ = self.enqueue_bridge_key(b'w', false);
+                self.mouse_motion_y_acc -= self.mouse_move_threshold;
+            }
+            while self.mouse_motion_y_acc <= -self.mouse_move_threshold {
+                let _ = self.enqueue_bridge_key(b's', true);
+                let _ = self.enqueue_bridge_key(b's', false);
+                self.mouse_motion_y_acc += self.mouse_move_threshold;
+            }
+        }
+
+        true
+    }
+
+    fn set_mouse_turn_threshold(&mut self, threshold: i16) -> bool {
+        if !(1..=64).contains(&threshold) {
+            return false;
+        }
+        self.mouse_turn_threshold = threshold;
+        true
+    }
+
+    fn set_mouse_move_threshold(&mut self, threshold: i16) -> bool {
+        if !(1..=64).contains(&threshold) {
+            return false;
+        }
+        self.mouse_move_threshold = threshold;
+        true
+    }
+
+    fn set_mouse_y_enabled(&mut self, enabled: bool) {
+        self.mouse_y_enabled = enabled;
+        self.mouse_motion_y_acc = 0;
+    }
 }
 
-pub fn poll(now_ticks: u64) {
-    with_state_mut(|state| state.poll(now_ticks));
+/// Velocity a fallback-runtime control key selects.
+fn fallback_velocity(byte: u8) -> Option<(i16, i16)> {
+    match byte {
+        b'w' | b'W' | b'k' | b'K' => Some((0, -1)),
+        b's' | b'S' | b'j' | b'J' => Some((0, 1)),
+        b'a' | b'A' | b'h' | b'H' => Some((-1, 0)),
+        b'd' | b'D' | b'l' | b'L' => Some((1, 0)),
+        b'x' | b'X' | b' ' => Some((0, 0)),
+        _ => None,
+    }
 }
 
-pub fn inject_key(byte: u8) -> bool {
+/// Advances the engine to `now_ticks`. Returns whether Doom is running and wants the next tick.
+pub fn poll(now_ticks: u64) -> bool {
     with_state_mut(|state| {
-        if !state.running {
+        state.poll(now_ticks);
+        state.running
+    })
+}
+
+pub fn inject_key(byte: u8) -> bool {
+    with_input_mut(|input| {
+        if !input.running {
             return false;
         }
-        state.register_input(byte)
+        input.register_input(byte)
     })
 }
 
 pub fn inject_key_release(byte: u8) -> bool {
-    with_state_mut(|state| {
-        if !state.running {
+    with_input_mut(|input| {
+        if !input.running {
             return false;
         }
-        if !state.play_mode {
+        if !input.play_mode {
             return false;
         }
-        state.keyboard_events = state.keyboard_events.saturating_add(1);
-        state.enqueue_bridge_key(byte, false)
+        input.keyboard_events = input.keyboard_events.saturating_add(1);
+        input.enqueue_bridge_key(byte, false)
     })
 }
 
 pub fn set_capture(enabled: bool) -> bool {
-    with_state_mut(|state| state.set_capture_mode(enabled))
+    with_input_mut(|input| input.set_capture_mode(enabled))
 }
 
 pub fn capture_enabled() -> bool {
-    with_state_mut(|state| state.capture_mode)
+    with_input_mut(|input| input.capture_mode)
 }
 
 pub fn inject_mouse(
@@ -995,21 +1042,21 @@ pub fn inject_mouse(
     right_button: bool,
     middle_button: bool,
 ) -> bool {
-    with_state_mut(|state| {
-        state.inject_mouse_event(dx, dy, left_button, right_button, middle_button)
+    with_input_mut(|input| {
+        input.inject_mouse_event(dx, dy, left_button, right_button, middle_button)
     })
 }
 
 pub fn set_mouse_turn_threshold(threshold: i16) -> bool {
-    with_state_mut(|state| state.set_mouse_turn_threshold(threshold))
+    with_input_mut(|input| input.set_mouse_turn_threshold(threshold))
 }
 
 pub fn set_mouse_move_threshold(threshold: i16) -> bool {
-    with_state_mut(|state| state.set_mouse_move_threshold(threshold))
+    with_input_mut(|input| input.set_mouse_move_threshold(threshold))
 }
 
 pub fn set_mouse_y_enabled(enabled: bool) {
-    with_state_mut(|state| state.set_mouse_y_enabled(enabled));
+    with_input_mut(|input| input.set_mouse_y_enabled(enabled));
 }
 
 pub fn start(now_ticks: u64) -> bool {
@@ -1020,6 +1067,7 @@ pub fn start(now_ticks: u64) -> bool {
         }
         state.running = true;
         state.reset_runtime(now_ticks);
+        state.publish_mode();
         audio::reset_runtime_metrics();
         true
     })
@@ -1035,14 +1083,16 @@ pub fn play(now_ticks: u64) -> PlayStart {
         state.running = true;
         state.reset_runtime(now_ticks);
         audio::reset_runtime_metrics();
-        if doomgeneric_ready() {
+        let started = if doomgeneric_ready() {
             state.play_mode = true;
             doom_bridge::create_engine();
             state.sync_bridge_stats();
             PlayStart::DoomGeneric
         } else {
             PlayStart::Fallback
-        }
+        };
+        state.publish_mode();
+        started
     })
 }
 
@@ -1055,8 +1105,8 @@ pub fn stop(now_ticks: u64) -> bool {
         state.poll(now_ticks);
         state.running = false;
         state.play_mode = false;
-        state.capture_mode = false;
-        state.release_capture_buttons();
+        state.publish_mode();
+        with_input_mut(|input| input.set_capture_mode(false));
         doom_bridge::reset();
         true
     });
@@ -1070,11 +1120,12 @@ pub fn reset(now_ticks: u64) {
     with_state_mut(|state| {
         state.shell_commands = state.shell_commands.saturating_add(1);
         let keep_play_mode = state.play_mode;
-        let keep_capture_mode = state.capture_mode;
+        let keep_capture_mode = with_input_mut(|input| input.capture_mode);
         state.reset_runtime(now_ticks);
         audio::reset_runtime_metrics();
         state.play_mode = keep_play_mode;
-        state.capture_mode = keep_capture_mode && keep_play_mode;
+        state.publish_mode();
+        with_input_mut(|input| input.capture_mode = keep_capture_mode && keep_play_mode);
         if keep_play_mode {
             doom_bridge::create_engine();
             state.sync_bridge_stats();
@@ -1156,10 +1207,34 @@ pub fn log_status() {
         pcm.pcm_last_ctrl_status,
         status.last_key
     ));
+    let frames = doom_bridge::frame_stats();
+    serial::write_fmt(format_args!(
+        "doom: frame_slots published={} shown={} skipped={}\n",
+        frames.published, frames.shown, frames.skipped
+    ));
+    let input = doom_bridge::input_latency();
+    serial::write_fmt(format_args!(
+        "doom: input_to_frame samples={} last_cycles={} max_cycles={}\n",
+        input.samples, input.last_cycles, input.max_cycles
+    ));
+    let heap = with_state_mut(|_| doom_bridge::heap_stats());
+    serial::write_fmt(format_args!(
+        "doom: heap capacity={} used={} peak={} free={} largest_free={} free_blocks={} frag={}% allocs={} frees={} failed={}\n",
+        heap.capacity,
+        heap.used,
+        heap.peak,
+        heap.free_bytes,
+        heap.largest_free,
+        heap.free_blocks,
+        heap.fragmentation_pct(),
+        heap.allocs,
+        heap.frees,
+        heap.failed
+    ));
 }
 
 pub fn log_doomgeneric_info() {
-    let bridge = doom_bridge::stats();
+    let bridge = with_state_mut(|_| doom_bridge::stats());
     serial::write_fmt(format_args!(
         "doomgeneric: ready={} root={} core={} core_obj={} ({} bytes) core_ready={} port={} ({} bytes) port_ready={} wad={} wad_present={} bridge={} dg_frames={} dg_draw={} dg_key={} dg_poll={} dg_drop={} dg_sleep={}({}ms) dg_audio={} dg_audio_samples={} dg_audio_q={} dg_audio_drop={} dg_title_len={} dg_frame={}\n",
         DOOM_GENERIC_READY,
@@ -1230,6 +1305,15 @@ pub fn render_ui_status() {
 }
 
 fn with_state_mut<R>(f: impl FnOnce(&mut DoomState) -> R) -> R {
-    // SAFETY: ArrOSt scheduler loop is single-threaded for this milestone.
+    let _guard = DOOM_LOCK.lock();
+    // SAFETY: holding `DOOM_LOCK` makes this the only reference to the Doom state.
     unsafe { f(&mut *DOOM_STATE.0.get()) }
 }
+
+fn with_input_mut<R>(f: impl FnOnce(&mut DoomInput) -> R) -> R {
+    interrupts::without_interrupts(|| {
+        let _guard = INPUT_LOCK.lock();
+        // SAFETY: holding `INPUT_LOCK` makes this the only reference to the input state.
+        unsafe { f(&mut *DOOM_INPUT.0.get()) }
+    })
+}
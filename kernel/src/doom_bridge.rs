@@ -1,10 +1,14 @@
 // kernel/src/doom_bridge.rs: M10.6 DoomGeneric C bridge callbacks and shared frame/input state.
 use crate::audio;
 use crate::fs;
+use crate::gfx::{DoomViewFilter, Scaler};
 use crate::serial;
+use crate::sync::spsc::SpscRing;
 use crate::time;
+use crate::trace::{self, Span};
 use core::cell::UnsafeCell;
 use core::ffi::c_char;
+use core::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
 
 mod wad_embed {
     include!(concat!(env!("OUT_DIR"), "/doom_wad_embed.rs"));
@@ -14,11 +18,16 @@ pub const VIEWPORT_W: usize = 320;
 pub const VIEWPORT_H: usize = 200;
 pub const VIEWPORT_PIXELS: usize = VIEWPORT_W * VIEWPORT_H;
 
+const FRAME_SLOTS: usize = 3;
+/// Set in `FrameSlots::ready` while that slot holds a frame the compositor has not taken.
+const SLOT_FRESH: usize = 1 << 2;
+const SLOT_INDEX: usize = SLOT_FRESH - 1;
+/// Input stamp of a frame that is the first to reflect no key.
+const NO_INPUT: u64 = u64::MAX;
 const KEY_QUEUE_CAP: usize = 256;
 const TITLE_CAP: usize = 64;
 const MAX_SOURCE_PIXELS: usize = 1024 * 768;
 const CFG_PATH: &str = "/arr.cfg";
-const CFG_PERSIST_MAX: usize = fs::MAX_FILE_BYTES;
 const AUDIO_QUEUE_CAP_SAMPLES: u32 = 32_768;
 const NOISY_RATE_CONTROL_LOG: &[u8] = b"Resetting rate control";
 const KEY_LEFTARROW: u8 = 0xac;
@@ -34,10 +43,18 @@ const KEY_BACKSPACE: u8 = 0x7f;
 
 struct BridgeCell(UnsafeCell<BridgeState>);
 
-// SAFETY: bridge state is mutated from the single kernel thread used in current milestones.
+// SAFETY: bridge state is only touched from `doom` with its state lock held; the engine
+// callbacks run inside the ticks it drives under that lock.
 unsafe impl Sync for BridgeCell {}
 
 static BRIDGE_STATE: BridgeCell = BridgeCell(UnsafeCell::new(BridgeState::new()));
+static FRAMES: FrameSlots = FrameSlots::new();
+/// Filled by `doom`'s input path, whose lock serializes the producers; drained by the
+/// engine's `arr_dg_pop_key` under the Doom state lock.
+static KEY_QUEUE: SpscRing<QueuedKey, KEY_QUEUE_CAP> = SpscRing::new();
+static KEY_EVENTS: AtomicU64 = AtomicU64::new(0);
+/// `KEY_QUEUE.dropped()` at the last reset, so stats count drops per engine run.
+static KEY_DROPPED_BASE: AtomicU64 = AtomicU64::new(0);
 
 #[derive(Clone, Copy)]
 pub struct BridgeStats {
@@ -57,15 +74,218 @@ pub struct BridgeStats {
     pub has_frame: bool,
 }
 
+/// TSC cycles from a key entering the bridge queue to the first frame shown after the
+/// engine read it.
+#[derive(Clone, Copy)]
+pub struct InputLatency {
+    pub samples: u64,
+    pub last_cycles: u64,
+    pub max_cycles: u64,
+}
+
+/// A queued key with the TSC at which it was queued.
+#[derive(Clone, Copy)]
+struct QueuedKey {
+    key: u8,
+    pressed: bool,
+    tsc: u64,
+}
+
+#[derive(Clone, Copy)]
+pub struct FrameStats {
+    pub published: u64,
+    pub shown: u64,
+    pub skipped: u64,
+}
+
+/// Doom libc heap counters; layout mirrors `struct arr_heap_stats` in freestanding_libc.c.
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct HeapStats {
+    pub capacity: u64,
+    pub used: u64,
+    pub peak: u64,
+    pub free_bytes: u64,
+    pub largest_free: u64,
+    pub free_blocks: u64,
+    pub allocs: u64,
+    pub frees: u64,
+    pub failed: u64,
+}
+
+impl HeapStats {
+    /// Share of free memory not reachable by a single allocation (0 = one contiguous block).
+    pub fn fragmentation_pct(&self) -> u64 {
+        if self.free_bytes == 0 {
+            return 0;
+        }
+        100 - self.largest_free.saturating_mul(100) / self.free_bytes
+    }
+}
+
+/// Triple-buffered, lock-free handoff between the engine and the compositor. The engine
+/// (under the Doom lock) always fills `back` and publishes it by swapping it into `ready`;
+/// the compositor (under the graphics lock) swaps a fresh `ready` into `front`. The three
+/// indices stay a permutation, so each side only touches its own slot, no frame is copied,
+/// and a slow redraw only makes the engine overwrite `ready` instead of stalling it.
+struct FrameSlots {
+    pixels: [UnsafeCell<[u32; VIEWPORT_PIXELS]>; FRAME_SLOTS],
+    /// Queue time of the oldest key each slot's frame is the first to reflect.
+    input_tsc: [AtomicU64; FRAME_SLOTS],
+    /// Slot index, plus `SLOT_FRESH`; the only word both sides write.
+    ready: AtomicUsize,
+    /// Slot the engine draws into; engine side only.
+    back: AtomicUsize,
+    /// Slot on screen; compositor side only.
+    front: AtomicUsize,
+    /// `front` holds a frame at all.
+    shown: AtomicBool,
+    published: AtomicU64,
+    shown_frames: AtomicU64,
+    skipped: AtomicU64,
+    latency_samples: AtomicU64,
+    latency_last: AtomicU64,
+    latency_max: AtomicU64,
+}
+
+// SAFETY: the engine writes only the `back` slot's pixels and the compositor reads only the
+// `front` slot's. A slot changes hands only through the AcqRel operations on `ready`, which
+// order the pixel writes before the other side's reads, and each side is serialized by its
+// own lock.
+unsafe impl Sync for FrameSlots {}
+
+impl FrameSlots {
+    const fn new() -> Self {
+        Self {
+            pixels: [const { UnsafeCell::new([0; VIEWPORT_PIXELS]) }; FRAME_SLOTS],
+            input_tsc: [const { AtomicU64::new(NO_INPUT) }; FRAME_SLOTS],
+            ready: AtomicUsize::new(1),
+            back: AtomicUsize::new(2),
+            front: AtomicUsize::new(0),
+            shown: AtomicBool::new(false),
+            published: AtomicU64::new(0),
+            shown_frames: AtomicU64::new(0),
+            skipped: AtomicU64::new(0),
+            latency_samples: AtomicU64::new(0),
+            latency_last: AtomicU64::new(0),
+            latency_max: AtomicU64::new(0),
+        }
+    }
+
+    /// Engine side: zeroes the counters for a new run. A compositor update racing the reset
+    /// may survive it, which only skews the next report.
+    fn reset_stats(&self) {
+        for counter in [
+            &self.published,
+            &self.shown_frames,
+            &self.skipped,
+            &self.latency_samples,
+            &self.latency_last,
+            &self.latency_max,
+        ] {
+            counter.store(0, Ordering::Relaxed);
+        }
+    }
+
+    /// Engine side: runs `f` over the back slot.
+    fn with_back<R>(&self, f: impl FnOnce(&mut [u32; VIEWPORT_PIXELS]) -> R) -> R {
+        let back = self.back.load(Ordering::Relaxed);
+        // SAFETY: the back slot is neither `ready` nor `front`, so the compositor never reads
+        // it, and the engine side is serialized by the Doom lock.
+        unsafe { f(&mut *self.pixels[back].get()) }
+    }
+
+    /// Engine side: publishes the back slot, stamped with the queue time of the oldest key
+    /// it is the first to reflect. A frame replacing one the compositor never took inherits
+    /// that frame's stamp.
+    fn publish(&self, input_tsc: Option<u64>) {
+        let back = self.back.load(Ordering::Relaxed);
+        let mut current = self.ready.load(Ordering::Acquire);
+        loop {
+            let mut stamp = input_tsc.unwrap_or(NO_INPUT);
+            if current & SLOT_FRESH != 0 {
+                stamp = stamp.min(self.input_tsc[current & SLOT_INDEX].load(Ordering::Relaxed));
+            }
+            self.input_tsc[back].store(stamp, Ordering::Relaxed);
+            match self.ready.compare_exchange_weak(
+                current,
+                back | SLOT_FRESH,
+                Ordering::AcqRel,
+                Ordering::Acquire,
+            ) {
+                Ok(_) => break,
+                Err(actual) => current = actual,
+            }
+        }
+        self.back.store(current & SLOT_INDEX, Ordering::Relaxed);
+        if current & SLOT_FRESH != 0 {
+            self.skipped.fetch_add(1, Ordering::Relaxed);
+        }
+        self.published.fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Compositor side: moves a fresh `ready` slot into `front` and records the latency of
+    /// the input it reflects. Returns whether the front slot changed.
+    fn acquire(&self) -> bool {
+        if !self.pending() {
+            return false;
+        }
+        let previous = self
+            .ready
+            .swap(self.front.load(Ordering::Relaxed), Ordering::AcqRel);
+        let front = previous & SLOT_INDEX;
+        self.front.store(front, Ordering::Relaxed);
+        self.shown.store(true, Ordering::Relaxed);
+        self.shown_frames.fetch_add(1, Ordering::Relaxed);
+        let stamp = self.input_tsc[front].load(Ordering::Relaxed);
+        if stamp != NO_INPUT {
+            let cycles = time::read_tsc().saturating_sub(stamp);
+            self.latency_samples.fetch_add(1, Ordering::Relaxed);
+            self.latency_last.store(cycles, Ordering::Relaxed);
+            self.latency_max.fetch_max(cycles, Ordering::Relaxed);
+        }
+        true
+    }
+
+    /// Compositor side: runs `f` over the front slot, if it holds a frame.
+    fn with_front<R>(&self, f: impl FnOnce(&[u32; VIEWPORT_PIXELS]) -> R) -> Option<R> {
+        if !self.shown.load(Ordering::Relaxed) {
+            return None;
+        }
+        let front = self.front.load(Ordering::Relaxed);
+        // SAFETY: the engine never writes the front slot, and only the compositor, serialized
+        // by the graphics lock, moves it.
+        Some(unsafe { f(&*self.pixels[front].get()) })
+    }
+
+    fn pending(&self) -> bool {
+        self.ready.load(Ordering::Acquire) & SLOT_FRESH != 0
+    }
+
+    fn stats(&self) -> FrameStats {
+        FrameStats {
+            published: self.published.load(Ordering::Relaxed),
+            shown: self.shown_frames.load(Ordering::Relaxed),
+            skipped: self.skipped.load(Ordering::Relaxed),
+        }
+    }
+
+    fn latency(&self) -> InputLatency {
+        InputLatency {
+            samples: self.latency_samples.load(Ordering::Relaxed),
+            last_cycles: self.latency_last.load(Ordering::Relaxed),
+            max_cycles: self.latency_max.load(Ordering::Relaxed),
+        }
+    }
+}
+
 struct BridgeState {
-    pixels: [u32; VIEWPORT_PIXELS],
+    /// Tables for engines whose resolution differs from the viewport.
+    scaler: Option<Scaler>,
     has_frame: bool,
-    key_queue: [u16; KEY_QUEUE_CAP],
-    key_head: usize,
-    key_tail: usize,
-    key_events: u64,
     key_polls: u64,
-    key_dropped: u64,
+    /// Queue time of the oldest key the engine has read but no published frame reflects.
+    pending_input_tsc: Option<u64>,
     draw_calls: u64,
     last_nonzero_pixels: u32,
     sleep_calls: u64,
@@ -82,14 +302,10 @@ struct BridgeState {
 impl BridgeState {
     const fn new() -> Self {
         Self {
-            pixels: [0; VIEWPORT_PIXELS],
+            scaler: None,
             has_frame: false,
-            key_queue: [0; KEY_QUEUE_CAP],
-            key_head: 0,
-            key_tail: 0,
-            key_events: 0,
             key_polls: 0,
-            key_dropped: 0,
+            pending_input_tsc: None,
             draw_calls: 0,
             last_nonzero_pixels: 0,
             sleep_calls: 0,
@@ -105,13 +321,13 @@ impl BridgeState {
     }
 
     fn reset(&mut self) {
-        self.pixels = [0; VIEWPORT_PIXELS];
+        FRAMES.reset_stats();
         self.has_frame = false;
-        self.key_head = 0;
-        self.key_tail = 0;
-        self.key_events = 0;
+        KEY_QUEUE.clear();
+        KEY_EVENTS.store(0, Ordering::Relaxed);
+        KEY_DROPPED_BASE.store(KEY_QUEUE.dropped(), Ordering::Relaxed);
         self.key_polls = 0;
-        self.key_dropped = 0;
+        self.pending_input_tsc = None;
         self.draw_calls = 0;
         self.last_nonzero_pixels = 0;
         self.sleep_calls = 0;
@@ -124,36 +340,16 @@ impl BridgeState {
         self.title_len = 0;
     }
 
-    fn queue_next(index: usize) -> usize {
-        (index + 1) % KEY_QUEUE_CAP
-    }
-
-    fn queue_push(&mut self, key: u8) -> bool {
-        self.queue_push_event(key, true)
-    }
-
-    fn queue_push_event(&mut self, key: u8, pressed: bool) -> bool {
-        let next = Self::queue_next(self.key_head);
-        if next == self.key_tail {
-            self.key_tail = Self::queue_next(self.key_tail);
-            self.key_dropped = self.key_dropped.saturating_add(1);
-        }
-        let encoded = u16::from(key) | (u16::from(u8::from(pressed)) << 8);
-        self.key_queue[self.key_head] = encoded;
-        self.key_head = next;
-        self.key_events = self.key_events.saturating_add(1);
-        true
+    fn queue_pop(&mut self) -> Option<(bool, u8)> {
+        let queued = KEY_QUEUE.pop()?;
+        self.pending_input_tsc.get_or_insert(queued.tsc);
+        Some((queued.pressed, queued.key))
     }
 
-    fn queue_pop(&mut self) -> Option<(bool, u8)> {
-        if self.key_head == self.key_tail {
-            return None;
-        }
-        let encoded = self.key_queue[self.key_tail];
-        self.key_tail = Self::queue_next(self.key_tail);
-        let key = (encoded & 0x00ff) as u8;
-        let pressed = ((encoded >> 8) & 1) != 0;
-        Some((pressed, key))
+    fn publish_frame(&mut self) {
+        FRAMES.publish(self.pending_input_tsc.take());
+        self.has_frame = true;
+        self.draw_calls = self.draw_calls.saturating_add(1);
     }
 
     fn stats(&self) -> BridgeStats {
@@ -161,9 +357,11 @@ impl BridgeState {
             frames: c_engine_frames(),
             draw_calls: self.draw_calls,
             nonzero_pixels: self.last_nonzero_pixels,
-            key_events: self.key_events,
+            key_events: KEY_EVENTS.load(Ordering::Relaxed),
             key_polls: self.key_polls,
-            key_dropped: self.key_dropped,
+            key_dropped: KEY_QUEUE
+                .dropped()
+                .saturating_sub(KEY_DROPPED_BASE.load(Ordering::Relaxed)),
             sleep_calls: self.sleep_calls,
             last_sleep_ms: self.last_sleep_ms,
             audio_mix_calls: self.audio_mix_calls,
@@ -204,41 +402,79 @@ fn map_input_key(byte: u8) -> Option<u8> {
 }
 
 fn current_tick_millis() -> u64 {
-    time::ticks().saturating_mul(10)
+    time::uptime_millis()
 }
 
 pub fn reset() {
     with_bridge_mut(BridgeState::reset);
 }
 
+/// Queues a key for the engine. Callers serialize producers with the Doom input lock.
 pub fn enqueue_key_press(byte: u8) -> bool {
-    let Some(mapped) = map_input_key(byte) else {
-        return false;
-    };
-    with_bridge_mut(|state| state.queue_push(mapped))
+    push_key(byte, true)
 }
 
+/// Like `enqueue_key_press`, for a key release.
 pub fn enqueue_key_release(byte: u8) -> bool {
-    let Some(mapped) = map_input_key(byte) else {
+    push_key(byte, false)
+}
+
+fn push_key(byte: u8, pressed: bool) -> bool {
+    let Some(key) = map_input_key(byte) else {
         return false;
     };
-    with_bridge_mut(|state| state.queue_push_event(mapped, false))
+    let queued = KEY_QUEUE.push(QueuedKey {
+        key,
+        pressed,
+        tsc: time::read_tsc(),
+    });
+    if queued {
+        KEY_EVENTS.fetch_add(1, Ordering::Relaxed);
+    }
+    queued
 }
 
-pub fn copy_pixels(target: &mut [u32; VIEWPORT_PIXELS]) -> bool {
-    with_bridge_mut(|state| {
-        if !state.has_frame {
-            return false;
-        }
-        target.copy_from_slice(&state.pixels);
-        true
-    })
+/// Whether the engine published a frame since the last reset.
+pub fn has_frame() -> bool {
+    with_bridge_mut(|state| state.has_frame)
+}
+
+/// Whether a published frame is waiting for the compositor. Lock-free.
+pub fn frame_pending() -> bool {
+    FRAMES.pending()
+}
+
+/// Compositor only, under the graphics lock: moves the newest published frame into the
+/// front slot. Returns whether it changed.
+pub fn acquire_frame() -> bool {
+    FRAMES.acquire()
+}
+
+/// Compositor only, under the graphics lock: borrows the front slot in place; it stays
+/// stable until the next `acquire_frame`.
+pub fn with_front_frame<R>(f: impl FnOnce(&[u32; VIEWPORT_PIXELS]) -> R) -> Option<R> {
+    FRAMES.with_front(f)
+}
+
+pub fn frame_stats() -> FrameStats {
+    FRAMES.stats()
+}
+
+pub fn input_latency() -> InputLatency {
+    FRAMES.latency()
 }
 
 pub fn stats() -> BridgeStats {
     with_bridge_mut(|state| state.stats())
 }
 
+pub fn heap_stats() -> HeapStats {
+    let mut stats = HeapStats::default();
+    // SAFETY: C side fills the caller-owned, layout-compatible struct and keeps no reference.
+    unsafe { arr_freestd_heap_stats(&mut stats) };
+    stats
+}
+
 pub fn consume_audio_samples(samples: u32) {
     if samples == 0 {
         return;
@@ -274,6 +510,7 @@ pub extern "C" fn arr_dg_init() {
 
 #[unsafe(no_mangle)]
 pub extern "C" fn arr_dg_draw_frame(frame: *const u32, width: u32, height: u32) {
+    let _span = trace::span(Span::DoomDrawFrame);
     if frame.is_null() || width == 0 || height == 0 {
         return;
     }
@@ -292,102 +529,53 @@ pub extern "C" fn arr_dg_draw_frame(frame: *const u32, width: u32, height: u32)
         let source = unsafe { core::slice::from_raw_parts(frame, source_len) };
         let mut nonzero_pixels = 0u32;
         if width == VIEWPORT_W && height == VIEWPORT_H {
-            for (index, pixel) in source.iter().take(VIEWPORT_PIXELS).enumerate() {
-                let rgb = *pixel & 0x00FF_FFFF;
-                if rgb != 0 {
-                    nonzero_pixels = nonzero_pixels.saturating_add(1);
+            FRAMES.with_back(|target| {
+                for (out, pixel) in target.iter_mut().zip(source) {
+                    let rgb = *pixel & 0x00FF_FFFF;
+                    if rgb != 0 {
+                        nonzero_pixels = nonzero_pixels.saturating_add(1);
+                    }
+                    *out = rgb;
                 }
-                state.pixels[index] = rgb;
-            }
-            state.has_frame = true;
-            state.draw_calls = state.draw_calls.saturating_add(1);
+            });
+            state.publish_frame();
             state.last_nonzero_pixels = nonzero_pixels;
             return;
         }
 
-        for y in 0..VIEWPORT_H {
-            let sy_fp = if VIEWPORT_H > 1 {
-                ((y as u64)
-                    .saturating_mul((height.saturating_sub(1)) as u64)
-                    .saturating_mul(1u64 << 16)
-                    / ((VIEWPORT_H - 1) as u64)) as u32
-            } else {
-                0
-            };
-            let y0 = ((sy_fp >> 16) as usize).min(height.saturating_sub(1));
-            let y1 = (y0 + 1).min(height.saturating_sub(1));
-            let wy = sy_fp & 0xFFFF;
-            for x in 0..VIEWPORT_W {
-                let sx_fp = if VIEWPORT_W > 1 {
-                    ((x as u64)
-                        .saturating_mul((width.saturating_sub(1)) as u64)
-                        .saturating_mul(1u64 << 16)
-                        / ((VIEWPORT_W - 1) as u64)) as u32
-                } else {
-                    0
-                };
-                let x0 = ((sx_fp >> 16) as usize).min(width.saturating_sub(1));
-                let x1 = (x0 + 1).min(width.saturating_sub(1));
-                let wx = sx_fp & 0xFFFF;
-
-                let c00 = source[y0.saturating_mul(width).saturating_add(x0)] & 0x00FF_FFFF;
-                let c10 = source[y0.saturating_mul(width).saturating_add(x1)] & 0x00FF_FFFF;
-                let c01 = source[y1.saturating_mul(width).saturating_add(x0)] & 0x00FF_FFFF;
-                let c11 = source[y1.saturating_mul(width).saturating_add(x1)] & 0x00FF_FFFF;
-
-                let r = bilinear_channel(
-                    ((c00 >> 16) & 0xFF) as u8,
-                    ((c10 >> 16) & 0xFF) as u8,
-                    ((c01 >> 16) & 0xFF) as u8,
-                    ((c11 >> 16) & 0xFF) as u8,
-                    wx,
-                    wy,
-                );
-                let g = bilinear_channel(
-                    ((c00 >> 8) & 0xFF) as u8,
-                    ((c10 >> 8) & 0xFF) as u8,
-                    ((c01 >> 8) & 0xFF) as u8,
-                    ((c11 >> 8) & 0xFF) as u8,
-                    wx,
-                    wy,
-                );
-                let b = bilinear_channel(
-                    (c00 & 0xFF) as u8,
-                    (c10 & 0xFF) as u8,
-                    (c01 & 0xFF) as u8,
-                    (c11 & 0xFF) as u8,
-                    wx,
-                    wy,
-                );
-                let rgb = ((r as u32) << 16) | ((g as u32) << 8) | (b as u32);
-                if rgb != 0 {
-                    nonzero_pixels = nonzero_pixels.saturating_add(1);
-                }
-                state.pixels[y * VIEWPORT_W + x] = rgb;
+        let scaler = match state.scaler.take() {
+            Some(scaler)
+                if scaler.matches(
+                    width,
+                    height,
+                    VIEWPORT_W,
+                    VIEWPORT_H,
+                    DoomViewFilter::Bilinear,
+                ) =>
+            {
+                scaler
             }
-        }
-        state.has_frame = true;
-        state.draw_calls = state.draw_calls.saturating_add(1);
+            _ => Scaler::new(
+                width,
+                height,
+                VIEWPORT_W,
+                VIEWPORT_H,
+                DoomViewFilter::Bilinear,
+            ),
+        };
+        FRAMES.with_back(|target| {
+            for (y, row) in target.chunks_exact_mut(VIEWPORT_W).enumerate() {
+                scaler.scale_row(source, y, 0, row, |rgb| rgb);
+                nonzero_pixels = nonzero_pixels
+                    .saturating_add(row.iter().filter(|rgb| **rgb != 0).count() as u32);
+            }
+        });
+        state.scaler = Some(scaler);
+        state.publish_frame();
         state.last_nonzero_pixels = nonzero_pixels;
     });
 }
 
-fn bilinear_channel(c00: u8, c10: u8, c01: u8, c11: u8, wx: u32, wy: u32) -> u8 {
-    let one = 1u64 << 16;
-    let inv_wx = one.saturating_sub(wx as u64);
-    let inv_wy = one.saturating_sub(wy as u64);
-
-    let top = ((u64::from(c00).saturating_mul(inv_wx) + u64::from(c10).saturating_mul(wx as u64))
-        .saturating_add(1u64 << 15))
-        >> 16;
-    let bottom = ((u64::from(c01).saturating_mul(inv_wx)
-        + u64::from(c11).saturating_mul(wx as u64))
-    .saturating_add(1u64 << 15))
-        >> 16;
-    (((top.saturating_mul(inv_wy) + bottom.saturating_mul(wy as u64)).saturating_add(1u64 << 15))
-        >> 16) as u8
-}
-
 #[unsafe(no_mangle)]
 pub extern "C" fn arr_dg_get_ticks_ms() -> u32 {
     with_bridge_mut(|state| {
@@ -399,6 +587,17 @@ pub extern "C" fn arr_dg_get_ticks_ms() -> u32 {
     })
 }
 
+/// Start stamp for a C-side span; 0 while tracing is off.
+#[unsafe(no_mangle)]
+pub extern "C" fn arr_dg_trace_begin() -> u64 {
+    trace::begin()
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn arr_dg_trace_audio_mix(start_tsc: u64) {
+    trace::record(Span::DoomMixAudio, start_tsc, time::read_tsc());
+}
+
 #[unsafe(no_mangle)]
 pub extern "C" fn arr_dg_get_realtime_ms() -> u32 {
     current_tick_millis().min(u64::from(u32::MAX)) as u32
@@ -533,20 +732,11 @@ pub extern "C" fn arr_dg_cfg_load(out: *mut u8, cap: usize) -> usize {
         return 0;
     }
 
-    let mut buffer = [0u8; CFG_PERSIST_MAX];
-    let Ok(len) = fs::read_file(CFG_PATH, &mut buffer) else {
-        return 0;
-    };
-    if len == 0 {
-        return 0;
-    }
-
-    let to_copy = len.min(cap);
     // SAFETY: caller provides writable output buffer of `cap` bytes.
-    unsafe {
-        core::ptr::copy_nonoverlapping(buffer.as_ptr(), out, to_copy);
-    }
-    to_copy
+    let out = unsafe { core::slice::from_raw_parts_mut(out, cap) };
+    fs::open_file(CFG_PATH)
+        .and_then(|handle| fs::read_at(handle, 0, out))
+        .unwrap_or(0)
 }
 
 #[unsafe(no_mangle)]
@@ -555,10 +745,15 @@ pub extern "C" fn arr_dg_cfg_store(data: *const u8, len: usize) -> i32 {
         return 0;
     }
 
-    let to_store = len.min(CFG_PERSIST_MAX);
+    let to_store = len.min(fs::max_file_bytes());
     // SAFETY: caller provides a valid readable buffer for `len` bytes.
     let slice = unsafe { core::slice::from_raw_parts(data, to_store) };
-    match fs::write_file(CFG_PATH, slice) {
+    let stored = fs::create_file(CFG_PATH).and_then(|handle| {
+        let written = fs::write_at(handle, 0, slice)?;
+        fs::truncate(handle, written)?;
+        Ok(written)
+    });
+    match stored {
         Ok(written) if written == to_store => 1,
         Ok(_) => 0,
         Err(_) => 0,
@@ -566,7 +761,7 @@ pub extern "C" fn arr_dg_cfg_store(data: *const u8, len: usize) -> i32 {
 }
 
 fn with_bridge_mut<R>(f: impl FnOnce(&mut BridgeState) -> R) -> R {
-    // SAFETY: ArrOSt runtime in this milestone is single-threaded for Doom bridge access.
+    // SAFETY: the bridge is only entered with the Doom state lock held.
     unsafe { f(&mut *BRIDGE_STATE.0.get()) }
 }
 
@@ -574,4 +769,5 @@ unsafe extern "C" {
     fn arr_doomgeneric_create();
     fn arr_doomgeneric_tick();
     fn arr_doomgeneric_frame_counter() -> u32;
+    fn arr_freestd_heap_stats(out: *mut HeapStats);
 }
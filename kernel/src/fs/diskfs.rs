@@ -1,15 +1,103 @@
-// kernel/src/fs/diskfs.rs: M6.1 fixed-layout block filesystem over virtio-blk sectors.
-use super::{DirEntry, FsError, MAX_FILE_BYTES, MAX_FILE_NAME_BYTES, MAX_FILES, Vfs};
+// kernel/src/fs/diskfs.rs: M6.2 bitmap-allocated, multi-extent block filesystem over virtio-blk.
+use super::{DirEntry, FileHandle, FsError, MAX_FILE_NAME_BYTES, Vfs};
+use crate::serial;
 use crate::storage;
+use alloc::vec::Vec;
 
-const MAGIC: &[u8; 8] = b"AROSTFS1";
-const VERSION: u16 = 1;
+pub const MAX_FILES: usize = 64;
+pub const MAX_EXTENTS: usize = 9;
+pub const MAX_FILE_BYTES: usize = 16 * 1024 * 1024;
+
+const MAGIC: &[u8; 8] = b"AROSTFS2";
+const VERSION: u16 = 2;
 const SUPERBLOCK_SECTOR: u64 = 0;
 const DIR_START_SECTOR: u64 = 1;
-const DIR_ENTRY_BYTES: usize = 72;
+const DIR_ENTRY_BYTES: usize = 128;
+const DIR_ENTRY_NAME: usize = 8;
+const DIR_ENTRY_EXTENTS: usize = DIR_ENTRY_NAME + MAX_FILE_NAME_BYTES;
 const DIR_BYTES: usize = DIR_ENTRY_BYTES * MAX_FILES;
 const DIR_SECTORS: usize = DIR_BYTES.div_ceil(storage::SECTOR_SIZE);
-const DATA_START_SECTOR: u64 = DIR_START_SECTOR + DIR_SECTORS as u64;
+const ENTRIES_PER_SECTOR: usize = storage::SECTOR_SIZE / DIR_ENTRY_BYTES;
+const BITMAP_START_SECTOR: u64 = DIR_START_SECTOR + DIR_SECTORS as u64;
+const BITS_PER_SECTOR: u64 = (storage::SECTOR_SIZE * 8) as u64;
+// 64 bitmap sectors cover 128 MiB; larger disks are formatted to that size.
+const MAX_BITMAP_SECTORS: usize = 64;
+const MAX_BITMAP_BYTES: usize = MAX_BITMAP_SECTORS * storage::SECTOR_SIZE;
+const MAX_TOTAL_SECTORS: u64 = MAX_BITMAP_SECTORS as u64 * BITS_PER_SECTOR;
+const INDEX_SLOTS: usize = MAX_FILES * 2;
+const INDEX_EMPTY: u8 = u8::MAX;
+
+const _: () = assert!(DIR_ENTRY_EXTENTS + MAX_EXTENTS * 8 <= DIR_ENTRY_BYTES);
+const _: () = assert!(DIR_ENTRY_BYTES * ENTRIES_PER_SECTOR == storage::SECTOR_SIZE);
+const _: () = assert!(DIR_SECTORS <= 32 && MAX_BITMAP_SECTORS <= 64);
+const _: () = assert!(MAX_FILES < INDEX_EMPTY as usize && INDEX_SLOTS.is_power_of_two());
+
+// Legacy AROSTFS1 layout, only read to migrate old images.
+const V1_MAGIC: &[u8; 8] = b"AROSTFS1";
+const V1_MAX_FILES: usize = 16;
+const V1_DIR_ENTRY_BYTES: usize = 72;
+const V1_MAX_FILE_BYTES: usize = 512;
+
+#[derive(Clone, Copy)]
+struct Extent {
+    start: u32,
+    count: u32,
+}
+
+impl Extent {
+    const fn empty() -> Self {
+        Self { start: 0, count: 0 }
+    }
+
+    const fn end(&self) -> u64 {
+        self.start as u64 + self.count as u64
+    }
+}
+
+#[derive(Clone, Copy)]
+struct ExtentList {
+    extents: [Extent; MAX_EXTENTS],
+    count: usize,
+}
+
+impl ExtentList {
+    const fn empty() -> Self {
+        Self {
+            extents: [Extent::empty(); MAX_EXTENTS],
+            count: 0,
+        }
+    }
+
+    fn as_slice(&self) -> &[Extent] {
+        &self.extents[..self.count]
+    }
+
+    fn sectors(&self) -> u64 {
+        self.as_slice()
+            .iter()
+            .map(|extent| extent.count as u64)
+            .sum()
+    }
+
+    /// Appends `[start, start + count)`, merging with the last extent when adjacent.
+    fn push(&mut self, start: u64, count: u64) -> bool {
+        if let Some(last) = self.extents[..self.count].last_mut()
+            && last.end() == start
+        {
+            last.count += count as u32;
+            return true;
+        }
+        if self.count == MAX_EXTENTS {
+            return false;
+        }
+        self.extents[self.count] = Extent {
+            start: start as u32,
+            count: count as u32,
+        };
+        self.count += 1;
+        true
+    }
+}
 
 #[derive(Clone, Copy)]
 struct DiskEntry {
@@ -17,8 +105,9 @@ struct DiskEntry {
     name: [u8; MAX_FILE_NAME_BYTES],
     name_len: usize,
     size_bytes: u32,
-    start_sector: u64,
-    sector_count: u32,
+    extents: ExtentList,
+    /// In-memory identity for `FileHandle` validation; not stored on disk.
+    id: u32,
 }
 
 impl DiskEntry {
@@ -28,8 +117,8 @@ impl DiskEntry {
             name: [0; MAX_FILE_NAME_BYTES],
             name_len: 0,
             size_bytes: 0,
-            start_sector: 0,
-            sector_count: 0,
+            extents: ExtentList::empty(),
+            id: 0,
         }
     }
 
@@ -49,10 +138,21 @@ impl DiskEntry {
 pub struct DiskFs {
     mounted: bool,
     total_sectors: u64,
-    next_free_sector: u64,
+    bitmap_sectors: usize,
+    data_start_sector: u64,
+    free_sectors: u64,
     file_count: u16,
     entries: [DiskEntry; MAX_FILES],
+    /// Open-addressed name hash -> entry index (`INDEX_EMPTY` marks a free slot).
+    name_index: [u8; INDEX_SLOTS],
     dir_bytes: [u8; DIR_BYTES],
+    bitmap: [u8; MAX_BITMAP_BYTES],
+    /// Directory/bitmap sectors changed since the last flush, one bit per sector.
+    dir_dirty: u32,
+    bitmap_dirty: u64,
+    /// Superblock/directory/bitmap changes not yet written; coalesced until the next flush.
+    metadata_dirty: bool,
+    next_id: u32,
 }
 
 impl DiskFs {
@@ -60,10 +160,18 @@ impl DiskFs {
         Self {
             mounted: false,
             total_sectors: 0,
-            next_free_sector: DATA_START_SECTOR,
+            bitmap_sectors: 0,
+            data_start_sector: 0,
+            free_sectors: 0,
             file_count: 0,
             entries: [DiskEntry::empty(); MAX_FILES],
+            name_index: [INDEX_EMPTY; INDEX_SLOTS],
             dir_bytes: [0; DIR_BYTES],
+            bitmap: [0; MAX_BITMAP_BYTES],
+            dir_dirty: 0,
+            bitmap_dirty: 0,
+            metadata_dirty: false,
+            next_id: 1,
         }
     }
 
@@ -71,11 +179,13 @@ impl DiskFs {
         if self.mounted {
             return Ok(());
         }
-        self.total_sectors = storage::capacity_sectors();
+        self.total_sectors = storage::capacity_sectors().min(MAX_TOTAL_SECTORS);
         self.mount_or_format()
     }
 
     pub fn remount(&mut self) -> Result<(), FsError> {
+        // Pending directory updates would otherwise be lost when the directory is re-read.
+        self.flush_metadata()?;
         self.mounted = false;
         self.init()
     }
@@ -85,6 +195,20 @@ impl DiskFs {
         self.persist_metadata()
     }
 
+    /// Writes deferred directory updates, if any. Returns whether anything was written.
+    pub fn flush_metadata(&mut self) -> Result<bool, FsError> {
+        if !self.mounted || !self.metadata_dirty {
+            return Ok(false);
+        }
+        self.persist_metadata()?;
+        Ok(true)
+    }
+
+    pub fn free_bytes(&self) -> u64 {
+        self.free_sectors
+            .saturating_mul(storage::SECTOR_SIZE as u64)
+    }
+
     fn ensure_mounted(&mut self) -> Result<(), FsError> {
         if self.mounted {
             return Ok(());
@@ -96,7 +220,8 @@ impl DiskFs {
         if !storage::is_ready() {
             return Err(FsError::StorageUnavailable);
         }
-        if self.total_sectors <= DATA_START_SECTOR {
+        let bitmap_sectors = self.total_sectors.div_ceil(BITS_PER_SECTOR) as usize;
+        if self.total_sectors <= BITMAP_START_SECTOR + bitmap_sectors as u64 {
             return Err(FsError::StorageNoSpace);
         }
 
@@ -104,90 +229,180 @@ impl DiskFs {
         storage::read_sector(SUPERBLOCK_SECTOR, &mut super_sector)
             .map_err(|_| FsError::StorageIo)?;
 
+        if &super_sector[..V1_MAGIC.len()] == V1_MAGIC {
+            return self.migrate_v1();
+        }
         if &super_sector[..MAGIC.len()] != MAGIC {
             return self.format();
         }
 
-        let version = u16::from_le_bytes([super_sector[8], super_sector[9]]);
-        if version != VERSION {
-            return Err(FsError::DiskCorrupt);
-        }
-
-        let next_free = read_u64(&super_sector, 16)?;
-        let file_count = read_u16(&super_sector, 24)?;
-        if next_free < DATA_START_SECTOR || next_free > self.total_sectors {
+        let version = read_u16(&super_sector, 8)?;
+        let dir_sectors = read_u16(&super_sector, 12)? as usize;
+        let stored_bitmap_sectors = read_u16(&super_sector, 14)? as usize;
+        let total_sectors = read_u64(&super_sector, 16)?;
+        let data_start = read_u64(&super_sector, 24)?;
+        if version != VERSION
+            || dir_sectors != DIR_SECTORS
+            || total_sectors > self.total_sectors
+            || stored_bitmap_sectors != total_sectors.div_ceil(BITS_PER_SECTOR) as usize
+            || stored_bitmap_sectors > MAX_BITMAP_SECTORS
+            || data_start != BITMAP_START_SECTOR + stored_bitmap_sectors as u64
+            || data_start >= total_sectors
+        {
             return Err(FsError::DiskCorrupt);
         }
 
-        self.next_free_sector = next_free;
-        self.file_count = file_count;
+        self.total_sectors = total_sectors;
+        self.bitmap_sectors = stored_bitmap_sectors;
+        self.data_start_sector = data_start;
+        self.load_bitmap()?;
         self.load_directory()?;
+        self.dir_dirty = 0;
+        self.bitmap_dirty = 0;
+        self.metadata_dirty = false;
         self.mounted = true;
         Ok(())
     }
 
     fn format(&mut self) -> Result<(), FsError> {
+        self.bitmap_sectors = self.total_sectors.div_ceil(BITS_PER_SECTOR) as usize;
+        self.data_start_sector = BITMAP_START_SECTOR + self.bitmap_sectors as u64;
         self.entries = [DiskEntry::empty(); MAX_FILES];
+        self.name_index = [INDEX_EMPTY; INDEX_SLOTS];
         self.dir_bytes.fill(0);
+        self.bitmap.fill(0);
         self.file_count = 0;
-        self.next_free_sector = DATA_START_SECTOR;
+        self.free_sectors = self.total_sectors;
+        // Metadata sectors are permanently allocated so the bitmap covers the whole disk.
+        self.mark_range(0, self.data_start_sector, true);
+        self.dir_dirty = low_bits_u32(DIR_SECTORS);
+        self.bitmap_dirty = low_bits_u64(self.bitmap_sectors);
         self.persist_metadata()?;
         self.mounted = true;
         Ok(())
     }
 
-    fn load_directory(&mut self) -> Result<(), FsError> {
-        self.dir_bytes.fill(0);
-        let mut sector_buf = [0u8; storage::SECTOR_SIZE];
-        for sector_idx in 0..DIR_SECTORS {
-            storage::read_sector(DIR_START_SECTOR + sector_idx as u64, &mut sector_buf)
-                .map_err(|_| FsError::StorageIo)?;
-            let start = sector_idx * storage::SECTOR_SIZE;
-            let end = (start + storage::SECTOR_SIZE).min(DIR_BYTES);
-            let len = end.saturating_sub(start);
-            self.dir_bytes[start..end].copy_from_slice(&sector_buf[..len]);
+    /// Reformats an AROSTFS1 image as AROSTFS2 and rewrites its (small, contiguous) files.
+    fn migrate_v1(&mut self) -> Result<(), FsError> {
+        let mut dir = [0u8; V1_DIR_ENTRY_BYTES * V1_MAX_FILES];
+        storage::read_sectors(DIR_START_SECTOR, &mut dir).map_err(|_| FsError::StorageIo)?;
+
+        let mut files: Vec<(DiskEntry, Vec<u8>)> = Vec::new();
+        for base in (0..dir.len()).step_by(V1_DIR_ENTRY_BYTES) {
+            if dir[base] == 0 {
+                continue;
+            }
+            let name_len = dir[base + 1] as usize;
+            let size = read_u32(&dir, base + 4)? as usize;
+            let start = read_u64(&dir, base + 8)?;
+            if name_len == 0 || name_len > MAX_FILE_NAME_BYTES || size > V1_MAX_FILE_BYTES {
+                return Err(FsError::DiskCorrupt);
+            }
+            let mut entry = DiskEntry::empty();
+            entry.name[..name_len].copy_from_slice(&dir[base + 24..base + 24 + name_len]);
+            entry.name_len = name_len;
+            let mut data = alloc::vec![0u8; size];
+            if size > 0 {
+                if start == 0 || start.saturating_add(1) > self.total_sectors {
+                    return Err(FsError::DiskCorrupt);
+                }
+                storage::read_sectors(start, &mut data).map_err(|_| FsError::StorageIo)?;
+            }
+            files.push((entry, data));
+        }
+
+        self.format()?;
+        for (entry, data) in &files {
+            self.write(entry.name(), data)?;
+        }
+        self.persist_metadata()?;
+        serial::write_fmt(format_args!(
+            "FS: migrated AROSTFS1 -> AROSTFS2 files={}\n",
+            files.len()
+        ));
+        Ok(())
+    }
+
+    fn load_bitmap(&mut self) -> Result<(), FsError> {
+        let bytes = self.bitmap_sectors * storage::SECTOR_SIZE;
+        self.bitmap.fill(0);
+        storage::read_sectors(BITMAP_START_SECTOR, &mut self.bitmap[..bytes])
+            .map_err(|_| FsError::StorageIo)?;
+        for sector in 0..self.data_start_sector {
+            if !self.is_allocated(sector) {
+                return Err(FsError::DiskCorrupt);
+            }
+        }
+        let used: u64 = self.bitmap[..bytes]
+            .iter()
+            .map(|byte| byte.count_ones() as u64)
+            .sum();
+        if used > self.total_sectors {
+            return Err(FsError::DiskCorrupt);
         }
+        self.free_sectors = self.total_sectors - used;
+        Ok(())
+    }
+
+    fn load_directory(&mut self) -> Result<(), FsError> {
+        storage::read_sectors(DIR_START_SECTOR, &mut self.dir_bytes)
+            .map_err(|_| FsError::StorageIo)?;
 
         self.entries = [DiskEntry::empty(); MAX_FILES];
         let mut used_count = 0u16;
-        for (index, entry) in self.entries.iter_mut().enumerate() {
+        for index in 0..MAX_FILES {
             let base = index * DIR_ENTRY_BYTES;
             if self.dir_bytes[base] == 0 {
                 continue;
             }
             let name_len = self.dir_bytes[base + 1] as usize;
-            if name_len == 0 || name_len > MAX_FILE_NAME_BYTES {
+            let extent_count = self.dir_bytes[base + 2] as usize;
+            if name_len == 0 || name_len > MAX_FILE_NAME_BYTES || extent_count > MAX_EXTENTS {
                 return Err(FsError::DiskCorrupt);
             }
             let size_bytes = read_u32(&self.dir_bytes, base + 4)?;
-            let start_sector = read_u64(&self.dir_bytes, base + 8)?;
-            let sector_count = read_u32(&self.dir_bytes, base + 16)?;
-            if sector_count > 0 {
-                let end = start_sector.saturating_add(sector_count as u64);
-                if start_sector < DATA_START_SECTOR || end > self.total_sectors {
+
+            let mut extents = ExtentList::empty();
+            for slot in 0..extent_count {
+                let offset = base + DIR_ENTRY_EXTENTS + slot * 8;
+                let start = read_u32(&self.dir_bytes, offset)? as u64;
+                let count = read_u32(&self.dir_bytes, offset + 4)? as u64;
+                let end = start.saturating_add(count);
+                if count == 0 || start < self.data_start_sector || end > self.total_sectors {
                     return Err(FsError::DiskCorrupt);
                 }
-                if (size_bytes as usize) > (sector_count as usize * storage::SECTOR_SIZE) {
+                if (start..end).any(|sector| !self.is_allocated(sector)) {
                     return Err(FsError::DiskCorrupt);
                 }
-            } else if size_bytes != 0 {
+                extents.extents[slot] = Extent {
+                    start: start as u32,
+                    count: count as u32,
+                };
+            }
+            extents.count = extent_count;
+            if size_bytes as u64 > extents.sectors() * storage::SECTOR_SIZE as u64 {
                 return Err(FsError::DiskCorrupt);
             }
 
+            let entry = &mut self.entries[index];
             entry.used = true;
             entry.name_len = name_len;
-            entry.name[..name_len]
-                .copy_from_slice(&self.dir_bytes[base + 24..base + 24 + name_len]);
+            entry.name[..name_len].copy_from_slice(
+                &self.dir_bytes[base + DIR_ENTRY_NAME..base + DIR_ENTRY_NAME + name_len],
+            );
             entry.size_bytes = size_bytes;
-            entry.start_sector = start_sector;
-            entry.sector_count = sector_count;
+            entry.extents = extents;
+            entry.id = self.next_id;
+            self.next_id = self.next_id.wrapping_add(1);
             used_count = used_count.saturating_add(1);
         }
 
         self.file_count = used_count;
+        self.rebuild_index();
         Ok(())
     }
 
+    /// Writes the superblock plus only the directory/bitmap sectors changed since last time.
     fn persist_metadata(&mut self) -> Result<(), FsError> {
         if !storage::is_ready() {
             return Err(FsError::StorageUnavailable);
@@ -197,41 +412,66 @@ impl DiskFs {
         super_sector[..MAGIC.len()].copy_from_slice(MAGIC);
         super_sector[8..10].copy_from_slice(&VERSION.to_le_bytes());
         super_sector[10..12].copy_from_slice(&(MAX_FILES as u16).to_le_bytes());
-        super_sector[12..14].copy_from_slice(&(MAX_FILE_BYTES as u16).to_le_bytes());
-        super_sector[14..16].copy_from_slice(&(DIR_SECTORS as u16).to_le_bytes());
-        super_sector[16..24].copy_from_slice(&self.next_free_sector.to_le_bytes());
-        super_sector[24..26].copy_from_slice(&self.file_count.to_le_bytes());
-        super_sector[26..34].copy_from_slice(&self.total_sectors.to_le_bytes());
+        super_sector[12..14].copy_from_slice(&(DIR_SECTORS as u16).to_le_bytes());
+        super_sector[14..16].copy_from_slice(&(self.bitmap_sectors as u16).to_le_bytes());
+        super_sector[16..24].copy_from_slice(&self.total_sectors.to_le_bytes());
+        super_sector[24..32].copy_from_slice(&self.data_start_sector.to_le_bytes());
+        super_sector[32..34].copy_from_slice(&self.file_count.to_le_bytes());
+        super_sector[34..36].copy_from_slice(&(MAX_EXTENTS as u16).to_le_bytes());
+        super_sector[40..48].copy_from_slice(&self.free_sectors.to_le_bytes());
         storage::write_sector(SUPERBLOCK_SECTOR, &super_sector).map_err(|_| FsError::StorageIo)?;
 
-        self.dir_bytes.fill(0);
-        for (index, entry) in self.entries.iter().enumerate() {
-            if !entry.used {
+        for sector in 0..DIR_SECTORS {
+            if self.dir_dirty & (1 << sector) == 0 {
                 continue;
             }
-            let base = index * DIR_ENTRY_BYTES;
-            self.dir_bytes[base] = 1;
-            self.dir_bytes[base + 1] = entry.name_len as u8;
-            self.dir_bytes[base + 4..base + 8].copy_from_slice(&entry.size_bytes.to_le_bytes());
-            self.dir_bytes[base + 8..base + 16].copy_from_slice(&entry.start_sector.to_le_bytes());
-            self.dir_bytes[base + 16..base + 20].copy_from_slice(&entry.sector_count.to_le_bytes());
-            self.dir_bytes[base + 24..base + 24 + entry.name_len]
-                .copy_from_slice(&entry.name[..entry.name_len]);
+            let base = sector * storage::SECTOR_SIZE;
+            storage::write_sectors(
+                DIR_START_SECTOR + sector as u64,
+                &self.dir_bytes[base..base + storage::SECTOR_SIZE],
+            )
+            .map_err(|_| FsError::StorageIo)?;
+            self.dir_dirty &= !(1 << sector);
         }
-
-        let mut sector_buf = [0u8; storage::SECTOR_SIZE];
-        for sector_idx in 0..DIR_SECTORS {
-            sector_buf.fill(0);
-            let start = sector_idx * storage::SECTOR_SIZE;
-            let end = (start + storage::SECTOR_SIZE).min(DIR_BYTES);
-            let len = end.saturating_sub(start);
-            sector_buf[..len].copy_from_slice(&self.dir_bytes[start..end]);
-            storage::write_sector(DIR_START_SECTOR + sector_idx as u64, &sector_buf)
-                .map_err(|_| FsError::StorageIo)?;
+        for sector in 0..self.bitmap_sectors {
+            if self.bitmap_dirty & (1 << sector) == 0 {
+                continue;
+            }
+            let base = sector * storage::SECTOR_SIZE;
+            storage::write_sectors(
+                BITMAP_START_SECTOR + sector as u64,
+                &self.bitmap[base..base + storage::SECTOR_SIZE],
+            )
+            .map_err(|_| FsError::StorageIo)?;
+            self.bitmap_dirty &= !(1 << sector);
         }
+        self.metadata_dirty = false;
         Ok(())
     }
 
+    /// Re-encodes one directory entry into `dir_bytes` and marks its sector dirty.
+    fn store_entry(&mut self, index: usize) {
+        let entry = self.entries[index];
+        let base = index * DIR_ENTRY_BYTES;
+        let bytes = &mut self.dir_bytes[base..base + DIR_ENTRY_BYTES];
+        bytes.fill(0);
+        if entry.used {
+            bytes[0] = 1;
+            bytes[1] = entry.name_len as u8;
+            bytes[2] = entry.extents.count as u8;
+            bytes[4..8].copy_from_slice(&entry.size_bytes.to_le_bytes());
+            bytes[DIR_ENTRY_NAME..DIR_ENTRY_NAME + entry.name_len]
+                .copy_from_slice(&entry.name[..entry.name_len]);
+            for (slot, extent) in entry.extents.as_slice().iter().enumerate() {
+                let offset = DIR_ENTRY_EXTENTS + slot * 8;
+                bytes[offset..offset + 4].copy_from_slice(&extent.start.to_le_bytes());
+                bytes[offset + 4..offset + 8].copy_from_slice(&extent.count.to_le_bytes());
+            }
+        }
+        self.dir_dirty |= 1 << (index / ENTRIES_PER_SECTOR);
+        self.metadata_dirty = true;
+    }
+
     fn normalize_name(path: &str) -> Result<&str, FsError> {
         let trimmed = path.trim();
         let name = match trimmed.strip_prefix('/') {
@@ -248,26 +488,224 @@ impl DiskFs {
     }
 
     fn find_index(&self, name: &str) -> Option<usize> {
-        self.entries
-            .iter()
-            .enumerate()
-            .find(|(_, entry)| entry.used && entry.name() == name)
-            .map(|(idx, _)| idx)
+        let mut slot = name_hash(name) as usize & (INDEX_SLOTS - 1);
+        for _ in 0..INDEX_SLOTS {
+            let index = self.name_index[slot];
+            if index == INDEX_EMPTY {
+                return None;
+            }
+            let entry = &self.entries[index as usize];
+            if entry.used && entry.name() == name {
+                return Some(index as usize);
+            }
+            slot = (slot + 1) & (INDEX_SLOTS - 1);
+        }
+        None
+    }
+
+    fn index_insert(&mut self, name: &str, index: usize) {
+        let mut slot = name_hash(name) as usize & (INDEX_SLOTS - 1);
+        // The table is twice the directory size, so a free slot always exists.
+        while self.name_index[slot] != INDEX_EMPTY {
+            slot = (slot + 1) & (INDEX_SLOTS - 1);
+        }
+        self.name_index[slot] = index as u8;
+    }
+
+    // Deletes are rare and the table is tiny, so rebuilding beats tombstone bookkeeping.
+    fn rebuild_index(&mut self) {
+        self.name_index = [INDEX_EMPTY; INDEX_SLOTS];
+        for index in 0..MAX_FILES {
+            if self.entries[index].used {
+                let entry = self.entries[index];
+                self.index_insert(entry.name(), index);
+            }
+        }
     }
 
     fn find_free_index(&self) -> Option<usize> {
         self.entries.iter().position(|entry| !entry.used)
     }
 
-    fn allocate_extent(&mut self, sectors: u32) -> Result<u64, FsError> {
-        let needed = sectors as u64;
-        let end = self.next_free_sector.saturating_add(needed);
-        if end > self.total_sectors {
+    fn allocate_id(&mut self) -> u32 {
+        let id = self.next_id;
+        self.next_id = self.next_id.wrapping_add(1);
+        id
+    }
+
+    fn entry_for(&self, handle: FileHandle) -> Result<usize, FsError> {
+        if !self.mounted {
+            return Err(FsError::StorageUnavailable);
+        }
+        match self.entries.get(handle.slot) {
+            Some(entry) if entry.used && entry.id == handle.id => Ok(handle.slot),
+            _ => Err(FsError::StaleHandle),
+        }
+    }
+
+    /// Makes sure the file at `index` owns sectors for `len` bytes, growing its extents.
+    fn reserve(&mut self, index: usize, len: usize) -> Result<(), FsError> {
+        let needed = len.div_ceil(storage::SECTOR_SIZE) as u64;
+        let mut extents = self.entries[index].extents;
+        let held = extents.sectors();
+        if needed > held {
+            self.allocate(&mut extents, needed - held)?;
+            self.entries[index].extents = extents;
+            self.store_entry(index);
+        }
+        Ok(())
+    }
+
+    /// Writes zeros over file bytes `[start, end)`, e.g. the gap left by a seek past the end.
+    fn zero_fill(&self, index: usize, start: usize, end: usize) -> Result<(), FsError> {
+        static ZEROS: [u8; 8 * storage::SECTOR_SIZE] = [0; 8 * storage::SECTOR_SIZE];
+        let extents = &self.entries[index].extents;
+        let size = self.entries[index].size_bytes as usize;
+        let mut offset = start;
+        while offset < end {
+            // Align chunks to sectors so the middle of a large gap is written whole.
+            let chunk_end = ((offset / ZEROS.len()) + 1) * ZEROS.len();
+            let len = chunk_end.min(end) - offset;
+            write_range(extents, offset, &ZEROS[..len], size)?;
+            offset += len;
+        }
+        Ok(())
+    }
+
+    fn is_allocated(&self, sector: u64) -> bool {
+        let bit = sector as usize;
+        self.bitmap[bit / 8] & (1 << (bit % 8)) != 0
+    }
+
+    fn mark_range(&mut self, start: u64, count: u64, used: bool) {
+        for sector in start..start + count {
+            let bit = sector as usize;
+            let mask = 1u8 << (bit % 8);
+            let byte = &mut self.bitmap[bit / 8];
+            if (*byte & mask != 0) == used {
+                continue;
+            }
+            if used {
+                *byte |= mask;
+                self.free_sectors -= 1;
+            } else {
+                *byte &= !mask;
+                self.free_sectors += 1;
+            }
+            self.bitmap_dirty |= 1 << (sector / BITS_PER_SECTOR);
+        }
+        self.metadata_dirty = true;
+    }
+
+    /// Returns the first free run at or after `from` as `(start, len)`.
+    fn next_free_run(&self, from: u64) -> Option<(u64, u64)> {
+        let mut sector = from.max(self.data_start_sector);
+        while sector < self.total_sectors {
+            // Skip fully allocated bytes without testing each bit.
+            if sector.is_multiple_of(8) && self.bitmap[sector as usize / 8] == u8::MAX {
+                sector += 8;
+                continue;
+            }
+            if self.is_allocated(sector) {
+                sector += 1;
+                continue;
+            }
+            let start = sector;
+            while sector < self.total_sectors && !self.is_allocated(sector) {
+                sector += 1;
+            }
+            return Some((start, sector - start));
+        }
+        None
+    }
+
+    /// Allocates `sectors` onto the end of `extents`: first by growing the last extent in
+    /// place, then from the first free run big enough, then first-fit across smaller runs.
+    /// On failure nothing stays allocated and `extents` is unchanged.
+    fn allocate(&mut self, extents: &mut ExtentList, sectors: u64) -> Result<(), FsError> {
+        if sectors > self.free_sectors {
+            return Err(FsError::StorageNoSpace);
+        }
+        let mut grown = *extents;
+        let mut remaining = sectors;
+
+        if let Some(last) = grown.as_slice().last().copied()
+            && let Some((start, len)) = self.next_free_run(last.end())
+            && start == last.end()
+        {
+            let take = len.min(remaining);
+            grown.push(start, take);
+            self.mark_range(start, take, true);
+            remaining -= take;
+        }
+
+        if remaining > 0 {
+            let mut cursor = self.data_start_sector;
+            let mut fit = None;
+            while let Some((start, len)) = self.next_free_run(cursor) {
+                if len >= remaining {
+                    fit = Some(start);
+                    break;
+                }
+                cursor = start + len;
+            }
+            if let Some(start) = fit
+                && grown.push(start, remaining)
+            {
+                self.mark_range(start, remaining, true);
+                remaining = 0;
+            }
+        }
+
+        let mut cursor = self.data_start_sector;
+        while remaining > 0 {
+            let Some((start, len)) = self.next_free_run(cursor) else {
+                break;
+            };
+            let take = len.min(remaining);
+            if !grown.push(start, take) {
+                break;
+            }
+            self.mark_range(start, take, true);
+            remaining -= take;
+            cursor = start + take;
+        }
+
+        if remaining > 0 {
+            self.release_tail(&grown, extents.sectors());
             return Err(FsError::StorageNoSpace);
         }
-        let start = self.next_free_sector;
-        self.next_free_sector = end;
-        Ok(start)
+        *extents = grown;
+        Ok(())
+    }
+
+    /// Frees every sector of `extents` past the first `keep` sectors.
+    fn release_tail(&mut self, extents: &ExtentList, keep: u64) {
+        let mut offset = 0u64;
+        for extent in extents.as_slice() {
+            let count = extent.count as u64;
+            if offset + count > keep {
+                let skip = keep.saturating_sub(offset);
+                self.mark_range(extent.start as u64 + skip, count - skip, false);
+            }
+            offset += count;
+        }
+    }
+
+    /// Shrinks `extents` to exactly `keep` sectors, returning the rest to the bitmap.
+    fn truncate_extents(&mut self, extents: &mut ExtentList, keep: u64) {
+        self.release_tail(extents, keep);
+        let mut trimmed = ExtentList::empty();
+        let mut remaining = keep;
+        for extent in extents.as_slice() {
+            if remaining == 0 {
+                break;
+            }
+            let take = (extent.count as u64).min(remaining);
+            trimmed.push(extent.start as u64, take);
+            remaining -= take;
+        }
+        *extents = trimmed;
     }
 }
 
@@ -287,74 +725,55 @@ impl Vfs for DiskFs {
         written
     }
 
-    fn read(&self, path: &str, out: &mut [u8]) -> Result<usize, FsError> {
-        if !self.mounted {
-            return Err(FsError::StorageUnavailable);
-        }
-        let name = Self::normalize_name(path)?;
-        let index = self.find_index(name).ok_or(FsError::NotFound)?;
-        let entry = self.entries[index];
-        let size = entry.size_bytes as usize;
-        if out.len() < size {
-            return Err(FsError::BufferTooSmall);
-        }
-        if size == 0 {
-            return Ok(0);
-        }
-        if entry.sector_count == 0 || entry.start_sector < DATA_START_SECTOR {
-            return Err(FsError::DiskCorrupt);
-        }
-
-        let mut sector_buf = [0u8; storage::SECTOR_SIZE];
-        let sectors = entry.sector_count as usize;
-        for sector_idx in 0..sectors {
-            storage::read_sector(entry.start_sector + sector_idx as u64, &mut sector_buf)
-                .map_err(|_| FsError::StorageIo)?;
-            let start = sector_idx * storage::SECTOR_SIZE;
-            let end = (start + storage::SECTOR_SIZE).min(size);
-            let len = end.saturating_sub(start);
-            out[start..end].copy_from_slice(&sector_buf[..len]);
-        }
-        Ok(size)
-    }
-
     fn write(&mut self, path: &str, data: &[u8]) -> Result<usize, FsError> {
         self.ensure_mounted()?;
         if data.len() > MAX_FILE_BYTES {
             return Err(FsError::FileTooLarge);
         }
         let name = Self::normalize_name(path)?;
+        let needed = data.len().div_ceil(storage::SECTOR_SIZE) as u64;
 
-        let needed_sectors = if data.is_empty() {
-            0
-        } else {
-            data.len().div_ceil(storage::SECTOR_SIZE) as u32
-        };
-
-        let entry_index = if let Some(index) = self.find_index(name) {
-            index
-        } else {
-            self.find_free_index().ok_or(FsError::NoSpace)?
+        let existing = self.find_index(name);
+        let entry_index = match existing {
+            Some(index) => index,
+            None => self.find_free_index().ok_or(FsError::NoSpace)?,
         };
 
         let mut entry = self.entries[entry_index];
-        let start_sector = if needed_sectors == 0 {
-            0
-        } else if entry.used && entry.sector_count >= needed_sectors && entry.start_sector != 0 {
-            entry.start_sector
-        } else {
-            self.allocate_extent(needed_sectors)?
-        };
+        if existing.is_none() {
+            entry = DiskEntry::empty();
+            entry.id = self.allocate_id();
+        }
+        let mut extents = entry.extents;
+        let held = extents.sectors();
+        if needed <= held {
+            self.truncate_extents(&mut extents, needed);
+        } else if self.allocate(&mut extents, needed - held).is_err() {
+            // Too fragmented to grow within `MAX_EXTENTS`: lay the file out from scratch,
+            // reusing its own sectors. Restore the old extents if even that fails.
+            let old = extents;
+            self.truncate_extents(&mut extents, 0);
+            if let Err(error) = self.allocate(&mut extents, needed) {
+                for extent in old.as_slice() {
+                    self.mark_range(extent.start as u64, extent.count as u64, true);
+                }
+                return Err(error);
+            }
+        }
 
-        let mut sector_buf = [0u8; storage::SECTOR_SIZE];
-        for sector_idx in 0..needed_sectors as usize {
-            sector_buf.fill(0);
-            let start = sector_idx * storage::SECTOR_SIZE;
-            let end = (start + storage::SECTOR_SIZE).min(data.len());
-            let len = end.saturating_sub(start);
-            sector_buf[..len].copy_from_slice(&data[start..end]);
-            storage::write_sector(start_sector + sector_idx as u64, &sector_buf)
-                .map_err(|_| FsError::StorageIo)?;
+        if let Err(error) = write_extents(&extents, data) {
+            if existing.is_some() {
+                // Keep the new layout so no sector is leaked or still referenced after being
+                // freed; the contents are whatever reached the disk, as after a crash.
+                let capacity = extents.sectors() * storage::SECTOR_SIZE as u64;
+                entry.size_bytes = (entry.size_bytes as u64).min(capacity) as u32;
+                entry.extents = extents;
+                self.entries[entry_index] = entry;
+                self.store_entry(entry_index);
+            } else {
+                self.release_tail(&extents, 0);
+            }
+            return Err(error);
         }
 
         if !entry.used {
@@ -363,10 +782,12 @@ impl Vfs for DiskFs {
         entry.used = true;
         entry.set_name(name);
         entry.size_bytes = data.len() as u32;
-        entry.start_sector = start_sector;
-        entry.sector_count = needed_sectors;
+        entry.extents = extents;
         self.entries[entry_index] = entry;
-        self.persist_metadata()?;
+        if existing.is_none() {
+            self.index_insert(name, entry_index);
+        }
+        self.store_entry(entry_index);
         Ok(data.len())
     }
 
@@ -374,16 +795,17 @@ impl Vfs for DiskFs {
         self.ensure_mounted()?;
         let name = Self::normalize_name(path)?;
         let index = self.find_index(name).ok_or(FsError::NotFound)?;
-        if self.entries[index].used {
-            self.entries[index] = DiskEntry::empty();
-            self.file_count = self.file_count.saturating_sub(1);
-            self.persist_metadata()?;
-        }
+        let extents = self.entries[index].extents;
+        self.release_tail(&extents, 0);
+        self.entries[index] = DiskEntry::empty();
+        self.file_count = self.file_count.saturating_sub(1);
+        self.rebuild_index();
+        self.store_entry(index);
         Ok(())
     }
 
     fn file_count(&self) -> usize {
-        self.entries.iter().filter(|entry| entry.used).count()
+        self.file_count as usize
     }
 
     fn used_bytes(&self) -> usize {
@@ -393,6 +815,207 @@ impl Vfs for DiskFs {
             .map(|entry| entry.size_bytes as usize)
             .sum()
     }
+
+    fn open(&mut self, path: &str, create: bool) -> Result<FileHandle, FsError> {
+        self.ensure_mounted()?;
+        let name = Self::normalize_name(path)?;
+        if let Some(slot) = self.find_index(name) {
+            return Ok(FileHandle {
+                slot,
+                id: self.entries[slot].id,
+            });
+        }
+        if !create {
+            return Err(FsError::NotFound);
+        }
+
+        let slot = self.find_free_index().ok_or(FsError::NoSpace)?;
+        let mut entry = DiskEntry::empty();
+        entry.used = true;
+        entry.set_name(name);
+        entry.id = self.allocate_id();
+        self.entries[slot] = entry;
+        self.file_count = self.file_count.saturating_add(1);
+        self.index_insert(name, slot);
+        self.store_entry(slot);
+        Ok(FileHandle { slot, id: entry.id })
+    }
+
+    fn size(&self, handle: FileHandle) -> Result<usize, FsError> {
+        Ok(self.entries[self.entry_for(handle)?].size_bytes as usize)
+    }
+
+    fn read_at(&self, handle: FileHandle, offset: usize, out: &mut [u8]) -> Result<usize, FsError> {
+        let entry = &self.entries[self.entry_for(handle)?];
+        let size = entry.size_bytes as usize;
+        if offset >= size {
+            return Ok(0);
+        }
+        let len = out.len().min(size - offset);
+        read_range(&entry.extents, offset, &mut out[..len])?;
+        Ok(len)
+    }
+
+    fn write_at(
+        &mut self,
+        handle: FileHandle,
+        offset: usize,
+        data: &[u8],
+    ) -> Result<usize, FsError> {
+        let index = self.entry_for(handle)?;
+        if data.is_empty() {
+            return Ok(0);
+        }
+        let end = offset
+            .checked_add(data.len())
+            .filter(|&end| end <= MAX_FILE_BYTES)
+            .ok_or(FsError::FileTooLarge)?;
+        self.reserve(index, end)?;
+
+        let size = self.entries[index].size_bytes as usize;
+        if offset > size {
+            self.zero_fill(index, size, offset)?;
+        }
+        write_range(&self.entries[index].extents, offset, data, size)?;
+        if end > size {
+            self.entries[index].size_bytes = end as u32;
+            self.store_entry(index);
+        }
+        Ok(data.len())
+    }
+
+    fn truncate(&mut self, handle: FileHandle, len: usize) -> Result<(), FsError> {
+        let index = self.entry_for(handle)?;
+        if len > MAX_FILE_BYTES {
+            return Err(FsError::FileTooLarge);
+        }
+        let size = self.entries[index].size_bytes as usize;
+        if len < size {
+            let mut extents = self.entries[index].extents;
+            self.truncate_extents(&mut extents, len.div_ceil(storage::SECTOR_SIZE) as u64);
+            self.entries[index].extents = extents;
+        } else if len > size {
+            self.reserve(index, len)?;
+            self.zero_fill(index, size, len)?;
+        } else {
+            return Ok(());
+        }
+        self.entries[index].size_bytes = len as u32;
+        self.store_entry(index);
+        Ok(())
+    }
+}
+
+/// Maps file byte `offset` to `(sector, byte within sector, bytes from that sector's start to
+/// the end of its extent)`.
+fn locate(extents: &ExtentList, offset: usize) -> Option<(u64, usize, usize)> {
+    let mut base = 0usize;
+    for extent in extents.as_slice() {
+        let bytes = extent.count as usize * storage::SECTOR_SIZE;
+        if offset < base + bytes {
+            let rel = offset - base;
+            let sector_rel = rel / storage::SECTOR_SIZE;
+            let run = bytes - sector_rel * storage::SECTOR_SIZE;
+            return Some((
+                extent.start as u64 + sector_rel as u64,
+                rel % storage::SECTOR_SIZE,
+                run,
+            ));
+        }
+        base += bytes;
+    }
+    None
+}
+
+/// Reads file bytes at `offset` into `out`. Sector-aligned spans go straight to `out`; a
+/// span starting mid-sector goes through a one-sector buffer.
+fn read_range(extents: &ExtentList, offset: usize, out: &mut [u8]) -> Result<(), FsError> {
+    let mut done = 0usize;
+    while done < out.len() {
+        let (sector, within, run) = locate(extents, offset + done).ok_or(FsError::DiskCorrupt)?;
+        let remaining = out.len() - done;
+        let len = if within == 0 {
+            let len = remaining.min(run);
+            storage::read_sectors(sector, &mut out[done..done + len])
+                .map_err(|_| FsError::StorageIo)?;
+            len
+        } else {
+            let mut bytes = [0u8; storage::SECTOR_SIZE];
+            storage::read_sector(sector, &mut bytes).map_err(|_| FsError::StorageIo)?;
+            let len = (storage::SECTOR_SIZE - within).min(remaining);
+            out[done..done + len].copy_from_slice(&bytes[within..within + len]);
+            len
+        };
+        done += len;
+    }
+    Ok(())
+}
+
+/// Writes `data` at file byte `offset`. Whole sectors are written directly; partial sectors
+/// are read-modify-written unless they lie entirely past `size`, the current end of file.
+fn write_range(
+    extents: &ExtentList,
+    offset: usize,
+    data: &[u8],
+    size: usize,
+) -> Result<(), FsError> {
+    let mut done = 0usize;
+    while done < data.len() {
+        let position = offset + done;
+        let (sector, within, run) = locate(extents, position).ok_or(FsError::DiskCorrupt)?;
+        let remaining = data.len() - done;
+        let len = if within == 0 && remaining >= storage::SECTOR_SIZE {
+            let len = (remaining - remaining % storage::SECTOR_SIZE).min(run);
+            storage::write_sectors(sector, &data[done..done + len])
+                .map_err(|_| FsError::StorageIo)?;
+            len
+        } else {
+            let mut bytes = [0u8; storage::SECTOR_SIZE];
+            if position - within < size {
+                storage::read_sector(sector, &mut bytes).map_err(|_| FsError::StorageIo)?;
+            }
+            let len = (storage::SECTOR_SIZE - within).min(remaining);
+            bytes[within..within + len].copy_from_slice(&data[done..done + len]);
+            storage::write_sector(sector, &bytes).map_err(|_| FsError::StorageIo)?;
+            len
+        };
+        done += len;
+    }
+    Ok(())
+}
+
+fn write_extents(extents: &ExtentList, data: &[u8]) -> Result<(), FsError> {
+    let mut offset = 0usize;
+    for extent in extents.as_slice() {
+        let len = (data.len() - offset).min(extent.count as usize * storage::SECTOR_SIZE);
+        storage::write_sectors(extent.start as u64, &data[offset..offset + len])
+            .map_err(|_| FsError::StorageIo)?;
+        offset += len;
+    }
+    Ok(())
+}
+
+/// FNV-1a; names are short and the table small, so distribution matters more than speed.
+fn name_hash(name: &str) -> u32 {
+    name.as_bytes().iter().fold(0x811c_9dc5u32, |hash, byte| {
+        (hash ^ *byte as u32).wrapping_mul(0x0100_0193)
+    })
+}
+
+const fn low_bits_u32(count: usize) -> u32 {
+    if count >= 32 {
+        u32::MAX
+    } else {
+        (1u32 << count) - 1
+    }
+}
+
+const fn low_bits_u64(count: usize) -> u64 {
+    if count >= 64 {
+        u64::MAX
+    } else {
+        (1u64 << count) - 1
+    }
 }
 
 fn read_u16(bytes: &[u8], offset: usize) -> Result<u16, FsError> {
@@ -1,15 +1,28 @@
-// kernel/src/fs/mod.rs: M6.1 VFS facade with diskfs backend and ramfs fallback.
+// kernel/src/fs/mod.rs: M6.2 VFS facade with diskfs backend and ramfs fallback.
 mod diskfs;
 mod ramfs;
 
 use crate::serial;
 use crate::storage;
+use crate::sync::SpinLock;
+use crate::time::{self, PIT_HZ};
 use core::cell::UnsafeCell;
-use core::hint::spin_loop;
-use core::sync::atomic::{AtomicBool, Ordering};
 use diskfs::DiskFs;
 
-pub use ramfs::{MAX_FILE_BYTES, MAX_FILE_NAME_BYTES, MAX_FILES, RamFs};
+pub use ramfs::{MAX_FILE_NAME_BYTES, RamFs};
+
+/// Directory capacity of the largest backend; sizes listing buffers.
+pub const MAX_FILES: usize = diskfs::MAX_FILES;
+/// Chunk size used by the streaming helpers (`cat`, copy); one sector keeps chunks aligned.
+const STREAM_CHUNK_BYTES: usize = storage::SECTOR_SIZE;
+
+/// Scratch file `bench_to_serial` writes, reads back and deletes.
+const BENCH_PATH: &str = "/BENCH.TMP";
+/// Bench transfer size per call: several sectors, so the loop times the backend, not the VFS.
+const BENCH_CHUNK_BYTES: usize = 8 * storage::SECTOR_SIZE;
+
+/// Deferred diskfs directory updates are written at most this often from `fs::poll`.
+const METADATA_FLUSH_TICKS: u64 = PIT_HZ as u64 / 2;
 
 #[derive(Clone, Copy)]
 pub struct FsInitReport {
@@ -17,6 +30,7 @@ pub struct FsInitReport {
     pub storage_backed: bool,
     pub file_count: usize,
     pub used_bytes: usize,
+    pub free_bytes: u64,
     pub max_files: usize,
     pub max_file_bytes: usize,
 }
@@ -28,11 +42,11 @@ pub enum FsError {
     NotFound,
     NoSpace,
     FileTooLarge,
-    BufferTooSmall,
     DiskCorrupt,
     StorageUnavailable,
     StorageIo,
     StorageNoSpace,
+    StaleHandle,
 }
 
 impl FsError {
@@ -43,11 +57,11 @@ impl FsError {
             Self::NotFound => "not_found",
             Self::NoSpace => "no_space",
             Self::FileTooLarge => "file_too_large",
-            Self::BufferTooSmall => "buffer_too_small",
             Self::DiskCorrupt => "disk_corrupt",
             Self::StorageUnavailable => "storage_unavailable",
             Self::StorageIo => "storage_io",
             Self::StorageNoSpace => "storage_no_space",
+            Self::StaleHandle => "stale_handle",
         }
     }
 }
@@ -88,13 +102,40 @@ impl DirEntry {
     }
 }
 
+/// Open-file reference: a directory slot plus the id the file had when opened, so a handle
+/// to a deleted (or deleted and recreated) file is rejected instead of aliasing the new one.
+#[derive(Clone, Copy, Eq, PartialEq)]
+pub struct FileHandle {
+    slot: usize,
+    id: u32,
+}
+
 pub trait Vfs {
     fn list(&self, out: &mut [DirEntry]) -> usize;
-    fn read(&self, path: &str, out: &mut [u8]) -> Result<usize, FsError>;
     fn write(&mut self, path: &str, data: &[u8]) -> Result<usize, FsError>;
     fn delete(&mut self, path: &str) -> Result<(), FsError>;
     fn file_count(&self) -> usize;
     fn used_bytes(&self) -> usize;
+
+    /// Opens `path`, creating an empty file when `create` is set and it does not exist.
+    fn open(&mut self, path: &str, create: bool) -> Result<FileHandle, FsError>;
+    fn size(&self, handle: FileHandle) -> Result<usize, FsError>;
+    /// Reads up to `out.len()` bytes at `offset`; returns fewer at end of file, 0 past it.
+    fn read_at(&self, handle: FileHandle, offset: usize, out: &mut [u8]) -> Result<usize, FsError>;
+    /// Writes `data` at `offset`, growing the file; a gap past the old end reads as zeros.
+    fn write_at(
+        &mut self,
+        handle: FileHandle,
+        offset: usize,
+        data: &[u8],
+    ) -> Result<usize, FsError>;
+    /// Shrinks or zero-extends the file to `len` bytes.
+    fn truncate(&mut self, handle: FileHandle, len: usize) -> Result<(), FsError>;
+
+    fn append(&mut self, handle: FileHandle, data: &[u8]) -> Result<usize, FsError> {
+        let size = self.size(handle)?;
+        self.write_at(handle, size, data)
+    }
 }
 
 struct FsStateCell(UnsafeCell<FsState>);
@@ -116,6 +157,7 @@ struct FsState {
     backend: FsBackend,
     ramfs: RamFs,
     diskfs: DiskFs,
+    next_metadata_flush_tick: u64,
 }
 
 impl FsState {
@@ -125,6 +167,7 @@ impl FsState {
             backend: FsBackend::RamFs,
             ramfs: RamFs::new(),
             diskfs: DiskFs::new(),
+            next_metadata_flush_tick: 0,
         }
     }
 
@@ -166,16 +209,18 @@ impl FsState {
                 storage_backed: false,
                 file_count: self.ramfs.file_count(),
                 used_bytes: self.ramfs.used_bytes(),
-                max_files: MAX_FILES,
-                max_file_bytes: MAX_FILE_BYTES,
+                free_bytes: self.ramfs.free_bytes(),
+                max_files: ramfs::MAX_FILES,
+                max_file_bytes: ramfs::MAX_FILE_BYTES,
             },
             FsBackend::DiskFs => FsInitReport {
-                backend: "diskfs-v0",
+                backend: "diskfs-v2",
                 storage_backed: true,
                 file_count: self.diskfs.file_count(),
                 used_bytes: self.diskfs.used_bytes(),
-                max_files: MAX_FILES,
-                max_file_bytes: MAX_FILE_BYTES,
+                free_bytes: self.diskfs.free_bytes(),
+                max_files: diskfs::MAX_FILES,
+                max_file_bytes: diskfs::MAX_FILE_BYTES,
             },
         }
     }
@@ -183,7 +228,7 @@ impl FsState {
     fn seed_defaults_ramfs(&mut self) {
         let _ = self.ramfs.write(
             "/README.TXT",
-            b"ArrOSt diskfs v0\nTry: ls, cat README.TXT, echo hello > NOTE.TXT\n",
+            b"ArrOSt diskfs v2\nTry: ls, cat README.TXT, echo hello > NOTE.TXT\n",
         );
         let _ = self
             .ramfs
@@ -193,7 +238,7 @@ impl FsState {
     fn seed_defaults_diskfs(&mut self) {
         let _ = self.diskfs.write(
             "/README.TXT",
-            b"ArrOSt diskfs v0\nTry: ls, cat README.TXT, echo hello > NOTE.TXT\n",
+            b"ArrOSt diskfs v2\nTry: ls, cat README.TXT, echo hello > NOTE.TXT\n",
         );
         let _ = self
             .diskfs
@@ -220,26 +265,71 @@ pub fn list_entries(out: &mut [DirEntry]) -> usize {
 }
 
 pub fn cat_to_serial(path: &str) {
-    let mut data = [0u8; MAX_FILE_BYTES];
-    match read_file(path, &mut data) {
-        Ok(len) => {
-            serial::write_fmt(format_args!("cat: {} bytes from {}\n", len, path.trim()));
-            for byte in data.iter().take(len) {
-                if *byte == b'\n' {
+    let result = open_file(path).and_then(|handle| {
+        let size = file_size(handle)?;
+        serial::write_fmt(format_args!("cat: {} bytes from {}\n", size, path.trim()));
+        let mut chunk = [0u8; STREAM_CHUNK_BYTES];
+        let mut offset = 0usize;
+        let mut last = b'\n';
+        loop {
+            let len = read_at(handle, offset, &mut chunk)?;
+            if len == 0 {
+                break;
+            }
+            for &byte in &chunk[..len] {
+                if byte == b'\n' {
                     serial::write_byte(b'\r');
                 }
-                serial::write_byte(*byte);
-            }
-            if len == 0 || data[len.saturating_sub(1)] != b'\n' {
-                serial::write_str("\n");
+                serial::write_byte(byte);
             }
+            last = chunk[len - 1];
+            offset += len;
         }
-        Err(err) => serial::write_fmt(format_args!("cat: {} ({})\n", path.trim(), err.as_str())),
+        if offset == 0 || last != b'\n' {
+            serial::write_str("\n");
+        }
+        Ok(())
+    });
+    if let Err(err) = result {
+        serial::write_fmt(format_args!("cat: {} ({})\n", path.trim(), err.as_str()));
     }
 }
 
-pub fn read_file(path: &str, out: &mut [u8]) -> Result<usize, FsError> {
-    with_vfs(|vfs| vfs.read(path, out))
+pub fn open_file(path: &str) -> Result<FileHandle, FsError> {
+    with_vfs_mut(|vfs| vfs.open(path, false))
+}
+
+/// Opens `path`, creating it empty if missing. Existing contents are kept.
+pub fn create_file(path: &str) -> Result<FileHandle, FsError> {
+    with_vfs_mut(|vfs| vfs.open(path, true))
+}
+
+pub fn file_size(handle: FileHandle) -> Result<usize, FsError> {
+    with_vfs(|vfs| vfs.size(handle))
+}
+
+pub fn read_at(handle: FileHandle, offset: usize, out: &mut [u8]) -> Result<usize, FsError> {
+    with_vfs(|vfs| vfs.read_at(handle, offset, out))
+}
+
+pub fn write_at(handle: FileHandle, offset: usize, data: &[u8]) -> Result<usize, FsError> {
+    with_vfs_mut(|vfs| vfs.write_at(handle, offset, data))
+}
+
+pub fn append(handle: FileHandle, data: &[u8]) -> Result<usize, FsError> {
+    with_vfs_mut(|vfs| vfs.append(handle, data))
+}
+
+pub fn truncate(handle: FileHandle, len: usize) -> Result<(), FsError> {
+    with_vfs_mut(|vfs| vfs.truncate(handle, len))
+}
+
+/// Largest file the active backend can hold.
+pub fn max_file_bytes() -> usize {
+    with_fs_mut(|state| match state.backend {
+        FsBackend::RamFs => ramfs::MAX_FILE_BYTES,
+        FsBackend::DiskFs => diskfs::MAX_FILE_BYTES,
+    })
 }
 
 pub fn write_from_echo(path: &str, text: &str) {
@@ -253,14 +343,45 @@ pub fn write_from_echo(path: &str, text: &str) {
     }
 }
 
+pub fn append_from_echo(path: &str, text: &str) {
+    let result = create_file(path).and_then(|handle| {
+        let written = append(handle, text.as_bytes())?;
+        append(handle, b"\n")?;
+        Ok(written + 1)
+    });
+    match result {
+        Ok(written) => serial::write_fmt(format_args!(
+            "echo: appended {} bytes to {}\n",
+            written,
+            path.trim()
+        )),
+        Err(err) => serial::write_fmt(format_args!("echo: {} ({})\n", path.trim(), err.as_str())),
+    }
+}
+
 pub fn write_file(path: &str, data: &[u8]) -> Result<usize, FsError> {
     with_vfs_mut(|vfs| vfs.write(path, data))
 }
 
+/// Streams `source` into `destination` one chunk at a time, replacing its contents.
 pub fn copy_file(source: &str, destination: &str) -> Result<usize, FsError> {
-    let mut data = [0u8; MAX_FILE_BYTES];
-    let len = read_file(source, &mut data)?;
-    write_file(destination, &data[..len])
+    let from = open_file(source)?;
+    let to = create_file(destination)?;
+    if from == to {
+        return file_size(from);
+    }
+    let mut chunk = [0u8; STREAM_CHUNK_BYTES];
+    let mut offset = 0usize;
+    loop {
+        let len = read_at(from, offset, &mut chunk)?;
+        if len == 0 {
+            break;
+        }
+        write_at(to, offset, &chunk[..len])?;
+        offset += len;
+    }
+    truncate(to, offset)?;
+    Ok(offset)
 }
 
 pub fn copy_file_to_serial(source: &str, destination: &str) {
@@ -295,16 +416,110 @@ pub fn delete_file_to_serial(path: &str) {
     }
 }
 
-pub fn sync_to_disk_to_serial() {
-    match with_fs_mut(|state| match state.backend {
-        FsBackend::DiskFs => state.diskfs.sync_metadata(),
+/// Periodic main-loop hook: writes coalesced diskfs directory updates into the block cache.
+pub fn poll(now_ticks: u64) {
+    with_fs_mut(|state| {
+        if !matches!(state.backend, FsBackend::DiskFs) || now_ticks < state.next_metadata_flush_tick
+        {
+            return;
+        }
+        state.next_metadata_flush_tick = now_ticks.saturating_add(METADATA_FLUSH_TICKS);
+        let _ = state.diskfs.flush_metadata();
+    });
+}
+
+/// Saves diskfs metadata and writes every dirty cached sector to the device. Returns the
+/// number of sectors flushed.
+fn sync_to_disk() -> Result<usize, FsError> {
+    with_fs_mut(|state| match state.backend {
+        FsBackend::DiskFs => state
+            .diskfs
+            .sync_metadata()
+            .and_then(|()| storage::flush().map_err(|_| FsError::StorageIo)),
         FsBackend::RamFs => Err(FsError::StorageUnavailable),
-    }) {
-        Ok(()) => serial::write_line("sync: diskfs metadata saved"),
+    })
+}
+
+pub fn sync_to_disk_to_serial() {
+    match sync_to_disk() {
+        Ok(flushed) => serial::write_fmt(format_args!(
+            "sync: diskfs metadata saved flushed_sectors={}\n",
+            flushed
+        )),
         Err(err) => serial::write_fmt(format_args!("sync: failed ({})\n", err.as_str())),
     }
 }
 
+/// Times writing `kib` KiB to a scratch file (synced to disk on diskfs) and reading it back.
+/// Sizes well past the 64 KiB block cache keep most reads on the device.
+pub fn bench_to_serial(kib: usize) {
+    let bytes = kib.saturating_mul(1024);
+    let (backend, storage_backed) = with_fs_mut(|state| {
+        let report = state.report();
+        (report.backend, report.storage_backed)
+    });
+    let result = create_file(BENCH_PATH).and_then(|handle| {
+        let timed = bench_file(handle, bytes, storage_backed);
+        let _ = delete_file(BENCH_PATH);
+        timed
+    });
+    match result {
+        Ok((write_ns, read_ns)) => serial::write_fmt(format_args!(
+            "fs: bench backend={} bytes={} write_ns={} read_ns={} write_kib_s={} read_kib_s={}\n",
+            backend,
+            bytes,
+            write_ns,
+            read_ns,
+            kib_per_second(bytes, write_ns),
+            kib_per_second(bytes, read_ns)
+        )),
+        Err(err) => serial::write_fmt(format_args!("fs: bench failed ({})\n", err.as_str())),
+    }
+}
+
+/// Writes a position-dependent pattern, syncs it when `sync` is set, then reads it back and
+/// checks it. Returns the nanoseconds of each phase.
+fn bench_file(handle: FileHandle, bytes: usize, sync: bool) -> Result<(u64, u64), FsError> {
+    truncate(handle, 0)?;
+    let mut chunk = [0u8; BENCH_CHUNK_BYTES];
+    let mut expected = [0u8; BENCH_CHUNK_BYTES];
+    let write_start = time::monotonic_ns();
+    let mut offset = 0usize;
+    while offset < bytes {
+        let len = chunk.len().min(bytes - offset);
+        fill_bench_pattern(&mut chunk[..len], offset);
+        write_at(handle, offset, &chunk[..len])?;
+        offset += len;
+    }
+    if sync {
+        sync_to_disk()?;
+    }
+    let write_ns = time::monotonic_ns().saturating_sub(write_start);
+    let read_start = time::monotonic_ns();
+    offset = 0;
+    while offset < bytes {
+        let len = read_at(handle, offset, &mut chunk)?;
+        fill_bench_pattern(&mut expected[..len], offset);
+        if len == 0 || chunk[..len] != expected[..len] {
+            return Err(FsError::DiskCorrupt);
+        }
+        offset += len;
+    }
+    Ok((write_ns, time::monotonic_ns().saturating_sub(read_start)))
+}
+
+/// Differs in every sector, so a misplaced or stale block fails the check.
+fn fill_bench_pattern(out: &mut [u8], offset: usize) {
+    for (index, byte) in out.iter_mut().enumerate() {
+        let position = offset + index;
+        *byte = position as u8 ^ (position / storage::SECTOR_SIZE) as u8;
+    }
+}
+
+fn kib_per_second(bytes: usize, elapsed_ns: u64) -> u64 {
+    (bytes as u64).saturating_mul(1_000_000_000) / elapsed_ns.max(1) / 1024
+}
+
 pub fn reload_from_disk_to_serial() {
     match with_fs_mut(|state| match state.backend {
         FsBackend::DiskFs => state.diskfs.remount(),
@@ -344,32 +559,3 @@ fn with_fs_mut<R>(f: impl FnOnce(&mut FsState) -> R) -> R {
     // SAFETY: `FS_LOCK` serializes mutable access to global filesystem state.
     unsafe { f(&mut *FS_STATE.0.get()) }
 }
-
-struct SpinLock {
-    locked: AtomicBool,
-}
-
-impl SpinLock {
-    const fn new() -> Self {
-        Self {
-            locked: AtomicBool::new(false),
-        }
-    }
-
-    fn lock(&self) -> SpinLockGuard<'_> {
-        while self.locked.swap(true, Ordering::Acquire) {
-            spin_loop();
-        }
-        SpinLockGuard { lock: self }
-    }
-}
-
-struct SpinLockGuard<'a> {
-    lock: &'a SpinLock,
-}
-
-impl Drop for SpinLockGuard<'_> {
-    fn drop(&mut self) {
-        self.lock.locked.store(false, Ordering::Release);
-    }
-}
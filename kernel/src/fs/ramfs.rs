@@ -1,5 +1,5 @@
 // kernel/src/fs/ramfs.rs: fixed-capacity in-memory filesystem for M5.
-use super::{DirEntry, FsError, Vfs};
+use super::{DirEntry, FileHandle, FsError, Vfs};
 
 pub const MAX_FILES: usize = 16;
 pub const MAX_FILE_NAME_BYTES: usize = 48;
@@ -12,6 +12,7 @@ struct RamFile {
     name_len: usize,
     data: [u8; MAX_FILE_BYTES],
     data_len: usize,
+    id: u32,
 }
 
 impl RamFile {
@@ -22,6 +23,7 @@ impl RamFile {
             name_len: 0,
             data: [0; MAX_FILE_BYTES],
             data_len: 0,
+            id: 0,
         }
     }
 
@@ -34,15 +36,23 @@ impl RamFile {
 
 pub struct RamFs {
     files: [RamFile; MAX_FILES],
+    next_id: u32,
 }
 
 impl RamFs {
     pub const fn new() -> Self {
         Self {
             files: [RamFile::empty(); MAX_FILES],
+            next_id: 1,
         }
     }
 
+    /// Bytes available to new files; each file owns a fixed `MAX_FILE_BYTES` slot.
+    pub fn free_bytes(&self) -> u64 {
+        let free_slots = self.files.iter().filter(|file| !file.used).count();
+        (free_slots * MAX_FILE_BYTES) as u64
+    }
+
     fn normalize_name(path: &str) -> Result<&str, FsError> {
         let trimmed = path.trim();
         let name = match trimmed.strip_prefix('/') {
@@ -80,6 +90,23 @@ impl RamFs {
         None
     }
 
+    fn create_slot(&mut self, name: &str, data: &[u8]) -> Result<usize, FsError> {
+        let Some(index) = self.find_free_slot() else {
+            return Err(FsError::NoSpace);
+        };
+        Self::write_slot(&mut self.files[index], name, data);
+        self.files[index].id = self.next_id;
+        self.next_id = self.next_id.wrapping_add(1);
+        Ok(index)
+    }
+
+    fn file_for(&self, handle: FileHandle) -> Result<usize, FsError> {
+        match self.files.get(handle.slot) {
+            Some(file) if file.used && file.id == handle.id => Ok(handle.slot),
+            _ => Err(FsError::StaleHandle),
+        }
+    }
+
     fn write_slot(file: &mut RamFile, name: &str, data: &[u8]) {
         file.clear();
         file.used = true;
@@ -108,19 +135,6 @@ impl Vfs for RamFs {
         written
     }
 
-    fn read(&self, path: &str, out: &mut [u8]) -> Result<usize, FsError> {
-        let name = Self::normalize_name(path)?;
-        let Some(index) = self.find_index(name) else {
-            return Err(FsError::NotFound);
-        };
-        let file = &self.files[index];
-        if out.len() < file.data_len {
-            return Err(FsError::BufferTooSmall);
-        }
-        out[..file.data_len].copy_from_slice(&file.data[..file.data_len]);
-        Ok(file.data_len)
-    }
-
     fn write(&mut self, path: &str, data: &[u8]) -> Result<usize, FsError> {
         if data.len() > MAX_FILE_BYTES {
             return Err(FsError::FileTooLarge);
@@ -130,10 +144,7 @@ impl Vfs for RamFs {
             Self::write_slot(&mut self.files[index], name, data);
             return Ok(data.len());
         }
-        let Some(index) = self.find_free_slot() else {
-            return Err(FsError::NoSpace);
-        };
-        Self::write_slot(&mut self.files[index], name, data);
+        self.create_slot(name, data)?;
         Ok(data.len())
     }
 
@@ -157,4 +168,64 @@ impl Vfs for RamFs {
             .map(|file| file.data_len)
             .sum()
     }
+
+    fn open(&mut self, path: &str, create: bool) -> Result<FileHandle, FsError> {
+        let name = Self::normalize_name(path)?;
+        let slot = match self.find_index(name) {
+            Some(index) => index,
+            None if create => self.create_slot(name, &[])?,
+            None => return Err(FsError::NotFound),
+        };
+        Ok(FileHandle {
+            slot,
+            id: self.files[slot].id,
+        })
+    }
+
+    fn size(&self, handle: FileHandle) -> Result<usize, FsError> {
+        Ok(self.files[self.file_for(handle)?].data_len)
+    }
+
+    fn read_at(&self, handle: FileHandle, offset: usize, out: &mut [u8]) -> Result<usize, FsError> {
+        let file = &self.files[self.file_for(handle)?];
+        if offset >= file.data_len {
+            return Ok(0);
+        }
+        let len = out.len().min(file.data_len - offset);
+        out[..len].copy_from_slice(&file.data[offset..offset + len]);
+        Ok(len)
+    }
+
+    fn write_at(
+        &mut self,
+        handle: FileHandle,
+        offset: usize,
+        data: &[u8],
+    ) -> Result<usize, FsError> {
+        let index = self.file_for(handle)?;
+        let end = offset.saturating_add(data.len());
+        if end > MAX_FILE_BYTES {
+            return Err(FsError::FileTooLarge);
+        }
+        let file = &mut self.files[index];
+        if offset > file.data_len {
+            file.data[file.data_len..offset].fill(0);
+        }
+        file.data[offset..end].copy_from_slice(data);
+        file.data_len = file.data_len.max(end);
+        Ok(data.len())
+    }
+
+    fn truncate(&mut self, handle: FileHandle, len: usize) -> Result<(), FsError> {
+        let index = self.file_for(handle)?;
+        if len > MAX_FILE_BYTES {
+            return Err(FsError::FileTooLarge);
+        }
+        let file = &mut self.files[index];
+        if len > file.data_len {
+            file.data[file.data_len..len].fill(0);
+        }
+        file.data_len = len;
+        Ok(())
+    }
 }
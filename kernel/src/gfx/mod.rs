@@ -1,8 +1,13 @@
 // kernel/src/gfx/mod.rs: M8 framebuffer desktop with minimal compositor/event queue.
 use crate::doom;
+use crate::doom_bridge;
 use crate::mouse;
+use crate::proc::sched;
 use crate::serial;
+use crate::sync::SpinLock;
+use crate::sync::spsc::SpscRing;
 use crate::time;
+use crate::trace::{self, Span};
 use alloc::vec::Vec;
 use bootloader_api::{
     BootInfo,
@@ -11,6 +16,10 @@ use bootloader_api::{
 use core::cell::UnsafeCell;
 use core::cmp::min;
 
+mod scale;
+
+pub use scale::Scaler;
+
 const WINDOW_COUNT: usize = 3;
 const SHELL_WINDOW_INDEX: usize = 0;
 const FILE_MANAGER_WINDOW_INDEX: usize = 1;
@@ -18,10 +27,13 @@ const DOOM_WINDOW_INDEX: usize = 2;
 const WINDOW_MAX_COLS: usize = 96;
 const WINDOW_MAX_ROWS: usize = 32;
 const INPUT_EVENT_CAPACITY: usize = 128;
+/// Serial mirror bytes drained per batch.
+const MIRROR_BATCH: usize = 256;
 const DAMAGE_CAPACITY: usize = 24;
 const CHAR_W: usize = 6;
 const CHAR_H: usize = 8;
 const TITLE_BAR_HEIGHT: usize = 18;
+const TOP_BAR_HEIGHT: usize = 26;
 const WINDOW_PADDING: usize = 8;
 const MIN_WINDOW_WIDTH: usize = 220;
 const MIN_WINDOW_HEIGHT: usize = 140;
@@ -31,9 +43,11 @@ const MINIMIZED_WINDOW_HEIGHT: usize = TITLE_BAR_HEIGHT + 2;
 const DOUBLE_CLICK_TICKS: u64 = 25;
 const POINTER_RECT_SIZE: usize = 8;
 const DAMAGE_MERGE_PAD: usize = 12;
+/// Nearby damage rects merge only while the union repaints at most this share of extra pixels.
+const DAMAGE_MERGE_WASTE_PCT: usize = 25;
 const MAX_BACKBUFFER_BYTES: usize = 8 * 1024 * 1024;
-const DOOM_VIEW_MAX_W: usize = 320;
-const DOOM_VIEW_MAX_H: usize = 200;
+pub const DOOM_VIEW_MAX_W: usize = 320;
+pub const DOOM_VIEW_MAX_H: usize = 200;
 const DOOM_VIEW_MAX_PIXELS: usize = DOOM_VIEW_MAX_W * DOOM_VIEW_MAX_H;
 
 #[derive(Clone, Copy)]
@@ -69,48 +83,125 @@ fn color_from_rgb24(pixel: u32) -> Color {
     )
 }
 
-fn bilinear_channel(c00: u8, c10: u8, c01: u8, c11: u8, wx: u32, wy: u32) -> u8 {
-    let one = 1u64 << 16;
-    let inv_wx = one.saturating_sub(wx as u64);
-    let inv_wy = one.saturating_sub(wy as u64);
-
-    let top = ((u64::from(c00).saturating_mul(inv_wx) + u64::from(c10).saturating_mul(wx as u64))
-        .saturating_add(1u64 << 15))
-        >> 16;
-    let bottom = ((u64::from(c01).saturating_mul(inv_wx)
-        + u64::from(c11).saturating_mul(wx as u64))
-    .saturating_add(1u64 << 15))
-        >> 16;
-    (((top.saturating_mul(inv_wy) + bottom.saturating_mul(wy as u64)).saturating_add(1u64 << 15))
-        >> 16) as u8
+/// Framebuffer channel order, resolved once from `PixelFormat` so spans encode a color once.
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum PixelEncoding {
+    Rgb,
+    Bgr,
+    Gray,
 }
 
-fn bilinear_rgb24(c00: u32, c10: u32, c01: u32, c11: u32, wx: u32, wy: u32) -> Color {
-    let r = bilinear_channel(
-        ((c00 >> 16) & 0xFF) as u8,
-        ((c10 >> 16) & 0xFF) as u8,
-        ((c01 >> 16) & 0xFF) as u8,
-        ((c11 >> 16) & 0xFF) as u8,
-        wx,
-        wy,
-    );
-    let g = bilinear_channel(
-        ((c00 >> 8) & 0xFF) as u8,
-        ((c10 >> 8) & 0xFF) as u8,
-        ((c01 >> 8) & 0xFF) as u8,
-        ((c11 >> 8) & 0xFF) as u8,
-        wx,
-        wy,
-    );
-    let b = bilinear_channel(
-        (c00 & 0xFF) as u8,
-        (c10 & 0xFF) as u8,
-        (c01 & 0xFF) as u8,
-        (c11 & 0xFF) as u8,
-        wx,
-        wy,
-    );
-    Color::rgb(r, g, b)
+impl PixelEncoding {
+    fn from_format(format: PixelFormat) -> Self {
+        match format {
+            PixelFormat::Bgr => Self::Bgr,
+            PixelFormat::U8 => Self::Gray,
+            _ => Self::Rgb,
+        }
+    }
+
+    /// Packs `color` as the little-endian bytes stored for one framebuffer pixel.
+    fn pack(self, color: Color) -> u32 {
+        match self {
+            Self::Rgb => u32::from(color.r) | u32::from(color.g) << 8 | u32::from(color.b) << 16,
+            Self::Bgr => u32::from(color.b) | u32::from(color.g) << 8 | u32::from(color.r) << 16,
+            Self::Gray => (u32::from(color.r) + u32::from(color.g) + u32::from(color.b)) / 3,
+        }
+    }
+
+    /// Packs a `0x00RRGGBB` Doom pixel; BGR framebuffers store it unchanged.
+    fn pack_rgb24(self, pixel: u32) -> u32 {
+        match self {
+            Self::Bgr => pixel & 0x00FF_FFFF,
+            Self::Rgb => ((pixel & 0xFF) << 16) | (pixel & 0xFF00) | ((pixel >> 16) & 0xFF),
+            Self::Gray => self.pack(color_from_rgb24(pixel)),
+        }
+    }
+}
+
+/// Writes `count` copies of a packed pixel.
+///
+/// # Safety
+/// `dst` must be valid for `count * bytes_per_pixel` bytes.
+unsafe fn fill_packed(dst: *mut u8, bytes_per_pixel: usize, packed: u32, count: usize) {
+    // SAFETY: caller guarantees the destination span is in bounds.
+    unsafe {
+        match bytes_per_pixel {
+            4 => {
+                let dst = dst.cast::<u32>();
+                for index in 0..count {
+                    dst.add(index).write_unaligned(packed);
+                }
+            }
+            1 => core::ptr::write_bytes(dst, packed as u8, count),
+            _ => {
+                for index in 0..count {
+                    store_packed(dst.add(index * bytes_per_pixel), bytes_per_pixel, packed);
+                }
+            }
+        }
+    }
+}
+
+/// Writes one packed pixel.
+///
+/// # Safety
+/// `dst` must be valid for `bytes_per_pixel` bytes.
+unsafe fn store_packed(dst: *mut u8, bytes_per_pixel: usize, packed: u32) {
+    let bytes = packed.to_le_bytes();
+    // SAFETY: caller guarantees `bytes_per_pixel` writable bytes; at most 4 are copied.
+    unsafe {
+        core::ptr::copy_nonoverlapping(bytes.as_ptr(), dst, bytes_per_pixel.min(bytes.len()));
+    }
+}
+
+/// Compositor work per frame: layers skipped because they were occluded or outside the damage,
+/// and pixels actually written to the draw surface.
+#[derive(Clone, Copy)]
+struct PaintCounters {
+    layers_skipped: u64,
+    pixels_painted: u64,
+}
+
+impl PaintCounters {
+    const fn new() -> Self {
+        Self {
+            layers_skipped: 0,
+            pixels_painted: 0,
+        }
+    }
+}
+
+/// Running TSC cycle counts for one kind of frame work.
+#[derive(Clone, Copy)]
+struct FrameTiming {
+    frames: u64,
+    last_cycles: u64,
+    max_cycles: u64,
+    total_cycles: u64,
+}
+
+impl FrameTiming {
+    const fn new() -> Self {
+        Self {
+            frames: 0,
+            last_cycles: 0,
+            max_cycles: 0,
+            total_cycles: 0,
+        }
+    }
+
+    fn record(&mut self, start_tsc: u64) {
+        let cycles = time::read_tsc().saturating_sub(start_tsc);
+        self.frames = self.frames.saturating_add(1);
+        self.last_cycles = cycles;
+        self.max_cycles = self.max_cycles.max(cycles);
+        self.total_cycles = self.total_cycles.saturating_add(cycles);
+    }
+
+    fn avg_cycles(&self) -> u64 {
+        self.total_cycles / self.frames.max(1)
+    }
 }
 
 #[derive(Clone, Copy)]
@@ -161,6 +252,57 @@ impl Rect {
         !(a_x1 <= b_x0 || b_x1 <= a_x0 || a_y1 <= b_y0 || b_y1 <= a_y0)
     }
 
+    const fn area(self) -> usize {
+        self.w.saturating_mul(self.h)
+    }
+
+    fn contains(self, other: Self) -> bool {
+        other.x >= self.x
+            && other.y >= self.y
+            && other.x.saturating_add(other.w) <= self.x.saturating_add(self.w)
+            && other.y.saturating_add(other.h) <= self.y.saturating_add(self.h)
+    }
+
+    fn intersects(self, other: Self) -> bool {
+        self.intersects_or_near(other, 0)
+    }
+
+    fn overlap_area(self, other: Self) -> usize {
+        let x0 = self.x.max(other.x);
+        let y0 = self.y.max(other.y);
+        let x1 = self
+            .x
+            .saturating_add(self.w)
+            .min(other.x.saturating_add(other.w));
+        let y1 = self
+            .y
+            .saturating_add(self.h)
+            .min(other.y.saturating_add(other.h));
+        x1.saturating_sub(x0).saturating_mul(y1.saturating_sub(y0))
+    }
+
+    /// Pixels a merged bounding box would repaint that neither rect needs.
+    fn merge_waste(self, other: Self) -> usize {
+        let covered = self
+            .area()
+            .saturating_add(other.area())
+            .saturating_sub(self.overlap_area(other));
+        self.union(other).area().saturating_sub(covered)
+    }
+
+    /// Merging pays off when the rects touch and the union adds little unneeded area; an L of
+    /// two thin strips stays split instead of repainting the box around it.
+    fn should_merge(self, other: Self) -> bool {
+        if self.contains(other) || other.contains(self) {
+            return true;
+        }
+        if !self.intersects_or_near(other, DAMAGE_MERGE_PAD) {
+            return false;
+        }
+        let needed = self.area().saturating_add(other.area());
+        self.merge_waste(other) <= needed.saturating_mul(DAMAGE_MERGE_WASTE_PCT) / 100
+    }
+
     fn union(self, other: Self) -> Self {
         let x0 = self.x.min(other.x);
         let y0 = self.y.min(other.y);
@@ -370,42 +512,6 @@ impl UiWindow {
     }
 }
 
-#[derive(Clone, Copy)]
-struct ByteQueue<const CAPACITY: usize> {
-    bytes: [u8; CAPACITY],
-    head: usize,
-    tail: usize,
-}
-
-impl<const CAPACITY: usize> ByteQueue<CAPACITY> {
-    const fn new() -> Self {
-        Self {
-            bytes: [0; CAPACITY],
-            head: 0,
-            tail: 0,
-        }
-    }
-
-    fn push(&mut self, byte: u8) -> bool {
-        let next_head = (self.head + 1) % CAPACITY;
-        if next_head == self.tail {
-            return false;
-        }
-        self.bytes[self.head] = byte;
-        self.head = next_head;
-        true
-    }
-
-    fn pop(&mut self) -> Option<u8> {
-        if self.tail == self.head {
-            return None;
-        }
-        let byte = self.bytes[self.tail];
-        self.tail = (self.tail + 1) % CAPACITY;
-        Some(byte)
-    }
-}
-
 #[derive(Clone, Copy)]
 struct GfxStatus {
     width: usize,
@@ -437,6 +543,10 @@ struct GfxStatus {
     present_partial: u64,
     present_full: u64,
     double_buffer: bool,
+    redraw_timing: FrameTiming,
+    doom_view_timing: FrameTiming,
+    last_paint: PaintCounters,
+    total_paint: PaintCounters,
 }
 
 #[derive(Clone, Copy)]
@@ -481,11 +591,27 @@ impl ResizeState {
     }
 }
 
+/// Pixels handed to the Doom window.
+pub enum DoomFrame<'a> {
+    /// Caller-owned pixels, copied into the gfx view buffer (fallback renderer).
+    Pixels(&'a [u32]),
+    /// The bridge's front frame slot, read in place at draw time. Once the view is bound to
+    /// it, `poll` takes each newly published frame without any call from Doom.
+    Bridge,
+}
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum DoomViewSource {
+    Local,
+    Bridge,
+}
+
 struct DoomViewLayer {
     active: bool,
     width: usize,
     height: usize,
     filter: DoomViewFilter,
+    source: DoomViewSource,
 }
 
 impl DoomViewLayer {
@@ -495,25 +621,46 @@ impl DoomViewLayer {
             width: 0,
             height: 0,
             filter: DoomViewFilter::Nearest,
+            source: DoomViewSource::Local,
         }
     }
 
-    fn set(&mut self, width: usize, height: usize, pixels: &[u32]) -> bool {
+    /// Returns whether the view content changed and needs redrawing.
+    fn set(&mut self, width: usize, height: usize, frame: DoomFrame<'_>) -> bool {
         if width == 0 || height == 0 || width > DOOM_VIEW_MAX_W || height > DOOM_VIEW_MAX_H {
             return false;
         }
         let len = width.saturating_mul(height);
-        if pixels.len() < len {
-            return false;
-        }
+        let source = match frame {
+            DoomFrame::Pixels(pixels) => {
+                if pixels.len() < len {
+                    return false;
+                }
+                with_doom_view_pixels_mut(|storage| {
+                    storage[..len].copy_from_slice(&pixels[..len]);
+                });
+                DoomViewSource::Local
+            }
+            DoomFrame::Bridge => {
+                if len > doom_bridge::VIEWPORT_PIXELS {
+                    return false;
+                }
+                let fresh = doom_bridge::acquire_frame();
+                let unchanged = self.active
+                    && self.source == DoomViewSource::Bridge
+                    && self.width == width
+                    && self.height == height;
+                if unchanged && !fresh {
+                    return false;
+                }
+                DoomViewSource::Bridge
+            }
+        };
 
         self.active = true;
         self.width = width;
         self.height = height;
-        with_doom_view_pixels_mut(|storage| {
-            storage[..len].copy_from_slice(&pixels[..len]);
-            storage[len..DOOM_VIEW_MAX_PIXELS].fill(0);
-        });
+        self.source = source;
         true
     }
 
@@ -521,6 +668,7 @@ impl DoomViewLayer {
         self.active = false;
         self.width = 0;
         self.height = 0;
+        self.source = DoomViewSource::Local;
     }
 
     fn set_filter(&mut self, filter: DoomViewFilter) -> bool {
@@ -536,6 +684,9 @@ impl DoomViewLayer {
 pub enum DoomViewFilter {
     Bilinear,
     Nearest,
+    /// Largest whole-number scale that fits the window; each source pixel becomes an exact
+    /// block, so rows are packed once and replicated.
+    Integer,
 }
 
 impl DoomViewFilter {
@@ -543,25 +694,34 @@ impl DoomViewFilter {
         match self {
             Self::Bilinear => "bilinear",
             Self::Nearest => "nearest",
+            Self::Integer => "integer",
         }
     }
 }
 
 struct DoomViewPixelsCell(UnsafeCell<[u32; DOOM_VIEW_MAX_PIXELS]>);
 
-// SAFETY: doom view pixels are accessed only from the single-threaded graphics path.
+// SAFETY: doom view pixels are accessed only from `GfxState` methods, under `GFX_LOCK`.
 unsafe impl Sync for DoomViewPixelsCell {}
 
 static DOOM_VIEW_PIXELS: DoomViewPixelsCell =
     DoomViewPixelsCell(UnsafeCell::new([0; DOOM_VIEW_MAX_PIXELS]));
 
 fn with_doom_view_pixels<R>(f: impl FnOnce(&[u32; DOOM_VIEW_MAX_PIXELS]) -> R) -> R {
-    // SAFETY: graphics rendering runs on one thread in current milestones.
+    // SAFETY: callers hold `GFX_LOCK`, so no mutable reference to the pixels is live.
     unsafe { f(&*DOOM_VIEW_PIXELS.0.get()) }
 }
 
+/// Runs `f` over the view pixels of `source` in place.
+fn with_doom_view_source<R>(source: DoomViewSource, f: impl FnOnce(&[u32]) -> R) -> Option<R> {
+    match source {
+        DoomViewSource::Local => Some(with_doom_view_pixels(|pixels| f(pixels))),
+        DoomViewSource::Bridge => doom_bridge::with_front_frame(|pixels| f(pixels)),
+    }
+}
+
 fn with_doom_view_pixels_mut<R>(f: impl FnOnce(&mut [u32; DOOM_VIEW_MAX_PIXELS]) -> R) -> R {
-    // SAFETY: graphics rendering runs on one thread in current milestones.
+    // SAFETY: callers hold `GFX_LOCK`, so this is the only reference to the pixels.
     unsafe { f(&mut *DOOM_VIEW_PIXELS.0.get()) }
 }
 
@@ -570,11 +730,11 @@ struct GfxState {
     buffer_len: usize,
     backbuffer: Option<Vec<u8>>,
     info: FrameBufferInfo,
+    encoding: PixelEncoding,
     windows: [UiWindow; WINDOW_COUNT],
     focused_window: usize,
-    input_queue: ByteQueue<INPUT_EVENT_CAPACITY>,
+    input_queue: SpscRing<u8, INPUT_EVENT_CAPACITY>,
     events: u64,
-    dropped: u64,
     stdout_events: u64,
     frames: u64,
     pointer_x: usize,
@@ -602,6 +762,15 @@ struct GfxState {
     present_full: u64,
     doom_window_open: bool,
     doom_view: DoomViewLayer,
+    /// Scaling tables for the current Doom viewport size, rebuilt when the layout changes.
+    doom_scaler: Option<Scaler>,
+    /// Scratch row of packed pixels for scaled Doom spans.
+    span_row: Vec<u32>,
+    redraw_timing: FrameTiming,
+    doom_view_timing: FrameTiming,
+    frame_paint: PaintCounters,
+    last_paint: PaintCounters,
+    total_paint: PaintCounters,
 }
 
 impl GfxState {
@@ -633,11 +802,11 @@ impl GfxState {
             buffer_len,
             backbuffer,
             info,
+            encoding: PixelEncoding::from_format(info.pixel_format),
             windows,
             focused_window: 0,
-            input_queue: ByteQueue::new(),
+            input_queue: SpscRing::new(),
             events: 0,
-            dropped: 0,
             stdout_events: 0,
             frames: 0,
             pointer_x: info.width / 2,
@@ -665,6 +834,13 @@ impl GfxState {
             present_full: 0,
             doom_window_open: false,
             doom_view: DoomViewLayer::new(),
+            doom_scaler: None,
+            span_row: Vec::new(),
+            redraw_timing: FrameTiming::new(),
+            doom_view_timing: FrameTiming::new(),
+            frame_paint: PaintCounters::new(),
+            last_paint: PaintCounters::new(),
+            total_paint: PaintCounters::new(),
         }
     }
 
@@ -713,9 +889,7 @@ impl GfxState {
     }
 
     fn push_event(&mut self, byte: u8) {
-        if !self.input_queue.push(byte) {
-            self.dropped = self.dropped.saturating_add(1);
-        }
+        self.input_queue.push(byte);
     }
 
     fn append_mirror_byte_damage(&mut self, byte: u8) -> Option<Rect> {
@@ -729,19 +903,28 @@ impl GfxState {
     }
 
     fn process_events(&mut self) {
-        while let Some(byte) = self.input_queue.pop() {
-            self.events = self.events.saturating_add(1);
+        let mut input = [0u8; INPUT_EVENT_CAPACITY];
+        let count = self.input_queue.pop_slice(&mut input);
+        self.events = self.events.saturating_add(count as u64);
+        for &byte in &input[..count] {
             self.handle_key(byte);
         }
 
         let mut stdout_damage: Option<Rect> = None;
-        while let Some(byte) = serial::pop_mirror_byte() {
-            self.stdout_events = self.stdout_events.saturating_add(1);
-            if let Some(rect) = self.append_mirror_byte_damage(byte) {
-                stdout_damage = Some(match stdout_damage {
-                    Some(existing) => existing.union(rect),
-                    None => rect,
-                });
+        let mut mirror = [0u8; MIRROR_BATCH];
+        loop {
+            let count = serial::pop_mirror_bytes(&mut mirror);
+            if count == 0 {
+                break;
+            }
+            self.stdout_events = self.stdout_events.saturating_add(count as u64);
+            for &byte in &mirror[..count] {
+                if let Some(rect) = self.append_mirror_byte_damage(byte) {
+                    stdout_damage = Some(match stdout_damage {
+                        Some(existing) => existing.union(rect),
+                        None => rect,
+                    });
+                }
             }
         }
         if let Some(rect) = stdout_damage {
@@ -753,11 +936,32 @@ impl GfxState {
             self.handle_mouse(event);
         }
 
+        self.take_doom_frame();
+
         if self.damage_len > 0 {
             self.flush_damage();
         }
     }
 
+    /// Picks up the engine's newest frame from the bridge. A frame is taken even while the
+    /// view shows something else, so none stays pending and keeps the compositor awake.
+    fn take_doom_frame(&mut self) {
+        if !doom_bridge::acquire_frame() {
+            return;
+        }
+        if !self.doom_window_open
+            || !self.doom_view.active
+            || self.doom_view.source != DoomViewSource::Bridge
+        {
+            return;
+        }
+        let window = self.windows[DOOM_WINDOW_INDEX];
+        let damage = self
+            .doom_view_damage_rect(window)
+            .unwrap_or_else(|| self.window_rect(DOOM_WINDOW_INDEX));
+        self.invalidate_rect(damage);
+    }
+
     fn handle_key(&mut self, byte: u8) {
         if byte == b'\t' {
             self.focus_next_internal();
@@ -842,7 +1046,7 @@ impl GfxState {
         }
     }
 
-    fn set_doom_view(&mut self, width: usize, height: usize, pixels: &[u32]) {
+    fn set_doom_view(&mut self, width: usize, height: usize, frame: DoomFrame<'_>) {
         self.open_doom_window();
         let window = self.windows[DOOM_WINDOW_INDEX];
         let previous_damage = if self.doom_view.active {
@@ -850,7 +1054,7 @@ impl GfxState {
         } else {
             None
         };
-        if self.doom_view.set(width, height, pixels) {
+        if self.doom_view.set(width, height, frame) {
             let next_damage = self.doom_view_damage_rect(window);
             match (previous_damage, next_damage) {
                 (Some(previous), Some(next)) => self.invalidate_rect(previous.union(next)),
@@ -1283,7 +1487,7 @@ impl GfxState {
         };
 
         for index in 0..self.damage_len {
-            if self.damage[index].intersects_or_near(clamped, DAMAGE_MERGE_PAD) {
+            if self.damage[index].should_merge(clamped) {
                 self.damage[index] = self.damage[index].union(clamped);
                 self.damage_coalesced = self.damage_coalesced.saturating_add(1);
                 self.merge_damage_from(index);
@@ -1296,21 +1500,32 @@ impl GfxState {
             self.damage_len += 1;
             return;
         }
+
+        // Queue full: fold the new rect into whichever entry grows the least, rather than
+        // always widening the first one.
         self.damage_dropped = self.damage_dropped.saturating_add(1);
-        if self.damage_len > 0 {
-            self.damage[0] = self.damage[0].union(clamped);
-            self.damage_coalesced = self.damage_coalesced.saturating_add(1);
-            self.merge_damage_from(0);
+        let mut best = 0usize;
+        let mut best_waste = usize::MAX;
+        for index in 0..self.damage_len {
+            let waste = self.damage[index].merge_waste(clamped);
+            if waste < best_waste {
+                best = index;
+                best_waste = waste;
+            }
         }
+        self.damage[best] = self.damage[best].union(clamped);
+        self.damage_coalesced = self.damage_coalesced.saturating_add(1);
+        self.merge_damage_from(best);
     }
 
     fn merge_damage_from(&mut self, index: usize) {
         let mut next = index + 1;
         while next < self.damage_len {
-            if self.damage[index].intersects_or_near(self.damage[next], DAMAGE_MERGE_PAD) {
+            if self.damage[index].should_merge(self.damage[next]) {
                 self.damage[index] = self.damage[index].union(self.damage[next]);
                 self.remove_damage_at(next);
                 self.damage_coalesced = self.damage_coalesced.saturating_add(1);
+                next = index + 1;
             } else {
                 next += 1;
             }
@@ -1339,25 +1554,72 @@ impl GfxState {
 
     fn flush_damage(&mut self) {
         self.coalesce_damage_queue();
+        if self.damage_len == 0 {
+            return;
+        }
+        let start_tsc = time::read_tsc();
         for index in 0..self.damage_len {
             self.redraw_region(self.damage[index]);
         }
         self.damage_len = 0;
+        self.redraw_timing.record(start_tsc);
+        self.finish_paint_frame();
+    }
+
+    /// Opaque footprint of window `index` (frame and body; the shadow is not fully covering).
+    fn window_opaque_rect(&self, index: usize) -> Rect {
+        let window = self.windows[index];
+        Rect::new(window.x, window.y, window.w, window.h)
+    }
+
+    /// Lowest layer that must be painted for `rect`: 0 = desktop, 1 = top bar, 2 + i = window
+    /// `i`. Everything below the topmost layer that fully covers `rect` is hidden.
+    fn first_visible_layer(&self, rect: Rect) -> usize {
+        for index in (0..WINDOW_COUNT).rev() {
+            if self.window_visible(index) && self.window_opaque_rect(index).contains(rect) {
+                return 2 + index;
+            }
+        }
+        if Rect::new(0, 0, self.info.width, TOP_BAR_HEIGHT).contains(rect) {
+            return 1;
+        }
+        0
     }
 
     fn redraw_region(&mut self, rect: Rect) {
+        let _span = trace::span(Span::GfxRedrawRegion);
         self.clip = Some(rect);
-        self.draw_desktop_background();
-        self.draw_top_bar();
+        let first_layer = self.first_visible_layer(rect);
+        let mut skipped = first_layer.min(2) as u64;
+        if first_layer == 0 {
+            self.draw_desktop_background();
+        }
+        if first_layer <= 1 {
+            self.draw_top_bar();
+        }
 
         for index in 0..WINDOW_COUNT {
             if !self.window_visible(index) {
                 continue;
             }
+            // Windows under an opaque cover, or whose frame and shadow miss the rect entirely,
+            // contribute no pixels.
+            let window = self.windows[index];
+            let footprint = Rect::new(
+                window.x,
+                window.y,
+                window.w.saturating_add(4),
+                window.h.saturating_add(4),
+            );
+            if 2 + index < first_layer || !footprint.intersects(rect) {
+                skipped += 1;
+                continue;
+            }
             let focused = index == self.focused_window;
-            self.draw_window(index, self.windows[index], focused);
+            self.draw_window(index, window, focused);
         }
         self.draw_pointer();
+        self.frame_paint.layers_skipped = self.frame_paint.layers_skipped.saturating_add(skipped);
 
         self.clip = None;
         self.present_rect(rect);
@@ -1418,7 +1680,7 @@ impl GfxState {
             pixel_format: pixel_format_name(self.info.pixel_format),
             focused_window: self.focused_window + 1,
             events: self.events,
-            dropped: self.dropped,
+            dropped: self.input_queue.dropped(),
             stdout_events: self.stdout_events,
             stdout_dropped: serial::mirror_dropped(),
             frames: self.frames,
@@ -1440,10 +1702,15 @@ impl GfxState {
             present_partial: self.present_partial,
             present_full: self.present_full,
             double_buffer: self.backbuffer.is_some(),
+            redraw_timing: self.redraw_timing,
+            doom_view_timing: self.doom_view_timing,
+            last_paint: self.last_paint,
+            total_paint: self.total_paint,
         }
     }
 
     fn redraw(&mut self) {
+        let start_tsc = time::read_tsc();
         self.clip = None;
         self.draw_desktop_background();
         self.draw_top_bar();
@@ -1461,6 +1728,29 @@ impl GfxState {
         self.frames = self.frames.saturating_add(1);
         self.full_redraws = self.full_redraws.saturating_add(1);
         self.present_full = self.present_full.saturating_add(1);
+        self.redraw_timing.record(start_tsc);
+        self.finish_paint_frame();
+    }
+
+    fn finish_paint_frame(&mut self) {
+        let frame = self.frame_paint;
+        self.last_paint = frame;
+        self.total_paint.layers_skipped = self
+            .total_paint
+            .layers_skipped
+            .saturating_add(frame.layers_skipped);
+        self.total_paint.pixels_painted = self
+            .total_paint
+            .pixels_painted
+            .saturating_add(frame.pixels_painted);
+        self.frame_paint = PaintCounters::new();
+    }
+
+    fn count_painted(&mut self, pixels: usize) {
+        self.frame_paint.pixels_painted = self
+            .frame_paint
+            .pixels_painted
+            .saturating_add(pixels as u64);
     }
 
     fn draw_desktop_background(&mut self) {
@@ -1500,7 +1790,7 @@ impl GfxState {
 
     fn draw_top_bar(&mut self) {
         let bar = Color::rgb(9, 22, 40);
-        self.fill_rect(0, 0, self.info.width, 26, bar);
+        self.fill_rect(0, 0, self.info.width, TOP_BAR_HEIGHT, bar);
         self.draw_text(
             10,
             8,
@@ -1645,16 +1935,24 @@ impl GfxState {
         let src_h = self.doom_view.height as u64;
         let body_w_u64 = body_w as u64;
         let body_h_u64 = body_h as u64;
-        let (draw_w, draw_h) =
-            if body_w_u64.saturating_mul(src_h) <= body_h_u64.saturating_mul(src_w) {
-                let width = body_w.max(1);
-                let height = ((body_w_u64.saturating_mul(src_h) / src_w) as usize).max(1);
-                (width, height)
-            } else {
-                let height = body_h.max(1);
-                let width = ((body_h_u64.saturating_mul(src_w) / src_h) as usize).max(1);
-                (width, height)
-            };
+        let scale = min(
+            body_w / self.doom_view.width,
+            body_h / self.doom_view.height,
+        );
+        let (draw_w, draw_h) = if self.doom_view.filter == DoomViewFilter::Integer && scale > 0 {
+            (
+                self.doom_view.width.saturating_mul(scale),
+                self.doom_view.height.saturating_mul(scale),
+            )
+        } else if body_w_u64.saturating_mul(src_h) <= body_h_u64.saturating_mul(src_w) {
+            let width = body_w.max(1);
+            let height = ((body_w_u64.saturating_mul(src_h) / src_w) as usize).max(1);
+            (width, height)
+        } else {
+            let height = body_h.max(1);
+            let width = ((body_h_u64.saturating_mul(src_w) / src_h) as usize).max(1);
+            (width, height)
+        };
         if draw_w == 0 || draw_h == 0 {
             return None;
         }
@@ -1700,83 +1998,83 @@ impl GfxState {
         );
         self.fill_rect(draw_x, draw_y, draw_w, draw_h, panel_color);
 
-        with_doom_view_pixels(|pixels| {
-            if draw_w == src_w && draw_h == src_h {
-                for y in 0..src_h {
-                    for x in 0..src_w {
-                        let source =
-                            pixels[y.saturating_mul(src_w).saturating_add(x)] & 0x00FF_FFFF;
-                        self.write_pixel(
-                            draw_x.saturating_add(x),
-                            draw_y.saturating_add(y),
-                            color_from_rgb24(source),
-                        );
-                    }
-                }
+        let (clip_x0, clip_y0, clip_x1, clip_y1) = self.clip_bounds();
+        let x_start = draw_x.max(clip_x0);
+        let x_end = draw_x.saturating_add(draw_w).min(clip_x1);
+        let y_start = draw_y.max(clip_y0);
+        let y_end = draw_y.saturating_add(draw_h).min(clip_y1);
+        if x_start < x_end && y_start < y_end {
+            let start_tsc = time::read_tsc();
+            // Only the clipped part of the viewport is scaled; each row is packed into the
+            // scratch span and stored with one bounds check.
+            let span_len = x_end - x_start;
+            let dx0 = x_start - draw_x;
+            let encoding = self.encoding;
+            let mut row = core::mem::take(&mut self.span_row);
+            row.clear();
+            row.resize(span_len, 0);
+            let filter = self.doom_view.filter;
+            let integer_scale =
+                (draw_w % src_w == 0 && draw_h % src_h == 0 && draw_w / src_w == draw_h / src_h)
+                    .then_some(draw_w / src_w);
+            let integer_scale =
+                integer_scale.filter(|scale| *scale == 1 || filter != DoomViewFilter::Bilinear);
+            let scaler = if integer_scale.is_some() {
+                None
             } else {
-                let src_w_last = src_w.saturating_sub(1);
-                let src_h_last = src_h.saturating_sub(1);
-                let draw_w_den = draw_w.saturating_sub(1).max(1) as u64;
-                let draw_h_den = draw_h.saturating_sub(1).max(1) as u64;
-                let step_x_fp =
-                    ((src_w_last as u64).saturating_mul(1u64 << 16) / draw_w_den) as u32;
-                let step_y_fp =
-                    ((src_h_last as u64).saturating_mul(1u64 << 16) / draw_h_den) as u32;
-                let x_last_fp = (src_w_last as u32).saturating_mul(1u32 << 16);
-                let y_last_fp = (src_h_last as u32).saturating_mul(1u32 << 16);
-                let mut sy_fp = 0u32;
-                if self.doom_view.filter == DoomViewFilter::Nearest {
-                    for y in 0..draw_h {
-                        let sy_cur = if y + 1 == draw_h { y_last_fp } else { sy_fp };
-                        let sy = (((sy_cur as u64).saturating_add(1u64 << 15)) >> 16) as usize;
-                        let row = sy.min(src_h_last).saturating_mul(src_w);
-                        let mut sx_fp = 0u32;
-                        for x in 0..draw_w {
-                            let sx_cur = if x + 1 == draw_w { x_last_fp } else { sx_fp };
-                            let sx = (((sx_cur as u64).saturating_add(1u64 << 15)) >> 16) as usize;
-                            let source =
-                                pixels[row.saturating_add(sx.min(src_w_last))] & 0x00FF_FFFF;
-                            self.write_pixel(
-                                draw_x.saturating_add(x),
-                                draw_y.saturating_add(y),
-                                color_from_rgb24(source),
-                            );
-                            sx_fp = sx_fp.saturating_add(step_x_fp);
-                        }
-                        sy_fp = sy_fp.saturating_add(step_y_fp);
+                match self.doom_scaler.take() {
+                    Some(scaler) if scaler.matches(src_w, src_h, draw_w, draw_h, filter) => {
+                        Some(scaler)
                     }
-                } else {
-                    for y in 0..draw_h {
-                        let sy_cur = if y + 1 == draw_h { y_last_fp } else { sy_fp };
-                        let y0 = ((sy_cur >> 16) as usize).min(src_h_last);
-                        let y1 = (y0 + 1).min(src_h_last);
-                        let wy = sy_cur & 0xFFFF;
-                        let row0 = y0.saturating_mul(src_w);
-                        let row1 = y1.saturating_mul(src_w);
-                        let mut sx_fp = 0u32;
-                        for x in 0..draw_w {
-                            let sx_cur = if x + 1 == draw_w { x_last_fp } else { sx_fp };
-                            let x0 = ((sx_cur >> 16) as usize).min(src_w_last);
-                            let x1 = (x0 + 1).min(src_w_last);
-                            let wx = sx_cur & 0xFFFF;
-
-                            let c00 = pixels[row0.saturating_add(x0)] & 0x00FF_FFFF;
-                            let c10 = pixels[row0.saturating_add(x1)] & 0x00FF_FFFF;
-                            let c01 = pixels[row1.saturating_add(x0)] & 0x00FF_FFFF;
-                            let c11 = pixels[row1.saturating_add(x1)] & 0x00FF_FFFF;
-
-                            self.write_pixel(
-                                draw_x.saturating_add(x),
-                                draw_y.saturating_add(y),
-                                bilinear_rgb24(c00, c10, c01, c11, wx, wy),
-                            );
-                            sx_fp = sx_fp.saturating_add(step_x_fp);
+                    _ => Some(Scaler::new(src_w, src_h, draw_w, draw_h, filter)),
+                }
+            };
+            let view = with_doom_view_source(self.doom_view.source, |pixels| {
+                if let Some(scale) = integer_scale {
+                    // Source pixels map to exact scale x scale blocks: each source row is
+                    // packed once and every destination row of its block reuses it.
+                    let mut packed_sy = usize::MAX;
+                    for y in y_start..y_end {
+                        let sy = (y - draw_y) / scale;
+                        if sy != packed_sy {
+                            let src_row = &pixels[sy * src_w..(sy + 1) * src_w];
+                            let mut sx = dx0 / scale;
+                            let mut phase = dx0 % scale;
+                            let mut packed = encoding.pack_rgb24(src_row[sx]);
+                            for out in row.iter_mut() {
+                                if phase == scale {
+                                    phase = 0;
+                                    sx += 1;
+                                    packed = encoding.pack_rgb24(src_row[sx]);
+                                }
+                                *out = packed;
+                                phase += 1;
+                            }
+                            packed_sy = sy;
                         }
-                        sy_fp = sy_fp.saturating_add(step_y_fp);
+                        self.write_span(y, x_start, &row);
                     }
+                    return;
+                }
+
+                let Some(scaler) = scaler.as_ref() else {
+                    return;
+                };
+                for y in y_start..y_end {
+                    scaler.scale_row(pixels, y - draw_y, dx0, &mut row, |rgb| {
+                        encoding.pack_rgb24(rgb)
+                    });
+                    self.write_span(y, x_start, &row);
                 }
+            });
+            self.span_row = row;
+            if scaler.is_some() {
+                self.doom_scaler = scaler;
             }
-        });
+            if view.is_some() {
+                self.doom_view_timing.record(start_tsc);
+            }
+        }
 
         self.draw_text(
             draw_x,
@@ -1840,29 +2138,18 @@ impl GfxState {
             return;
         }
 
-        let mut start_x = min(x, self.info.width);
-        let mut start_y = min(y, self.info.height);
-        let mut end_x = min(x.saturating_add(width), self.info.width);
-        let mut end_y = min(y.saturating_add(height), self.info.height);
-
-        if let Some(clip) = self.clip {
-            let clip_x0 = clip.x;
-            let clip_y0 = clip.y;
-            let clip_x1 = clip.x.saturating_add(clip.w).min(self.info.width);
-            let clip_y1 = clip.y.saturating_add(clip.h).min(self.info.height);
-            start_x = start_x.max(clip_x0);
-            start_y = start_y.max(clip_y0);
-            end_x = end_x.min(clip_x1);
-            end_y = end_y.min(clip_y1);
-        }
+        let (clip_x0, clip_y0, clip_x1, clip_y1) = self.clip_bounds();
+        let start_x = x.max(clip_x0);
+        let start_y = y.max(clip_y0);
+        let end_x = x.saturating_add(width).min(clip_x1);
+        let end_y = y.saturating_add(height).min(clip_y1);
         if end_x <= start_x || end_y <= start_y {
             return;
         }
 
+        let packed = self.encoding.pack(color);
         for yy in start_y..end_y {
-            for xx in start_x..end_x {
-                self.write_pixel(xx, yy, color);
-            }
+            self.fill_span(yy, start_x, end_x, packed);
         }
     }
 
@@ -1891,127 +2178,142 @@ impl GfxState {
 
     fn draw_char(&mut self, x: usize, y: usize, byte: u8, fg: Color, bg: Option<Color>) {
         let glyph = glyph_rows(byte);
-        for (row, bits) in glyph.iter().copied().enumerate() {
-            for col in 0..5 {
-                let on = (bits & (1 << (4 - col))) != 0;
-                let px = x.saturating_add(col);
-                let py = y.saturating_add(row);
-                if on {
-                    self.write_pixel(px, py, fg);
-                } else if let Some(bg_color) = bg {
-                    self.write_pixel(px, py, bg_color);
-                }
-            }
-            if let Some(bg_color) = bg {
-                self.write_pixel(x.saturating_add(5), y.saturating_add(row), bg_color);
-            }
+        let (clip_x0, clip_y0, clip_x1, clip_y1) = self.clip_bounds();
+        // With a background the cell is 6x8 (glyph plus spacing column and row), otherwise
+        // only lit glyph pixels are written.
+        let (cell_w, cell_h) = if bg.is_some() {
+            (CHAR_W, CHAR_H)
+        } else {
+            (5, glyph.len())
+        };
+        let col_start = x.max(clip_x0);
+        let col_end = x.saturating_add(cell_w).min(clip_x1);
+        if col_start >= col_end {
+            return;
         }
-        if let Some(bg_color) = bg {
-            for col in 0..6 {
-                self.write_pixel(
-                    x.saturating_add(col),
-                    y.saturating_add(CHAR_H - 1),
-                    bg_color,
-                );
+        let fg = self.encoding.pack(fg);
+        let bg = bg.map(|color| self.encoding.pack(color));
+        let bytes_per_pixel = self.info.bytes_per_pixel;
+        let mut painted = 0usize;
+
+        for row in 0..cell_h {
+            let py = y.saturating_add(row);
+            if py < clip_y0 || py >= clip_y1 {
+                continue;
+            }
+            let bits = glyph.get(row).copied().unwrap_or(0);
+            let Some(dst) = self.span_ptr(py, col_start, col_end) else {
+                continue;
+            };
+            for px in col_start..col_end {
+                let col = px - x;
+                let packed = if col < 5 && (bits & (1 << (4 - col))) != 0 {
+                    fg
+                } else if let Some(bg) = bg {
+                    bg
+                } else {
+                    continue;
+                };
+                // SAFETY: `span_ptr` validated the whole `col_start..col_end` span.
+                unsafe {
+                    store_packed(
+                        dst.add((px - col_start) * bytes_per_pixel),
+                        bytes_per_pixel,
+                        packed,
+                    )
+                };
+                painted += 1;
             }
         }
+        self.count_painted(painted);
     }
 
     fn write_pixel(&mut self, x: usize, y: usize, color: Color) {
-        if x >= self.info.width || y >= self.info.height || self.info.bytes_per_pixel == 0 {
+        let (clip_x0, clip_y0, clip_x1, clip_y1) = self.clip_bounds();
+        if x < clip_x0 || x >= clip_x1 || y < clip_y0 || y >= clip_y1 {
             return;
         }
-        if let Some(clip) = self.clip {
-            let clip_x1 = clip.x.saturating_add(clip.w).min(self.info.width);
-            let clip_y1 = clip.y.saturating_add(clip.h).min(self.info.height);
-            if x < clip.x || x >= clip_x1 || y < clip.y || y >= clip_y1 {
-                return;
-            }
-        }
+        let packed = self.encoding.pack(color);
+        self.fill_span(y, x, x + 1, packed);
+    }
 
-        let pixel_index = y.saturating_mul(self.info.stride).saturating_add(x);
-        let byte_offset = pixel_index.saturating_mul(self.info.bytes_per_pixel);
-        if let Some(backbuffer) = self.backbuffer.as_mut() {
-            if byte_offset.saturating_add(self.info.bytes_per_pixel) > backbuffer.len() {
-                return;
-            }
-            let pixel = &mut backbuffer[byte_offset..byte_offset + self.info.bytes_per_pixel];
-            Self::encode_pixel(
-                self.info.pixel_format,
-                self.info.bytes_per_pixel,
-                pixel,
-                color,
-            );
-            return;
+    /// Drawable area: the screen intersected with the active clip rect.
+    fn clip_bounds(&self) -> (usize, usize, usize, usize) {
+        let (width, height) = (self.info.width, self.info.height);
+        match self.clip {
+            Some(clip) => (
+                clip.x.min(width),
+                clip.y.min(height),
+                clip.x.saturating_add(clip.w).min(width),
+                clip.y.saturating_add(clip.h).min(height),
+            ),
+            None => (0, 0, width, height),
         }
+    }
 
-        if byte_offset.saturating_add(self.info.bytes_per_pixel) > self.buffer_len {
-            return;
+    /// Start of pixels `x0..x1` on row `y` in the draw surface (the backbuffer when enabled,
+    /// otherwise the framebuffer), or `None` if the span does not fit. Callers clip first.
+    fn span_ptr(&mut self, y: usize, x0: usize, x1: usize) -> Option<*mut u8> {
+        let bytes_per_pixel = self.info.bytes_per_pixel;
+        if x1 <= x0 || bytes_per_pixel == 0 {
+            return None;
         }
-        // SAFETY: framebuffer pointer/length come from bootloader and remain valid for kernel life.
-        // Offset and pixel size are bounds-checked above, so this mutable slice is in range.
-        let pixel = unsafe {
-            core::slice::from_raw_parts_mut(
-                self.buffer_ptr.add(byte_offset),
-                self.info.bytes_per_pixel,
-            )
+        let start = y
+            .saturating_mul(self.info.stride)
+            .saturating_add(x0)
+            .saturating_mul(bytes_per_pixel);
+        let end = start.saturating_add((x1 - x0).saturating_mul(bytes_per_pixel));
+        let (base, len) = match self.backbuffer.as_mut() {
+            Some(backbuffer) => (backbuffer.as_mut_ptr(), backbuffer.len()),
+            None => (self.buffer_ptr, self.buffer_len),
         };
-        Self::encode_pixel(
-            self.info.pixel_format,
-            self.info.bytes_per_pixel,
-            pixel,
-            color,
-        );
+        if end > len {
+            return None;
+        }
+        // SAFETY: `start < end <= len`, and `base` is valid for `len` bytes (backbuffer Vec or
+        // bootloader framebuffer that lives for the kernel lifetime).
+        Some(unsafe { base.add(start) })
     }
 
-    fn encode_pixel(
-        pixel_format: PixelFormat,
-        bytes_per_pixel: usize,
-        pixel: &mut [u8],
-        color: Color,
-    ) {
-        match pixel_format {
-            PixelFormat::Rgb => {
-                pixel[0] = color.r;
-                if bytes_per_pixel > 1 {
-                    pixel[1] = color.g;
-                }
-                if bytes_per_pixel > 2 {
-                    pixel[2] = color.b;
-                }
-            }
-            PixelFormat::Bgr => {
-                pixel[0] = color.b;
-                if bytes_per_pixel > 1 {
-                    pixel[1] = color.g;
-                }
-                if bytes_per_pixel > 2 {
-                    pixel[2] = color.r;
-                }
-            }
-            PixelFormat::U8 => {
-                let gray = ((color.r as u16 + color.g as u16 + color.b as u16) / 3) as u8;
-                pixel[0] = gray;
-            }
-            _ => {
-                pixel[0] = color.r;
-                if bytes_per_pixel > 1 {
-                    pixel[1] = color.g;
-                }
-                if bytes_per_pixel > 2 {
-                    pixel[2] = color.b;
+    fn fill_span(&mut self, y: usize, x0: usize, x1: usize, packed: u32) {
+        let bytes_per_pixel = self.info.bytes_per_pixel;
+        if let Some(dst) = self.span_ptr(y, x0, x1) {
+            // SAFETY: `span_ptr` validated `x1 - x0` pixels at `dst`.
+            unsafe { fill_packed(dst, bytes_per_pixel, packed, x1 - x0) };
+            self.count_painted(x1 - x0);
+        }
+    }
+
+    /// Stores a row of already packed pixels starting at `(x0, y)`.
+    fn write_span(&mut self, y: usize, x0: usize, packed: &[u32]) {
+        let bytes_per_pixel = self.info.bytes_per_pixel;
+        let Some(dst) = self.span_ptr(y, x0, x0.saturating_add(packed.len())) else {
+            return;
+        };
+        // SAFETY: `span_ptr` validated `packed.len()` pixels at `dst`; the scratch row never
+        // aliases the draw surface.
+        unsafe {
+            if bytes_per_pixel == 4 {
+                core::ptr::copy_nonoverlapping(packed.as_ptr().cast::<u8>(), dst, packed.len() * 4);
+            } else {
+                for (index, pixel) in packed.iter().enumerate() {
+                    store_packed(dst.add(index * bytes_per_pixel), bytes_per_pixel, *pixel);
                 }
             }
         }
+        self.count_painted(packed.len());
     }
 }
 
 struct GfxCell(UnsafeCell<Option<GfxState>>);
 
-// SAFETY: access to graphics state is serialized on the main loop thread.
+// SAFETY: access to graphics state is serialized by `GFX_LOCK`.
 unsafe impl Sync for GfxCell {}
 
 static GFX_STATE: GfxCell = GfxCell(UnsafeCell::new(None));
+/// Serializes every entry point, so the compositor, the shell and user-task presents can
+/// call into graphics from any thread.
+static GFX_LOCK: SpinLock = SpinLock::new();
 
 pub fn init(boot_info: &mut BootInfo) -> GfxInitReport {
     let Some(framebuffer) = boot_info.framebuffer.as_mut() else {
@@ -2067,12 +2369,19 @@ pub fn poll() {
     let _ = with_state_mut(|state| state.process_events());
 }
 
+/// Whether the engine published a frame `poll` has not taken yet. False without a
+/// framebuffer, where nothing would ever take it.
+pub fn doom_frame_pending() -> bool {
+    with_state_mut(|_| doom_bridge::frame_pending()).unwrap_or(false)
+}
+
 pub fn try_enable_backbuffer() -> bool {
     with_state_mut(|state| state.try_enable_backbuffer()).unwrap_or(false)
 }
 
 pub fn on_input_byte(byte: u8) {
     let _ = with_state_mut(|state| state.push_event(byte));
+    sched::notify();
 }
 
 pub fn set_file_manager_text(text: &str) {
@@ -2094,20 +2403,25 @@ pub fn set_doom_window_text(text: &str) {
     });
 }
 
-pub fn set_file_manager_doom_overlay(text: &str, width: usize, height: usize, pixels: &[u32]) {
+pub fn set_file_manager_doom_overlay(
+    text: &str,
+    width: usize,
+    height: usize,
+    frame: DoomFrame<'_>,
+) {
     let _ = with_state_mut(|state| {
         state.open_doom_window();
         state.set_window_text(DOOM_WINDOW_INDEX, text);
-        state.set_doom_view(width, height, pixels);
+        state.set_doom_view(width, height, frame);
         if state.damage_len > 0 {
             state.flush_damage();
         }
     });
 }
 
-pub fn set_file_manager_doom_view(width: usize, height: usize, pixels: &[u32]) {
+pub fn set_file_manager_doom_view(width: usize, height: usize, frame: DoomFrame<'_>) {
     let _ = with_state_mut(|state| {
-        state.set_doom_view(width, height, pixels);
+        state.set_doom_view(width, height, frame);
         if state.damage_len > 0 {
             state.flush_damage();
         }
@@ -2167,7 +2481,7 @@ pub fn log_info() {
     match status {
         Some(status) => {
             serial::write_fmt(format_args!(
-                "ui: backend=uefi-gop ready=true {}x{} stride={} bpp={} fmt={} focused={} events={} dropped={} stdout_events={} stdout_dropped={} frames={} full_redraws={} partial_redraws={} present_full={} present_partial={} damage_dropped={} damage_coalesced={} double_buffer={} mouse=({}, {}) mouse_events={} mouse_focus_clicks={} drag_steps={} resize_steps={} minimize_toggles={} drag_active={} resize_active={} focused_minimized={} minimized_windows={}\n",
+                "ui: backend=uefi-gop ready=true {}x{} stride={} bpp={} fmt={} focused={} events={} dropped={} stdout_events={} stdout_dropped={} frames={} full_redraws={} partial_redraws={} present_full={} present_partial={} damage_dropped={} damage_coalesced={} double_buffer={} redraw_frames={} redraw_cycles_last={} redraw_cycles_avg={} redraw_cycles_max={} doom_view_frames={} doom_view_cycles_last={} doom_view_cycles_avg={} doom_view_cycles_max={} frame_layers_skipped={} frame_pixels_painted={} layers_skipped={} pixels_painted={} mouse=({}, {}) mouse_events={} mouse_focus_clicks={} drag_steps={} resize_steps={} minimize_toggles={} drag_active={} resize_active={} focused_minimized={} minimized_windows={}\n",
                 status.width,
                 status.height,
                 status.stride,
@@ -2186,6 +2500,18 @@ pub fn log_info() {
                 status.damage_dropped,
                 status.damage_coalesced,
                 status.double_buffer,
+                status.redraw_timing.frames,
+                status.redraw_timing.last_cycles,
+                status.redraw_timing.avg_cycles(),
+                status.redraw_timing.max_cycles,
+                status.doom_view_timing.frames,
+                status.doom_view_timing.last_cycles,
+                status.doom_view_timing.avg_cycles(),
+                status.doom_view_timing.max_cycles,
+                status.last_paint.layers_skipped,
+                status.last_paint.pixels_painted,
+                status.total_paint.layers_skipped,
+                status.total_paint.pixels_painted,
                 status.mouse_x,
                 status.mouse_y,
                 status.mouse_events,
@@ -2204,7 +2530,8 @@ pub fn log_info() {
 }
 
 fn with_state_mut<T>(f: impl FnOnce(&mut GfxState) -> T) -> Option<T> {
-    // SAFETY: ArrOSt kernel main loop is single-threaded in current milestones.
+    let _guard = GFX_LOCK.lock();
+    // SAFETY: holding `GFX_LOCK` makes this the only reference to the graphics state.
     let slot = unsafe { &mut *GFX_STATE.0.get() };
     let state = slot.as_mut()?;
     Some(f(state))
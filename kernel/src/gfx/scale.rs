@@ -0,0 +1,154 @@
+// kernel/src/gfx/scale.rs: precomputed RGB24 image scaler shared by the compositor and Doom bridge.
+use super::DoomViewFilter;
+use alloc::vec::Vec;
+
+/// Blend weights use 8 fractional bits so two channels fit one 32-bit lane pair.
+const WEIGHT_ONE: u32 = 256;
+const RB_MASK: u32 = 0x00FF_00FF;
+const G_MASK: u32 = 0x0000_FF00;
+
+/// Source taps for one destination column or row: neighbouring indices and the weight of `i1`.
+#[derive(Clone, Copy)]
+struct ScaleTap {
+    i0: u32,
+    i1: u32,
+    weight: u32,
+}
+
+/// Maps destination samples onto `src_len` with endpoints aligned (first to first, last to
+/// last), matching the original per-pixel 16.16 scaling.
+fn build_taps(src_len: usize, dst_len: usize, filter: DoomViewFilter) -> Vec<ScaleTap> {
+    let src_last = src_len.saturating_sub(1);
+    let den = dst_len.saturating_sub(1).max(1) as u64;
+    let mut taps = Vec::with_capacity(dst_len);
+    for index in 0..dst_len {
+        let pos_fp = if index + 1 == dst_len {
+            (src_last as u64) << 16
+        } else {
+            (index as u64).saturating_mul((src_last as u64) << 16) / den
+        };
+        let tap = if filter == DoomViewFilter::Bilinear {
+            let i0 = ((pos_fp >> 16) as usize).min(src_last);
+            let weight = ((((pos_fp & 0xFFFF) as u32) + 0x80) >> 8).min(WEIGHT_ONE);
+            ScaleTap {
+                i0: i0 as u32,
+                i1: (i0 + 1).min(src_last) as u32,
+                weight,
+            }
+        } else {
+            let nearest = (((pos_fp + (1 << 15)) >> 16) as usize).min(src_last);
+            ScaleTap {
+                i0: nearest as u32,
+                i1: nearest as u32,
+                weight: 0,
+            }
+        };
+        taps.push(tap);
+    }
+    taps
+}
+
+/// Blends two 0x00RRGGBB pixels with red and blue packed in one register and green in another,
+/// so each step is two multiplies instead of three per-channel blends.
+#[inline(always)]
+fn lerp_rgb24(a: u32, b: u32, weight: u32) -> u32 {
+    let inv = WEIGHT_ONE - weight;
+    let rb = ((a & RB_MASK) * inv + (b & RB_MASK) * weight + 0x0080_0080) >> 8;
+    let g = ((a & G_MASK) * inv + (b & G_MASK) * weight + 0x0000_8000) >> 8;
+    (rb & RB_MASK) | (g & G_MASK)
+}
+
+/// Scaler for one (source size, destination size, filter) triple. Column and row taps are
+/// computed once, so scaling a row is table lookups and packed blends with no divides.
+pub struct Scaler {
+    src_w: usize,
+    src_h: usize,
+    filter: DoomViewFilter,
+    cols: Vec<ScaleTap>,
+    rows: Vec<ScaleTap>,
+}
+
+impl Scaler {
+    /// `Integer` has no tables of its own and scales like `Nearest`.
+    pub fn new(
+        src_w: usize,
+        src_h: usize,
+        dst_w: usize,
+        dst_h: usize,
+        filter: DoomViewFilter,
+    ) -> Self {
+        let filter = match filter {
+            DoomViewFilter::Bilinear => DoomViewFilter::Bilinear,
+            DoomViewFilter::Nearest | DoomViewFilter::Integer => DoomViewFilter::Nearest,
+        };
+        Self {
+            src_w,
+            src_h,
+            filter,
+            cols: build_taps(src_w, dst_w, filter),
+            rows: build_taps(src_h, dst_h, filter),
+        }
+    }
+
+    pub fn matches(
+        &self,
+        src_w: usize,
+        src_h: usize,
+        dst_w: usize,
+        dst_h: usize,
+        filter: DoomViewFilter,
+    ) -> bool {
+        let filter_matches = match filter {
+            DoomViewFilter::Bilinear => self.filter == DoomViewFilter::Bilinear,
+            DoomViewFilter::Nearest | DoomViewFilter::Integer => {
+                self.filter == DoomViewFilter::Nearest
+            }
+        };
+        filter_matches
+            && self.src_w == src_w
+            && self.src_h == src_h
+            && self.cols.len() == dst_w
+            && self.rows.len() == dst_h
+    }
+
+    /// Scales destination row `dy`, columns `dx0..dx0 + out.len()`, of the 0x00RRGGBB image
+    /// `src` into `out`, passing each result through `pack`.
+    pub fn scale_row(
+        &self,
+        src: &[u32],
+        dy: usize,
+        dx0: usize,
+        out: &mut [u32],
+        pack: impl Fn(u32) -> u32,
+    ) {
+        let Some(row_tap) = self.rows.get(dy) else {
+            return;
+        };
+        let Some(cols) = self.cols.get(dx0..dx0.saturating_add(out.len())) else {
+            return;
+        };
+        let row0 = row_tap.i0 as usize * self.src_w;
+        let Some(src0) = src.get(row0..row0 + self.src_w) else {
+            return;
+        };
+
+        if self.filter != DoomViewFilter::Bilinear {
+            for (target, tap) in out.iter_mut().zip(cols) {
+                *target = pack(src0[tap.i0 as usize] & 0x00FF_FFFF);
+            }
+            return;
+        }
+
+        let row1 = row_tap.i1 as usize * self.src_w;
+        let Some(src1) = src.get(row1..row1 + self.src_w) else {
+            return;
+        };
+        let wy = row_tap.weight;
+        for (target, tap) in out.iter_mut().zip(cols) {
+            let (x0, x1) = (tap.i0 as usize, tap.i1 as usize);
+            let top = lerp_rgb24(src0[x0], src0[x1], tap.weight);
+            let bottom = lerp_rgb24(src1[x0], src1[x1], tap.weight);
+            *target = pack(lerp_rgb24(top, bottom, wy));
+        }
+    }
+}
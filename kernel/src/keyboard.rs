@@ -1,6 +1,6 @@
 // kernel/src/keyboard.rs: PS/2 set-1 scancode decoding with byte queue + press/release events.
-use core::cell::UnsafeCell;
-use core::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
+use crate::sync::spsc::SpscRing;
+use core::sync::atomic::{AtomicBool, Ordering};
 
 const BYTE_QUEUE_CAPACITY: usize = 1024;
 const EVENT_QUEUE_CAPACITY: usize = 1024;
@@ -26,40 +26,16 @@ pub struct KeyEvent {
     pub pressed: bool,
 }
 
-struct ByteQueueStorage(UnsafeCell<[u8; BYTE_QUEUE_CAPACITY]>);
-
-// SAFETY: access is synchronized through the single-producer/single-consumer indices.
-unsafe impl Sync for ByteQueueStorage {}
-
-struct EventQueueStorage(UnsafeCell<[u16; EVENT_QUEUE_CAPACITY]>);
-
-// SAFETY: access is synchronized through the single-producer/single-consumer indices.
-unsafe impl Sync for EventQueueStorage {}
-
-static BYTE_QUEUE_STORAGE: ByteQueueStorage =
-    ByteQueueStorage(UnsafeCell::new([0; BYTE_QUEUE_CAPACITY]));
-static BYTE_QUEUE_HEAD: AtomicUsize = AtomicUsize::new(0);
-static BYTE_QUEUE_TAIL: AtomicUsize = AtomicUsize::new(0);
-static BYTE_QUEUE_OVERFLOW_COUNT: AtomicU64 = AtomicU64::new(0);
-
-static EVENT_QUEUE_STORAGE: EventQueueStorage =
-    EventQueueStorage(UnsafeCell::new([0; EVENT_QUEUE_CAPACITY]));
-static EVENT_QUEUE_HEAD: AtomicUsize = AtomicUsize::new(0);
-static EVENT_QUEUE_TAIL: AtomicUsize = AtomicUsize::new(0);
-static EVENT_QUEUE_OVERFLOW_COUNT: AtomicU64 = AtomicU64::new(0);
+/// Filled by the IRQ1 handler, drained by the shell thread.
+static BYTES: SpscRing<u8, BYTE_QUEUE_CAPACITY> = SpscRing::new();
+static EVENTS: SpscRing<u16, EVENT_QUEUE_CAPACITY> = SpscRing::new();
 
 static SHIFT_PRESSED: AtomicBool = AtomicBool::new(false);
 static EXTENDED_PREFIX: AtomicBool = AtomicBool::new(false);
 
 pub fn init() {
-    BYTE_QUEUE_HEAD.store(0, Ordering::Relaxed);
-    BYTE_QUEUE_TAIL.store(0, Ordering::Relaxed);
-    BYTE_QUEUE_OVERFLOW_COUNT.store(0, Ordering::Relaxed);
-
-    EVENT_QUEUE_HEAD.store(0, Ordering::Relaxed);
-    EVENT_QUEUE_TAIL.store(0, Ordering::Relaxed);
-    EVENT_QUEUE_OVERFLOW_COUNT.store(0, Ordering::Relaxed);
-
+    BYTES.clear();
+    EVENTS.clear();
     SHIFT_PRESSED.store(false, Ordering::Relaxed);
     EXTENDED_PREFIX.store(false, Ordering::Relaxed);
 }
@@ -100,80 +76,27 @@ pub fn handle_scancode(scancode: u8) {
 }
 
 pub fn pop_byte() -> Option<u8> {
-    let tail = BYTE_QUEUE_TAIL.load(Ordering::Relaxed);
-    let head = BYTE_QUEUE_HEAD.load(Ordering::Acquire);
-    if tail == head {
-        return None;
-    }
-
-    // SAFETY: `tail != head`, so the slot contains initialized queue data.
-    let byte = unsafe {
-        let ptr = (*BYTE_QUEUE_STORAGE.0.get()).as_ptr().add(tail);
-        ptr.read()
-    };
-    let next_tail = (tail + 1) % BYTE_QUEUE_CAPACITY;
-    BYTE_QUEUE_TAIL.store(next_tail, Ordering::Release);
-    Some(byte)
+    BYTES.pop()
 }
 
 pub fn pop_key_event() -> Option<KeyEvent> {
-    let tail = EVENT_QUEUE_TAIL.load(Ordering::Relaxed);
-    let head = EVENT_QUEUE_HEAD.load(Ordering::Acquire);
-    if tail == head {
-        return None;
-    }
-
-    // SAFETY: `tail != head`, so the slot contains initialized queue data.
-    let encoded = unsafe {
-        let ptr = (*EVENT_QUEUE_STORAGE.0.get()).as_ptr().add(tail);
-        ptr.read()
-    };
-    let next_tail = (tail + 1) % EVENT_QUEUE_CAPACITY;
-    EVENT_QUEUE_TAIL.store(next_tail, Ordering::Release);
-    decode_key_event(encoded)
+    decode_key_event(EVENTS.pop()?)
 }
 
 pub fn overflow_count() -> u64 {
-    BYTE_QUEUE_OVERFLOW_COUNT.load(Ordering::Relaxed)
+    BYTES.dropped()
 }
 
 pub fn event_overflow_count() -> u64 {
-    EVENT_QUEUE_OVERFLOW_COUNT.load(Ordering::Relaxed)
+    EVENTS.dropped()
 }
 
 fn push_byte(byte: u8) {
-    let head = BYTE_QUEUE_HEAD.load(Ordering::Relaxed);
-    let next_head = (head + 1) % BYTE_QUEUE_CAPACITY;
-    let tail = BYTE_QUEUE_TAIL.load(Ordering::Acquire);
-    if next_head == tail {
-        BYTE_QUEUE_OVERFLOW_COUNT.fetch_add(1, Ordering::Relaxed);
-        return;
-    }
-
-    // SAFETY: queue slot `head` is free when `next_head != tail`.
-    unsafe {
-        let ptr = (*BYTE_QUEUE_STORAGE.0.get()).as_mut_ptr().add(head);
-        ptr.write(byte);
-    }
-    BYTE_QUEUE_HEAD.store(next_head, Ordering::Release);
+    BYTES.push(byte);
 }
 
 fn push_key_event(event: KeyEvent) {
-    let head = EVENT_QUEUE_HEAD.load(Ordering::Relaxed);
-    let next_head = (head + 1) % EVENT_QUEUE_CAPACITY;
-    let tail = EVENT_QUEUE_TAIL.load(Ordering::Acquire);
-    if next_head == tail {
-        EVENT_QUEUE_OVERFLOW_COUNT.fetch_add(1, Ordering::Relaxed);
-        return;
-    }
-
-    let encoded = encode_key_event(event);
-    // SAFETY: queue slot `head` is free when `next_head != tail`.
-    unsafe {
-        let ptr = (*EVENT_QUEUE_STORAGE.0.get()).as_mut_ptr().add(head);
-        ptr.write(encoded);
-    }
-    EVENT_QUEUE_HEAD.store(next_head, Ordering::Release);
+    EVENTS.push(encode_key_event(event));
 }
 
 fn encode_key_event(event: KeyEvent) -> u16 {
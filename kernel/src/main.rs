@@ -17,10 +17,13 @@ mod mem;
 mod mouse;
 mod net;
 mod proc;
+mod profile;
 mod serial;
 mod shell;
 mod storage;
+mod sync;
 mod time;
+mod trace;
 
 const VERSION_MAJOR: &str = match option_env!("ARROST_VERSION_MAJOR") {
     Some(value) => value,
@@ -103,10 +106,14 @@ const DOOM_WAD_PRESENT: &str = match option_env!("ARROST_DOOM_WAD_PRESENT") {
     None => "false",
 };
 
+use arch::x86_64::smp;
 use bootloader_api::{BootInfo, BootloaderConfig, config::Mapping, entry_point};
 use core::alloc::Layout;
 use core::panic::PanicInfo;
-use x86_64::instructions::hlt;
+use core::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use proc::sched::{self, Priority};
+use proc::work;
+use trace::Span;
 
 // kernel/src/main.rs: bootloader setup required by M2 memory management.
 pub static BOOTLOADER_CONFIG: BootloaderConfig = {
@@ -160,10 +167,11 @@ fn kernel_main(boot_info: &'static mut BootInfo) -> ! {
                 report.guard_high,
             ));
             serial::write_fmt(format_args!(
-                "Alloc smoke: box={:#x} vec_len={} checksum={} sample_heap_phys={:#018x}\n",
+                "Alloc smoke: box={:#x} vec_len={} checksum={} reuse={} sample_heap_phys={:#018x}\n",
                 report.alloc_box_value,
                 report.alloc_vec_len,
                 report.alloc_checksum,
+                report.alloc_reused,
                 report.sample_heap_phys_addr,
             ));
         }
@@ -202,6 +210,15 @@ fn kernel_main(boot_info: &'static mut BootInfo) -> ! {
         irq.pit_hz,
         irq.pit_divisor
     ));
+    serial::write_fmt(format_args!(
+        "Clock: source={} tsc_hz={} invariant={} event={} event_hz={} detail={}\n",
+        irq.clock.clocksource,
+        irq.clock.tsc_hz,
+        irq.clock.invariant_tsc,
+        irq.clock.event_timer,
+        irq.clock.event_timer_hz,
+        irq.clock.event_detail
+    ));
     serial::write_fmt(format_args!(
         "Mouse: backend={} ready={} ack={:#04x}/{:#04x}\n",
         irq.mouse_backend, irq.mouse_ready, irq.mouse_ack_defaults, irq.mouse_ack_enable
@@ -258,11 +275,12 @@ fn kernel_main(boot_info: &'static mut BootInfo) -> ! {
 
     let fs_report = fs::init();
     serial::write_fmt(format_args!(
-        "FS: backend={} storage_backed={} files={} used_bytes={} capacity_files={} capacity_file_bytes={}\n",
+        "FS: backend={} storage_backed={} files={} used_bytes={} free_bytes={} capacity_files={} capacity_file_bytes={}\n",
         fs_report.backend,
         fs_report.storage_backed,
         fs_report.file_count,
         fs_report.used_bytes,
+        fs_report.free_bytes,
         fs_report.max_files,
         fs_report.max_file_bytes
     ));
@@ -300,6 +318,17 @@ fn kernel_main(boot_info: &'static mut BootInfo) -> ! {
         proc_report.scripted_input_bytes
     ));
 
+    let smp_report = smp::init(boot_info);
+    serial::write_fmt(format_args!(
+        "SMP: cpus={} online={} failures={} bsp_apic={} trampoline={:#x} detail={}\n",
+        smp_report.cpus_listed,
+        smp_report.cpus_online,
+        smp_report.start_failures,
+        smp_report.bsp_apic_id,
+        smp_report.trampoline_phys,
+        smp_report.detail
+    ));
+
     run_loop()
 }
 
@@ -341,15 +370,118 @@ fn alloc_error(layout: Layout) -> ! {
     halt_loop()
 }
 
+const THREAD_STACK_BYTES: usize = 64 * 1024;
+const SHELL_STACK_BYTES: usize = 128 * 1024;
+const DOOM_STACK_BYTES: usize = 256 * 1024;
+/// Re-poll interval while audio output is in flight.
+const AUDIO_ACTIVE_POLL_NS: u64 = 5_000_000;
+/// Cadence of the diskfs metadata flush and block-cache write-back checks when the network
+/// has no timer pending.
+const IO_HOUSEKEEPING_NS: u64 = 100_000_000;
+/// Cores the Doom tick and the compositor are pinned to when online; their threads only
+/// hand the work over and wait. Network, fs and storage polls go to whichever worker is free.
+const DOOM_CPU: usize = 1;
+const GFX_CPU: usize = 2;
+
+static DOOM_RUNNING: AtomicBool = AtomicBool::new(false);
+/// Thread the Doom thread unparks when the engine publishes a frame.
+static GFX_THREAD: AtomicUsize = AtomicUsize::new(0);
+static NET_TIMERS: AtomicBool = AtomicBool::new(false);
+
+/// Splits the old polling loop into preemptive threads. Audio and input are high priority so
+/// a long Doom tick or a stalled device no longer delays them; the boot context becomes idle.
 fn run_loop() -> ! {
+    sched::start();
+    spawn_thread("audio", Priority::High, THREAD_STACK_BYTES, audio_thread);
+    spawn_thread("shell", Priority::High, SHELL_STACK_BYTES, shell_thread);
+    if let Some(id) = spawn_thread("gfx", Priority::Normal, THREAD_STACK_BYTES, gfx_thread) {
+        GFX_THREAD.store(id, Ordering::Relaxed);
+    }
+    spawn_thread("io", Priority::Normal, THREAD_STACK_BYTES, io_thread);
+    spawn_thread("user", Priority::Normal, THREAD_STACK_BYTES, user_thread);
+    spawn_thread("doom", Priority::Low, DOOM_STACK_BYTES, doom_thread);
+    loop {
+        sched::wait_event();
+        sched::yield_now();
+    }
+}
+
+fn spawn_thread(
+    name: &'static str,
+    priority: Priority,
+    stack_bytes: usize,
+    entry: fn() -> !,
+) -> Option<usize> {
+    match sched::spawn(name, priority, stack_bytes, entry) {
+        Ok(id) => {
+            serial::write_fmt(format_args!(
+                "sched: tid={} name={} prio={} stack={}\n",
+                id,
+                name,
+                priority.as_str(),
+                stack_bytes
+            ));
+            Some(id)
+        }
+        Err(err) => {
+            serial::write_fmt(format_args!(
+                "sched: spawn name={} failed: {}\n",
+                name,
+                err.as_str()
+            ));
+            None
+        }
+    }
+}
+
+fn audio_thread() -> ! {
+    loop {
+        let active = {
+            let _span = trace::span(Span::AudioPoll);
+            audio::poll(time::ticks())
+        };
+        if active {
+            sched::wait_until(time::monotonic_ns().saturating_add(AUDIO_ACTIVE_POLL_NS));
+        } else {
+            sched::wait_event();
+        }
+    }
+}
+
+fn shell_thread() -> ! {
+    loop {
+        let timed = {
+            let _span = trace::span(Span::ShellPoll);
+            shell::poll()
+        };
+        if timed {
+            sched::wait_until(next_tick_ns());
+        } else {
+            sched::wait_event();
+        }
+    }
+}
+
+/// Redraws on input events and on Doom frames. A frame published after the check below
+/// comes with an `unpark`, which also ends `wait_event`.
+fn gfx_thread() -> ! {
     loop {
-        shell::poll();
-        gfx::poll();
-        net::poll();
-        let ticks = time::ticks();
-        doom::poll(ticks);
-        audio::poll(ticks);
-        proc::run_once(ticks);
+        work::run_pinned(GFX_CPU, gfx_step);
+        if !gfx::doom_frame_pending() {
+            sched::wait_event();
+        }
+    }
+}
+
+fn gfx_step() {
+    let _span = trace::span(Span::GfxPoll);
+    gfx::poll();
+}
+
+fn io_thread() -> ! {
+    loop {
+        work::run_all(&[net_step, fs_step, storage_step]);
+        let net_timers = NET_TIMERS.load(Ordering::Relaxed);
         if time::heartbeat_enabled()
             && let Some(seconds) = time::poll_elapsed_second()
         {
@@ -359,10 +491,76 @@ fn run_loop() -> ! {
                 time::ticks()
             ));
         }
-        hlt();
+
+        let now = time::monotonic_ns();
+        let mut deadline = if net_timers {
+            next_tick_ns()
+        } else {
+            now.saturating_add(IO_HOUSEKEEPING_NS)
+        };
+        if time::heartbeat_enabled() {
+            deadline = deadline.min((now / 1_000_000_000 + 1) * 1_000_000_000);
+        }
+        sched::wait_until(deadline);
+    }
+}
+
+fn user_thread() -> ! {
+    loop {
+        let next = {
+            let _span = trace::span(Span::UserPoll);
+            proc::run_once(time::ticks())
+        };
+        match next {
+            Some(tick) => sched::wait_until(tick.saturating_mul(time::TICK_NS)),
+            None => sched::wait_event(),
+        }
+    }
+}
+
+fn net_step() {
+    let _span = trace::span(Span::NetPoll);
+    NET_TIMERS.store(net::poll(), Ordering::Relaxed);
+}
+
+fn fs_step() {
+    let _span = trace::span(Span::FsPoll);
+    fs::poll(time::ticks());
+}
+
+fn storage_step() {
+    let _span = trace::span(Span::StoragePoll);
+    storage::poll(time::ticks());
+}
+
+/// Doom's C engine is the only code built with SSE, and it only runs from this thread's job
+/// or from shell commands, both under the Doom state lock. SSE registers are caller-saved, so
+/// none are live when the lock is released, and switches do not need to save FPU state.
+/// Application processors never switch threads at all.
+fn doom_thread() -> ! {
+    loop {
+        work::run_pinned(DOOM_CPU, doom_step);
+        if doom_bridge::frame_pending() {
+            sched::unpark(GFX_THREAD.load(Ordering::Relaxed));
+        }
+        if DOOM_RUNNING.load(Ordering::Relaxed) {
+            sched::wait_until(next_tick_ns());
+        } else {
+            sched::wait_event();
+        }
     }
 }
 
+fn doom_step() {
+    let _span = trace::span(Span::DoomPoll);
+    DOOM_RUNNING.store(doom::poll(time::ticks()), Ordering::Relaxed);
+}
+
+/// Start of the next tick, for subsystems whose timeouts are counted in `time::ticks`.
+fn next_tick_ns() -> u64 {
+    (time::ticks() + 1).saturating_mul(time::TICK_NS)
+}
+
 fn halt_loop() -> ! {
     loop {
         // SAFETY: halting in an infinite loop is the intended idle state for this early kernel.
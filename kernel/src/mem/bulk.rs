@@ -0,0 +1,354 @@
+// kernel/src/mem/bulk.rs: memcpy/memmove/memset shared by kernel code and the Doom C runtime.
+//
+// These strong definitions override the weak compiler-builtins versions for the whole image, so
+// Rust slice copies, gfx blits, and the freestanding libc all land here. The bulk paths only use
+// general-purpose registers and string instructions: interrupt handlers do not save SSE state,
+// so touching XMM registers here could corrupt an interrupted Doom frame.
+use crate::serial;
+use alloc::vec;
+use core::arch::asm;
+use core::arch::x86_64::{__cpuid, __cpuid_count, _rdtsc};
+use core::hint::black_box;
+use core::sync::atomic::{AtomicU8, Ordering};
+
+/// Copies up to this size use overlapping fixed-width moves instead of a string instruction.
+const SMALL_COPY_BYTES: usize = 64;
+const BENCH_BUFFER_BYTES: usize = 256 * 1024;
+const BENCH_SIZES: [usize; 5] = [64, 512, 4096, 65_536, BENCH_BUFFER_BYTES];
+const BENCH_BYTES_PER_SIZE: usize = 8 * 1024 * 1024;
+const BENCH_MIN_ITERS: usize = 16;
+
+const PATH_UNKNOWN: u8 = 0;
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+#[repr(u8)]
+enum CopyPath {
+    /// `rep movsq`/`rep stosq` for the bulk, bytes for the tail.
+    Qword = 1,
+    /// Enhanced REP MOVSB/STOSB: byte string ops run at line speed for large sizes.
+    Erms = 2,
+    /// Fast short REP MOVSB: byte string ops are cheap even for short sizes.
+    Fsrm = 3,
+}
+
+impl CopyPath {
+    const fn as_str(self) -> &'static str {
+        match self {
+            Self::Qword => "rep-movsq",
+            Self::Erms => "erms",
+            Self::Fsrm => "fsrm",
+        }
+    }
+}
+
+static COPY_PATH: AtomicU8 = AtomicU8::new(PATH_UNKNOWN);
+
+fn copy_path() -> CopyPath {
+    match COPY_PATH.load(Ordering::Relaxed) {
+        1 => CopyPath::Qword,
+        2 => CopyPath::Erms,
+        3 => CopyPath::Fsrm,
+        _ => {
+            let path = detect_copy_path();
+            COPY_PATH.store(path as u8, Ordering::Relaxed);
+            path
+        }
+    }
+}
+
+fn detect_copy_path() -> CopyPath {
+    // SAFETY: CPUID is available on every x86_64 CPU and has no side effects.
+    let max_leaf = unsafe { __cpuid(0) }.eax;
+    if max_leaf < 7 {
+        return CopyPath::Qword;
+    }
+    // SAFETY: leaf 7 is supported (checked above).
+    let features = unsafe { __cpuid_count(7, 0) };
+    if features.edx & (1 << 4) != 0 {
+        CopyPath::Fsrm
+    } else if features.ebx & (1 << 9) != 0 {
+        CopyPath::Erms
+    } else {
+        CopyPath::Qword
+    }
+}
+
+/// Copies `n <= SMALL_COPY_BYTES` bytes. Every load happens before the first store, so the
+/// ranges may overlap in either direction.
+#[inline(always)]
+unsafe fn copy_small(dst: *mut u8, src: *const u8, n: usize) {
+    // SAFETY: caller guarantees both ranges are valid for `n` bytes; each access below stays in
+    // `[0, n)` because head and tail windows are only used when `n` covers their width.
+    unsafe {
+        if n >= 32 {
+            let h0 = src.cast::<u64>().read_unaligned();
+            let h1 = src.add(8).cast::<u64>().read_unaligned();
+            let h2 = src.add(16).cast::<u64>().read_unaligned();
+            let h3 = src.add(24).cast::<u64>().read_unaligned();
+            let t0 = src.add(n - 32).cast::<u64>().read_unaligned();
+            let t1 = src.add(n - 24).cast::<u64>().read_unaligned();
+            let t2 = src.add(n - 16).cast::<u64>().read_unaligned();
+            let t3 = src.add(n - 8).cast::<u64>().read_unaligned();
+            dst.cast::<u64>().write_unaligned(h0);
+            dst.add(8).cast::<u64>().write_unaligned(h1);
+            dst.add(16).cast::<u64>().write_unaligned(h2);
+            dst.add(24).cast::<u64>().write_unaligned(h3);
+            dst.add(n - 32).cast::<u64>().write_unaligned(t0);
+            dst.add(n - 24).cast::<u64>().write_unaligned(t1);
+            dst.add(n - 16).cast::<u64>().write_unaligned(t2);
+            dst.add(n - 8).cast::<u64>().write_unaligned(t3);
+        } else if n >= 16 {
+            let h0 = src.cast::<u64>().read_unaligned();
+            let h1 = src.add(8).cast::<u64>().read_unaligned();
+            let t0 = src.add(n - 16).cast::<u64>().read_unaligned();
+            let t1 = src.add(n - 8).cast::<u64>().read_unaligned();
+            dst.cast::<u64>().write_unaligned(h0);
+            dst.add(8).cast::<u64>().write_unaligned(h1);
+            dst.add(n - 16).cast::<u64>().write_unaligned(t0);
+            dst.add(n - 8).cast::<u64>().write_unaligned(t1);
+        } else if n >= 8 {
+            let head = src.cast::<u64>().read_unaligned();
+            let tail = src.add(n - 8).cast::<u64>().read_unaligned();
+            dst.cast::<u64>().write_unaligned(head);
+            dst.add(n - 8).cast::<u64>().write_unaligned(tail);
+        } else if n >= 4 {
+            let head = src.cast::<u32>().read_unaligned();
+            let tail = src.add(n - 4).cast::<u32>().read_unaligned();
+            dst.cast::<u32>().write_unaligned(head);
+            dst.add(n - 4).cast::<u32>().write_unaligned(tail);
+        } else if n >= 2 {
+            let head = src.cast::<u16>().read_unaligned();
+            let tail = src.add(n - 2).cast::<u16>().read_unaligned();
+            dst.cast::<u16>().write_unaligned(head);
+            dst.add(n - 2).cast::<u16>().write_unaligned(tail);
+        } else if n == 1 {
+            *dst = *src;
+        }
+    }
+}
+
+/// Ascending copy; also correct for overlapping ranges with `dst < src`.
+#[inline(always)]
+unsafe fn copy_forward(dst: *mut u8, src: *const u8, n: usize) {
+    if n <= SMALL_COPY_BYTES {
+        // SAFETY: forwarded caller contract.
+        unsafe { copy_small(dst, src, n) };
+        return;
+    }
+    match copy_path() {
+        CopyPath::Erms | CopyPath::Fsrm => {
+            // SAFETY: caller guarantees both ranges are valid for `n` bytes; DF is clear per the
+            // SysV ABI, so the copy ascends.
+            unsafe {
+                asm!(
+                    "rep movsb",
+                    inout("rcx") n => _,
+                    inout("rdi") dst => _,
+                    inout("rsi") src => _,
+                    options(nostack, preserves_flags)
+                );
+            }
+        }
+        CopyPath::Qword => {
+            // SAFETY: as above; the qword pass leaves rsi/rdi at the tail for the byte pass.
+            unsafe {
+                asm!(
+                    "rep movsq",
+                    "mov rcx, {tail}",
+                    "rep movsb",
+                    tail = in(reg) n & 7,
+                    inout("rcx") n >> 3 => _,
+                    inout("rdi") dst => _,
+                    inout("rsi") src => _,
+                    options(nostack, preserves_flags)
+                );
+            }
+        }
+    }
+}
+
+/// Descending copy for overlapping ranges with `dst > src`. It uses a qword loop instead of
+/// `std; rep movsb`, which is slow on most cores and leaves DF set if interrupted.
+#[inline(always)]
+unsafe fn copy_backward(dst: *mut u8, src: *const u8, n: usize) {
+    if n <= SMALL_COPY_BYTES {
+        // SAFETY: forwarded caller contract; `copy_small` tolerates overlap.
+        unsafe { copy_small(dst, src, n) };
+        return;
+    }
+    let head = n & 7;
+    // SAFETY: caller guarantees both ranges are valid for `n` bytes. The loop moves qwords at
+    // offsets `n - 8` down to `head`; each load happens before the store that could clobber it
+    // because `dst > src`. The unaligned head is copied last, below every written qword.
+    unsafe {
+        asm!(
+            "2:",
+            "sub {off}, 8",
+            "mov {tmp}, qword ptr [{src} + {off}]",
+            "mov qword ptr [{dst} + {off}], {tmp}",
+            "cmp {off}, {head}",
+            "ja 2b",
+            off = inout(reg) n => _,
+            tmp = out(reg) _,
+            src = in(reg) src,
+            dst = in(reg) dst,
+            head = in(reg) head,
+            options(nostack)
+        );
+        copy_small(dst, src, head);
+    }
+}
+
+#[inline(always)]
+unsafe fn fill(dst: *mut u8, byte: u8, n: usize) {
+    let pattern = u64::from(byte) * 0x0101_0101_0101_0101;
+    if n <= SMALL_COPY_BYTES {
+        // SAFETY: caller guarantees `dst` is valid for `n` bytes; windows mirror `copy_small`.
+        unsafe {
+            if n >= 32 {
+                for offset in [0, 8, 16, 24, n - 32, n - 24, n - 16, n - 8] {
+                    dst.add(offset).cast::<u64>().write_unaligned(pattern);
+                }
+            } else if n >= 16 {
+                for offset in [0, 8, n - 16, n - 8] {
+                    dst.add(offset).cast::<u64>().write_unaligned(pattern);
+                }
+            } else if n >= 8 {
+                dst.cast::<u64>().write_unaligned(pattern);
+                dst.add(n - 8).cast::<u64>().write_unaligned(pattern);
+            } else if n >= 4 {
+                dst.cast::<u32>().write_unaligned(pattern as u32);
+                dst.add(n - 4).cast::<u32>().write_unaligned(pattern as u32);
+            } else if n >= 2 {
+                dst.cast::<u16>().write_unaligned(pattern as u16);
+                dst.add(n - 2).cast::<u16>().write_unaligned(pattern as u16);
+            } else if n == 1 {
+                *dst = byte;
+            }
+        }
+        return;
+    }
+    match copy_path() {
+        CopyPath::Erms | CopyPath::Fsrm => {
+            // SAFETY: caller guarantees `dst` is valid for `n` bytes; DF is clear per the ABI.
+            unsafe {
+                asm!(
+                    "rep stosb",
+                    inout("rcx") n => _,
+                    inout("rdi") dst => _,
+                    in("al") byte,
+                    options(nostack, preserves_flags)
+                );
+            }
+        }
+        CopyPath::Qword => {
+            // SAFETY: as above; the qword pass leaves rdi at the tail for the byte pass.
+            unsafe {
+                asm!(
+                    "rep stosq",
+                    "mov rcx, {tail}",
+                    "rep stosb",
+                    tail = in(reg) n & 7,
+                    inout("rcx") n >> 3 => _,
+                    inout("rdi") dst => _,
+                    in("rax") pattern,
+                    options(nostack, preserves_flags)
+                );
+            }
+        }
+    }
+}
+
+#[unsafe(no_mangle)]
+unsafe extern "C" fn memcpy(dst: *mut u8, src: *const u8, n: usize) -> *mut u8 {
+    // SAFETY: C `memcpy` contract: both ranges are valid for `n` bytes and do not overlap.
+    unsafe { copy_forward(dst, src, n) };
+    dst
+}
+
+#[unsafe(no_mangle)]
+unsafe extern "C" fn memmove(dst: *mut u8, src: *const u8, n: usize) -> *mut u8 {
+    // SAFETY: C `memmove` contract: both ranges are valid for `n` bytes and may overlap. A
+    // descending copy is only needed when `dst` starts inside the source range.
+    unsafe {
+        if (dst as usize).wrapping_sub(src as usize) >= n {
+            copy_forward(dst, src, n);
+        } else {
+            copy_backward(dst, src, n);
+        }
+    }
+    dst
+}
+
+#[unsafe(no_mangle)]
+unsafe extern "C" fn memset(dst: *mut u8, value: i32, n: usize) -> *mut u8 {
+    // SAFETY: C `memset` contract: `dst` is valid for `n` bytes.
+    unsafe { fill(dst, value as u8, n) };
+    dst
+}
+
+/// Times memcpy/memmove/memset over a range of sizes and prints TSC bytes per cycle
+/// (shell command `mem bench`).
+pub fn log_benchmark() {
+    let mut src = vec![0x5au8; BENCH_BUFFER_BYTES + SMALL_COPY_BYTES];
+    let mut dst = vec![0u8; BENCH_BUFFER_BYTES + SMALL_COPY_BYTES];
+    serial::write_fmt(format_args!(
+        "mem bench: path={} buffer={} KiB (TSC cycles)\n",
+        copy_path().as_str(),
+        BENCH_BUFFER_BYTES / 1024
+    ));
+    for size in BENCH_SIZES {
+        let iters = (BENCH_BYTES_PER_SIZE / size).max(BENCH_MIN_ITERS);
+        let src_ptr = src.as_mut_ptr();
+        let dst_ptr = dst.as_mut_ptr();
+        let copy = time_cycles(iters, || {
+            // SAFETY: both buffers hold at least `size` bytes and are distinct allocations.
+            unsafe { memcpy(black_box(dst_ptr), black_box(src_ptr), black_box(size)) };
+        });
+        let shift = time_cycles(iters, || {
+            // SAFETY: the buffer holds `size + 1` bytes; the overlapping move needs memmove.
+            unsafe {
+                memmove(
+                    black_box(src_ptr.add(1)),
+                    black_box(src_ptr),
+                    black_box(size),
+                )
+            };
+        });
+        let set = time_cycles(iters, || {
+            // SAFETY: the buffer holds at least `size` bytes.
+            unsafe { memset(black_box(dst_ptr), black_box(0), black_box(size)) };
+        });
+        let bytes = (size as u64).saturating_mul(iters as u64);
+        serial::write_fmt(format_args!(
+            "mem bench: size={} iters={} memcpy={} memmove={} memset={} bytes/cycle\n",
+            size,
+            iters,
+            BytesPerCycle(bytes, copy),
+            BytesPerCycle(bytes, shift),
+            BytesPerCycle(bytes, set)
+        ));
+    }
+    black_box(&mut dst);
+}
+
+fn time_cycles(iters: usize, mut op: impl FnMut()) -> u64 {
+    // SAFETY: RDTSC is unprivileged and side-effect free.
+    let start = unsafe { _rdtsc() };
+    for _ in 0..iters {
+        op();
+    }
+    // SAFETY: as above.
+    let end = unsafe { _rdtsc() };
+    end.saturating_sub(start).max(1)
+}
+
+/// Formats `bytes / cycles` with two decimals without touching floating point.
+struct BytesPerCycle(u64, u64);
+
+impl core::fmt::Display for BytesPerCycle {
+    fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+        let hundredths = self.0.saturating_mul(100) / self.1;
+        write!(f, "{}.{:02}", hundredths / 100, hundredths % 100)
+    }
+}
@@ -1,4 +1,8 @@
 // kernel/src/mem/mod.rs: M2 memory management (frame allocator, paging, heap, smoke test).
+mod bulk;
+
+use crate::serial;
+use crate::sync::SpinLock;
 use alloc::{boxed::Box, vec::Vec};
 use bootloader_api::{
     BootInfo,
@@ -6,10 +10,10 @@ use bootloader_api::{
 };
 use core::alloc::{GlobalAlloc, Layout};
 use core::cell::UnsafeCell;
+use core::cmp::min;
 use core::fmt;
-use core::hint::spin_loop;
 use core::ptr::{NonNull, null_mut};
-use core::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use core::sync::atomic::{AtomicU64, Ordering};
 use x86_64::registers::control::Cr3;
 use x86_64::structures::paging::{
     FrameAllocator, Mapper, Page, PageSize, PageTable, PageTableFlags, PhysFrame, Size4KiB,
@@ -17,6 +21,8 @@ use x86_64::structures::paging::{
 };
 use x86_64::{PhysAddr, VirtAddr};
 
+pub use bulk::log_benchmark;
+
 const PAGE_SIZE: usize = Size4KiB::SIZE as usize;
 const MIN_ALLOC_PHYS_ADDR: u64 = 0x10_0000;
 const HEAP_GUARD_BYTES: usize = PAGE_SIZE;
@@ -24,9 +30,15 @@ const HEAP_SIZE_BYTES: usize = 16 * 1024 * 1024;
 const HEAP_GUARD_LOW_START: u64 = 0x_4444_4444_0000;
 const HEAP_START: u64 = HEAP_GUARD_LOW_START + HEAP_GUARD_BYTES as u64;
 const HEAP_GUARD_HIGH_START: u64 = HEAP_START + HEAP_SIZE_BYTES as u64;
+const SLAB_MIN_BLOCK_BYTES: usize = 16;
+pub const SLAB_CLASS_COUNT: usize = 8;
+const SLAB_MAX_BLOCK_BYTES: usize = SLAB_MIN_BLOCK_BYTES << (SLAB_CLASS_COUNT - 1);
+const SLAB_BYTES: usize = 4 * PAGE_SIZE;
+const LINK_BYTES: usize = core::mem::size_of::<usize>();
+const FREE_REGION_ALIGN: usize = 2 * LINK_BYTES;
 
 #[global_allocator]
-static GLOBAL_ALLOCATOR: Locked<BumpAllocator> = Locked::new(BumpAllocator::new());
+static GLOBAL_ALLOCATOR: Locked<HeapAllocator> = Locked::new(HeapAllocator::new());
 static PHYSICAL_MEMORY_OFFSET: AtomicU64 = AtomicU64::new(0);
 
 #[derive(Clone, Copy)]
@@ -51,6 +63,74 @@ impl MemoryStats {
     }
 }
 
+#[derive(Clone, Copy)]
+pub struct HeapClassStats {
+    pub block_size: usize,
+    pub total_blocks: usize,
+    pub live_blocks: usize,
+    pub free_blocks: usize,
+    pub live_requested_bytes: usize,
+    pub hits: u64,
+    pub misses: u64,
+    pub frees: u64,
+    pub refill_failures: u64,
+}
+
+impl HeapClassStats {
+    const fn empty() -> Self {
+        Self {
+            block_size: 0,
+            total_blocks: 0,
+            live_blocks: 0,
+            free_blocks: 0,
+            live_requested_bytes: 0,
+            hits: 0,
+            misses: 0,
+            frees: 0,
+            refill_failures: 0,
+        }
+    }
+
+    pub fn reserved_bytes(self) -> usize {
+        self.total_blocks.saturating_mul(self.block_size)
+    }
+
+    /// Percentage of slab bytes not holding requested data (idle blocks plus rounding slack).
+    pub fn fragmentation_pct(self) -> u64 {
+        percent_unused(self.live_requested_bytes, self.reserved_bytes())
+    }
+}
+
+#[derive(Clone, Copy)]
+pub struct HeapStats {
+    pub heap_bytes: usize,
+    pub in_use_bytes: usize,
+    pub peak_in_use_bytes: usize,
+    pub failed_allocs: u64,
+    pub classes: [HeapClassStats; SLAB_CLASS_COUNT],
+    pub large_allocs: u64,
+    pub large_frees: u64,
+    pub large_live_bytes: usize,
+    pub free_region_bytes: usize,
+    pub free_regions: usize,
+    pub largest_free_region: usize,
+}
+
+impl HeapStats {
+    /// Percentage of free-list bytes unusable for a single allocation of the combined size.
+    pub fn external_fragmentation_pct(self) -> u64 {
+        percent_unused(self.largest_free_region, self.free_region_bytes)
+    }
+}
+
+fn percent_unused(used: usize, total: usize) -> u64 {
+    if total == 0 {
+        return 0;
+    }
+    let unused = total.saturating_sub(used) as u64;
+    unused.saturating_mul(100) / total as u64
+}
+
 pub struct MemoryInitReport {
     pub stats: MemoryStats,
     pub physical_memory_offset: u64,
@@ -66,6 +146,7 @@ pub struct MemoryInitReport {
     pub alloc_box_value: u64,
     pub alloc_vec_len: usize,
     pub alloc_checksum: u64,
+    pub alloc_reused: bool,
 }
 
 #[derive(Debug)]
@@ -152,6 +233,7 @@ pub fn init(boot_info: &'static BootInfo) -> Result<MemoryInitReport, MemoryErro
         alloc_box_value: alloc.box_value,
         alloc_vec_len: alloc.vec_len,
         alloc_checksum: alloc.checksum,
+        alloc_reused: alloc.reused,
     })
 }
 
@@ -160,6 +242,8 @@ pub fn virt_to_phys(virt_addr: usize) -> Option<u64> {
     if physical_memory_offset == 0 {
         return None;
     }
+    // A non-canonical address has no mapping, and `VirtAddr::new` would panic on it.
+    let virt = VirtAddr::try_new(virt_addr as u64).ok()?;
 
     let offset = VirtAddr::new(physical_memory_offset);
     let level_4_phys = Cr3::read().0.start_address();
@@ -171,9 +255,43 @@ pub fn virt_to_phys(virt_addr: usize) -> Option<u64> {
     let level_4_table = unsafe { &mut *level_4_ptr };
     // SAFETY: `level_4_table` references the active page table and `offset` is valid.
     let mapper = unsafe { OffsetPageTable::new(level_4_table, offset) };
-    mapper
-        .translate_addr(VirtAddr::new(virt_addr as u64))
-        .map(PhysAddr::as_u64)
+    mapper.translate_addr(virt).map(PhysAddr::as_u64)
+}
+
+pub fn heap_stats() -> HeapStats {
+    GLOBAL_ALLOCATOR.with_lock(|allocator| allocator.stats())
+}
+
+pub fn log_info() {
+    let stats = heap_stats();
+    serial::write_fmt(format_args!(
+        "mem: heap={} KiB in_use={} peak={} failed={} large_live={} large_allocs={} large_frees={} free={} regions={} largest={} ext_frag={}%\n",
+        stats.heap_bytes / 1024,
+        stats.in_use_bytes,
+        stats.peak_in_use_bytes,
+        stats.failed_allocs,
+        stats.large_live_bytes,
+        stats.large_allocs,
+        stats.large_frees,
+        stats.free_region_bytes,
+        stats.free_regions,
+        stats.largest_free_region,
+        stats.external_fragmentation_pct(),
+    ));
+    for class in stats.classes.iter() {
+        serial::write_fmt(format_args!(
+            "mem: slab={} blocks={} live={} free={} hits={} misses={} frees={} refill_fail={} frag={}%\n",
+            class.block_size,
+            class.total_blocks,
+            class.live_blocks,
+            class.free_blocks,
+            class.hits,
+            class.misses,
+            class.frees,
+            class.refill_failures,
+            class.fragmentation_pct(),
+        ));
+    }
 }
 
 pub fn phys_to_virt(phys_addr: u64) -> Option<usize> {
@@ -309,10 +427,21 @@ fn allocation_smoke_test() -> Result<AllocationSmokeReport, MemoryError> {
         return Err(MemoryError::AllocationSmokeFailed);
     }
 
+    // A freed slab block must be handed out again to the next same-class request.
+    let box_value = *boxed;
+    let freed_addr = &*boxed as *const u64 as usize;
+    drop(boxed);
+    let reused_box = Box::new(BOX_SENTINEL);
+    let reused = &*reused_box as *const u64 as usize == freed_addr;
+    if !reused {
+        return Err(MemoryError::AllocationSmokeFailed);
+    }
+
     Ok(AllocationSmokeReport {
-        box_value: *boxed,
+        box_value,
         vec_len: values.len(),
         checksum,
+        reused,
     })
 }
 
@@ -321,6 +450,7 @@ struct AllocationSmokeReport {
     box_value: u64,
     vec_len: usize,
     checksum: u64,
+    reused: bool,
 }
 
 struct BootInfoFrameAllocator {
@@ -439,57 +569,274 @@ fn align_up_usize(addr: usize, align: usize) -> Option<usize> {
 }
 
 struct Locked<T> {
-    locked: AtomicBool,
+    lock: SpinLock,
     value: UnsafeCell<T>,
 }
 
 impl<T> Locked<T> {
     const fn new(value: T) -> Self {
         Self {
-            locked: AtomicBool::new(false),
+            lock: SpinLock::new(),
             value: UnsafeCell::new(value),
         }
     }
 
     fn with_lock<R>(&self, f: impl FnOnce(&mut T) -> R) -> R {
-        while self.locked.swap(true, Ordering::Acquire) {
-            spin_loop();
-        }
-
+        let _guard = self.lock.lock();
         // SAFETY: lock is held, so this mutable reference is unique.
-        let result = unsafe { f(&mut *self.value.get()) };
-        self.locked.store(false, Ordering::Release);
-        result
+        unsafe { f(&mut *self.value.get()) }
     }
 }
 
 // SAFETY: `Locked<T>` serializes mutable access, so sharing is safe when `T: Send`.
 unsafe impl<T> Sync for Locked<T> where T: Send {}
 
-struct BumpAllocator {
+#[derive(Clone, Copy)]
+struct SlabClass {
+    block_size: usize,
+    free_head: usize,
+    free_blocks: usize,
+    total_blocks: usize,
+    live_blocks: usize,
+    live_requested_bytes: usize,
+    hits: u64,
+    misses: u64,
+    frees: u64,
+    refill_failures: u64,
+}
+
+impl SlabClass {
+    const fn new(block_size: usize) -> Self {
+        Self {
+            block_size,
+            free_head: 0,
+            free_blocks: 0,
+            total_blocks: 0,
+            live_blocks: 0,
+            live_requested_bytes: 0,
+            hits: 0,
+            misses: 0,
+            frees: 0,
+            refill_failures: 0,
+        }
+    }
+
+    fn push_free(&mut self, block: usize) {
+        // SAFETY: `block` is a heap-owned, unused block of at least `LINK_BYTES` bytes.
+        unsafe {
+            write_word(block, self.free_head);
+        }
+        self.free_head = block;
+        self.free_blocks = self.free_blocks.saturating_add(1);
+    }
+
+    fn pop_free(&mut self) -> Option<usize> {
+        if self.free_head == 0 {
+            return None;
+        }
+        let block = self.free_head;
+        // SAFETY: every block on the class free list stores the next link in its first word.
+        self.free_head = unsafe { read_word(block) };
+        self.free_blocks = self.free_blocks.saturating_sub(1);
+        Some(block)
+    }
+
+    fn stats(&self) -> HeapClassStats {
+        HeapClassStats {
+            block_size: self.block_size,
+            total_blocks: self.total_blocks,
+            live_blocks: self.live_blocks,
+            free_blocks: self.free_blocks,
+            live_requested_bytes: self.live_requested_bytes,
+            hits: self.hits,
+            misses: self.misses,
+            frees: self.frees,
+            refill_failures: self.refill_failures,
+        }
+    }
+}
+
+/// Address-ordered first-fit free list with coalescing; backs large allocations and slab refills.
+struct FreeListHeap {
+    head: usize,
+    free_bytes: usize,
+    free_regions: usize,
+}
+
+impl FreeListHeap {
+    const fn new() -> Self {
+        Self {
+            head: 0,
+            free_bytes: 0,
+            free_regions: 0,
+        }
+    }
+
+    /// Returns `[addr, addr + size)` to the free list.
+    ///
+    /// # Safety
+    /// The range must be inside the mapped heap, `FREE_REGION_ALIGN`-aligned, unused, and not
+    /// already present on the free list.
+    unsafe fn release(&mut self, addr: usize, size: usize) {
+        let mut prev = 0usize;
+        let mut cursor = self.head;
+        while cursor != 0 && cursor < addr {
+            prev = cursor;
+            // SAFETY: `cursor` is a free-list node written by this allocator.
+            cursor = unsafe { region_next(cursor) };
+        }
+
+        let mut start = addr;
+        let mut end = addr.saturating_add(size);
+        let mut next = cursor;
+
+        if next != 0 && next == end {
+            // SAFETY: `next` is a free-list node written by this allocator.
+            unsafe {
+                end = end.saturating_add(region_size(next));
+                next = region_next(next);
+            }
+            self.free_regions = self.free_regions.saturating_sub(1);
+        }
+
+        // SAFETY: `prev` (when non-zero) is a free-list node written by this allocator.
+        let merged_with_prev =
+            prev != 0 && unsafe { prev.saturating_add(region_size(prev)) } == start;
+        if merged_with_prev {
+            start = prev;
+        } else {
+            self.free_regions = self.free_regions.saturating_add(1);
+        }
+
+        // SAFETY: `[start, end)` is free heap memory large enough to hold a region header.
+        unsafe {
+            write_region(start, end - start, next);
+        }
+        if !merged_with_prev {
+            if prev == 0 {
+                self.head = start;
+            } else {
+                // SAFETY: `prev` is a free-list node that now links to the new region.
+                unsafe {
+                    set_region_next(prev, start);
+                }
+            }
+        }
+        self.free_bytes = self.free_bytes.saturating_add(size);
+    }
+
+    fn allocate(&mut self, size: usize, align: usize) -> Option<usize> {
+        let align = align.max(FREE_REGION_ALIGN);
+        let size = align_up_usize(size.max(FREE_REGION_ALIGN), FREE_REGION_ALIGN)?;
+
+        let mut prev = 0usize;
+        let mut cursor = self.head;
+        while cursor != 0 {
+            // SAFETY: `cursor` is a free-list node written by this allocator.
+            let (region_len, next) = unsafe { (region_size(cursor), region_next(cursor)) };
+            let region_end = cursor.saturating_add(region_len);
+            if let Some(start) = align_up_usize(cursor, align)
+                && let Some(end) = start.checked_add(size)
+                && end <= region_end
+            {
+                // Front and back remainders are multiples of `FREE_REGION_ALIGN`, so each is
+                // either empty or large enough to hold its own region header.
+                let front = start - cursor;
+                let back = region_end - end;
+                let mut link = next;
+                if back != 0 {
+                    // SAFETY: `[end, region_end)` is the unused tail of the region.
+                    unsafe {
+                        write_region(end, back, next);
+                    }
+                    link = end;
+                }
+                if front != 0 {
+                    // SAFETY: `cursor` keeps its header and shrinks to the front remainder.
+                    unsafe {
+                        write_region(cursor, front, link);
+                    }
+                } else if prev == 0 {
+                    self.head = link;
+                } else {
+                    // SAFETY: `prev` is a free-list node; relink it past the consumed region.
+                    unsafe {
+                        set_region_next(prev, link);
+                    }
+                }
+
+                let remainders = usize::from(front != 0) + usize::from(back != 0);
+                self.free_regions = self
+                    .free_regions
+                    .saturating_add(remainders)
+                    .saturating_sub(1);
+                self.free_bytes = self.free_bytes.saturating_sub(size);
+                return Some(start);
+            }
+            prev = cursor;
+            cursor = next;
+        }
+        None
+    }
+
+    fn largest_region(&self) -> usize {
+        let mut largest = 0usize;
+        let mut cursor = self.head;
+        while cursor != 0 {
+            // SAFETY: `cursor` is a free-list node written by this allocator.
+            unsafe {
+                largest = largest.max(region_size(cursor));
+                cursor = region_next(cursor);
+            }
+        }
+        largest
+    }
+}
+
+struct HeapAllocator {
     heap_start: usize,
     heap_end: usize,
-    next: usize,
-    allocations: usize,
     initialized: bool,
+    classes: [SlabClass; SLAB_CLASS_COUNT],
+    large: FreeListHeap,
+    large_live_bytes: usize,
+    large_allocs: u64,
+    large_frees: u64,
+    failed_allocs: u64,
+    in_use_bytes: usize,
+    peak_in_use_bytes: usize,
 }
 
-impl BumpAllocator {
+impl HeapAllocator {
     const fn new() -> Self {
+        let mut classes = [SlabClass::new(0); SLAB_CLASS_COUNT];
+        let mut index = 0usize;
+        while index < SLAB_CLASS_COUNT {
+            classes[index] = SlabClass::new(SLAB_MIN_BLOCK_BYTES << index);
+            index += 1;
+        }
         Self {
             heap_start: 0,
             heap_end: 0,
-            next: 0,
-            allocations: 0,
             initialized: false,
+            classes,
+            large: FreeListHeap::new(),
+            large_live_bytes: 0,
+            large_allocs: 0,
+            large_frees: 0,
+            failed_allocs: 0,
+            in_use_bytes: 0,
+            peak_in_use_bytes: 0,
         }
     }
 
     unsafe fn init(&mut self, heap_start: usize, heap_size: usize) {
         self.heap_start = heap_start;
         self.heap_end = heap_start.saturating_add(heap_size);
-        self.next = heap_start;
-        self.allocations = 0;
+        // SAFETY: caller guarantees the range is mapped, writable and page-aligned.
+        unsafe {
+            self.large.release(heap_start, heap_size);
+        }
         self.initialized = true;
     }
 
@@ -502,36 +849,178 @@ impl BumpAllocator {
             return NonNull::<u8>::dangling().as_ptr();
         }
 
-        let Some(start) = align_up_usize(self.next, layout.align()) else {
-            return null_mut();
-        };
-        let Some(end) = start.checked_add(layout.size()) else {
-            return null_mut();
+        let ptr = match slab_class_index(layout) {
+            Some(index) => self.allocate_small(index, layout.size()),
+            None => self.allocate_large(layout),
         };
+        match ptr {
+            Some(addr) => {
+                self.in_use_bytes = self.in_use_bytes.saturating_add(layout.size());
+                self.peak_in_use_bytes = self.peak_in_use_bytes.max(self.in_use_bytes);
+                addr as *mut u8
+            }
+            None => {
+                self.failed_allocs = self.failed_allocs.saturating_add(1);
+                null_mut()
+            }
+        }
+    }
 
-        if end > self.heap_end {
-            return null_mut();
+    fn deallocate(&mut self, ptr: *mut u8, layout: Layout) {
+        let addr = ptr as usize;
+        if layout.size() == 0 || addr < self.heap_start || addr >= self.heap_end {
+            return;
         }
 
-        self.next = end;
-        self.allocations = self.allocations.saturating_add(1);
-        start as *mut u8
+        self.in_use_bytes = self.in_use_bytes.saturating_sub(layout.size());
+        match slab_class_index(layout) {
+            Some(index) => {
+                let class = &mut self.classes[index];
+                class.live_blocks = class.live_blocks.saturating_sub(1);
+                class.live_requested_bytes =
+                    class.live_requested_bytes.saturating_sub(layout.size());
+                class.frees = class.frees.saturating_add(1);
+                class.push_free(addr);
+            }
+            None => {
+                let size = large_block_size(layout.size());
+                self.large_live_bytes = self.large_live_bytes.saturating_sub(size);
+                self.large_frees = self.large_frees.saturating_add(1);
+                // SAFETY: `addr` was returned by `allocate_large` for a block of `size` bytes.
+                unsafe {
+                    self.large.release(addr, size);
+                }
+            }
+        }
     }
 
-    fn deallocate(&mut self, _ptr: *mut u8, layout: Layout) {
-        if layout.size() == 0 || self.allocations == 0 {
-            return;
+    fn allocate_small(&mut self, index: usize, requested: usize) -> Option<usize> {
+        let block = match self.classes[index].pop_free() {
+            Some(block) => {
+                self.classes[index].hits = self.classes[index].hits.saturating_add(1);
+                block
+            }
+            None => {
+                self.classes[index].misses = self.classes[index].misses.saturating_add(1);
+                if !self.refill_class(index) {
+                    self.classes[index].refill_failures =
+                        self.classes[index].refill_failures.saturating_add(1);
+                    return None;
+                }
+                self.classes[index].pop_free()?
+            }
+        };
+
+        let class = &mut self.classes[index];
+        class.live_blocks = class.live_blocks.saturating_add(1);
+        class.live_requested_bytes = class.live_requested_bytes.saturating_add(requested);
+        Some(block)
+    }
+
+    fn refill_class(&mut self, index: usize) -> bool {
+        let block_size = self.classes[index].block_size;
+        // Fall back to a single block when the heap is too fragmented for a full slab.
+        let (slab_start, slab_len) = match self.large.allocate(SLAB_BYTES, PAGE_SIZE) {
+            Some(start) => (start, SLAB_BYTES),
+            None => match self.large.allocate(block_size, block_size) {
+                Some(start) => (start, block_size),
+                None => return false,
+            },
+        };
+
+        let class = &mut self.classes[index];
+        let blocks = slab_len / block_size;
+        // Push in reverse so the free list hands out ascending addresses.
+        for block in (0..blocks).rev() {
+            class.push_free(slab_start + block * block_size);
         }
+        class.total_blocks = class.total_blocks.saturating_add(blocks);
+        true
+    }
+
+    fn allocate_large(&mut self, layout: Layout) -> Option<usize> {
+        let size = large_block_size(layout.size());
+        let start = self.large.allocate(size, layout.align())?;
+        self.large_live_bytes = self.large_live_bytes.saturating_add(size);
+        self.large_allocs = self.large_allocs.saturating_add(1);
+        Some(start)
+    }
 
-        self.allocations -= 1;
-        if self.allocations == 0 {
-            self.next = self.heap_start;
+    fn stats(&self) -> HeapStats {
+        let mut classes = [HeapClassStats::empty(); SLAB_CLASS_COUNT];
+        for (slot, class) in classes.iter_mut().zip(self.classes.iter()) {
+            *slot = class.stats();
+        }
+        HeapStats {
+            heap_bytes: self.heap_end.saturating_sub(self.heap_start),
+            in_use_bytes: self.in_use_bytes,
+            peak_in_use_bytes: self.peak_in_use_bytes,
+            failed_allocs: self.failed_allocs,
+            classes,
+            large_allocs: self.large_allocs,
+            large_frees: self.large_frees,
+            large_live_bytes: self.large_live_bytes,
+            free_region_bytes: self.large.free_bytes,
+            free_regions: self.large.free_regions,
+            largest_free_region: self.large.largest_region(),
         }
     }
 }
 
+/// Maps a layout onto its slab class, or `None` when it must use the free-list backend.
+fn slab_class_index(layout: Layout) -> Option<usize> {
+    let needed = layout.size().max(layout.align()).max(SLAB_MIN_BLOCK_BYTES);
+    if needed > SLAB_MAX_BLOCK_BYTES {
+        return None;
+    }
+    let block = needed.next_power_of_two();
+    Some((block.trailing_zeros() - SLAB_MIN_BLOCK_BYTES.trailing_zeros()) as usize)
+}
+
+fn large_block_size(size: usize) -> usize {
+    align_up_usize(size.max(FREE_REGION_ALIGN), FREE_REGION_ALIGN).unwrap_or(usize::MAX)
+}
+
+/// # Safety
+/// `addr` must point to a mapped, word-aligned heap word owned by the allocator.
+unsafe fn read_word(addr: usize) -> usize {
+    // SAFETY: guaranteed by caller.
+    unsafe { (addr as *const usize).read() }
+}
+
+/// # Safety
+/// `addr` must point to a mapped, word-aligned heap word owned by the allocator.
+unsafe fn write_word(addr: usize, value: usize) {
+    // SAFETY: guaranteed by caller.
+    unsafe { (addr as *mut usize).write(value) }
+}
+
+// Free regions store `[size, next]` in their first two words.
+unsafe fn region_size(region: usize) -> usize {
+    // SAFETY: caller passes a free-list node, whose first word is its size.
+    unsafe { read_word(region) }
+}
+
+unsafe fn region_next(region: usize) -> usize {
+    // SAFETY: caller passes a free-list node, whose second word is the next link.
+    unsafe { read_word(region + LINK_BYTES) }
+}
+
+unsafe fn set_region_next(region: usize, next: usize) {
+    // SAFETY: caller passes a free-list node, whose second word is the next link.
+    unsafe { write_word(region + LINK_BYTES, next) }
+}
+
+unsafe fn write_region(region: usize, size: usize, next: usize) {
+    // SAFETY: caller passes unused heap memory of at least `FREE_REGION_ALIGN` bytes.
+    unsafe {
+        write_word(region, size);
+        write_word(region + LINK_BYTES, next);
+    }
+}
+
 // SAFETY: `Locked` guarantees exclusive access to the allocator state.
-unsafe impl GlobalAlloc for Locked<BumpAllocator> {
+unsafe impl GlobalAlloc for Locked<HeapAllocator> {
     unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
         self.with_lock(|allocator| allocator.allocate(layout))
     }
@@ -539,4 +1028,40 @@ unsafe impl GlobalAlloc for Locked<BumpAllocator> {
     unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
         self.with_lock(|allocator| allocator.deallocate(ptr, layout));
     }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        // Growing or shrinking inside the same slab class keeps the block in place.
+        if layout.size() != 0
+            && new_size != 0
+            && let Ok(new_layout) = Layout::from_size_align(new_size, layout.align())
+            && let Some(index) = slab_class_index(layout)
+            && slab_class_index(new_layout) == Some(index)
+        {
+            self.with_lock(|allocator| {
+                let class = &mut allocator.classes[index];
+                class.live_requested_bytes = class
+                    .live_requested_bytes
+                    .saturating_sub(layout.size())
+                    .saturating_add(new_size);
+                allocator.in_use_bytes = allocator
+                    .in_use_bytes
+                    .saturating_sub(layout.size())
+                    .saturating_add(new_size);
+                allocator.peak_in_use_bytes =
+                    allocator.peak_in_use_bytes.max(allocator.in_use_bytes);
+            });
+            return ptr;
+        }
+
+        // SAFETY: caller upholds `GlobalAlloc::realloc` requirements; `new_size` fits `layout`.
+        unsafe {
+            let new_layout = Layout::from_size_align_unchecked(new_size, layout.align());
+            let new_ptr = self.alloc(new_layout);
+            if !new_ptr.is_null() {
+                core::ptr::copy_nonoverlapping(ptr, new_ptr, min(layout.size(), new_size));
+                self.dealloc(ptr, layout);
+            }
+            new_ptr
+        }
+    }
 }
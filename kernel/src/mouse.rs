@@ -1,6 +1,7 @@
 // kernel/src/mouse.rs: PS/2 mouse init + packet decode + event queue for M8.1.
 use crate::arch::x86_64::port;
 use crate::serial;
+use crate::sync::spsc::SpscRing;
 use core::cell::UnsafeCell;
 use core::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
 
@@ -51,23 +52,19 @@ pub struct MouseInitReport {
     pub ack_enable: u8,
 }
 
-struct EventStorage(UnsafeCell<[MouseEvent; EVENT_QUEUE_CAPACITY]>);
 struct PacketStorage(UnsafeCell<[u8; 3]>);
 struct LastEventCell(UnsafeCell<MouseEvent>);
 
-// SAFETY: queue access is coordinated with SPSC atomic indices.
-unsafe impl Sync for EventStorage {}
 // SAFETY: packet bytes are only mutated in IRQ12 handler context.
 unsafe impl Sync for PacketStorage {}
 // SAFETY: last event writes are atomic via single producer (IRQ handler).
 unsafe impl Sync for LastEventCell {}
 
-static EVENTS: EventStorage = EventStorage(UnsafeCell::new([EMPTY_EVENT; EVENT_QUEUE_CAPACITY]));
+/// Filled by the IRQ12 handler, drained by the compositor.
+static EVENTS: SpscRing<MouseEvent, EVENT_QUEUE_CAPACITY> = SpscRing::new();
 static PACKET_BYTES: PacketStorage = PacketStorage(UnsafeCell::new([0; 3]));
 static LAST_EVENT: LastEventCell = LastEventCell(UnsafeCell::new(EMPTY_EVENT));
 
-static EVENT_HEAD: AtomicUsize = AtomicUsize::new(0);
-static EVENT_TAIL: AtomicUsize = AtomicUsize::new(0);
 static PACKET_INDEX: AtomicUsize = AtomicUsize::new(0);
 
 static READY: AtomicBool = AtomicBool::new(false);
@@ -75,7 +72,6 @@ static HAS_LAST_EVENT: AtomicBool = AtomicBool::new(false);
 
 static BYTES_RX: AtomicU64 = AtomicU64::new(0);
 static PACKETS_RX: AtomicU64 = AtomicU64::new(0);
-static EVENTS_DROPPED: AtomicU64 = AtomicU64::new(0);
 static BAD_SYNC: AtomicU64 = AtomicU64::new(0);
 
 static CTRL_BEFORE: AtomicUsize = AtomicUsize::new(0);
@@ -84,12 +80,10 @@ static ACK_DEFAULTS: AtomicUsize = AtomicUsize::new(0);
 static ACK_ENABLE: AtomicUsize = AtomicUsize::new(0);
 
 pub fn init() -> MouseInitReport {
-    EVENT_HEAD.store(0, Ordering::Relaxed);
-    EVENT_TAIL.store(0, Ordering::Relaxed);
+    EVENTS.clear();
     PACKET_INDEX.store(0, Ordering::Relaxed);
     BYTES_RX.store(0, Ordering::Relaxed);
     PACKETS_RX.store(0, Ordering::Relaxed);
-    EVENTS_DROPPED.store(0, Ordering::Relaxed);
     BAD_SYNC.store(0, Ordering::Relaxed);
     HAS_LAST_EVENT.store(false, Ordering::Relaxed);
     READY.store(false, Ordering::Relaxed);
@@ -131,27 +125,14 @@ pub fn handle_data_byte(byte: u8) {
 }
 
 pub fn pop_event() -> Option<MouseEvent> {
-    let tail = EVENT_TAIL.load(Ordering::Relaxed);
-    let head = EVENT_HEAD.load(Ordering::Acquire);
-    if tail == head {
-        return None;
-    }
-
-    // SAFETY: when tail != head this slot contains a valid event.
-    let event = unsafe {
-        let ptr = (*EVENTS.0.get()).as_ptr().add(tail);
-        ptr.read()
-    };
-    let next_tail = (tail + 1) % EVENT_QUEUE_CAPACITY;
-    EVENT_TAIL.store(next_tail, Ordering::Release);
-    Some(event)
+    EVENTS.pop()
 }
 
 pub fn log_info() {
     let ready = READY.load(Ordering::Acquire);
     let bytes = BYTES_RX.load(Ordering::Relaxed);
     let packets = PACKETS_RX.load(Ordering::Relaxed);
-    let dropped = EVENTS_DROPPED.load(Ordering::Relaxed);
+    let dropped = EVENTS.dropped();
     let bad_sync = BAD_SYNC.load(Ordering::Relaxed);
     let ctrl_before = CTRL_BEFORE.load(Ordering::Acquire) as u8;
     let ctrl_after = CTRL_AFTER.load(Ordering::Acquire) as u8;
@@ -195,22 +176,14 @@ pub fn log_info() {
 }
 
 fn push_event(event: MouseEvent) {
-    let head = EVENT_HEAD.load(Ordering::Relaxed);
-    let next_head = (head + 1) % EVENT_QUEUE_CAPACITY;
-    let tail = EVENT_TAIL.load(Ordering::Acquire);
-    if next_head == tail {
-        EVENTS_DROPPED.fetch_add(1, Ordering::Relaxed);
+    if !EVENTS.push(event) {
         return;
     }
-
-    // SAFETY: queue slot `head` is free when next_head != tail.
+    // SAFETY: the IRQ12 handler is the only writer of the last event.
     unsafe {
-        let ptr = (*EVENTS.0.get()).as_mut_ptr().add(head);
-        ptr.write(event);
         *LAST_EVENT.0.get() = event;
     }
     HAS_LAST_EVENT.store(true, Ordering::Release);
-    EVENT_HEAD.store(next_head, Ordering::Release);
 }
 
 fn decode_packet(packet: [u8; 3]) -> MouseEvent {
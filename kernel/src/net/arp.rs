@@ -0,0 +1,307 @@
+// kernel/src/net/arp.rs: hashed neighbor table with aging, negative entries and held packets.
+use crate::time::PIT_HZ;
+
+const NEIGHBOR_SETS: usize = 8;
+const NEIGHBOR_WAYS: usize = 4;
+pub const NEIGHBOR_ENTRIES: usize = NEIGHBOR_SETS * NEIGHBOR_WAYS;
+/// Packets waiting on resolution, shared by every incomplete neighbor.
+const HOLD_SLOTS: usize = 8;
+const HOLD_PER_NEIGHBOR: u8 = 4;
+const NO_SLOT: u8 = u8::MAX;
+const PROBE_INTERVAL_TICKS: u64 = PIT_HZ as u64 / 2;
+const MAX_PROBES: u8 = 3;
+/// A resolved entry is trusted this long after its last confirmation, then re-resolved.
+const REACHABLE_TICKS: u64 = 60 * PIT_HZ as u64;
+/// A failed resolution answers sends immediately for this long instead of probing again.
+const NEGATIVE_TICKS: u64 = 5 * PIT_HZ as u64;
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum NeighborState {
+    Empty,
+    Incomplete,
+    Reachable,
+    Failed,
+}
+
+#[derive(Clone, Copy)]
+struct Neighbor {
+    state: NeighborState,
+    ip: [u8; 4],
+    mac: [u8; 6],
+    /// Tick of the last confirmation (Reachable) or of the failure (Failed).
+    updated: u64,
+    probes: u8,
+    next_probe: u64,
+    held_head: u8,
+    held_tail: u8,
+    held_len: u8,
+}
+
+impl Neighbor {
+    const fn empty() -> Self {
+        Self {
+            state: NeighborState::Empty,
+            ip: [0; 4],
+            mac: [0; 6],
+            updated: 0,
+            probes: 0,
+            next_probe: 0,
+            held_head: NO_SLOT,
+            held_tail: NO_SLOT,
+            held_len: 0,
+        }
+    }
+}
+
+/// Outcome of looking up a next hop for an outgoing packet.
+pub enum Resolve {
+    Reachable([u8; 6]),
+    /// Resolution is in progress on entry `id`; hold the packet there.
+    Pending(usize),
+    /// Negative entry: the neighbor did not answer recently.
+    Failed,
+    /// Every way of the set is mid-resolution.
+    Full,
+}
+
+/// What `probe_due` wants done for an incomplete entry.
+pub enum Probe {
+    Idle,
+    Send([u8; 4]),
+    /// Out of probes; the entry is now negative and its held packets must be dropped.
+    Failed,
+}
+
+#[derive(Clone, Copy)]
+pub struct NeighborStats {
+    pub hits: u64,
+    pub misses: u64,
+    pub negative_hits: u64,
+    pub requests: u64,
+    pub failures: u64,
+    pub held: u64,
+    pub hold_drops: u64,
+    pub evictions: u64,
+}
+
+impl NeighborStats {
+    const fn new() -> Self {
+        Self {
+            hits: 0,
+            misses: 0,
+            negative_hits: 0,
+            requests: 0,
+            failures: 0,
+            held: 0,
+            hold_drops: 0,
+            evictions: 0,
+        }
+    }
+}
+
+/// Set-associative neighbor cache keyed on IPv4 address. `T` is the held packet type; the
+/// table only queues packets, and `NetState` transmits or frees them.
+pub struct NeighborTable<T> {
+    entries: [Neighbor; NEIGHBOR_ENTRIES],
+    held: [Option<T>; HOLD_SLOTS],
+    held_next: [u8; HOLD_SLOTS],
+    incomplete: usize,
+    pub stats: NeighborStats,
+}
+
+impl<T> NeighborTable<T> {
+    pub const fn new() -> Self {
+        Self {
+            entries: [Neighbor::empty(); NEIGHBOR_ENTRIES],
+            held: [const { None }; HOLD_SLOTS],
+            held_next: [NO_SLOT; HOLD_SLOTS],
+            incomplete: 0,
+            stats: NeighborStats::new(),
+        }
+    }
+
+    /// First way of the set `ip` hashes to (Fibonacci hashing of the address).
+    fn set_base(ip: [u8; 4]) -> usize {
+        let hash = u32::from_be_bytes(ip).wrapping_mul(0x9E37_79B9);
+        (hash >> (32 - NEIGHBOR_SETS.trailing_zeros())) as usize * NEIGHBOR_WAYS
+    }
+
+    fn find(&self, ip: [u8; 4]) -> Option<usize> {
+        let base = Self::set_base(ip);
+        (base..base + NEIGHBOR_WAYS).find(|&id| {
+            let entry = &self.entries[id];
+            entry.state != NeighborState::Empty && entry.ip == ip
+        })
+    }
+
+    /// Picks a way for a new entry: an empty one, else the least recently updated entry that
+    /// is not mid-resolution (those own held packets).
+    fn victim(&self, ip: [u8; 4]) -> Option<usize> {
+        let base = Self::set_base(ip);
+        let ways = base..base + NEIGHBOR_WAYS;
+        if let Some(id) = ways
+            .clone()
+            .find(|&id| self.entries[id].state == NeighborState::Empty)
+        {
+            return Some(id);
+        }
+        ways.filter(|&id| self.entries[id].state != NeighborState::Incomplete)
+            .min_by_key(|&id| self.entries[id].updated)
+    }
+
+    fn claim(&mut self, ip: [u8; 4]) -> Option<usize> {
+        let id = self.victim(ip)?;
+        if self.entries[id].state != NeighborState::Empty {
+            self.stats.evictions = self.stats.evictions.saturating_add(1);
+        }
+        self.entries[id] = Neighbor::empty();
+        self.entries[id].ip = ip;
+        Some(id)
+    }
+
+    fn set_state(&mut self, id: usize, state: NeighborState) {
+        let entry = &mut self.entries[id];
+        if entry.state == NeighborState::Incomplete {
+            self.incomplete -= 1;
+        }
+        if state == NeighborState::Incomplete {
+            self.incomplete += 1;
+            entry.probes = 0;
+        }
+        entry.state = state;
+    }
+
+    /// Resolves `ip` for a send, starting resolution on a miss or once an entry has aged out.
+    pub fn resolve(&mut self, ip: [u8; 4], now: u64) -> Resolve {
+        let id = match self.find(ip) {
+            Some(id) => id,
+            None => {
+                self.stats.misses = self.stats.misses.saturating_add(1);
+                let Some(id) = self.claim(ip) else {
+                    return Resolve::Full;
+                };
+                self.set_state(id, NeighborState::Incomplete);
+                self.entries[id].next_probe = now;
+                return Resolve::Pending(id);
+            }
+        };
+        let entry = self.entries[id];
+        match entry.state {
+            NeighborState::Reachable if now.saturating_sub(entry.updated) < REACHABLE_TICKS => {
+                self.stats.hits = self.stats.hits.saturating_add(1);
+                Resolve::Reachable(entry.mac)
+            }
+            NeighborState::Failed if now.saturating_sub(entry.updated) < NEGATIVE_TICKS => {
+                self.stats.negative_hits = self.stats.negative_hits.saturating_add(1);
+                Resolve::Failed
+            }
+            NeighborState::Incomplete => Resolve::Pending(id),
+            _ => {
+                self.stats.misses = self.stats.misses.saturating_add(1);
+                self.set_state(id, NeighborState::Incomplete);
+                self.entries[id].next_probe = now;
+                Resolve::Pending(id)
+            }
+        }
+    }
+
+    /// True while a recent resolution of `ip` failed; has no side effects.
+    pub fn is_failed(&self, ip: [u8; 4], now: u64) -> bool {
+        self.find(ip).is_some_and(|id| {
+            let entry = &self.entries[id];
+            entry.state == NeighborState::Failed
+                && now.saturating_sub(entry.updated) < NEGATIVE_TICKS
+        })
+    }
+
+    /// Records `ip` at `mac`. Existing entries are always updated; a new one is created only
+    /// when `create` is set (we were the ARP target). Returns the entry if it has held
+    /// packets to release.
+    pub fn learn(&mut self, ip: [u8; 4], mac: [u8; 6], now: u64, create: bool) -> Option<usize> {
+        let id = match self.find(ip) {
+            Some(id) => id,
+            None if create => self.claim(ip)?,
+            None => return None,
+        };
+        self.set_state(id, NeighborState::Reachable);
+        let entry = &mut self.entries[id];
+        entry.mac = mac;
+        entry.updated = now;
+        (entry.held_len > 0).then_some(id)
+    }
+
+    /// Queues `packet` on incomplete entry `id`, or hands it back when the queue is full.
+    pub fn hold(&mut self, id: usize, packet: T) -> Result<(), T> {
+        let Some(slot) = self.held.iter().position(Option::is_none) else {
+            self.stats.hold_drops = self.stats.hold_drops.saturating_add(1);
+            return Err(packet);
+        };
+        let entry = &mut self.entries[id];
+        if entry.state != NeighborState::Incomplete || entry.held_len >= HOLD_PER_NEIGHBOR {
+            self.stats.hold_drops = self.stats.hold_drops.saturating_add(1);
+            return Err(packet);
+        }
+        let link = slot as u8;
+        if entry.held_tail == NO_SLOT {
+            entry.held_head = link;
+        } else {
+            self.held_next[usize::from(entry.held_tail)] = link;
+        }
+        entry.held_tail = link;
+        entry.held_len += 1;
+        self.held_next[slot] = NO_SLOT;
+        self.held[slot] = Some(packet);
+        self.stats.held = self.stats.held.saturating_add(1);
+        Ok(())
+    }
+
+    /// Takes the oldest packet held on entry `id`.
+    pub fn pop_held(&mut self, id: usize) -> Option<T> {
+        let entry = &mut self.entries[id];
+        if entry.held_head == NO_SLOT {
+            return None;
+        }
+        let slot = usize::from(entry.held_head);
+        entry.held_head = self.held_next[slot];
+        if entry.held_head == NO_SLOT {
+            entry.held_tail = NO_SLOT;
+        }
+        entry.held_len -= 1;
+        self.held[slot].take()
+    }
+
+    pub fn has_incomplete(&self) -> bool {
+        self.incomplete > 0
+    }
+
+    /// Advances entry `id`'s resolution: sends the next request when due and gives up after
+    /// `MAX_PROBES`.
+    pub fn probe_due(&mut self, id: usize, now: u64) -> Probe {
+        let entry = self.entries[id];
+        if entry.state != NeighborState::Incomplete || now < entry.next_probe {
+            return Probe::Idle;
+        }
+        if entry.probes >= MAX_PROBES {
+            self.set_state(id, NeighborState::Failed);
+            self.entries[id].updated = now;
+            self.stats.failures = self.stats.failures.saturating_add(1);
+            return Probe::Failed;
+        }
+        let entry = &mut self.entries[id];
+        entry.probes += 1;
+        entry.next_probe = now.saturating_add(PROBE_INTERVAL_TICKS);
+        self.stats.requests = self.stats.requests.saturating_add(1);
+        Probe::Send(entry.ip)
+    }
+
+    pub fn resident(&self) -> usize {
+        self.entries
+            .iter()
+            .filter(|entry| entry.state != NeighborState::Empty)
+            .count()
+    }
+
+    pub fn incomplete(&self) -> usize {
+        self.incomplete
+    }
+}
@@ -0,0 +1,402 @@
+// kernel/src/net/dns.rs: A-record cache with TTLs, negative entries and coalesced queries.
+use super::push_bytes;
+use crate::time::PIT_HZ;
+
+pub const DNS_CACHE_ENTRIES: usize = 16;
+pub const DNS_NAME_MAX: usize = 253;
+/// Upper bounds of the latency histogram buckets in milliseconds; the last bucket is open.
+pub const DNS_LATENCY_BOUNDS_MS: [u64; 7] = [10, 20, 50, 100, 200, 500, 1000];
+const DNS_LATENCY_BUCKETS: usize = DNS_LATENCY_BOUNDS_MS.len() + 1;
+const RETRY_TICKS: u64 = PIT_HZ as u64;
+const MAX_TRIES: u8 = 3;
+/// Answers are kept at least this long and at most a day, whatever TTL they carry.
+const MIN_TTL_SECS: u64 = 1;
+const MAX_TTL_SECS: u64 = 86_400;
+/// NXDOMAIN and empty answers; RFC 2308 would take this from the SOA, which we do not parse.
+const MISSING_TTL_TICKS: u64 = 30 * PIT_HZ as u64;
+const TIMEOUT_TTL_TICKS: u64 = 5 * PIT_HZ as u64;
+const QUERY_PORT_BASE: u16 = 53000;
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum DnsState {
+    Empty,
+    Pending,
+    Address,
+    /// The server answered, but with no A record.
+    Missing,
+    /// No answer after `MAX_TRIES` queries.
+    TimedOut,
+}
+
+#[derive(Clone, Copy)]
+struct DnsEntry {
+    state: DnsState,
+    name: [u8; DNS_NAME_MAX],
+    name_len: usize,
+    ip: [u8; 4],
+    expires: u64,
+    txid: u16,
+    port: u16,
+    started: u64,
+    next_retry: u64,
+    tries: u8,
+}
+
+impl DnsEntry {
+    const fn empty() -> Self {
+        Self {
+            state: DnsState::Empty,
+            name: [0; DNS_NAME_MAX],
+            name_len: 0,
+            ip: [0; 4],
+            expires: 0,
+            txid: 0,
+            port: 0,
+            started: 0,
+            next_retry: 0,
+            tries: 0,
+        }
+    }
+
+    fn matches(&self, name: &str) -> bool {
+        self.state != DnsState::Empty
+            && self.name[..self.name_len].eq_ignore_ascii_case(name.as_bytes())
+    }
+}
+
+/// Cached outcome for a name.
+pub enum DnsCached {
+    Address([u8; 4]),
+    Missing,
+    TimedOut,
+    /// A query for the name is already in flight; the caller joins it.
+    Pending,
+    Miss,
+}
+
+/// Result of an A query, parsed by `parse_dns_a_response`.
+pub enum DnsAnswer {
+    Address { ip: [u8; 4], ttl_secs: u32 },
+    Missing,
+}
+
+#[derive(Clone, Copy)]
+pub struct DnsStats {
+    pub hits: u64,
+    pub negative_hits: u64,
+    pub misses: u64,
+    pub retries: u64,
+    pub timeouts: u64,
+    pub answers: u64,
+    pub missing: u64,
+    pub evictions: u64,
+    /// Query latency from the first send to the answer, bucketed by `DNS_LATENCY_BOUNDS_MS`.
+    pub latency: [u64; DNS_LATENCY_BUCKETS],
+}
+
+impl DnsStats {
+    const fn new() -> Self {
+        Self {
+            hits: 0,
+            negative_hits: 0,
+            misses: 0,
+            retries: 0,
+            timeouts: 0,
+            answers: 0,
+            missing: 0,
+            evictions: 0,
+            latency: [0; DNS_LATENCY_BUCKETS],
+        }
+    }
+}
+
+/// Fixed table of names with their answers or in-flight queries. `NetState` sends and
+/// receives the packets; this type keeps the state and builds and parses them.
+pub struct DnsCache {
+    entries: [DnsEntry; DNS_CACHE_ENTRIES],
+    pending: usize,
+    serial: u16,
+    pub stats: DnsStats,
+}
+
+impl DnsCache {
+    pub const fn new() -> Self {
+        Self {
+            entries: [DnsEntry::empty(); DNS_CACHE_ENTRIES],
+            pending: 0,
+            serial: 0,
+            stats: DnsStats::new(),
+        }
+    }
+
+    fn find(&self, name: &str) -> Option<usize> {
+        self.entries.iter().position(|entry| entry.matches(name))
+    }
+
+    /// Looks `name` up, dropping its entry if it has expired.
+    pub fn lookup(&mut self, name: &str, now: u64) -> DnsCached {
+        let Some(id) = self.find(name) else {
+            return DnsCached::Miss;
+        };
+        let entry = self.entries[id];
+        if entry.state == DnsState::Pending {
+            return DnsCached::Pending;
+        }
+        if now >= entry.expires {
+            self.entries[id] = DnsEntry::empty();
+            return DnsCached::Miss;
+        }
+        match entry.state {
+            DnsState::Address => {
+                self.stats.hits = self.stats.hits.saturating_add(1);
+                DnsCached::Address(entry.ip)
+            }
+            DnsState::Missing => {
+                self.stats.negative_hits = self.stats.negative_hits.saturating_add(1);
+                DnsCached::Missing
+            }
+            _ => {
+                self.stats.negative_hits = self.stats.negative_hits.saturating_add(1);
+                DnsCached::TimedOut
+            }
+        }
+    }
+
+    /// Claims an entry for a new query of `name`: an empty or expired one, else the one
+    /// expiring soonest. Pending entries are never evicted, so this fails when all are.
+    pub fn begin(&mut self, name: &str, now: u64, seed: u32) -> Option<usize> {
+        if name.len() > DNS_NAME_MAX {
+            return None;
+        }
+        let id = match self.entries.iter().position(|entry| {
+            entry.state == DnsState::Empty
+                || (entry.state != DnsState::Pending && now >= entry.expires)
+        }) {
+            Some(id) => id,
+            None => {
+                let id = (0..DNS_CACHE_ENTRIES)
+                    .filter(|&id| self.entries[id].state != DnsState::Pending)
+                    .min_by_key(|&id| self.entries[id].expires)?;
+                self.stats.evictions = self.stats.evictions.saturating_add(1);
+                id
+            }
+        };
+        self.serial = self.serial.wrapping_add(1);
+        let mut entry = DnsEntry::empty();
+        entry.state = DnsState::Pending;
+        entry.name[..name.len()].copy_from_slice(name.as_bytes());
+        entry.name_len = name.len();
+        entry.txid = (seed as u16) ^ self.serial.wrapping_mul(0x9E37);
+        entry.port = QUERY_PORT_BASE + (((seed >> 16) as u16 ^ self.serial) & 0x03ff);
+        entry.started = now;
+        entry.next_retry = now.saturating_add(RETRY_TICKS);
+        entry.tries = 1;
+        self.entries[id] = entry;
+        self.pending += 1;
+        self.stats.misses = self.stats.misses.saturating_add(1);
+        Some(id)
+    }
+
+    /// Forgets a query whose first send failed.
+    pub fn cancel(&mut self, id: usize) {
+        if self.entries[id].state == DnsState::Pending {
+            self.pending -= 1;
+            self.entries[id] = DnsEntry::empty();
+        }
+    }
+
+    /// Writes the query for pending entry `id` into `out` and returns its length and source
+    /// port.
+    pub fn encode_query(&self, id: usize, out: &mut [u8]) -> Option<(usize, u16)> {
+        let entry = &self.entries[id];
+        let mut len = 0usize;
+        let header = [0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00];
+        if !push_bytes(out, &mut len, &entry.txid.to_be_bytes())
+            || !push_bytes(out, &mut len, &header)
+            || !encode_dns_name(&entry.name[..entry.name_len], out, &mut len)
+            || !push_bytes(out, &mut len, &1u16.to_be_bytes())
+            || !push_bytes(out, &mut len, &1u16.to_be_bytes())
+        {
+            return None;
+        }
+        Some((len, entry.port))
+    }
+
+    pub fn has_pending(&self) -> bool {
+        self.pending > 0
+    }
+
+    /// Advances pending entry `id`'s retry timer. True when its query should be sent again;
+    /// after `MAX_TRIES` the entry becomes a negative `TimedOut` one instead.
+    pub fn due(&mut self, id: usize, now: u64) -> bool {
+        let entry = &mut self.entries[id];
+        if entry.state != DnsState::Pending || now < entry.next_retry {
+            return false;
+        }
+        if entry.tries >= MAX_TRIES {
+            entry.state = DnsState::TimedOut;
+            entry.expires = now.saturating_add(TIMEOUT_TTL_TICKS);
+            self.pending -= 1;
+            self.stats.timeouts = self.stats.timeouts.saturating_add(1);
+            return false;
+        }
+        entry.tries += 1;
+        entry.next_retry = now.saturating_add(RETRY_TICKS);
+        self.stats.retries = self.stats.retries.saturating_add(1);
+        true
+    }
+
+    /// Completes the pending query a response to local `port` answers. Returns false when
+    /// no query matches, so the datagram is handled as ordinary UDP.
+    pub fn on_response(&mut self, port: u16, packet: &[u8], now: u64) -> bool {
+        if self.pending == 0 {
+            return false;
+        }
+        let Some(id) = self
+            .entries
+            .iter()
+            .position(|entry| entry.state == DnsState::Pending && entry.port == port)
+        else {
+            return false;
+        };
+        let Some(answer) = parse_dns_a_response(packet, self.entries[id].txid) else {
+            return false;
+        };
+        let entry = &mut self.entries[id];
+        match answer {
+            DnsAnswer::Address { ip, ttl_secs } => {
+                let ttl = u64::from(ttl_secs).clamp(MIN_TTL_SECS, MAX_TTL_SECS);
+                entry.state = DnsState::Address;
+                entry.ip = ip;
+                entry.expires = now.saturating_add(ttl * PIT_HZ as u64);
+                self.stats.answers = self.stats.answers.saturating_add(1);
+            }
+            DnsAnswer::Missing => {
+                entry.state = DnsState::Missing;
+                entry.expires = now.saturating_add(MISSING_TTL_TICKS);
+                self.stats.missing = self.stats.missing.saturating_add(1);
+            }
+        }
+        let latency_ms = now.saturating_sub(entry.started) * 1000 / PIT_HZ as u64;
+        let bucket = DNS_LATENCY_BOUNDS_MS
+            .iter()
+            .position(|&bound| latency_ms <= bound)
+            .unwrap_or(DNS_LATENCY_BOUNDS_MS.len());
+        self.stats.latency[bucket] = self.stats.latency[bucket].saturating_add(1);
+        self.pending -= 1;
+        true
+    }
+
+    pub fn resident(&self) -> usize {
+        self.entries
+            .iter()
+            .filter(|entry| entry.state != DnsState::Empty)
+            .count()
+    }
+
+    pub fn pending(&self) -> usize {
+        self.pending
+    }
+}
+
+fn encode_dns_name(host: &[u8], dst: &mut [u8], cursor: &mut usize) -> bool {
+    for label in host.split(|&byte| byte == b'.') {
+        if label.is_empty() || label.len() > 63 {
+            return false;
+        }
+        if !push_bytes(dst, cursor, &[label.len() as u8]) || !push_bytes(dst, cursor, label) {
+            return false;
+        }
+    }
+    push_bytes(dst, cursor, &[0])
+}
+
+/// Parses a response to query `txid`. The first A record wins, with its TTL; NXDOMAIN and
+/// answers without one map to `Missing`. Other failures (SERVFAIL, malformed packets) give
+/// `None`, so the query is retried.
+fn parse_dns_a_response(packet: &[u8], txid: u16) -> Option<DnsAnswer> {
+    if packet.len() < 12 {
+        return None;
+    }
+    let id = u16::from_be_bytes([packet[0], packet[1]]);
+    if id != txid {
+        return None;
+    }
+    let flags = u16::from_be_bytes([packet[2], packet[3]]);
+    if (flags & 0x8000) == 0 {
+        return None;
+    }
+    match flags & 0x000f {
+        0 => {}
+        3 => return Some(DnsAnswer::Missing),
+        _ => return None,
+    }
+    let qdcount = u16::from_be_bytes([packet[4], packet[5]]) as usize;
+    let ancount = u16::from_be_bytes([packet[6], packet[7]]) as usize;
+    let mut offset = 12usize;
+
+    for _ in 0..qdcount {
+        offset = skip_dns_name(packet, offset)?;
+        if offset + 4 > packet.len() {
+            return None;
+        }
+        offset += 4;
+    }
+
+    for _ in 0..ancount {
+        offset = skip_dns_name(packet, offset)?;
+        if offset + 10 > packet.len() {
+            return None;
+        }
+        let rtype = u16::from_be_bytes([packet[offset], packet[offset + 1]]);
+        let class = u16::from_be_bytes([packet[offset + 2], packet[offset + 3]]);
+        let ttl_secs = u32::from_be_bytes([
+            packet[offset + 4],
+            packet[offset + 5],
+            packet[offset + 6],
+            packet[offset + 7],
+        ]);
+        let rdlen = u16::from_be_bytes([packet[offset + 8], packet[offset + 9]]) as usize;
+        offset += 10;
+        if offset + rdlen > packet.len() {
+            return None;
+        }
+        if rtype == 1 && class == 1 && rdlen == 4 {
+            let ip = [
+                packet[offset],
+                packet[offset + 1],
+                packet[offset + 2],
+                packet[offset + 3],
+            ];
+            return Some(DnsAnswer::Address { ip, ttl_secs });
+        }
+        offset += rdlen;
+    }
+    Some(DnsAnswer::Missing)
+}
+
+fn skip_dns_name(packet: &[u8], mut offset: usize) -> Option<usize> {
+    let mut steps = 0usize;
+    while steps < 128 {
+        if offset >= packet.len() {
+            return None;
+        }
+        let len = packet[offset];
+        if (len & 0xc0) == 0xc0 {
+            if offset + 1 >= packet.len() {
+                return None;
+            }
+            return Some(offset + 2);
+        }
+        if len == 0 {
+            return Some(offset + 1);
+        }
+        let label_len = len as usize;
+        if label_len > 63 || offset + 1 + label_len > packet.len() {
+            return None;
+        }
+        offset += 1 + label_len;
+        steps = steps.saturating_add(1);
+    }
+    None
+}
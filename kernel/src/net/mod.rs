@@ -1,13 +1,25 @@
-// kernel/src/net/mod.rs: M7 virtio-net legacy driver + minimal IPv4/ARP/ICMP/UDP stack.
-use crate::arch::x86_64::port;
+// kernel/src/net/mod.rs: M7 virtio-net legacy driver + minimal IPv4/ARP/ICMP/UDP/TCP stack.
+mod arp;
+mod dns;
+mod tcp;
+
+use crate::arch::x86_64::{interrupts, port};
 use crate::mem;
 use crate::serial;
+use crate::sync::SpinLock;
 use crate::time;
+use crate::trace::{self, Span};
+use arp::{NEIGHBOR_ENTRIES, NeighborTable, Probe, Resolve};
 use core::cell::UnsafeCell;
 use core::hint::spin_loop;
 use core::mem::size_of;
 use core::ptr::{addr_of, addr_of_mut, read_volatile, write_volatile};
-use core::sync::atomic::{AtomicBool, Ordering, fence};
+use core::sync::atomic::{AtomicBool, AtomicU16, AtomicU64, Ordering, fence};
+use dns::{DNS_CACHE_ENTRIES, DNS_LATENCY_BOUNDS_MS, DNS_NAME_MAX, DnsCache, DnsCached};
+pub use tcp::TCP_MAX_CONNECTIONS;
+use tcp::{
+    TCP_FLAG_ACK, TCP_FLAG_FIN, TCP_FLAG_RST, TCP_FLAG_SYN, TCP_MSS, TcpAbort, TcpSegment, TcpTable,
+};
 
 const VIRTIO_VENDOR_ID: u16 = 0x1AF4;
 const VIRTIO_NET_TRANSITIONAL_ID: u16 = 0x1000;
@@ -26,6 +38,17 @@ const VIRTIO_PCI_STATUS: u16 = 0x12;
 const VIRTIO_PCI_ISR: u16 = 0x13;
 const VIRTIO_PCI_DEVICE_CONFIG: u16 = 0x14;
 
+const VIRTIO_NET_F_CSUM: u32 = 1 << 0;
+const VIRTIO_NET_F_GUEST_CSUM: u32 = 1 << 1;
+const VIRTIO_NET_F_HOST_TSO4: u32 = 1 << 11;
+const VIRTIO_NET_F_MRG_RXBUF: u32 = 1 << 15;
+/// Offloads we accept when the host offers them; anything else stays off.
+const NET_WANTED_FEATURES: u32 =
+    VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_HOST_TSO4 | VIRTIO_NET_F_MRG_RXBUF;
+const VIRTIO_NET_HDR_F_NEEDS_CSUM: u8 = 1;
+const VIRTIO_NET_HDR_F_DATA_VALID: u8 = 2;
+const VIRTIO_NET_HDR_GSO_TCPV4: u8 = 1;
+
 const VIRTIO_STATUS_ACK: u8 = 1;
 const VIRTIO_STATUS_DRIVER: u8 = 2;
 const VIRTIO_STATUS_DRIVER_OK: u8 = 4;
@@ -33,6 +56,9 @@ const VIRTIO_STATUS_FAILED: u8 = 128;
 
 const VIRTQ_DESC_F_NEXT: u16 = 1;
 const VIRTQ_DESC_F_WRITE: u16 = 2;
+const VIRTQ_AVAIL_F_NO_INTERRUPT: u16 = 1;
+const VIRTQ_USED_F_NO_NOTIFY: u16 = 1;
+const VIRTIO_ISR_QUEUE: u8 = 1;
 
 const RX_QUEUE_INDEX: u16 = 0;
 const TX_QUEUE_INDEX: u16 = 1;
@@ -42,11 +68,35 @@ const VRING_ALIGN: usize = 4096;
 const MAX_POLL_SPINS: usize = 2_000_000;
 
 const NET_HDR_SIZE: usize = size_of::<VirtioNetHdr>();
+/// Without MRG_RXBUF the header ends before `num_buffers`.
+const NET_HDR_BASE_SIZE: usize = NET_HDR_SIZE - 2;
 const MAX_RX_FRAME: usize = 2048;
 const MAX_TX_FRAME: usize = 1536;
+/// Receive buffers kept posted so bursts land in the ring while the main loop is busy.
+const RX_BUFFER_COUNT: usize = 64;
+/// Transmit buffers; completed ones are reclaimed lazily on the next send.
+const TX_BUFFER_COUNT: usize = 32;
+/// Space reserved in front of a transmit payload for Ethernet, IPv4, and TCP headers.
+const TX_HEADROOM: usize = 64;
+const ETH_HDR_LEN: usize = 14;
+const IPV4_HDR_LEN: usize = 20;
+const UDP_HDR_LEN: usize = 8;
+const TCP_HDR_LEN: usize = 20;
+/// Large transmit buffers for TSO: one TCP segment of up to `TSO_MAX_PAYLOAD` bytes that the
+/// device cuts at the MSS.
+const TSO_BUFFER_COUNT: usize = 4;
+const TSO_FRAME_PAGES: usize = 4;
+const TSO_FRAME_BYTES: usize = TSO_FRAME_PAGES * 4096;
+const TSO_MAX_PAYLOAD: usize = TSO_FRAME_BYTES - TX_HEADROOM;
+/// TSO buffers follow the small pool's descriptor pairs, each owning a header descriptor plus
+/// one per page its frame may touch.
+const TSO_DESC_BASE: usize = TX_BUFFER_COUNT * 2;
+const TSO_DESC_PER_BUFFER: usize = 1 + TSO_FRAME_PAGES;
 const UDP_MAILBOX_CAP: usize = 512;
 const CURL_HTTP_BUF: usize = 2048;
 const CURL_WAIT_TICKS: u64 = 300;
+/// Datagram size for `net bench udp`; small packets, so the rate measures per-packet cost.
+const BENCH_UDP_PAYLOAD: usize = 64;
 const DHCP_WAIT_TICKS: u64 = 400;
 
 const LOCAL_IP: [u8; 4] = [10, 0, 2, 15];
@@ -61,7 +111,6 @@ const IP_BROADCAST: [u8; 4] = [255, 255, 255, 255];
 const IP_ZERO: [u8; 4] = [0, 0, 0, 0];
 const MAC_BROADCAST: [u8; 6] = [0xff; 6];
 const DHCP_MAGIC_COOKIE: [u8; 4] = [99, 130, 83, 99];
-const DNS_WAIT_TICKS: u64 = 300;
 
 const DHCP_OPT_SUBNET_MASK: u8 = 1;
 const DHCP_OPT_ROUTER: u8 = 3;
@@ -84,11 +133,10 @@ const IP_PROTO_TCP: u8 = 6;
 const IP_PROTO_ICMP: u8 = 1;
 const IP_PROTO_UDP: u8 = 17;
 
-const TCP_FLAG_FIN: u16 = 0x01;
-const TCP_FLAG_SYN: u16 = 0x02;
-const TCP_FLAG_RST: u16 = 0x04;
-const TCP_FLAG_PSH: u16 = 0x08;
-const TCP_FLAG_ACK: u16 = 0x10;
+/// MSS option added to our SYN; every other segment carries the bare 20-byte header.
+const TCP_OPT_MSS: u8 = 2;
+/// Segments one connection may emit per flush before yielding to the rest of `poll`.
+const TCP_FLUSH_BURST: usize = 32;
 
 const fn align_up(value: usize, align: usize) -> usize {
     (value + (align - 1)) & !(align - 1)
@@ -145,30 +193,76 @@ struct VirtioNetHdr {
     gso_size: u16,
     csum_start: u16,
     csum_offset: u16,
+    num_buffers: u16,
 }
 
+// Headers are padded to 16 bytes and frames aligned to their size rounded to 2 KiB, so no
+// DMA segment crosses a page boundary.
 #[repr(C, align(16))]
-struct RxBuffer {
+#[derive(Clone, Copy)]
+struct NetHdrSlot {
     hdr: VirtioNetHdr,
-    frame: [u8; MAX_RX_FRAME],
 }
 
-#[repr(C, align(16))]
-struct TxBuffer {
-    hdr: VirtioNetHdr,
-    frame: [u8; MAX_TX_FRAME],
+#[repr(C, align(2048))]
+#[derive(Clone, Copy)]
+struct RxFrame {
+    bytes: [u8; MAX_RX_FRAME],
+}
+
+#[repr(C, align(2048))]
+#[derive(Clone, Copy)]
+struct TxFrame {
+    bytes: [u8; TX_HEADROOM + MAX_TX_FRAME],
+}
+
+struct RxBuffers {
+    hdrs: [NetHdrSlot; RX_BUFFER_COUNT],
+    frames: [RxFrame; RX_BUFFER_COUNT],
+}
+
+struct TxBuffers {
+    hdrs: [NetHdrSlot; TX_BUFFER_COUNT],
+    frames: [TxFrame; TX_BUFFER_COUNT],
+}
+
+// Page-aligned so each frame page is one DMA segment.
+#[repr(C, align(4096))]
+#[derive(Clone, Copy)]
+struct TsoFrame {
+    bytes: [u8; TSO_FRAME_BYTES],
+}
+
+struct TsoBuffers {
+    hdrs: [NetHdrSlot; TSO_BUFFER_COUNT],
+    frames: [TsoFrame; TSO_BUFFER_COUNT],
 }
 
+const EMPTY_NET_HDR: NetHdrSlot = NetHdrSlot {
+    hdr: VirtioNetHdr {
+        flags: 0,
+        gso_type: 0,
+        hdr_len: 0,
+        gso_size: 0,
+        csum_start: 0,
+        csum_offset: 0,
+        num_buffers: 0,
+    },
+};
+
 struct QueueMemoryCell(UnsafeCell<QueueMemory>);
-struct RxBufferCell(UnsafeCell<RxBuffer>);
-struct TxBufferCell(UnsafeCell<TxBuffer>);
+struct RxBuffersCell(UnsafeCell<RxBuffers>);
+struct TxBuffersCell(UnsafeCell<TxBuffers>);
+struct TsoBuffersCell(UnsafeCell<TsoBuffers>);
 
 // SAFETY: synchronized via `NET_LOCK`.
 unsafe impl Sync for QueueMemoryCell {}
 // SAFETY: synchronized via `NET_LOCK`.
-unsafe impl Sync for RxBufferCell {}
+unsafe impl Sync for RxBuffersCell {}
 // SAFETY: synchronized via `NET_LOCK`.
-unsafe impl Sync for TxBufferCell {}
+unsafe impl Sync for TxBuffersCell {}
+// SAFETY: synchronized via `NET_LOCK`.
+unsafe impl Sync for TsoBuffersCell {}
 
 static RX_QUEUE_MEMORY: QueueMemoryCell = QueueMemoryCell(UnsafeCell::new(QueueMemory {
     bytes: [0; VRING_BYTES],
@@ -177,43 +271,108 @@ static TX_QUEUE_MEMORY: QueueMemoryCell = QueueMemoryCell(UnsafeCell::new(QueueM
     bytes: [0; VRING_BYTES],
 }));
 
-static RX_BUFFER: RxBufferCell = RxBufferCell(UnsafeCell::new(RxBuffer {
-    hdr: VirtioNetHdr {
-        flags: 0,
-        gso_type: 0,
-        hdr_len: 0,
-        gso_size: 0,
-        csum_start: 0,
-        csum_offset: 0,
-    },
-    frame: [0; MAX_RX_FRAME],
+static RX_BUFFERS: RxBuffersCell = RxBuffersCell(UnsafeCell::new(RxBuffers {
+    hdrs: [EMPTY_NET_HDR; RX_BUFFER_COUNT],
+    frames: [RxFrame {
+        bytes: [0; MAX_RX_FRAME],
+    }; RX_BUFFER_COUNT],
 }));
 
-static TX_BUFFER: TxBufferCell = TxBufferCell(UnsafeCell::new(TxBuffer {
-    hdr: VirtioNetHdr {
-        flags: 0,
-        gso_type: 0,
-        hdr_len: 0,
-        gso_size: 0,
-        csum_start: 0,
-        csum_offset: 0,
-    },
-    frame: [0; MAX_TX_FRAME],
+static TX_BUFFERS: TxBuffersCell = TxBuffersCell(UnsafeCell::new(TxBuffers {
+    hdrs: [EMPTY_NET_HDR; TX_BUFFER_COUNT],
+    frames: [TxFrame {
+        bytes: [0; TX_HEADROOM + MAX_TX_FRAME],
+    }; TX_BUFFER_COUNT],
+}));
+
+static TSO_BUFFERS: TsoBuffersCell = TsoBuffersCell(UnsafeCell::new(TsoBuffers {
+    hdrs: [EMPTY_NET_HDR; TSO_BUFFER_COUNT],
+    frames: [TsoFrame {
+        bytes: [0; TSO_FRAME_BYTES],
+    }; TSO_BUFFER_COUNT],
 }));
 
+/// Set up by `try_init` for the interrupt handler, which must not take `NET_LOCK`: the main
+/// loop may hold it when the IRQ arrives.
+static NET_IRQ_IO_BASE: AtomicU16 = AtomicU16::new(0);
+static NET_IRQ_COUNT: AtomicU64 = AtomicU64::new(0);
+static NET_IRQ_MASKED: AtomicBool = AtomicBool::new(false);
+
+/// Transmit packet buffer leased from the TX pool or, for TSO segments, the TSO pool. The
+/// payload is written at `TX_HEADROOM` and each layer prepends its header in front of the bytes
+/// already there, so the finished frame goes to the device from the buffer it was built in.
+/// `offload` becomes the buffer's virtio-net header.
+struct TxPbuf {
+    index: usize,
+    tso: bool,
+    start: usize,
+    end: usize,
+    offload: VirtioNetHdr,
+}
+
+impl TxPbuf {
+    fn bytes_mut(&mut self) -> &mut [u8] {
+        // SAFETY: the lease owns buffer `index` of its pool until `transmit_pbuf` hands it to
+        // the device, and `NET_LOCK` is held by every caller.
+        unsafe {
+            if self.tso {
+                &mut (*TSO_BUFFERS.0.get()).frames[self.index].bytes
+            } else {
+                &mut (*TX_BUFFERS.0.get()).frames[self.index].bytes
+            }
+        }
+    }
+
+    fn len(&self) -> usize {
+        self.end - self.start
+    }
+
+    /// Appends `len` payload bytes; callers check sizes before leasing the buffer.
+    fn append(&mut self, len: usize) -> &mut [u8] {
+        let start = self.end;
+        self.end += len;
+        let end = self.end;
+        &mut self.bytes_mut()[start..end]
+    }
+
+    /// Claims `len` bytes of headroom in front of the current contents.
+    fn push_header(&mut self, len: usize) -> &mut [u8] {
+        self.start -= len;
+        let start = self.start;
+        &mut self.bytes_mut()[start..start + len]
+    }
+
+    /// The bytes from the current start, i.e. the outermost header and everything after it.
+    fn contents_mut(&mut self) -> &mut [u8] {
+        let (start, end) = (self.start, self.end);
+        &mut self.bytes_mut()[start..end]
+    }
+}
+
+/// Receive buffer being processed in place. `handle_udp` may keep it for the mailbox, in
+/// which case `poll_rx_once` does not requeue it.
+#[derive(Clone, Copy)]
+struct RxLease {
+    head: u16,
+    base: usize,
+}
+
+/// Last routing decision; cleared whenever the address, netmask or gateway changes.
 #[derive(Clone, Copy)]
-struct ArpEntry {
+struct RouteCache {
     valid: bool,
-    ip: [u8; 4],
-    mac: [u8; 6],
+    dst: [u8; 4],
+    next_hop: [u8; 4],
+    via_gateway: bool,
 }
 
-impl ArpEntry {
+impl RouteCache {
     const fn empty() -> Self {
         Self {
             valid: false,
-            ip: [0; 4],
-            mac: [0; 6],
+            dst: [0; 4],
+            next_hop: [0; 4],
+            via_gateway: false,
         }
     }
 }
@@ -260,6 +419,13 @@ struct NetStats {
     route_direct: u64,
     route_gateway: u64,
     dropped: u64,
+    rx_batch_max: u64,
+    tx_reclaimed: u64,
+    tx_ring_full: u64,
+    tx_csum_offload: u64,
+    tx_tso: u64,
+    rx_csum_valid: u64,
+    rx_merged_drop: u64,
 }
 
 impl NetStats {
@@ -282,6 +448,13 @@ impl NetStats {
             route_direct: 0,
             route_gateway: 0,
             dropped: 0,
+            rx_batch_max: 0,
+            tx_reclaimed: 0,
+            tx_ring_full: 0,
+            tx_csum_offload: 0,
+            tx_tso: 0,
+            rx_csum_valid: 0,
+            rx_merged_drop: 0,
         }
     }
 }
@@ -309,14 +482,17 @@ impl LastUdp {
     }
 }
 
+/// Latest datagram for `udp_recv`. The data stays in its receive buffer, which is kept off
+/// the RX ring until the datagram is read or replaced.
 #[derive(Clone, Copy)]
 struct UdpMailbox {
     valid: bool,
     src_ip: [u8; 4],
     src_port: u16,
     dst_port: u16,
+    rx_head: u16,
+    offset: usize,
     len: usize,
-    data: [u8; UDP_MAILBOX_CAP],
 }
 
 impl UdpMailbox {
@@ -326,8 +502,9 @@ impl UdpMailbox {
             src_ip: [0; 4],
             src_port: 0,
             dst_port: 0,
+            rx_head: 0,
+            offset: 0,
             len: 0,
-            data: [0; UDP_MAILBOX_CAP],
         }
     }
 }
@@ -370,45 +547,17 @@ impl DhcpOffer {
     }
 }
 
+/// Fields of an outbound TCP header other than the checksum and options.
 #[derive(Clone, Copy)]
-struct PendingHttpCurl {
-    active: bool,
-    dst_mac: [u8; 6],
-    remote_ip: [u8; 4],
-    remote_port: u16,
+struct TcpHeader {
     local_port: u16,
-    seq_next: u32,
-    ack_next: u32,
-    established: bool,
-    sent_request: bool,
-    finished: bool,
-    status_code: u16,
-    response_len: usize,
-    response: [u8; CURL_HTTP_BUF],
-}
-
-impl PendingHttpCurl {
-    const fn empty() -> Self {
-        Self {
-            active: false,
-            dst_mac: [0; 6],
-            remote_ip: [0; 4],
-            remote_port: 0,
-            local_port: 0,
-            seq_next: 0,
-            ack_next: 0,
-            established: false,
-            sent_request: false,
-            finished: false,
-            status_code: 0,
-            response_len: 0,
-            response: [0; CURL_HTTP_BUF],
-        }
-    }
-
-    fn clear(&mut self) {
-        *self = Self::empty();
-    }
+    remote_port: u16,
+    seq: u32,
+    ack: u32,
+    flags: u16,
+    window: u16,
+    /// MSS the device cuts a TSO payload at; larger payloads are only built in TSO buffers.
+    segment_size: u16,
 }
 
 #[derive(Clone, Copy)]
@@ -433,6 +582,20 @@ pub struct UdpRxMeta {
     pub len: usize,
 }
 
+/// Outcome of a non-blocking TCP read.
+#[derive(Clone, Copy)]
+/// Result of a non-blocking name lookup; `Pending` means poll again later.
+pub enum DnsLookup {
+    Resolved([u8; 4]),
+    Pending,
+}
+
+pub enum TcpRecv {
+    Data(usize),
+    WouldBlock,
+    Eof,
+}
+
 #[derive(Clone, Copy, Eq, PartialEq)]
 pub enum NetError {
     NotReady,
@@ -443,7 +606,13 @@ pub enum NetError {
     FrameTooLarge,
     IoTimeout,
     ArpTimeout,
+    ArpQueueFull,
+    DnsBusy,
     UdpPayloadTooLarge,
+    TcpNoSocket,
+    TcpBadSocket,
+    TcpNotConnected,
+    TcpReset,
 }
 
 impl NetError {
@@ -457,7 +626,13 @@ impl NetError {
             Self::FrameTooLarge => "frame_too_large",
             Self::IoTimeout => "io_timeout",
             Self::ArpTimeout => "arp_timeout",
+            Self::ArpQueueFull => "arp_queue_full",
+            Self::DnsBusy => "dns_busy",
             Self::UdpPayloadTooLarge => "udp_payload_too_large",
+            Self::TcpNoSocket => "tcp_no_socket",
+            Self::TcpBadSocket => "tcp_bad_socket",
+            Self::TcpNotConnected => "tcp_not_connected",
+            Self::TcpReset => "tcp_reset",
         }
     }
 }
@@ -469,6 +644,7 @@ struct PciLocation {
     function: u8,
     device_id: u16,
     io_base: u16,
+    irq_line: u8,
 }
 
 struct NetCell(UnsafeCell<NetState>);
@@ -499,18 +675,35 @@ struct NetState {
     rx_avail: u16,
     tx_last_used: u16,
     tx_avail: u16,
-    rx_hdr_phys: u64,
-    rx_frame_phys: u64,
-    tx_hdr_phys: u64,
-    tx_frame_phys: u64,
+    rx_buffers: u16,
+    tx_buffers: u16,
+    tx_free: [u16; TX_BUFFER_COUNT],
+    tx_free_len: usize,
+    tx_frame_phys: [u64; TX_BUFFER_COUNT],
+    /// Negotiated `VIRTIO_NET_F_*` bits and the header length they imply.
+    features: u32,
+    net_hdr_len: usize,
+    /// Zero when the device lacks HOST_TSO4 or the TX ring is too small for the TSO chains.
+    tso_buffers: u16,
+    tso_free: [u16; TSO_BUFFER_COUNT],
+    tso_free_len: usize,
+    tso_page_phys: [[u64; TSO_FRAME_PAGES]; TSO_BUFFER_COUNT],
+    rx_current: Option<RxLease>,
+    /// Continuation buffers of a merged receive still to be returned to the ring.
+    rx_merge_skip: u16,
+    /// The device vouched for the current frame's checksums (`DATA_VALID` or `NEEDS_CSUM`).
+    rx_csum_valid: bool,
+    irq_line: Option<u8>,
     next_ip_id: u16,
     next_ping_seq: u16,
-    arp: [ArpEntry; 8],
+    neighbors: NeighborTable<TxPbuf>,
+    route: RouteCache,
     pending_ping: PendingPing,
     stats: NetStats,
     last_udp: LastUdp,
     udp_mailbox: UdpMailbox,
-    pending_http: PendingHttpCurl,
+    tcp: TcpTable,
+    dns_cache: DnsCache,
     dhcp_xid: u32,
     dhcp_offer: DhcpOffer,
     dhcp_bound: bool,
@@ -538,18 +731,31 @@ impl NetState {
             rx_avail: 0,
             tx_last_used: 0,
             tx_avail: 0,
-            rx_hdr_phys: 0,
-            rx_frame_phys: 0,
-            tx_hdr_phys: 0,
-            tx_frame_phys: 0,
+            rx_buffers: 0,
+            tx_buffers: 0,
+            tx_free: [0; TX_BUFFER_COUNT],
+            tx_free_len: 0,
+            tx_frame_phys: [0; TX_BUFFER_COUNT],
+            features: 0,
+            net_hdr_len: NET_HDR_BASE_SIZE,
+            tso_buffers: 0,
+            tso_free: [0; TSO_BUFFER_COUNT],
+            tso_free_len: 0,
+            tso_page_phys: [[0; TSO_FRAME_PAGES]; TSO_BUFFER_COUNT],
+            rx_current: None,
+            rx_merge_skip: 0,
+            rx_csum_valid: false,
+            irq_line: None,
             next_ip_id: 1,
             next_ping_seq: 1,
-            arp: [ArpEntry::empty(); 8],
+            neighbors: NeighborTable::new(),
+            route: RouteCache::empty(),
             pending_ping: PendingPing::empty(),
             stats: NetStats::new(),
             last_udp: LastUdp::empty(),
             udp_mailbox: UdpMailbox::empty(),
-            pending_http: PendingHttpCurl::empty(),
+            tcp: TcpTable::new(),
+            dns_cache: DnsCache::new(),
             dhcp_xid: 0,
             dhcp_offer: DhcpOffer::empty(),
             dhcp_bound: false,
@@ -609,20 +815,38 @@ impl NetState {
         self.virtio_write_status(0);
         self.virtio_write_status(VIRTIO_STATUS_ACK);
         self.virtio_write_status(VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
-        let _ = self.virtio_read_u32(VIRTIO_PCI_HOST_FEATURES);
-        self.virtio_write_u32(VIRTIO_PCI_GUEST_FEATURES, 0);
+        let mut features = self.virtio_read_u32(VIRTIO_PCI_HOST_FEATURES) & NET_WANTED_FEATURES;
+        // TSO hands the device partial checksums, so it is only valid together with CSUM.
+        if features & VIRTIO_NET_F_CSUM == 0 {
+            features &= !VIRTIO_NET_F_HOST_TSO4;
+        }
+        self.virtio_write_u32(VIRTIO_PCI_GUEST_FEATURES, features);
+        self.features = features;
+        self.net_hdr_len = if features & VIRTIO_NET_F_MRG_RXBUF != 0 {
+            NET_HDR_SIZE
+        } else {
+            NET_HDR_BASE_SIZE
+        };
 
         self.setup_queue(RX_QUEUE_INDEX)?;
         self.setup_queue(TX_QUEUE_INDEX)?;
-        self.setup_buffers_phys()?;
-        self.setup_rx_descriptors()?;
-        self.post_rx_buffer()?;
+        self.setup_rx_ring()?;
+        self.setup_tx_pool()?;
+        self.setup_tso_pool()?;
 
         self.virtio_write_status(
             VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK,
         );
         self.ready = true;
 
+        NET_IRQ_IO_BASE.store(self.io_base, Ordering::Release);
+        if device.irq_line != 0 && device.irq_line < 16 {
+            let _ = self.virtio_read_u8(VIRTIO_PCI_ISR);
+            if interrupts::enable_net_irq(device.irq_line) {
+                self.irq_line = Some(device.irq_line);
+            }
+        }
+
         if !self.try_dhcp()? {
             self.config_source = IpConfigSource::Static;
             serial::write_line("Net: DHCP unavailable, using static 10.0.2.15/24 gw 10.0.2.2");
@@ -691,95 +915,266 @@ impl NetState {
         Ok(())
     }
 
-    fn setup_buffers_phys(&mut self) -> Result<(), NetError> {
-        let rx_hdr = rx_hdr_ptr() as usize;
-        let rx_frame = rx_frame_ptr() as usize;
-        let tx_hdr = tx_hdr_ptr() as usize;
-        let tx_frame = tx_frame_ptr() as usize;
-        self.rx_hdr_phys = mem::virt_to_phys(rx_hdr).ok_or(NetError::AddressTranslationFailed)?;
-        self.rx_frame_phys =
-            mem::virt_to_phys(rx_frame).ok_or(NetError::AddressTranslationFailed)?;
-        self.tx_hdr_phys = mem::virt_to_phys(tx_hdr).ok_or(NetError::AddressTranslationFailed)?;
-        self.tx_frame_phys =
-            mem::virt_to_phys(tx_frame).ok_or(NetError::AddressTranslationFailed)?;
+    /// Chains a header and frame descriptor per receive buffer (buffer `i` owns descriptors
+    /// `2i` and `2i + 1`) and posts every buffer with a single notify.
+    fn setup_rx_ring(&mut self) -> Result<(), NetError> {
+        let count = RX_BUFFER_COUNT.min(usize::from(self.rx_queue_size) / 2);
+        if count == 0 {
+            return Err(NetError::QueueUnavailable);
+        }
+        for index in 0..count {
+            // SAFETY: `NET_LOCK` is held; only addresses of the static buffers are taken.
+            let (hdr, frame) = unsafe {
+                let buffers = RX_BUFFERS.0.get();
+                (
+                    addr_of_mut!((*buffers).hdrs[index]) as usize,
+                    addr_of_mut!((*buffers).frames[index]) as usize,
+                )
+            };
+            let hdr_phys = mem::virt_to_phys(hdr).ok_or(NetError::AddressTranslationFailed)?;
+            let frame_phys = mem::virt_to_phys(frame).ok_or(NetError::AddressTranslationFailed)?;
+            let head = (index * 2) as u16;
+            // SAFETY: descriptors `head` and `head + 1` belong to this buffer and the queue is
+            // not live yet.
+            unsafe {
+                let desc = queue_desc_ptr(RX_QUEUE_INDEX);
+                write_volatile(
+                    desc.add(usize::from(head)),
+                    VirtqDesc {
+                        addr: hdr_phys,
+                        len: self.net_hdr_len as u32,
+                        flags: VIRTQ_DESC_F_NEXT | VIRTQ_DESC_F_WRITE,
+                        next: head + 1,
+                    },
+                );
+                write_volatile(
+                    desc.add(usize::from(head) + 1),
+                    VirtqDesc {
+                        addr: frame_phys,
+                        len: MAX_RX_FRAME as u32,
+                        flags: VIRTQ_DESC_F_WRITE,
+                        next: 0,
+                    },
+                );
+            }
+            self.queue_rx_buffer(head);
+        }
+        self.rx_buffers = count as u16;
+        self.publish_rx_buffers();
         Ok(())
     }
 
-    fn setup_rx_descriptors(&mut self) -> Result<(), NetError> {
-        // SAFETY: descriptor memory belongs to queue0 and access is serialized by `NET_LOCK`.
+    /// Fixes each transmit buffer's descriptor pair and marks every buffer free. The device is
+    /// asked not to interrupt on TX completion; used entries are reclaimed on demand.
+    fn setup_tx_pool(&mut self) -> Result<(), NetError> {
+        let count = TX_BUFFER_COUNT.min(usize::from(self.tx_queue_size) / 2);
+        if count == 0 {
+            return Err(NetError::QueueUnavailable);
+        }
+        for index in 0..count {
+            // SAFETY: `NET_LOCK` is held; only addresses of the static buffers are taken.
+            let (hdr, frame) = unsafe {
+                let buffers = TX_BUFFERS.0.get();
+                (
+                    addr_of_mut!((*buffers).hdrs[index]) as usize,
+                    addr_of_mut!((*buffers).frames[index]) as usize,
+                )
+            };
+            let hdr_phys = mem::virt_to_phys(hdr).ok_or(NetError::AddressTranslationFailed)?;
+            let frame_phys = mem::virt_to_phys(frame).ok_or(NetError::AddressTranslationFailed)?;
+            let head = index * 2;
+            // SAFETY: descriptors `head` and `head + 1` belong to this buffer and the queue is
+            // not live yet.
+            unsafe {
+                let desc = queue_desc_ptr(TX_QUEUE_INDEX);
+                write_volatile(
+                    desc.add(head),
+                    VirtqDesc {
+                        addr: hdr_phys,
+                        len: self.net_hdr_len as u32,
+                        flags: VIRTQ_DESC_F_NEXT,
+                        next: (head + 1) as u16,
+                    },
+                );
+                write_volatile(
+                    desc.add(head + 1),
+                    VirtqDesc {
+                        addr: frame_phys,
+                        len: 0,
+                        flags: 0,
+                        next: 0,
+                    },
+                );
+            }
+            self.tx_free[index] = index as u16;
+            self.tx_frame_phys[index] = frame_phys;
+        }
+        self.tx_buffers = count as u16;
+        self.tx_free_len = count;
+        // SAFETY: queue1 avail ring is only modified while holding `NET_LOCK`.
         unsafe {
-            let desc = queue_desc_ptr(RX_QUEUE_INDEX);
-            write_volatile(
-                desc.add(0),
-                VirtqDesc {
-                    addr: self.rx_hdr_phys,
-                    len: NET_HDR_SIZE as u32,
-                    flags: VIRTQ_DESC_F_NEXT | VIRTQ_DESC_F_WRITE,
-                    next: 1,
-                },
-            );
-            write_volatile(
-                desc.add(1),
-                VirtqDesc {
-                    addr: self.rx_frame_phys,
-                    len: MAX_RX_FRAME as u32,
-                    flags: VIRTQ_DESC_F_WRITE,
-                    next: 0,
-                },
-            );
+            let avail = queue_avail_ptr(TX_QUEUE_INDEX);
+            write_volatile(addr_of_mut!((*avail).flags), VIRTQ_AVAIL_F_NO_INTERRUPT);
         }
         Ok(())
     }
 
-    fn post_rx_buffer(&mut self) -> Result<(), NetError> {
-        if self.rx_queue_size == 0 {
-            return Err(NetError::QueueUnavailable);
+    /// Fixes each TSO buffer's header descriptor and records its page addresses; the frame
+    /// descriptors are written per send because a frame's page span varies.
+    fn setup_tso_pool(&mut self) -> Result<(), NetError> {
+        let descs_needed = TSO_DESC_BASE + TSO_BUFFER_COUNT * TSO_DESC_PER_BUFFER;
+        if self.features & VIRTIO_NET_F_HOST_TSO4 == 0
+            || usize::from(self.tx_queue_size) < descs_needed
+            || usize::from(self.tx_buffers) < TX_BUFFER_COUNT
+        {
+            return Ok(());
+        }
+        for index in 0..TSO_BUFFER_COUNT {
+            // SAFETY: `NET_LOCK` is held; only addresses of the static buffers are taken.
+            let (hdr, frame) = unsafe {
+                let buffers = TSO_BUFFERS.0.get();
+                (
+                    addr_of_mut!((*buffers).hdrs[index]) as usize,
+                    addr_of_mut!((*buffers).frames[index]) as usize,
+                )
+            };
+            let hdr_phys = mem::virt_to_phys(hdr).ok_or(NetError::AddressTranslationFailed)?;
+            for page in 0..TSO_FRAME_PAGES {
+                self.tso_page_phys[index][page] = mem::virt_to_phys(frame + page * 4096)
+                    .ok_or(NetError::AddressTranslationFailed)?;
+            }
+            let head = TSO_DESC_BASE + index * TSO_DESC_PER_BUFFER;
+            // SAFETY: descriptors `head..head + TSO_DESC_PER_BUFFER` belong to this buffer and
+            // the device is not using them.
+            unsafe {
+                write_volatile(
+                    queue_desc_ptr(TX_QUEUE_INDEX).add(head),
+                    VirtqDesc {
+                        addr: hdr_phys,
+                        len: self.net_hdr_len as u32,
+                        flags: VIRTQ_DESC_F_NEXT,
+                        next: (head + 1) as u16,
+                    },
+                );
+            }
+            self.tso_free[index] = index as u16;
         }
+        self.tso_buffers = TSO_BUFFER_COUNT as u16;
+        self.tso_free_len = TSO_BUFFER_COUNT;
+        Ok(())
+    }
+
+    /// Adds a receive chain to the avail ring without publishing it.
+    fn queue_rx_buffer(&mut self, head: u16) {
         // SAFETY: queue0 avail ring is only modified while holding `NET_LOCK`.
         unsafe {
             let avail = queue_avail_ptr(RX_QUEUE_INDEX);
             let slot = (self.rx_avail % self.rx_queue_size) as usize;
-            write_volatile(addr_of_mut!((*avail).ring[slot]), 0);
+            write_volatile(addr_of_mut!((*avail).ring[slot]), head);
+        }
+        self.rx_avail = self.rx_avail.wrapping_add(1);
+    }
+
+    /// Makes queued receive chains visible and kicks the device unless it opted out.
+    fn publish_rx_buffers(&mut self) {
+        // SAFETY: queue0 rings are only modified while holding `NET_LOCK`.
+        let no_notify = unsafe {
+            fence(Ordering::SeqCst);
+            write_volatile(
+                addr_of_mut!((*queue_avail_ptr(RX_QUEUE_INDEX)).idx),
+                self.rx_avail,
+            );
             fence(Ordering::SeqCst);
-            self.rx_avail = self.rx_avail.wrapping_add(1);
-            write_volatile(addr_of_mut!((*avail).idx), self.rx_avail);
+            read_volatile(addr_of!((*queue_used_ptr(RX_QUEUE_INDEX)).flags))
+                & VIRTQ_USED_F_NO_NOTIFY
+                != 0
+        };
+        if !no_notify {
+            self.virtio_write_u16(VIRTIO_PCI_QUEUE_NOTIFY, RX_QUEUE_INDEX);
         }
-        self.virtio_write_u16(VIRTIO_PCI_QUEUE_NOTIFY, RX_QUEUE_INDEX);
-        Ok(())
     }
 
     fn poll(&mut self) {
         if !self.ready {
             return;
         }
-        while self.poll_rx_once().unwrap_or(false) {}
+        // A frame whose handling fails (say, a reply that could not be sent) still had its
+        // buffer requeued, so keep draining and publish every buffer queued meanwhile.
+        let avail_before = self.rx_avail;
+        let mut batch = 0u64;
+        while !matches!(self.poll_rx_once(), Ok(false)) {
+            batch = batch.saturating_add(1);
+        }
+        if self.rx_avail != avail_before {
+            self.publish_rx_buffers();
+        }
+        self.stats.rx_batch_max = self.stats.rx_batch_max.max(batch);
+        self.poll_arp();
+        self.poll_dns();
+        self.poll_tcp();
     }
 
+    /// Handles one used receive buffer and requeues it, also when handling fails; `poll`
+    /// publishes requeued buffers once per batch. `Ok(false)` means none was waiting.
     fn poll_rx_once(&mut self) -> Result<bool, NetError> {
         // SAFETY: queue0 used ring access is synchronized by `NET_LOCK`.
-        unsafe {
+        let elem = unsafe {
             let used = queue_used_ptr(RX_QUEUE_INDEX);
             let used_idx = read_volatile(addr_of!((*used).idx));
             if used_idx == self.rx_last_used {
                 return Ok(false);
             }
+            fence(Ordering::SeqCst);
             let slot = (self.rx_last_used % self.rx_queue_size) as usize;
-            let elem = read_volatile(addr_of!((*used).ring[slot]));
-            self.rx_last_used = self.rx_last_used.wrapping_add(1);
-
-            let total_len = elem.len as usize;
-            let payload_len = total_len.saturating_sub(NET_HDR_SIZE).min(MAX_RX_FRAME);
-            let mut frame = [0u8; MAX_RX_FRAME];
-            if payload_len > 0 {
-                let rx_frame = &(*RX_BUFFER.0.get()).frame;
-                frame[..payload_len].copy_from_slice(&rx_frame[..payload_len]);
-            }
+            read_volatile(addr_of!((*used).ring[slot]))
+        };
+        self.rx_last_used = self.rx_last_used.wrapping_add(1);
 
-            self.post_rx_buffer()?;
-            self.stats.rx_frames = self.stats.rx_frames.saturating_add(1);
-            self.process_frame(&frame[..payload_len])?;
-            Ok(true)
+        let head = elem.id as u16;
+        let index = usize::from(head / 2);
+        if !head.is_multiple_of(2) || index >= usize::from(self.rx_buffers) {
+            self.stats.dropped = self.stats.dropped.saturating_add(1);
+            return Ok(true);
+        }
+        if self.rx_merge_skip > 0 {
+            self.rx_merge_skip -= 1;
+            self.queue_rx_buffer(head);
+            return Ok(true);
+        }
+        // SAFETY: the device finished writing this buffer's header before returning it.
+        let hdr = unsafe { read_volatile(addr_of!((*RX_BUFFERS.0.get()).hdrs[index].hdr)) };
+        if self.features & VIRTIO_NET_F_MRG_RXBUF != 0 && hdr.num_buffers > 1 {
+            // Frames up to the MTU fit one buffer; only receive-side GSO, which is not
+            // negotiated, would spread one over several.
+            self.stats.rx_merged_drop = self.stats.rx_merged_drop.saturating_add(1);
+            self.rx_merge_skip = hdr.num_buffers - 1;
+            self.queue_rx_buffer(head);
+            return Ok(true);
+        }
+        self.rx_csum_valid = self.features & VIRTIO_NET_F_GUEST_CSUM != 0
+            && hdr.flags & (VIRTIO_NET_HDR_F_DATA_VALID | VIRTIO_NET_HDR_F_NEEDS_CSUM) != 0;
+        if self.rx_csum_valid {
+            self.stats.rx_csum_valid = self.stats.rx_csum_valid.saturating_add(1);
+        }
+
+        let total_len = elem.len as usize;
+        let payload_len = total_len.saturating_sub(self.net_hdr_len).min(MAX_RX_FRAME);
+        // SAFETY: the device returned this buffer and does not write it again until it is
+        // requeued, which happens only after processing (or when the mailbox lets go of it).
+        let frame: &'static [u8] =
+            unsafe { &(&(*RX_BUFFERS.0.get()).frames[index].bytes)[..payload_len] };
+
+        self.stats.rx_frames = self.stats.rx_frames.saturating_add(1);
+        self.rx_current = Some(RxLease {
+            head,
+            base: frame.as_ptr() as usize,
+        });
+        let result = self.process_frame(frame);
+        if let Some(lease) = self.rx_current.take() {
+            self.queue_rx_buffer(lease.head);
         }
+        result?;
+        Ok(true)
     }
 
     fn process_frame(&mut self, frame: &[u8]) -> Result<(), NetError> {
@@ -834,7 +1229,7 @@ impl NetState {
         ];
         let sender_ip = [payload[14], payload[15], payload[16], payload[17]];
         let target_ip = [payload[24], payload[25], payload[26], payload[27]];
-        self.learn_arp(sender_ip, sender_mac);
+        self.learn_neighbor(sender_ip, sender_mac, target_ip == self.ipv4);
 
         if oper == 1 && target_ip == self.ipv4 {
             self.send_arp_reply(*src_mac, sender_ip)?;
@@ -869,7 +1264,7 @@ impl NetState {
         let proto = payload[9];
         let src_ip = [payload[12], payload[13], payload[14], payload[15]];
         let dst_ip = [payload[16], payload[17], payload[18], payload[19]];
-        self.learn_arp(src_ip, *src_mac);
+        self.learn_neighbor(src_ip, *src_mac, false);
         if dst_ip != self.ipv4 && dst_ip != IP_BROADCAST {
             return Ok(());
         }
@@ -886,7 +1281,7 @@ impl NetState {
             }
             IP_PROTO_TCP => {
                 self.stats.rx_tcp = self.stats.rx_tcp.saturating_add(1);
-                self.handle_tcp(*src_mac, src_ip, body)?;
+                self.handle_tcp(src_ip, body)?;
             }
             _ => {
                 self.stats.dropped = self.stats.dropped.saturating_add(1);
@@ -914,17 +1309,18 @@ impl NetState {
         let seq = u16::from_be_bytes([payload[6], payload[7]]);
 
         if icmp_type == 8 {
-            let mut reply = [0u8; MAX_TX_FRAME];
-            if payload.len() > reply.len() {
+            if payload.len() > MAX_TX_FRAME - ETH_HDR_LEN - IPV4_HDR_LEN {
                 return Err(NetError::FrameTooLarge);
             }
-            reply[..payload.len()].copy_from_slice(payload);
+            let mut pbuf = self.alloc_pbuf()?;
+            let reply = pbuf.append(payload.len());
+            reply.copy_from_slice(payload);
             reply[0] = 0;
             reply[2] = 0;
             reply[3] = 0;
-            let csum = checksum(&reply[..payload.len()]);
+            let csum = checksum(reply);
             reply[2..4].copy_from_slice(&csum.to_be_bytes());
-            self.send_ipv4_packet(src_mac, src_ip, IP_PROTO_ICMP, &reply[..payload.len()])?;
+            self.send_ipv4_pbuf(pbuf, src_mac, src_ip, self.ipv4, IP_PROTO_ICMP);
         } else if icmp_type == 0
             && self.pending_ping.active
             && self.pending_ping.ident == ident
@@ -959,6 +1355,10 @@ impl NetState {
             self.handle_dhcp_message(src_ip, data);
             return Ok(());
         }
+        if src_port == UDP_DNS_PORT && self.dns_cache.on_response(dst_port, data, time::ticks()) {
+            self.stats.dns_answer = self.stats.dns_answer.saturating_add(1);
+            return Ok(());
+        }
 
         self.last_udp.valid = true;
         self.last_udp.src_ip = src_ip;
@@ -968,14 +1368,18 @@ impl NetState {
         self.last_udp.preview.fill(0);
         let preview_len = data.len().min(self.last_udp.preview.len());
         self.last_udp.preview[..preview_len].copy_from_slice(&data[..preview_len]);
-        self.udp_mailbox.valid = true;
-        self.udp_mailbox.src_ip = src_ip;
-        self.udp_mailbox.src_port = src_port;
-        self.udp_mailbox.dst_port = dst_port;
-        self.udp_mailbox.len = data.len().min(self.udp_mailbox.data.len());
-        self.udp_mailbox.data.fill(0);
-        self.udp_mailbox.data[..self.udp_mailbox.len]
-            .copy_from_slice(&data[..self.udp_mailbox.len]);
+        if let Some(lease) = self.rx_current.take() {
+            self.clear_udp_mailbox();
+            self.udp_mailbox = UdpMailbox {
+                valid: true,
+                src_ip,
+                src_port,
+                dst_port,
+                rx_head: lease.head,
+                offset: data.as_ptr() as usize - lease.base,
+                len: data.len(),
+            };
+        }
 
         if dst_port == UDP_ECHO_PORT {
             self.send_udp_packet(src_mac, src_ip, src_port, UDP_ECHO_PORT, data)?;
@@ -983,13 +1387,8 @@ impl NetState {
         Ok(())
     }
 
-    fn handle_tcp(
-        &mut self,
-        _src_mac: [u8; 6],
-        src_ip: [u8; 4],
-        payload: &[u8],
-    ) -> Result<(), NetError> {
-        if payload.len() < 20 {
+    fn handle_tcp(&mut self, src_ip: [u8; 4], payload: &[u8]) -> Result<(), NetError> {
+        if payload.len() < TCP_HDR_LEN {
             self.stats.dropped = self.stats.dropped.saturating_add(1);
             return Ok(());
         }
@@ -998,90 +1397,180 @@ impl NetState {
         let seq = u32::from_be_bytes([payload[4], payload[5], payload[6], payload[7]]);
         let ack = u32::from_be_bytes([payload[8], payload[9], payload[10], payload[11]]);
         let data_offset = ((payload[12] >> 4) as usize) * 4;
-        if data_offset < 20 || payload.len() < data_offset {
+        if data_offset < TCP_HDR_LEN
+            || payload.len() < data_offset
+            || (!self.rx_csum_valid && tcp_checksum(src_ip, self.ipv4, payload) != 0)
+        {
             self.stats.dropped = self.stats.dropped.saturating_add(1);
             return Ok(());
         }
         let flags = u16::from(payload[13]) & 0x3f;
-        let data = &payload[data_offset..];
-
-        if !self.pending_http.active
-            || self.pending_http.remote_ip != src_ip
-            || self.pending_http.remote_port != src_port
-            || self.pending_http.local_port != dst_port
-        {
-            return Ok(());
-        }
+        let segment = TcpSegment {
+            seq,
+            ack,
+            flags,
+            window: u16::from_be_bytes([payload[14], payload[15]]),
+            mss: parse_tcp_mss(&payload[TCP_HDR_LEN..data_offset]),
+            data: &payload[data_offset..],
+        };
 
-        if (flags & TCP_FLAG_RST) != 0 {
-            self.pending_http.finished = true;
+        let Some(id) = self.tcp.find(src_ip, src_port, dst_port) else {
+            if flags & TCP_FLAG_RST == 0 {
+                self.send_tcp_reset(src_ip, dst_port, src_port, &segment);
+            }
             return Ok(());
-        }
+        };
+        let now = time::ticks();
+        self.tcp.on_segment(id, &segment, now);
+        self.flush_tcp(id, now);
+        Ok(())
+    }
 
-        if (flags & TCP_FLAG_SYN) != 0
-            && (flags & TCP_FLAG_ACK) != 0
-            && !self.pending_http.established
-        {
-            if ack == self.pending_http.seq_next {
-                self.pending_http.ack_next = seq.wrapping_add(1);
-                let _ = self.send_pending_tcp_segment(
-                    self.pending_http.seq_next,
-                    self.pending_http.ack_next,
-                    TCP_FLAG_ACK,
-                    &[],
-                );
-                self.pending_http.established = true;
+    /// Answers a segment for no known connection the way RFC 793 prescribes.
+    fn send_tcp_reset(
+        &mut self,
+        dst_ip: [u8; 4],
+        local_port: u16,
+        remote_port: u16,
+        segment: &TcpSegment,
+    ) {
+        let (seq, ack, flags) = if segment.flags & TCP_FLAG_ACK != 0 {
+            (segment.ack, 0, TCP_FLAG_RST)
+        } else {
+            let mut len = segment.data.len() as u32;
+            if segment.flags & TCP_FLAG_SYN != 0 {
+                len += 1;
             }
-            return Ok(());
-        }
+            if segment.flags & TCP_FLAG_FIN != 0 {
+                len += 1;
+            }
+            (
+                0,
+                segment.seq.wrapping_add(len),
+                TCP_FLAG_RST | TCP_FLAG_ACK,
+            )
+        };
+        let Ok(pbuf) = self.alloc_pbuf() else {
+            return;
+        };
+        let header = TcpHeader {
+            local_port,
+            remote_port,
+            seq,
+            ack,
+            flags,
+            window: 0,
+            segment_size: TCP_MSS as u16,
+        };
+        let _ = self.send_tcp_pbuf(pbuf, dst_ip, header);
+    }
 
-        if !self.pending_http.established {
-            return Ok(());
+    /// Emits whatever connection `id` has ready: data within the peer and congestion windows,
+    /// retransmissions, FIN, and due ACKs.
+    fn flush_tcp(&mut self, id: usize, now: u64) {
+        for _ in 0..TCP_FLUSH_BURST {
+            let tso_max = self.tso_available().then_some(TSO_MAX_PAYLOAD);
+            let Some(out) = self.tcp.poll_output(id, now, tso_max) else {
+                break;
+            };
+            let Some((dst_ip, local_port, remote_port)) = self.tcp.peer(id) else {
+                break;
+            };
+            // A segment that cannot be sent now is covered by the retransmit timer.
+            let pbuf = if out.len > out.mss {
+                self.alloc_tso_pbuf()
+            } else {
+                self.alloc_pbuf().ok()
+            };
+            let Some(mut pbuf) = pbuf else {
+                break;
+            };
+            if out.len > 0 {
+                self.tcp
+                    .copy_send(id, out.data_offset, pbuf.append(out.len));
+            }
+            let header = TcpHeader {
+                local_port,
+                remote_port,
+                seq: out.seq,
+                ack: out.ack,
+                flags: out.flags,
+                window: out.window,
+                segment_size: out.mss as u16,
+            };
+            if let Err(error) = self.send_tcp_pbuf(pbuf, dst_ip, header) {
+                // Lost segments are covered by the retransmit timer, but a handshake to a
+                // neighbor that just failed ARP gives up now.
+                if error == NetError::ArpTimeout {
+                    self.tcp.unreachable(id);
+                }
+                break;
+            }
         }
+    }
 
-        if !data.is_empty() {
-            if seq == self.pending_http.ack_next {
-                let available = self
-                    .pending_http
-                    .response
-                    .len()
-                    .saturating_sub(self.pending_http.response_len);
-                let copy_len = data.len().min(available);
-                if copy_len > 0 {
-                    let start = self.pending_http.response_len;
-                    let end = start + copy_len;
-                    self.pending_http.response[start..end].copy_from_slice(&data[..copy_len]);
-                    self.pending_http.response_len = end;
-                }
-                self.pending_http.ack_next =
-                    self.pending_http.ack_next.wrapping_add(data.len() as u32);
-                if self.pending_http.status_code == 0
-                    && let Some(code) = parse_http_status_code(
-                        &self.pending_http.response[..self.pending_http.response_len],
-                    )
-                {
-                    self.pending_http.status_code = code;
-                }
+    /// Runs every live connection's timers; called once per `poll`.
+    fn poll_tcp(&mut self) {
+        let now = time::ticks();
+        for id in 0..TCP_MAX_CONNECTIONS {
+            if self.tcp.is_live(id) {
+                self.flush_tcp(id, now);
             }
-            let _ = self.send_pending_tcp_segment(
-                self.pending_http.seq_next,
-                self.pending_http.ack_next,
-                TCP_FLAG_ACK,
-                &[],
-            );
         }
+    }
 
-        if (flags & TCP_FLAG_FIN) != 0 {
-            self.pending_http.ack_next = self.pending_http.ack_next.wrapping_add(1);
-            let _ = self.send_pending_tcp_segment(
-                self.pending_http.seq_next,
-                self.pending_http.ack_next,
-                TCP_FLAG_ACK,
-                &[],
-            );
-            self.pending_http.finished = true;
+    /// Prepends a TCP header to the payload already in `pbuf` and routes it. SYNs also carry
+    /// our MSS so the peer fills full-size segments.
+    fn send_tcp_pbuf(
+        &mut self,
+        mut pbuf: TxPbuf,
+        dst_ip: [u8; 4],
+        header: TcpHeader,
+    ) -> Result<(), NetError> {
+        let header_len = if header.flags & TCP_FLAG_SYN != 0 {
+            TCP_HDR_LEN + 4
+        } else {
+            TCP_HDR_LEN
+        };
+        let segment = pbuf.push_header(header_len);
+        segment[0..2].copy_from_slice(&header.local_port.to_be_bytes());
+        segment[2..4].copy_from_slice(&header.remote_port.to_be_bytes());
+        segment[4..8].copy_from_slice(&header.seq.to_be_bytes());
+        segment[8..12].copy_from_slice(&header.ack.to_be_bytes());
+        segment[12] = ((header_len / 4) as u8) << 4;
+        segment[13] = (header.flags & 0x3f) as u8;
+        segment[14..16].copy_from_slice(&header.window.to_be_bytes());
+        segment[16..18].copy_from_slice(&0u16.to_be_bytes());
+        segment[18..20].copy_from_slice(&0u16.to_be_bytes());
+        if header_len > TCP_HDR_LEN {
+            segment[20] = TCP_OPT_MSS;
+            segment[21] = 4;
+            segment[22..24].copy_from_slice(&(TCP_MSS as u16).to_be_bytes());
+        }
+        let payload_len = pbuf.len() - header_len;
+        let segment = pbuf.contents_mut();
+        if self.features & VIRTIO_NET_F_CSUM != 0 {
+            // The device sums from `csum_start` and adds our pseudo-header sum. For TSO the
+            // length is left out, as each cut segment gets its own (as Linux does).
+            let gso = payload_len > usize::from(header.segment_size);
+            let pseudo_len = if gso { 0 } else { segment.len() };
+            let pseudo = pseudo_header_sum(self.ipv4, dst_ip, IP_PROTO_TCP, pseudo_len);
+            segment[16..18].copy_from_slice(&pseudo.to_be_bytes());
+            pbuf.offload.flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+            pbuf.offload.csum_start = (ETH_HDR_LEN + IPV4_HDR_LEN) as u16;
+            pbuf.offload.csum_offset = 16;
+            if gso {
+                pbuf.offload.gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+                pbuf.offload.gso_size = header.segment_size;
+                pbuf.offload.hdr_len = (ETH_HDR_LEN + IPV4_HDR_LEN + header_len) as u16;
+                self.stats.tx_tso = self.stats.tx_tso.saturating_add(1);
+            }
+            self.stats.tx_csum_offload = self.stats.tx_csum_offload.saturating_add(1);
+        } else {
+            let checksum = tcp_checksum(self.ipv4, dst_ip, segment);
+            segment[16..18].copy_from_slice(&checksum.to_be_bytes());
         }
-        Ok(())
+        self.route_ipv4_pbuf(pbuf, dst_ip, IP_PROTO_TCP)
     }
 
     fn send_ping(&mut self, target: [u8; 4]) -> Result<u64, NetError> {
@@ -1102,8 +1591,6 @@ impl NetState {
         let csum = checksum(&icmp[..total]);
         icmp[2..4].copy_from_slice(&csum.to_be_bytes());
 
-        let next_hop = self.select_next_hop(target);
-        let dst_mac = self.resolve_arp(next_hop)?;
         let start = time::ticks();
         self.pending_ping = PendingPing {
             active: true,
@@ -1113,7 +1600,11 @@ impl NetState {
             start_tick: start,
             reply_tick: 0,
         };
-        self.send_ipv4_packet(dst_mac, target, IP_PROTO_ICMP, &icmp[..total])?;
+        // An unresolved next hop holds the request, so the ARP exchange counts toward the RTT.
+        if let Err(error) = self.send_ipv4_packet(target, IP_PROTO_ICMP, &icmp[..total]) {
+            self.pending_ping.active = false;
+            return Err(error);
+        }
 
         let timeout_ticks = 300;
         while time::ticks().saturating_sub(start) < timeout_ticks {
@@ -1151,18 +1642,17 @@ impl NetState {
         if payload.len() > MAX_TX_FRAME.saturating_sub(42) {
             return Err(NetError::UdpPayloadTooLarge);
         }
-        let dst_mac = if target_ip == IP_BROADCAST {
-            MAC_BROADCAST
-        } else {
-            let next_hop = self.select_next_hop(target_ip);
-            self.resolve_arp(next_hop)?
-        };
         let src_port = if src_port == 0 {
             UDP_ECHO_PORT
         } else {
             src_port
         };
-        self.send_udp_packet(dst_mac, target_ip, target_port, src_port, payload)?;
+        if target_ip == IP_BROADCAST {
+            self.send_udp_packet(MAC_BROADCAST, target_ip, target_port, src_port, payload)?;
+        } else {
+            let pbuf = self.build_udp_pbuf(target_port, src_port, payload)?;
+            self.route_ipv4_pbuf(pbuf, target_ip, IP_PROTO_UDP)?;
+        }
         Ok(payload.len())
     }
 
@@ -1173,7 +1663,7 @@ impl NetState {
         payload: &[u8],
         out: &mut [u8],
     ) -> Result<Option<UdpRxMeta>, NetError> {
-        self.udp_mailbox.valid = false;
+        self.clear_udp_mailbox();
         self.send_udp(target_ip, target_port, UDP_ECHO_PORT, payload)?;
         let start = time::ticks();
         while time::ticks().saturating_sub(start) < CURL_WAIT_TICKS {
@@ -1186,60 +1676,102 @@ impl NetState {
         Ok(None)
     }
 
-    fn dns_resolve_ipv4(&mut self, host: &str) -> Result<[u8; 4], NetError> {
+    /// Sends `count` datagrams back to back and returns how long that took in nanoseconds.
+    /// Polls only while the ARP hold queue is full, so the first packets can wait for the
+    /// next hop to resolve.
+    fn bench_udp(
+        &mut self,
+        target_ip: [u8; 4],
+        target_port: u16,
+        count: u32,
+    ) -> Result<u64, NetError> {
+        let mut payload = [0u8; BENCH_UDP_PAYLOAD];
+        let start = time::monotonic_ns();
+        let mut last_progress = time::ticks();
+        let mut sent = 0u32;
+        while sent < count {
+            payload[..4].copy_from_slice(&sent.to_be_bytes());
+            match self.send_udp(target_ip, target_port, UDP_ECHO_PORT, &payload) {
+                Ok(_) => {
+                    sent += 1;
+                    last_progress = time::ticks();
+                }
+                Err(NetError::ArpQueueFull) => {
+                    if time::ticks().saturating_sub(last_progress) >= CURL_WAIT_TICKS {
+                        return Err(NetError::ArpTimeout);
+                    }
+                    self.poll();
+                    spin_loop();
+                }
+                Err(error) => return Err(error),
+            }
+        }
+        Ok(time::monotonic_ns().saturating_sub(start))
+    }
+
+    /// Answers from the cache, joins a query already in flight for `host`, or sends a new
+    /// one; never waits. Replies are matched in `handle_udp` and retries run from `poll`.
+    fn dns_lookup(&mut self, host: &str) -> Result<DnsLookup, NetError> {
         let host = host.trim_end_matches('.');
-        if host.is_empty() || host.len() > 253 {
+        if host.is_empty() || host.len() > DNS_NAME_MAX {
             return Err(NetError::NotFound);
         }
-        let dns_server = if self.dns != [0; 4] {
-            self.dns
-        } else if self.gateway != [0; 4] {
-            self.gateway
-        } else {
-            return Err(NetError::NotFound);
-        };
-
-        let txid = (self.make_dhcp_xid() as u16).wrapping_add(time::ticks() as u16);
-        let src_port = 53000u16.wrapping_add((time::ticks() as u16) & 0x03ff);
-
-        let mut query = [0u8; UDP_MAILBOX_CAP];
-        query[0..2].copy_from_slice(&txid.to_be_bytes());
-        query[2..4].copy_from_slice(&0x0100u16.to_be_bytes());
-        query[4..6].copy_from_slice(&1u16.to_be_bytes());
-        query[6..8].copy_from_slice(&0u16.to_be_bytes());
-        query[8..10].copy_from_slice(&0u16.to_be_bytes());
-        query[10..12].copy_from_slice(&0u16.to_be_bytes());
-
-        let mut idx = 12usize;
-        if !encode_dns_name(host, &mut query, &mut idx) {
+        let now = time::ticks();
+        match self.dns_cache.lookup(host, now) {
+            DnsCached::Address(ip) => return Ok(DnsLookup::Resolved(ip)),
+            DnsCached::Missing => return Err(NetError::NotFound),
+            DnsCached::TimedOut => return Err(NetError::IoTimeout),
+            DnsCached::Pending => return Ok(DnsLookup::Pending),
+            DnsCached::Miss => {}
+        }
+        if self.dns_server().is_none() {
             return Err(NetError::NotFound);
         }
-        if !push_bytes(&mut query, &mut idx, &1u16.to_be_bytes())
-            || !push_bytes(&mut query, &mut idx, &1u16.to_be_bytes())
-        {
-            return Err(NetError::FrameTooLarge);
+        let seed = self.make_dhcp_xid();
+        let id = self
+            .dns_cache
+            .begin(host, now, seed)
+            .ok_or(NetError::DnsBusy)?;
+        if let Err(error) = self.send_dns_query(id) {
+            self.dns_cache.cancel(id);
+            return Err(error);
         }
+        Ok(DnsLookup::Pending)
+    }
 
-        self.udp_mailbox.valid = false;
-        self.send_udp(dns_server, UDP_DNS_PORT, src_port, &query[..idx])?;
+    fn dns_server(&self) -> Option<[u8; 4]> {
+        if self.dns != [0; 4] {
+            Some(self.dns)
+        } else if self.gateway != [0; 4] {
+            Some(self.gateway)
+        } else {
+            None
+        }
+    }
+
+    fn send_dns_query(&mut self, id: usize) -> Result<(), NetError> {
+        let server = self.dns_server().ok_or(NetError::NotFound)?;
+        let mut query = [0u8; UDP_MAILBOX_CAP];
+        let (len, src_port) = self
+            .dns_cache
+            .encode_query(id, &mut query)
+            .ok_or(NetError::NotFound)?;
+        self.send_udp(server, UDP_DNS_PORT, src_port, &query[..len])?;
         self.stats.dns_query = self.stats.dns_query.saturating_add(1);
+        Ok(())
+    }
 
-        let start = time::ticks();
-        let mut response = [0u8; UDP_MAILBOX_CAP];
-        while time::ticks().saturating_sub(start) < DNS_WAIT_TICKS {
-            self.poll();
-            if let Some(meta) = self.pop_udp_mailbox(&mut response) {
-                if meta.src_port != UDP_DNS_PORT {
-                    continue;
-                }
-                if let Some(ip) = parse_dns_a_response(&response[..meta.len], txid) {
-                    self.stats.dns_answer = self.stats.dns_answer.saturating_add(1);
-                    return Ok(ip);
-                }
+    /// Resends unanswered queries and expires those out of tries; called once per `poll`.
+    fn poll_dns(&mut self) {
+        if !self.dns_cache.has_pending() {
+            return;
+        }
+        let now = time::ticks();
+        for id in 0..DNS_CACHE_ENTRIES {
+            if self.dns_cache.due(id, now) {
+                let _ = self.send_dns_query(id);
             }
-            spin_loop();
         }
-        Err(NetError::IoTimeout)
     }
 
     fn curl_http_roundtrip(
@@ -1264,97 +1796,122 @@ impl NetState {
             return Err(NetError::FrameTooLarge);
         }
 
-        let next_hop = self.select_next_hop(target_ip);
-        let dst_mac = self.resolve_arp(next_hop)?;
-        let local_port = 49152u16.wrapping_add((time::ticks() as u16) & 0x0fff);
-        let initial_seq = self.make_dhcp_xid().wrapping_add(0x1234_0000);
-
-        self.pending_http.clear();
-        self.pending_http.active = true;
-        self.pending_http.dst_mac = dst_mac;
-        self.pending_http.remote_ip = target_ip;
-        self.pending_http.remote_port = target_port;
-        self.pending_http.local_port = local_port;
-        self.pending_http.seq_next = initial_seq;
-
-        self.send_pending_tcp_segment(self.pending_http.seq_next, 0, TCP_FLAG_SYN, &[])?;
-        self.pending_http.seq_next = self.pending_http.seq_next.wrapping_add(1);
+        let socket = self.tcp.allocate().ok_or(NetError::TcpNoSocket)?;
+        let result = self.curl_http_exchange(socket, target_ip, target_port, &request[..req_len]);
+        self.tcp.release(socket);
+        self.flush_tcp(socket, time::ticks());
+        result
+    }
 
-        let start = time::ticks();
-        while time::ticks().saturating_sub(start) < CURL_WAIT_TICKS {
+    /// Sends `request` and drains the response until the server closes. The timeout restarts
+    /// whenever data arrives, so long downloads are bounded only by stalls.
+    fn curl_http_exchange(
+        &mut self,
+        socket: usize,
+        target_ip: [u8; 4],
+        target_port: u16,
+        request: &[u8],
+    ) -> Result<(usize, u16), NetError> {
+        self.tcp_connect(socket, target_ip, target_port)?;
+        let mut head = [0u8; CURL_HTTP_BUF];
+        let mut head_len = 0usize;
+        let mut chunk = [0u8; TCP_MSS];
+        let mut sent = 0usize;
+        let mut total = 0usize;
+        let mut status = 0u16;
+        let mut last_progress = time::ticks();
+        loop {
             self.poll();
-
-            if self.pending_http.established && !self.pending_http.sent_request {
-                self.send_pending_tcp_segment(
-                    self.pending_http.seq_next,
-                    self.pending_http.ack_next,
-                    TCP_FLAG_ACK | TCP_FLAG_PSH,
-                    &request[..req_len],
-                )?;
-                self.pending_http.seq_next =
-                    self.pending_http.seq_next.wrapping_add(req_len as u32);
-                self.pending_http.sent_request = true;
+            let now = time::ticks();
+            if sent < request.len() {
+                sent += self.tcp_send(socket, &request[sent..])?;
             }
-
-            if self.pending_http.finished {
-                break;
+            loop {
+                let read = match self.tcp_recv(socket, &mut chunk)? {
+                    TcpRecv::Data(read) => read,
+                    TcpRecv::WouldBlock => break,
+                    TcpRecv::Eof => return Ok((total, status)),
+                };
+                let keep = read.min(head.len() - head_len);
+                head[head_len..head_len + keep].copy_from_slice(&chunk[..keep]);
+                head_len += keep;
+                total += read;
+                last_progress = now;
+            }
+            if status == 0
+                && let Some(code) = parse_http_status_code(&head[..head_len])
+            {
+                status = code;
+            }
+            if now.saturating_sub(last_progress) >= CURL_WAIT_TICKS {
+                if total == 0 {
+                    return Err(NetError::IoTimeout);
+                }
+                return Ok((total, status));
             }
             spin_loop();
         }
+    }
 
-        let got_any = self.pending_http.response_len > 0;
-        let status = self.pending_http.status_code;
-        let response_len = self.pending_http.response_len;
-        if !self.pending_http.finished {
-            let _ = self.send_pending_tcp_segment(
-                self.pending_http.seq_next,
-                self.pending_http.ack_next,
-                TCP_FLAG_RST | TCP_FLAG_ACK,
-                &[],
-            );
+    /// Starts the handshake; completion shows up as the connection accepting data.
+    fn tcp_connect(
+        &mut self,
+        socket: usize,
+        remote_ip: [u8; 4],
+        remote_port: u16,
+    ) -> Result<(), NetError> {
+        if !self.ready {
+            return Err(NetError::NotReady);
         }
-        self.pending_http.clear();
-
-        if !got_any {
-            return Err(NetError::IoTimeout);
+        if self.tcp.get(socket).is_none() {
+            return Err(NetError::TcpBadSocket);
         }
-        Ok((response_len, status))
+        // The SYN waits on the neighbor entry if the next hop is unresolved; only a recent
+        // ARP failure is reported here.
+        let next_hop = self.select_next_hop(remote_ip);
+        if self.neighbors.is_failed(next_hop, time::ticks()) {
+            return Err(NetError::ArpTimeout);
+        }
+        let port_hint = 49152u16.wrapping_add((time::ticks() as u16) & 0x0fff);
+        let iss = self.make_dhcp_xid().wrapping_add(0x1234_0000);
+        if !self
+            .tcp
+            .connect(socket, remote_ip, remote_port, port_hint, iss)
+        {
+            return Err(NetError::TcpBadSocket);
+        }
+        self.flush_tcp(socket, time::ticks());
+        Ok(())
     }
 
-    fn send_pending_tcp_segment(
-        &mut self,
-        seq: u32,
-        ack: u32,
-        flags: u16,
-        payload: &[u8],
-    ) -> Result<(), NetError> {
-        if payload.len() > MAX_TX_FRAME.saturating_sub(40) {
-            return Err(NetError::FrameTooLarge);
+    /// Queues what fits in the send buffer and pushes it out; `Ok(0)` means the buffer is full.
+    fn tcp_send(&mut self, socket: usize, data: &[u8]) -> Result<usize, NetError> {
+        let conn = self.tcp.get_mut(socket).ok_or(NetError::TcpBadSocket)?;
+        if !conn.can_send() {
+            return Err(tcp_error(conn.abort()));
         }
-        if !self.pending_http.active {
-            return Err(NetError::NotReady);
+        let queued = conn.write(data);
+        if queued > 0 {
+            self.flush_tcp(socket, time::ticks());
         }
-        let mut segment = [0u8; MAX_TX_FRAME];
-        segment[0..2].copy_from_slice(&self.pending_http.local_port.to_be_bytes());
-        segment[2..4].copy_from_slice(&self.pending_http.remote_port.to_be_bytes());
-        segment[4..8].copy_from_slice(&seq.to_be_bytes());
-        segment[8..12].copy_from_slice(&ack.to_be_bytes());
-        segment[12] = 5u8 << 4;
-        segment[13] = (flags & 0x3f) as u8;
-        segment[14..16].copy_from_slice(&4096u16.to_be_bytes());
-        segment[16..18].copy_from_slice(&0u16.to_be_bytes());
-        segment[18..20].copy_from_slice(&0u16.to_be_bytes());
-        segment[20..20 + payload.len()].copy_from_slice(payload);
-        let tcp_len = 20 + payload.len();
-        let checksum = tcp_checksum(self.ipv4, self.pending_http.remote_ip, &segment[..tcp_len]);
-        segment[16..18].copy_from_slice(&checksum.to_be_bytes());
-        self.send_ipv4_packet_with_src(
-            self.pending_http.dst_mac,
-            self.pending_http.remote_ip,
-            self.ipv4,
-            IP_PROTO_TCP,
-            &segment[..tcp_len],
-        )
+        Ok(queued)
+    }
+
+    fn tcp_recv(&mut self, socket: usize, out: &mut [u8]) -> Result<TcpRecv, NetError> {
+        let conn = self.tcp.get_mut(socket).ok_or(NetError::TcpBadSocket)?;
+        if conn.readable() == 0 {
+            if let Some(abort) = conn.abort() {
+                return Err(tcp_error(Some(abort)));
+            }
+            if conn.at_eof() {
+                return Ok(TcpRecv::Eof);
+            }
+            return Ok(TcpRecv::WouldBlock);
+        }
+        let read = conn.read(out);
+        // Reading may have reopened the window enough to be worth announcing.
+        self.flush_tcp(socket, time::ticks());
+        Ok(TcpRecv::Data(read))
     }
 
     fn send_udp_packet(
@@ -1377,50 +1934,119 @@ impl NetState {
         src_ip: [u8; 4],
         payload: &[u8],
     ) -> Result<(), NetError> {
-        let mut udp = [0u8; MAX_TX_FRAME];
-        let udp_len = 8 + payload.len();
+        let pbuf = self.build_udp_pbuf(dst_port, src_port, payload)?;
+        self.send_ipv4_pbuf(pbuf, dst_mac, dst_ip, src_ip, IP_PROTO_UDP);
+        Ok(())
+    }
+
+    /// Leases a transmit buffer holding `payload` behind a UDP header.
+    fn build_udp_pbuf(
+        &mut self,
+        dst_port: u16,
+        src_port: u16,
+        payload: &[u8],
+    ) -> Result<TxPbuf, NetError> {
+        if UDP_HDR_LEN + payload.len() > MAX_TX_FRAME - ETH_HDR_LEN - IPV4_HDR_LEN {
+            return Err(NetError::FrameTooLarge);
+        }
+        let mut pbuf = self.alloc_pbuf()?;
+        pbuf.append(payload.len()).copy_from_slice(payload);
+        let udp_len = pbuf.len() + UDP_HDR_LEN;
+        let udp = pbuf.push_header(UDP_HDR_LEN);
         udp[0..2].copy_from_slice(&src_port.to_be_bytes());
         udp[2..4].copy_from_slice(&dst_port.to_be_bytes());
         udp[4..6].copy_from_slice(&(udp_len as u16).to_be_bytes());
         udp[6..8].copy_from_slice(&0u16.to_be_bytes());
-        udp[8..8 + payload.len()].copy_from_slice(payload);
-        self.send_ipv4_packet_with_src(dst_mac, dst_ip, src_ip, IP_PROTO_UDP, &udp[..udp_len])
+        Ok(pbuf)
     }
 
     fn send_ipv4_packet(
         &mut self,
-        dst_mac: [u8; 6],
         dst_ip: [u8; 4],
         proto: u8,
         payload: &[u8],
     ) -> Result<(), NetError> {
-        self.send_ipv4_packet_with_src(dst_mac, dst_ip, self.ipv4, proto, payload)
+        if IPV4_HDR_LEN + payload.len() > MAX_TX_FRAME - ETH_HDR_LEN {
+            return Err(NetError::FrameTooLarge);
+        }
+        let mut pbuf = self.alloc_pbuf()?;
+        pbuf.append(payload.len()).copy_from_slice(payload);
+        self.route_ipv4_pbuf(pbuf, dst_ip, proto)
     }
 
-    fn send_ipv4_packet_with_src(
+    /// Sends the transport segment in `pbuf` to `dst_ip` through its next hop. While the next
+    /// hop is unresolved the finished frame is held on its neighbor entry and goes out when
+    /// the ARP reply arrives, so senders never wait for ARP.
+    fn route_ipv4_pbuf(
         &mut self,
-        dst_mac: [u8; 6],
+        mut pbuf: TxPbuf,
         dst_ip: [u8; 4],
-        src_ip: [u8; 4],
         proto: u8,
-        payload: &[u8],
     ) -> Result<(), NetError> {
-        let total_len = 20 + payload.len();
-        if total_len > MAX_TX_FRAME.saturating_sub(14) {
-            return Err(NetError::FrameTooLarge);
+        let next_hop = self.select_next_hop(dst_ip);
+        if next_hop == self.ipv4 {
+            let mac = self.mac;
+            self.send_ipv4_pbuf(pbuf, mac, dst_ip, self.ipv4, proto);
+            return Ok(());
         }
+        let now = time::ticks();
+        let id = match self.neighbors.resolve(next_hop, now) {
+            Resolve::Reachable(mac) => {
+                self.send_ipv4_pbuf(pbuf, mac, dst_ip, self.ipv4, proto);
+                return Ok(());
+            }
+            Resolve::Pending(id) => id,
+            Resolve::Failed => {
+                self.release_pbuf(pbuf);
+                return Err(NetError::ArpTimeout);
+            }
+            Resolve::Full => {
+                self.release_pbuf(pbuf);
+                self.stats.dropped = self.stats.dropped.saturating_add(1);
+                return Err(NetError::ArpQueueFull);
+            }
+        };
+        self.frame_ipv4(&mut pbuf, [0; 6], dst_ip, self.ipv4, proto);
+        if let Err(pbuf) = self.neighbors.hold(id, pbuf) {
+            self.release_pbuf(pbuf);
+            self.stats.dropped = self.stats.dropped.saturating_add(1);
+            return Err(NetError::ArpQueueFull);
+        }
+        self.probe_neighbor(id, now);
+        Ok(())
+    }
 
-        let mut frame = [0u8; MAX_TX_FRAME];
-        frame[0..6].copy_from_slice(&dst_mac);
-        frame[6..12].copy_from_slice(&self.mac);
-        frame[12..14].copy_from_slice(&ETH_TYPE_IPV4.to_be_bytes());
+    /// Prepends IPv4 and Ethernet headers to the transport segment in `pbuf` and queues it.
+    /// Callers size-check the segment before leasing the buffer.
+    fn send_ipv4_pbuf(
+        &mut self,
+        mut pbuf: TxPbuf,
+        dst_mac: [u8; 6],
+        dst_ip: [u8; 4],
+        src_ip: [u8; 4],
+        proto: u8,
+    ) {
+        self.frame_ipv4(&mut pbuf, dst_mac, dst_ip, src_ip, proto);
+        self.transmit_pbuf(pbuf);
+    }
 
-        let ip = &mut frame[14..14 + 20];
+    fn frame_ipv4(
+        &mut self,
+        pbuf: &mut TxPbuf,
+        dst_mac: [u8; 6],
+        dst_ip: [u8; 4],
+        src_ip: [u8; 4],
+        proto: u8,
+    ) {
+        let total_len = IPV4_HDR_LEN + pbuf.len();
+        let ip_id = self.next_ip_id;
+        self.next_ip_id = self.next_ip_id.wrapping_add(1);
+
+        let ip = pbuf.push_header(IPV4_HDR_LEN);
         ip[0] = 0x45;
         ip[1] = 0;
         ip[2..4].copy_from_slice(&(total_len as u16).to_be_bytes());
-        ip[4..6].copy_from_slice(&self.next_ip_id.to_be_bytes());
-        self.next_ip_id = self.next_ip_id.wrapping_add(1);
+        ip[4..6].copy_from_slice(&ip_id.to_be_bytes());
         ip[6..8].copy_from_slice(&0x4000u16.to_be_bytes());
         ip[8] = 64;
         ip[9] = proto;
@@ -1430,82 +2056,202 @@ impl NetState {
         let ip_csum = checksum(ip);
         ip[10..12].copy_from_slice(&ip_csum.to_be_bytes());
 
-        frame[34..34 + payload.len()].copy_from_slice(payload);
-        self.transmit_frame(&frame[..14 + total_len])
+        let eth = pbuf.push_header(ETH_HDR_LEN);
+        eth[0..6].copy_from_slice(&dst_mac);
+        eth[6..12].copy_from_slice(&self.mac);
+        eth[12..14].copy_from_slice(&ETH_TYPE_IPV4.to_be_bytes());
     }
 
-    fn transmit_frame(&mut self, frame: &[u8]) -> Result<(), NetError> {
+    /// Returns completed transmit buffers to the free list.
+    fn reclaim_tx(&mut self) {
+        loop {
+            // SAFETY: queue1 used ring is accessed while `NET_LOCK` is held.
+            let elem = unsafe {
+                let used = queue_used_ptr(TX_QUEUE_INDEX);
+                if read_volatile(addr_of!((*used).idx)) == self.tx_last_used {
+                    return;
+                }
+                fence(Ordering::SeqCst);
+                let slot = (self.tx_last_used % self.tx_queue_size) as usize;
+                read_volatile(addr_of!((*used).ring[slot]))
+            };
+            self.tx_last_used = self.tx_last_used.wrapping_add(1);
+            let id = elem.id as usize;
+            if id >= TSO_DESC_BASE {
+                let index = ((id - TSO_DESC_BASE) / TSO_DESC_PER_BUFFER) as u16;
+                if index < self.tso_buffers && self.tso_free_len < TSO_BUFFER_COUNT {
+                    self.tso_free[self.tso_free_len] = index;
+                    self.tso_free_len += 1;
+                    self.stats.tx_reclaimed = self.stats.tx_reclaimed.saturating_add(1);
+                }
+                continue;
+            }
+            let index = (id / 2) as u16;
+            if index < self.tx_buffers && self.tx_free_len < TX_BUFFER_COUNT {
+                self.tx_free[self.tx_free_len] = index;
+                self.tx_free_len += 1;
+                self.stats.tx_reclaimed = self.stats.tx_reclaimed.saturating_add(1);
+            }
+        }
+    }
+
+    /// Takes a free transmit buffer, reclaiming completions first and waiting for the device
+    /// only when every buffer is in flight.
+    fn alloc_tx_buffer(&mut self) -> Result<usize, NetError> {
+        self.reclaim_tx();
+        if self.tx_free_len == 0 {
+            self.stats.tx_ring_full = self.stats.tx_ring_full.saturating_add(1);
+            let mut spins = 0usize;
+            while self.tx_free_len == 0 {
+                if spins >= MAX_POLL_SPINS {
+                    let _ = self.virtio_read_u8(VIRTIO_PCI_ISR);
+                    return Err(NetError::IoTimeout);
+                }
+                spins = spins.saturating_add(1);
+                spin_loop();
+                self.reclaim_tx();
+            }
+        }
+        self.tx_free_len -= 1;
+        Ok(usize::from(self.tx_free[self.tx_free_len]))
+    }
+
+    /// Leases a transmit buffer with `TX_HEADROOM` bytes free in front of the payload.
+    fn alloc_pbuf(&mut self) -> Result<TxPbuf, NetError> {
         if !self.ready {
             return Err(NetError::NotReady);
         }
+        let index = self.alloc_tx_buffer()?;
+        Ok(TxPbuf {
+            index,
+            tso: false,
+            start: TX_HEADROOM,
+            end: TX_HEADROOM,
+            offload: EMPTY_NET_HDR.hdr,
+        })
+    }
+
+    /// Whether a TSO buffer is free right now; never waits, since a TCP sender can always
+    /// fall back to MSS-sized segments.
+    fn tso_available(&mut self) -> bool {
+        if self.tso_buffers == 0 {
+            return false;
+        }
+        if self.tso_free_len == 0 {
+            self.reclaim_tx();
+        }
+        self.tso_free_len > 0
+    }
+
+    fn alloc_tso_pbuf(&mut self) -> Option<TxPbuf> {
+        if !self.tso_available() {
+            return None;
+        }
+        self.tso_free_len -= 1;
+        Some(TxPbuf {
+            index: usize::from(self.tso_free[self.tso_free_len]),
+            tso: true,
+            start: TX_HEADROOM,
+            end: TX_HEADROOM,
+            offload: EMPTY_NET_HDR.hdr,
+        })
+    }
+
+    /// Returns a lease that will not be transmitted to its free list.
+    fn release_pbuf(&mut self, pbuf: TxPbuf) {
+        if pbuf.tso {
+            self.tso_free[self.tso_free_len] = pbuf.index as u16;
+            self.tso_free_len += 1;
+        } else {
+            self.tx_free[self.tx_free_len] = pbuf.index as u16;
+            self.tx_free_len += 1;
+        }
+    }
+
+    /// Copies a fully built frame into a transmit buffer; used for ARP, which has no layers
+    /// below it to prepend.
+    fn transmit_frame(&mut self, frame: &[u8]) -> Result<(), NetError> {
         if frame.len() > MAX_TX_FRAME {
             return Err(NetError::FrameTooLarge);
         }
+        let mut pbuf = self.alloc_pbuf()?;
+        pbuf.append(frame.len()).copy_from_slice(frame);
+        self.transmit_pbuf(pbuf);
+        Ok(())
+    }
 
-        // SAFETY: `NET_LOCK` serializes access to shared TX buffer.
-        unsafe {
-            let tx = &mut *TX_BUFFER.0.get();
-            tx.hdr.flags = 0;
-            tx.hdr.gso_type = 0;
-            tx.hdr.hdr_len = 0;
-            tx.hdr.gso_size = 0;
-            tx.hdr.csum_start = 0;
-            tx.hdr.csum_offset = 0;
-            tx.frame[..frame.len()].copy_from_slice(frame);
-        }
+    /// Points the buffer's frame descriptor at the built frame and queues it on the TX ring
+    /// without waiting for the device.
+    fn transmit_pbuf(&mut self, pbuf: TxPbuf) {
+        let _span = trace::span(Span::NetTransmit);
+        let head = if pbuf.tso {
+            self.write_tso_chain(&pbuf)
+        } else {
+            let head = pbuf.index * 2;
+            let frame_phys = self.tx_frame_phys[pbuf.index] + pbuf.start as u64;
+            // SAFETY: the lease owns buffer `pbuf.index`, so the device is not reading it, and
+            // `NET_LOCK` serializes access to its descriptors.
+            unsafe {
+                (*TX_BUFFERS.0.get()).hdrs[pbuf.index].hdr = pbuf.offload;
+                let desc = queue_desc_ptr(TX_QUEUE_INDEX).add(head + 1);
+                write_volatile(addr_of_mut!((*desc).addr), frame_phys);
+                write_volatile(addr_of_mut!((*desc).len), pbuf.len() as u32);
+            }
+            head
+        };
 
-        // SAFETY: queue1 memory belongs to TX queue and is serialized by `NET_LOCK`.
+        // SAFETY: `NET_LOCK` serializes access to the avail ring.
         unsafe {
-            let desc = queue_desc_ptr(TX_QUEUE_INDEX);
-            write_volatile(
-                desc.add(0),
-                VirtqDesc {
-                    addr: self.tx_hdr_phys,
-                    len: NET_HDR_SIZE as u32,
-                    flags: VIRTQ_DESC_F_NEXT,
-                    next: 1,
-                },
-            );
-            write_volatile(
-                desc.add(1),
-                VirtqDesc {
-                    addr: self.tx_frame_phys,
-                    len: frame.len() as u32,
-                    flags: 0,
-                    next: 0,
-                },
-            );
-
             let avail = queue_avail_ptr(TX_QUEUE_INDEX);
             let slot = (self.tx_avail % self.tx_queue_size) as usize;
-            write_volatile(addr_of_mut!((*avail).ring[slot]), 0);
+            write_volatile(addr_of_mut!((*avail).ring[slot]), head as u16);
             fence(Ordering::SeqCst);
             self.tx_avail = self.tx_avail.wrapping_add(1);
             write_volatile(addr_of_mut!((*avail).idx), self.tx_avail);
             fence(Ordering::SeqCst);
         }
 
-        self.virtio_write_u16(VIRTIO_PCI_QUEUE_NOTIFY, TX_QUEUE_INDEX);
+        // SAFETY: queue1 used ring is accessed while `NET_LOCK` is held.
+        let no_notify = unsafe {
+            read_volatile(addr_of!((*queue_used_ptr(TX_QUEUE_INDEX)).flags))
+                & VIRTQ_USED_F_NO_NOTIFY
+                != 0
+        };
+        if !no_notify {
+            self.virtio_write_u16(VIRTIO_PCI_QUEUE_NOTIFY, TX_QUEUE_INDEX);
+        }
+        self.stats.tx_frames = self.stats.tx_frames.saturating_add(1);
+    }
 
-        let expected = self.tx_last_used.wrapping_add(1);
-        let mut spins = 0usize;
-        loop {
-            // SAFETY: queue1 used ring is accessed while `NET_LOCK` is held.
-            let observed =
-                unsafe { read_volatile(addr_of!((*queue_used_ptr(TX_QUEUE_INDEX)).idx)) };
-            if observed == expected {
-                self.tx_last_used = expected;
-                self.stats.tx_frames = self.stats.tx_frames.saturating_add(1);
-                break;
-            }
-            if spins >= MAX_POLL_SPINS {
-                let _ = self.virtio_read_u8(VIRTIO_PCI_ISR);
-                return Err(NetError::IoTimeout);
+    /// Describes a TSO frame page by page after its header descriptor and returns the chain
+    /// head.
+    fn write_tso_chain(&mut self, pbuf: &TxPbuf) -> usize {
+        let head = TSO_DESC_BASE + pbuf.index * TSO_DESC_PER_BUFFER;
+        // SAFETY: the lease owns TSO buffer `pbuf.index` and its descriptors, and `NET_LOCK`
+        // serializes access to them.
+        unsafe {
+            (*TSO_BUFFERS.0.get()).hdrs[pbuf.index].hdr = pbuf.offload;
+            let desc = queue_desc_ptr(TX_QUEUE_INDEX);
+            let mut pos = pbuf.start;
+            let mut slot = head + 1;
+            while pos < pbuf.end {
+                let page = pos / 4096;
+                let len = (pbuf.end - pos).min(4096 - pos % 4096);
+                let more = pos + len < pbuf.end;
+                write_volatile(
+                    desc.add(slot),
+                    VirtqDesc {
+                        addr: self.tso_page_phys[pbuf.index][page] + (pos % 4096) as u64,
+                        len: len as u32,
+                        flags: if more { VIRTQ_DESC_F_NEXT } else { 0 },
+                        next: if more { (slot + 1) as u16 } else { 0 },
+                    },
+                );
+                pos += len;
+                slot += 1;
             }
-            spins = spins.saturating_add(1);
-            spin_loop();
         }
-        Ok(())
+        head
     }
 
     fn send_arp_request(&mut self, target_ip: [u8; 4]) -> Result<(), NetError> {
@@ -1794,6 +2540,7 @@ impl NetState {
         self.ipv4 = lease_ip;
         self.netmask = lease_mask;
         self.gateway = lease_gateway;
+        self.route = RouteCache::empty();
         self.dns = lease_dns;
         self.config_source = IpConfigSource::Dhcp;
         self.dhcp_bound = true;
@@ -1803,12 +2550,25 @@ impl NetState {
     }
 
     fn select_next_hop(&mut self, dst_ip: [u8; 4]) -> [u8; 4] {
-        if dst_ip == self.ipv4 || self.in_same_subnet(dst_ip) || self.gateway == [0; 4] {
+        let route = if self.route.valid && self.route.dst == dst_ip {
+            self.route
+        } else {
+            let direct =
+                dst_ip == self.ipv4 || self.in_same_subnet(dst_ip) || self.gateway == [0; 4];
+            self.route = RouteCache {
+                valid: true,
+                dst: dst_ip,
+                next_hop: if direct { dst_ip } else { self.gateway },
+                via_gateway: !direct,
+            };
+            self.route
+        };
+        if route.via_gateway {
+            self.stats.route_gateway = self.stats.route_gateway.saturating_add(1);
+        } else {
             self.stats.route_direct = self.stats.route_direct.saturating_add(1);
-            return dst_ip;
         }
-        self.stats.route_gateway = self.stats.route_gateway.saturating_add(1);
-        self.gateway
+        route.next_hop
     }
 
     fn in_same_subnet(&self, other: [u8; 4]) -> bool {
@@ -1818,55 +2578,47 @@ impl NetState {
             && (self.ipv4[3] & self.netmask[3]) == (other[3] & self.netmask[3])
     }
 
-    fn learn_arp(&mut self, ip: [u8; 4], mac: [u8; 6]) {
+    /// Records a neighbor's MAC and sends anything that was waiting for it. `create` is set
+    /// only when we were the ARP target, as RFC 826 suggests; other traffic just refreshes
+    /// entries we already have.
+    fn learn_neighbor(&mut self, ip: [u8; 4], mac: [u8; 6], create: bool) {
         if ip == [0; 4] || mac == [0; 6] {
             return;
         }
-        for entry in &mut self.arp {
-            if entry.valid && entry.ip == ip {
-                entry.mac = mac;
-                return;
-            }
-        }
-        for entry in &mut self.arp {
-            if !entry.valid {
-                entry.valid = true;
-                entry.ip = ip;
-                entry.mac = mac;
-                return;
+        if let Some(id) = self.neighbors.learn(ip, mac, time::ticks(), create) {
+            while let Some(mut pbuf) = self.neighbors.pop_held(id) {
+                pbuf.contents_mut()[0..6].copy_from_slice(&mac);
+                self.transmit_pbuf(pbuf);
             }
         }
-        self.arp[0] = ArpEntry {
-            valid: true,
-            ip,
-            mac,
-        };
     }
 
-    fn lookup_arp(&self, ip: [u8; 4]) -> Option<[u8; 6]> {
-        self.arp
-            .iter()
-            .find(|entry| entry.valid && entry.ip == ip)
-            .map(|entry| entry.mac)
+    /// Sends entry `id`'s next ARP request when due, or drops its held packets once it has
+    /// run out of probes.
+    fn probe_neighbor(&mut self, id: usize, now: u64) {
+        match self.neighbors.probe_due(id, now) {
+            Probe::Idle => {}
+            Probe::Send(ip) => {
+                let _ = self.send_arp_request(ip);
+            }
+            Probe::Failed => {
+                while let Some(pbuf) = self.neighbors.pop_held(id) {
+                    self.release_pbuf(pbuf);
+                    self.stats.dropped = self.stats.dropped.saturating_add(1);
+                }
+            }
+        }
     }
 
-    fn resolve_arp(&mut self, target_ip: [u8; 4]) -> Result<[u8; 6], NetError> {
-        if target_ip == self.ipv4 {
-            return Ok(self.mac);
+    /// Runs ARP retransmission for unresolved neighbors; called once per `poll`.
+    fn poll_arp(&mut self) {
+        if !self.neighbors.has_incomplete() {
+            return;
         }
-        if let Some(mac) = self.lookup_arp(target_ip) {
-            return Ok(mac);
+        let now = time::ticks();
+        for id in 0..NEIGHBOR_ENTRIES {
+            self.probe_neighbor(id, now);
         }
-        self.send_arp_request(target_ip)?;
-        let start = time::ticks();
-        while time::ticks().saturating_sub(start) < 200 {
-            self.poll();
-            if let Some(mac) = self.lookup_arp(target_ip) {
-                return Ok(mac);
-            }
-            spin_loop();
-        }
-        Err(NetError::ArpTimeout)
     }
 
     fn pop_udp_mailbox(&mut self, dst: &mut [u8]) -> Option<UdpRxMeta> {
@@ -1874,21 +2626,36 @@ impl NetState {
             return None;
         }
 
-        let copy_len = self.udp_mailbox.len.min(dst.len());
+        let mailbox = self.udp_mailbox;
+        let copy_len = mailbox.len.min(dst.len());
         if copy_len > 0 {
-            dst[..copy_len].copy_from_slice(&self.udp_mailbox.data[..copy_len]);
+            let index = usize::from(mailbox.rx_head / 2);
+            // SAFETY: the mailbox keeps this receive buffer off the ring, so the device is not
+            // writing it; `NET_LOCK` is held.
+            let frame = unsafe { &(*RX_BUFFERS.0.get()).frames[index].bytes };
+            dst[..copy_len].copy_from_slice(&frame[mailbox.offset..mailbox.offset + copy_len]);
         }
 
         let meta = UdpRxMeta {
-            src_ip: self.udp_mailbox.src_ip,
-            src_port: self.udp_mailbox.src_port,
-            dst_port: self.udp_mailbox.dst_port,
+            src_ip: mailbox.src_ip,
+            src_port: mailbox.src_port,
+            dst_port: mailbox.dst_port,
             len: copy_len,
         };
-        self.udp_mailbox.valid = false;
+        self.clear_udp_mailbox();
         Some(meta)
     }
 
+    /// Drops the pending datagram and gives its receive buffer back to the device.
+    fn clear_udp_mailbox(&mut self) {
+        if !self.udp_mailbox.valid {
+            return;
+        }
+        self.udp_mailbox.valid = false;
+        self.queue_rx_buffer(self.udp_mailbox.rx_head);
+        self.publish_rx_buffers();
+    }
+
     fn virtio_read_u8(&self, offset: u16) -> u8 {
         // SAFETY: device I/O port range is validated during PCI discovery.
         unsafe { port::inb(self.io_base.saturating_add(offset)) }
@@ -1928,8 +2695,42 @@ pub fn init() -> NetInitReport {
     with_net_mut(|state| state.init())
 }
 
-pub fn poll() {
-    with_net_mut(|state| state.poll());
+/// Drains received frames and runs ARP, DNS and TCP timers. Returns whether anything needs
+/// the next tick: the device is polled rather than interrupt-driven, or a timer is pending.
+pub fn poll() -> bool {
+    with_net_mut(|state| {
+        state.poll();
+        state.ready
+            && (NET_IRQ_IO_BASE.load(Ordering::Acquire) == 0
+                || NET_IRQ_MASKED.load(Ordering::Acquire)
+                || state.tcp.active() > 0
+                || state.neighbors.has_incomplete()
+                || state.dns_cache.has_pending())
+    })
+}
+
+/// virtio-net IRQ handler body; returns whether the device had raised the interrupt. Reading
+/// ISR acknowledges the level-triggered line; the work itself happens in `poll`, which the
+/// interrupt wakes the idle loop for, because the main loop may hold `NET_LOCK` here.
+pub fn handle_interrupt() -> bool {
+    let io_base = NET_IRQ_IO_BASE.load(Ordering::Acquire);
+    if io_base == 0 {
+        return false;
+    }
+    // SAFETY: `io_base` is the device's I/O BAR; reading ISR has no side effect beyond the ack.
+    let isr = unsafe { port::inb(io_base.saturating_add(VIRTIO_PCI_ISR)) };
+    if isr == 0 {
+        return false;
+    }
+    if isr & VIRTIO_ISR_QUEUE != 0 {
+        NET_IRQ_COUNT.fetch_add(1, Ordering::Relaxed);
+    }
+    true
+}
+
+/// Called from interrupt context when the shared line had to be masked.
+pub fn on_irq_disabled() {
+    NET_IRQ_MASKED.store(true, Ordering::Release);
 }
 
 pub fn log_info() {
@@ -1939,7 +2740,7 @@ pub fn log_info() {
             return;
         }
         serial::write_fmt(format_args!(
-            "net: backend=virtio-net-legacy cfg={} io={:#06x} pci={:02x}:{:02x}.{} mac={:02x}:{:02x}:{:02x}:{:02x}:{:02x}:{:02x} ip={}.{}.{}.{} gw={}.{}.{}.{} mask={}.{}.{}.{} dns={}.{}.{}.{} rx={} tx={} arp={} ipv4={} icmp={} udp={} tcp={} dhcp_discover={} dhcp_offer={} dhcp_ack={} dns_query={} dns_answer={} curl_udp={} curl_http={} route_direct={} route_gw={} drop={}\n",
+            "net: backend=virtio-net-legacy cfg={} io={:#06x} pci={:02x}:{:02x}.{} mac={:02x}:{:02x}:{:02x}:{:02x}:{:02x}:{:02x} ip={}.{}.{}.{} gw={}.{}.{}.{} mask={}.{}.{}.{} dns={}.{}.{}.{} rx={} tx={} arp={} ipv4={} icmp={} udp={} tcp={} dhcp_discover={} dhcp_offer={} dhcp_ack={} dns_query={} dns_answer={} curl_udp={} curl_http={} route_direct={} route_gw={} drop={} rx_ring={} tx_ring={} tx_free={} rx_batch_max={} tx_reclaimed={} tx_ring_full={} irq={} irq_line={} irqs={}\n",
             state.config_source.as_str(),
             state.io_base,
             state.pci_bus,
@@ -1983,8 +2784,105 @@ pub fn log_info() {
             state.stats.curl_http,
             state.stats.route_direct,
             state.stats.route_gateway,
-            state.stats.dropped
+            state.stats.dropped,
+            state.rx_buffers,
+            state.tx_buffers,
+            state.tx_free_len,
+            state.stats.rx_batch_max,
+            state.stats.tx_reclaimed,
+            state.stats.tx_ring_full,
+            if state.irq_line.is_some() {
+                "on"
+            } else {
+                "poll"
+            },
+            state.irq_line.unwrap_or(0),
+            NET_IRQ_COUNT.load(Ordering::Relaxed)
+        ));
+        serial::write_fmt(format_args!(
+            "net: offload features={:#x} csum={} guest_csum={} tso4={} mrg_rxbuf={} hdr_len={} tx_csum={} tx_tso={} rx_csum_valid={} rx_merged_drop={}\n",
+            state.features,
+            on_off(state.features & VIRTIO_NET_F_CSUM != 0),
+            on_off(state.features & VIRTIO_NET_F_GUEST_CSUM != 0),
+            on_off(state.tso_buffers > 0),
+            on_off(state.features & VIRTIO_NET_F_MRG_RXBUF != 0),
+            state.net_hdr_len,
+            state.stats.tx_csum_offload,
+            state.stats.tx_tso,
+            state.stats.rx_csum_valid,
+            state.stats.rx_merged_drop
+        ));
+        let arp = state.neighbors.stats;
+        serial::write_fmt(format_args!(
+            "net: arp entries={}/{} incomplete={} hits={} misses={} negative_hits={} requests={} failures={} held={} hold_drops={} evictions={}\n",
+            state.neighbors.resident(),
+            NEIGHBOR_ENTRIES,
+            state.neighbors.incomplete(),
+            arp.hits,
+            arp.misses,
+            arp.negative_hits,
+            arp.requests,
+            arp.failures,
+            arp.held,
+            arp.hold_drops,
+            arp.evictions
         ));
+        let dns = state.dns_cache.stats;
+        serial::write_fmt(format_args!(
+            "net: dns entries={}/{} pending={} hits={} negative_hits={} misses={} retries={} timeouts={} answers={} nxdomain={} evictions={}\n",
+            state.dns_cache.resident(),
+            DNS_CACHE_ENTRIES,
+            state.dns_cache.pending(),
+            dns.hits,
+            dns.negative_hits,
+            dns.misses,
+            dns.retries,
+            dns.timeouts,
+            dns.answers,
+            dns.missing,
+            dns.evictions
+        ));
+        serial::write_str("net: dns latency_ms");
+        for (bucket, count) in dns.latency.iter().enumerate() {
+            match DNS_LATENCY_BOUNDS_MS.get(bucket) {
+                Some(bound) => serial::write_fmt(format_args!(" le{}={}", bound, count)),
+                None => serial::write_fmt(format_args!(
+                    " gt{}={}",
+                    DNS_LATENCY_BOUNDS_MS[bucket - 1],
+                    count
+                )),
+            }
+        }
+        serial::write_str("\n");
+        let tcp = state.tcp.stats;
+        serial::write_fmt(format_args!(
+            "net: tcp conns={}/{} opened={} segs_in={} segs_out={} retransmits={} fast_retransmits={} timeouts={} ooo={} delayed_acks={} resets={}\n",
+            state.tcp.active(),
+            TCP_MAX_CONNECTIONS,
+            tcp.opened,
+            tcp.segs_in,
+            tcp.segs_out,
+            tcp.retransmits,
+            tcp.fast_retransmits,
+            tcp.timeouts,
+            tcp.ooo_segments,
+            tcp.delayed_acks,
+            tcp.resets
+        ));
+        for (id, conn) in state.tcp.live() {
+            serial::write_fmt(format_args!(
+                "net: tcp[{}] state={} local={} remote={}.{}.{}.{}:{} rx_queued={}\n",
+                id,
+                conn.state().as_str(),
+                conn.local_port,
+                conn.remote_ip[0],
+                conn.remote_ip[1],
+                conn.remote_ip[2],
+                conn.remote_ip[3],
+                conn.remote_port,
+                conn.readable()
+            ));
+        }
     });
 }
 
@@ -2021,7 +2919,7 @@ pub fn curl_to_serial(spec: &str) {
         });
         let target = match parse_ipv4(host) {
             Some(ip) => ip,
-            None => match with_net_mut(|state| state.dns_resolve_ipv4(host)) {
+            None => match resolve_host(host) {
                 Ok(ip) => {
                     serial::write_fmt(format_args!(
                         "curl: dns {} -> {}.{}.{}.{}\n",
@@ -2091,6 +2989,46 @@ pub fn udp_send_to_serial(ip_text: &str, port: u16, payload: &str) {
     }
 }
 
+/// `net bench udp`: transmit rate for `count` small datagrams to `ip_text:port`.
+pub fn bench_udp_to_serial(ip_text: &str, port: u16, count: u32) {
+    let Some(target) = parse_ipv4(ip_text) else {
+        serial::write_line("net: bench udp invalid ip");
+        return;
+    };
+    match with_net_mut(|state| state.bench_udp(target, port, count)) {
+        Ok(elapsed_ns) => serial::write_fmt(format_args!(
+            "net: bench udp packets={} bytes={} elapsed_ns={} pps={}\n",
+            count,
+            u64::from(count) * BENCH_UDP_PAYLOAD as u64,
+            elapsed_ns,
+            u64::from(count).saturating_mul(1_000_000_000) / elapsed_ns.max(1)
+        )),
+        Err(err) => serial::write_fmt(format_args!("net: bench udp failed ({})\n", err.as_str())),
+    }
+}
+
+/// `net bench http`: one HTTP/1.0 GET of `path`, timed from connect to the server's close.
+pub fn bench_http_to_serial(ip_text: &str, port: u16, path: &str) {
+    let Some(target) = parse_ipv4(ip_text) else {
+        serial::write_line("net: bench http invalid ip");
+        return;
+    };
+    let start = time::monotonic_ns();
+    match with_net_mut(|state| state.curl_http_roundtrip(target, port, path)) {
+        Ok((bytes, status)) => {
+            let elapsed_ns = time::monotonic_ns().saturating_sub(start);
+            serial::write_fmt(format_args!(
+                "net: bench http status={} bytes={} elapsed_ns={} kib_s={}\n",
+                status,
+                bytes,
+                elapsed_ns,
+                (bytes as u64).saturating_mul(1_000_000_000) / elapsed_ns.max(1) / 1024
+            ));
+        }
+        Err(err) => serial::write_fmt(format_args!("net: bench http failed ({})\n", err.as_str())),
+    }
+}
+
 fn curl_udp_to_serial_ip(target: [u8; 4], port: u16, payload: &str) {
     let mut response = [0u8; UDP_MAILBOX_CAP];
     match with_net_mut(|state| {
@@ -2119,6 +3057,23 @@ fn curl_udp_to_serial_ip(target: [u8; 4], port: u16, payload: &str) {
     }
 }
 
+/// Non-blocking name lookup for callers that poll, such as a scheduled task.
+pub fn dns_lookup(host: &str) -> Result<DnsLookup, NetError> {
+    with_net_mut(|state| state.dns_lookup(host))
+}
+
+/// Polls `dns_lookup` to completion, dropping the lock between polls. The cache's retry
+/// limit bounds the wait.
+fn resolve_host(host: &str) -> Result<[u8; 4], NetError> {
+    loop {
+        if let DnsLookup::Resolved(ip) = dns_lookup(host)? {
+            return Ok(ip);
+        }
+        poll();
+        spin_loop();
+    }
+}
+
 pub fn udp_send(
     target_ip: [u8; 4],
     target_port: u16,
@@ -2137,6 +3092,42 @@ pub fn udp_recv(buffer: &mut [u8]) -> Result<Option<UdpRxMeta>, NetError> {
     })
 }
 
+/// Claims a TCP connection slot; the returned socket id is what the other `tcp_*` calls take.
+pub fn tcp_open() -> Result<usize, NetError> {
+    with_net_mut(|state| {
+        if !state.ready {
+            return Err(NetError::NotReady);
+        }
+        state.tcp.allocate().ok_or(NetError::TcpNoSocket)
+    })
+}
+
+/// Sends the SYN and returns without waiting; data written meanwhile is sent once the
+/// handshake completes.
+pub fn tcp_connect(socket: usize, remote_ip: [u8; 4], remote_port: u16) -> Result<(), NetError> {
+    with_net_mut(|state| state.tcp_connect(socket, remote_ip, remote_port))
+}
+
+pub fn tcp_send(socket: usize, data: &[u8]) -> Result<usize, NetError> {
+    with_net_mut(|state| state.tcp_send(socket, data))
+}
+
+pub fn tcp_recv(socket: usize, out: &mut [u8]) -> Result<TcpRecv, NetError> {
+    with_net_mut(|state| state.tcp_recv(socket, out))
+}
+
+/// Releases the socket; an open connection still finishes its FIN exchange in the background.
+pub fn tcp_close(socket: usize) -> Result<(), NetError> {
+    with_net_mut(|state| {
+        if state.tcp.get(socket).is_none() {
+            return Err(NetError::TcpBadSocket);
+        }
+        state.tcp.release(socket);
+        state.flush_tcp(socket, time::ticks());
+        Ok(())
+    })
+}
+
 pub fn log_last_udp() {
     with_net(|state| {
         if !state.last_udp.valid {
@@ -2215,91 +3206,37 @@ fn parse_host_port(host_port: &str, default_port: Option<u16>) -> Option<(&str,
     Some((host_port, port))
 }
 
-fn encode_dns_name(host: &str, dst: &mut [u8], cursor: &mut usize) -> bool {
-    for label in host.split('.') {
-        if label.is_empty() || label.len() > 63 {
-            return false;
-        }
-        if !push_bytes(dst, cursor, &[label.len() as u8])
-            || !push_bytes(dst, cursor, label.as_bytes())
-        {
-            return false;
-        }
-    }
-    push_bytes(dst, cursor, &[0])
+fn on_off(enabled: bool) -> &'static str {
+    if enabled { "on" } else { "off" }
 }
 
-fn parse_dns_a_response(packet: &[u8], txid: u16) -> Option<[u8; 4]> {
-    if packet.len() < 12 {
-        return None;
-    }
-    let id = u16::from_be_bytes([packet[0], packet[1]]);
-    if id != txid {
-        return None;
-    }
-    let flags = u16::from_be_bytes([packet[2], packet[3]]);
-    if (flags & 0x8000) == 0 || (flags & 0x000f) != 0 {
-        return None;
-    }
-    let qdcount = u16::from_be_bytes([packet[4], packet[5]]) as usize;
-    let ancount = u16::from_be_bytes([packet[6], packet[7]]) as usize;
-    let mut offset = 12usize;
-
-    for _ in 0..qdcount {
-        offset = skip_dns_name(packet, offset)?;
-        if offset + 4 > packet.len() {
-            return None;
-        }
-        offset += 4;
-    }
-
-    for _ in 0..ancount {
-        offset = skip_dns_name(packet, offset)?;
-        if offset + 10 > packet.len() {
-            return None;
-        }
-        let rtype = u16::from_be_bytes([packet[offset], packet[offset + 1]]);
-        let class = u16::from_be_bytes([packet[offset + 2], packet[offset + 3]]);
-        let rdlen = u16::from_be_bytes([packet[offset + 8], packet[offset + 9]]) as usize;
-        offset += 10;
-        if offset + rdlen > packet.len() {
-            return None;
-        }
-        if rtype == 1 && class == 1 && rdlen == 4 {
-            return Some([
-                packet[offset],
-                packet[offset + 1],
-                packet[offset + 2],
-                packet[offset + 3],
-            ]);
-        }
-        offset += rdlen;
+fn tcp_error(abort: Option<TcpAbort>) -> NetError {
+    match abort {
+        Some(TcpAbort::Reset) => NetError::TcpReset,
+        Some(TcpAbort::TimedOut) => NetError::IoTimeout,
+        Some(TcpAbort::Unreachable) => NetError::ArpTimeout,
+        None => NetError::TcpNotConnected,
     }
-    None
 }
 
-fn skip_dns_name(packet: &[u8], mut offset: usize) -> Option<usize> {
-    let mut steps = 0usize;
-    while steps < 128 {
-        if offset >= packet.len() {
-            return None;
-        }
-        let len = packet[offset];
-        if (len & 0xc0) == 0xc0 {
-            if offset + 1 >= packet.len() {
-                return None;
+/// MSS from a SYN's option list, if present.
+fn parse_tcp_mss(options: &[u8]) -> Option<u16> {
+    let mut index = 0usize;
+    while index < options.len() {
+        match options[index] {
+            0 => return None,
+            1 => index += 1,
+            kind => {
+                let len = usize::from(*options.get(index + 1)?);
+                if len < 2 || index + len > options.len() {
+                    return None;
+                }
+                if kind == TCP_OPT_MSS && len == 4 {
+                    return Some(u16::from_be_bytes([options[index + 2], options[index + 3]]));
+                }
+                index += len;
             }
-            return Some(offset + 2);
         }
-        if len == 0 {
-            return Some(offset + 1);
-        }
-        let label_len = len as usize;
-        if label_len > 63 || offset + 1 + label_len > packet.len() {
-            return None;
-        }
-        offset += 1 + label_len;
-        steps = steps.saturating_add(1);
     }
     None
 }
@@ -2390,26 +3327,6 @@ unsafe fn queue_used_ptr(queue: u16) -> *mut VirtqUsed {
     unsafe { queue_base_ptr(queue).add(USED_OFFSET) as *mut VirtqUsed }
 }
 
-fn rx_hdr_ptr() -> *mut VirtioNetHdr {
-    // SAFETY: caller ensures synchronized access to RX buffer.
-    unsafe { addr_of_mut!((*RX_BUFFER.0.get()).hdr) }
-}
-
-fn rx_frame_ptr() -> *mut u8 {
-    // SAFETY: caller ensures synchronized access to RX buffer.
-    unsafe { (*RX_BUFFER.0.get()).frame.as_mut_ptr() }
-}
-
-fn tx_hdr_ptr() -> *mut VirtioNetHdr {
-    // SAFETY: caller ensures synchronized access to TX buffer.
-    unsafe { addr_of_mut!((*TX_BUFFER.0.get()).hdr) }
-}
-
-fn tx_frame_ptr() -> *mut u8 {
-    // SAFETY: caller ensures synchronized access to TX buffer.
-    unsafe { (*TX_BUFFER.0.get()).frame.as_mut_ptr() }
-}
-
 fn find_virtio_net_pci() -> Option<PciLocation> {
     for bus in 0u16..=255u16 {
         for device in 0u16..32u16 {
@@ -2434,9 +3351,14 @@ fn find_virtio_net_pci() -> Option<PciLocation> {
                     continue;
                 }
                 let io_base = (bar0 & !0x3) as u16;
+                // I/O space and bus mastering on; clear INTx-disable so the device can raise
+                // its legacy interrupt.
                 let command =
-                    pci_read_u16(bus as u8, device as u8, function as u8, 0x04) | 0x1 | 0x4;
+                    (pci_read_u16(bus as u8, device as u8, function as u8, 0x04) | 0x1 | 0x4)
+                        & !0x400;
                 pci_write_u16(bus as u8, device as u8, function as u8, 0x04, command);
+                let irq_line =
+                    (pci_read_u16(bus as u8, device as u8, function as u8, 0x3C) & 0xFF) as u8;
 
                 return Some(PciLocation {
                     bus: bus as u8,
@@ -2444,6 +3366,7 @@ fn find_virtio_net_pci() -> Option<PciLocation> {
                     function: function as u8,
                     device_id,
                     io_base,
+                    irq_line,
                 });
             }
         }
@@ -2492,68 +3415,52 @@ fn pci_write_u16(bus: u8, device: u8, function: u8, offset: u8, value: u16) {
     pci_write_u32(bus, device, function, aligned, dword);
 }
 
-fn checksum(data: &[u8]) -> u16 {
-    let mut sum = 0u32;
-    let mut chunks = data.chunks_exact(2);
-    for chunk in &mut chunks {
-        sum = sum.wrapping_add(u16::from_be_bytes([chunk[0], chunk[1]]) as u32);
-    }
-    if let Some(last) = chunks.remainder().first() {
-        sum = sum.wrapping_add((*last as u32) << 8);
-    }
-    while (sum >> 16) != 0 {
-        sum = (sum & 0xffff) + (sum >> 16);
-    }
-    !(sum as u16)
-}
-
-fn tcp_checksum(src_ip: [u8; 4], dst_ip: [u8; 4], segment: &[u8]) -> u16 {
-    let mut sum = 0u32;
-    sum = sum.wrapping_add(u16::from_be_bytes([src_ip[0], src_ip[1]]) as u32);
-    sum = sum.wrapping_add(u16::from_be_bytes([src_ip[2], src_ip[3]]) as u32);
-    sum = sum.wrapping_add(u16::from_be_bytes([dst_ip[0], dst_ip[1]]) as u32);
-    sum = sum.wrapping_add(u16::from_be_bytes([dst_ip[2], dst_ip[3]]) as u32);
-    sum = sum.wrapping_add(IP_PROTO_TCP as u32);
-    sum = sum.wrapping_add(segment.len() as u32);
-
-    let mut chunks = segment.chunks_exact(2);
+/// Ones' complement sum of `data` as big-endian 16-bit words, folded but not inverted. Words
+/// are added eight bytes at a time with end-around carry; summing in little-endian order only
+/// swaps the bytes of the folded result (RFC 1071), which one swap at the end undoes.
+fn ones_sum(data: &[u8]) -> u16 {
+    let mut sum = 0u64;
+    let mut chunks = data.chunks_exact(8);
     for chunk in &mut chunks {
-        sum = sum.wrapping_add(u16::from_be_bytes([chunk[0], chunk[1]]) as u32);
-    }
-    if let Some(last) = chunks.remainder().first() {
-        sum = sum.wrapping_add((*last as u32) << 8);
+        let mut word = [0u8; 8];
+        word.copy_from_slice(chunk);
+        let (next, carry) = sum.overflowing_add(u64::from_le_bytes(word));
+        sum = next + u64::from(carry);
     }
-    while (sum >> 16) != 0 {
-        sum = (sum & 0xffff) + (sum >> 16);
+    let rest = chunks.remainder();
+    if !rest.is_empty() {
+        let mut word = [0u8; 8];
+        word[..rest.len()].copy_from_slice(rest);
+        let (next, carry) = sum.overflowing_add(u64::from_le_bytes(word));
+        sum = next + u64::from(carry);
     }
-    !(sum as u16)
+    let mut folded = (sum & 0xffff_ffff) + (sum >> 32);
+    folded = (folded & 0xffff_ffff) + (folded >> 32);
+    let mut folded = (folded as u32 & 0xffff) + (folded as u32 >> 16);
+    folded = (folded & 0xffff) + (folded >> 16);
+    (folded as u16).swap_bytes()
 }
 
-struct SpinLock {
-    locked: AtomicBool,
+fn ones_add(a: u16, b: u16) -> u16 {
+    let sum = u32::from(a) + u32::from(b);
+    ((sum & 0xffff) + (sum >> 16)) as u16
 }
 
-impl SpinLock {
-    const fn new() -> Self {
-        Self {
-            locked: AtomicBool::new(false),
-        }
-    }
-
-    fn lock(&self) -> SpinLockGuard<'_> {
-        while self.locked.swap(true, Ordering::Acquire) {
-            spin_loop();
-        }
-        SpinLockGuard { lock: self }
-    }
+fn checksum(data: &[u8]) -> u16 {
+    !ones_sum(data)
 }
 
-struct SpinLockGuard<'a> {
-    lock: &'a SpinLock,
+/// Folded IPv4 pseudo-header sum; this is what the checksum field holds for device offload.
+fn pseudo_header_sum(src_ip: [u8; 4], dst_ip: [u8; 4], proto: u8, len: usize) -> u16 {
+    let mut header = [0u8; 12];
+    header[0..4].copy_from_slice(&src_ip);
+    header[4..8].copy_from_slice(&dst_ip);
+    header[9] = proto;
+    header[10..12].copy_from_slice(&(len as u16).to_be_bytes());
+    ones_sum(&header)
 }
 
-impl Drop for SpinLockGuard<'_> {
-    fn drop(&mut self) {
-        self.lock.locked.store(false, Ordering::Release);
-    }
+fn tcp_checksum(src_ip: [u8; 4], dst_ip: [u8; 4], segment: &[u8]) -> u16 {
+    let pseudo = pseudo_header_sum(src_ip, dst_ip, IP_PROTO_TCP, segment.len());
+    !ones_add(pseudo, ones_sum(segment))
 }
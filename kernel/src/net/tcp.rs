@@ -0,0 +1,957 @@
+// kernel/src/net/tcp.rs: TCP connection table with sliding windows, RTT-based retransmission,
+// delayed ACKs, and out-of-order reassembly.
+use crate::time::PIT_HZ;
+
+pub const TCP_FLAG_FIN: u16 = 0x01;
+pub const TCP_FLAG_SYN: u16 = 0x02;
+pub const TCP_FLAG_RST: u16 = 0x04;
+pub const TCP_FLAG_PSH: u16 = 0x08;
+pub const TCP_FLAG_ACK: u16 = 0x10;
+
+pub const TCP_MAX_CONNECTIONS: usize = 8;
+/// Largest payload we send and the MSS we advertise: a 1500-byte MTU minus IPv4 and TCP headers.
+pub const TCP_MSS: usize = 1460;
+/// Assumed when the peer's SYN carries no MSS option (RFC 1122).
+const DEFAULT_MSS: usize = 536;
+const SEND_BUF_LEN: usize = 8 * 1024;
+/// Also the advertised window, so it must stay below 64 KiB (no window scaling).
+const RECV_BUF_LEN: usize = 16 * 1024;
+const OOO_RANGES: usize = 4;
+const INITIAL_CWND_SEGMENTS: usize = 4;
+const DUP_ACK_THRESHOLD: u32 = 3;
+const RTO_INITIAL_TICKS: u64 = PIT_HZ as u64;
+const RTO_MIN_TICKS: u64 = PIT_HZ as u64 / 5;
+const RTO_MAX_TICKS: u64 = 30 * PIT_HZ as u64;
+/// Giving up after this many timeouts in a row closes the connection as timed out.
+const MAX_RETRIES: u32 = 8;
+/// In-order data is ACKed after this delay unless a second segment arrives first.
+const DELAYED_ACK_TICKS: u64 = PIT_HZ as u64 / 25;
+const TIME_WAIT_TICKS: u64 = 2 * PIT_HZ as u64;
+/// A released connection whose peer never sends its FIN is dropped after this long in FIN_WAIT_2.
+const FIN_WAIT2_TICKS: u64 = 30 * PIT_HZ as u64;
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum TcpState {
+    Closed,
+    SynSent,
+    Established,
+    FinWait1,
+    FinWait2,
+    Closing,
+    TimeWait,
+    CloseWait,
+    LastAck,
+}
+
+impl TcpState {
+    pub const fn as_str(self) -> &'static str {
+        match self {
+            Self::Closed => "closed",
+            Self::SynSent => "syn_sent",
+            Self::Established => "established",
+            Self::FinWait1 => "fin_wait1",
+            Self::FinWait2 => "fin_wait2",
+            Self::Closing => "closing",
+            Self::TimeWait => "time_wait",
+            Self::CloseWait => "close_wait",
+            Self::LastAck => "last_ack",
+        }
+    }
+}
+
+/// Why a connection closed without the normal FIN exchange.
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum TcpAbort {
+    Reset,
+    TimedOut,
+    /// ARP for the next hop failed during the handshake.
+    Unreachable,
+}
+
+/// Parsed inbound segment; `data` borrows the RX buffer.
+pub struct TcpSegment<'a> {
+    pub seq: u32,
+    pub ack: u32,
+    pub flags: u16,
+    pub window: u16,
+    pub mss: Option<u16>,
+    pub data: &'a [u8],
+}
+
+/// One segment for the stack to emit. The payload is `len` bytes at `data_offset` in the
+/// connection's send buffer; `copy_send` fills it into the TX buffer.
+#[derive(Clone, Copy)]
+pub struct TcpOutput {
+    pub seq: u32,
+    pub ack: u32,
+    pub flags: u16,
+    pub window: u16,
+    pub data_offset: usize,
+    pub len: usize,
+    /// The connection's MSS; `len` exceeds it only when the caller offered TSO.
+    pub mss: usize,
+}
+
+#[derive(Clone, Copy)]
+pub struct TcpStats {
+    pub opened: u64,
+    pub segs_in: u64,
+    pub segs_out: u64,
+    pub retransmits: u64,
+    pub fast_retransmits: u64,
+    pub timeouts: u64,
+    pub ooo_segments: u64,
+    pub delayed_acks: u64,
+    pub resets: u64,
+}
+
+impl TcpStats {
+    const fn new() -> Self {
+        Self {
+            opened: 0,
+            segs_in: 0,
+            segs_out: 0,
+            retransmits: 0,
+            fast_retransmits: 0,
+            timeouts: 0,
+            ooo_segments: 0,
+            delayed_acks: 0,
+            resets: 0,
+        }
+    }
+}
+
+const fn seq_lt(a: u32, b: u32) -> bool {
+    (a.wrapping_sub(b) as i32) < 0
+}
+
+const fn seq_le(a: u32, b: u32) -> bool {
+    !seq_lt(b, a)
+}
+
+/// Byte ring addressed by offset from its read head; callers keep `offset + len <= N`.
+struct ByteRing<const N: usize> {
+    bytes: [u8; N],
+    head: usize,
+}
+
+impl<const N: usize> ByteRing<N> {
+    const fn new() -> Self {
+        Self {
+            bytes: [0; N],
+            head: 0,
+        }
+    }
+
+    fn write_at(&mut self, offset: usize, data: &[u8]) {
+        let start = (self.head + offset) % N;
+        let first = data.len().min(N - start);
+        self.bytes[start..start + first].copy_from_slice(&data[..first]);
+        self.bytes[..data.len() - first].copy_from_slice(&data[first..]);
+    }
+
+    fn read_at(&self, offset: usize, out: &mut [u8]) {
+        let start = (self.head + offset) % N;
+        let first = out.len().min(N - start);
+        let rest = out.len() - first;
+        out[..first].copy_from_slice(&self.bytes[start..start + first]);
+        out[first..].copy_from_slice(&self.bytes[..rest]);
+    }
+
+    fn consume(&mut self, len: usize) {
+        self.head = (self.head + len) % N;
+    }
+}
+
+pub struct TcpConnection {
+    state: TcpState,
+    /// Owned by a socket handle; a released connection still finishes its close.
+    in_use: bool,
+    abort: Option<TcpAbort>,
+    pub local_port: u16,
+    pub remote_ip: [u8; 4],
+    pub remote_port: u16,
+
+    iss: u32,
+    snd_una: u32,
+    snd_nxt: u32,
+    /// Highest sequence sent; `snd_nxt` falls back to `snd_una` on timeout and catches up.
+    snd_max: u32,
+    snd_wnd: u32,
+    snd_mss: usize,
+    cwnd: usize,
+    ssthresh: usize,
+    send: ByteRing<SEND_BUF_LEN>,
+    /// Sequence number of the byte at the send ring head (oldest unacknowledged data).
+    send_seq: u32,
+    send_len: usize,
+    fin_queued: bool,
+
+    rcv_nxt: u32,
+    recv: ByteRing<RECV_BUF_LEN>,
+    /// In-order bytes waiting for the application; out-of-order data sits past them.
+    recv_len: usize,
+    ooo: [(u32, u32); OOO_RANGES],
+    ooo_count: usize,
+    fin_received: bool,
+
+    srtt_x8: u64,
+    rttvar_x4: u64,
+    rto: u64,
+    rtt_seq: u32,
+    rtt_start: Option<u64>,
+    rtx_deadline: Option<u64>,
+    retries: u32,
+    dup_acks: u32,
+    fast_retransmit: bool,
+    ack_now: bool,
+    ack_deadline: Option<u64>,
+    unacked_segments: u32,
+    last_window: u16,
+    time_wait_until: u64,
+    fin_wait2_until: Option<u64>,
+}
+
+impl TcpConnection {
+    const fn new() -> Self {
+        Self {
+            state: TcpState::Closed,
+            in_use: false,
+            abort: None,
+            local_port: 0,
+            remote_ip: [0; 4],
+            remote_port: 0,
+            iss: 0,
+            snd_una: 0,
+            snd_nxt: 0,
+            snd_max: 0,
+            snd_wnd: 0,
+            snd_mss: DEFAULT_MSS,
+            cwnd: 0,
+            ssthresh: 0,
+            send: ByteRing::new(),
+            send_seq: 0,
+            send_len: 0,
+            fin_queued: false,
+            rcv_nxt: 0,
+            recv: ByteRing::new(),
+            recv_len: 0,
+            ooo: [(0, 0); OOO_RANGES],
+            ooo_count: 0,
+            fin_received: false,
+            srtt_x8: 0,
+            rttvar_x4: 0,
+            rto: RTO_INITIAL_TICKS,
+            rtt_seq: 0,
+            rtt_start: None,
+            rtx_deadline: None,
+            retries: 0,
+            dup_acks: 0,
+            fast_retransmit: false,
+            ack_now: false,
+            ack_deadline: None,
+            unacked_segments: 0,
+            last_window: 0,
+            time_wait_until: 0,
+            fin_wait2_until: None,
+        }
+    }
+
+    /// Resets the control block in place, leaving the buffers alone: they are only reached
+    /// through lengths, and rebuilding them would put 24 KiB on the stack.
+    fn reset(&mut self) {
+        self.state = TcpState::Closed;
+        self.abort = None;
+        self.snd_mss = DEFAULT_MSS;
+        self.send_seq = 0;
+        self.send_len = 0;
+        self.fin_queued = false;
+        self.recv_len = 0;
+        self.ooo_count = 0;
+        self.fin_received = false;
+        self.srtt_x8 = 0;
+        self.rttvar_x4 = 0;
+        self.rto = RTO_INITIAL_TICKS;
+        self.rtt_start = None;
+        self.rtx_deadline = None;
+        self.retries = 0;
+        self.dup_acks = 0;
+        self.fast_retransmit = false;
+        self.ack_now = false;
+        self.ack_deadline = None;
+        self.unacked_segments = 0;
+        self.last_window = 0;
+        self.fin_wait2_until = None;
+    }
+
+    pub fn state(&self) -> TcpState {
+        self.state
+    }
+
+    pub fn abort(&self) -> Option<TcpAbort> {
+        self.abort
+    }
+
+    pub fn readable(&self) -> usize {
+        self.recv_len
+    }
+
+    /// True once every byte before the peer's FIN (or an abort) has been read.
+    pub fn at_eof(&self) -> bool {
+        self.recv_len == 0 && (self.fin_received || self.state == TcpState::Closed)
+    }
+
+    pub fn can_send(&self) -> bool {
+        matches!(
+            self.state,
+            TcpState::SynSent | TcpState::Established | TcpState::CloseWait
+        ) && !self.fin_queued
+    }
+
+    /// Queues as much of `data` as the send buffer holds; bytes written during the handshake
+    /// go out as soon as it completes.
+    pub fn write(&mut self, data: &[u8]) -> usize {
+        if !self.can_send() {
+            return 0;
+        }
+        let len = data.len().min(SEND_BUF_LEN - self.send_len);
+        self.send.write_at(self.send_len, &data[..len]);
+        self.send_len += len;
+        len
+    }
+
+    pub fn read(&mut self, out: &mut [u8]) -> usize {
+        let len = out.len().min(self.recv_len);
+        self.recv.read_at(0, &mut out[..len]);
+        self.recv.consume(len);
+        self.recv_len -= len;
+        len
+    }
+
+    /// Copies `out.len()` bytes starting `offset` bytes past the send ring head.
+    pub fn copy_send(&self, offset: usize, out: &mut [u8]) {
+        self.send.read_at(offset, out);
+    }
+
+    pub fn close(&mut self) {
+        match self.state {
+            TcpState::SynSent => self.state = TcpState::Closed,
+            TcpState::Established | TcpState::CloseWait => self.fin_queued = true,
+            _ => {}
+        }
+    }
+
+    fn recv_window(&self) -> u16 {
+        (RECV_BUF_LEN - self.recv_len).min(u16::MAX as usize) as u16
+    }
+
+    fn fin_seq(&self) -> u32 {
+        self.send_seq.wrapping_add(self.send_len as u32)
+    }
+
+    fn set_abort(&mut self, abort: TcpAbort) {
+        self.state = TcpState::Closed;
+        self.abort = Some(abort);
+        self.send_len = 0;
+        self.rtx_deadline = None;
+        self.ack_deadline = None;
+    }
+
+    fn enter_time_wait(&mut self, now: u64) {
+        self.state = TcpState::TimeWait;
+        self.time_wait_until = now.saturating_add(TIME_WAIT_TICKS);
+        self.rtx_deadline = None;
+    }
+
+    /// Jacobson/Karels smoothing in ticks, with the usual 1/8 and 1/4 gains kept as fixed point.
+    fn sample_rtt(&mut self, rtt: u64) {
+        if self.srtt_x8 == 0 {
+            self.srtt_x8 = rtt << 3;
+            self.rttvar_x4 = rtt << 1;
+        } else {
+            let srtt = (self.srtt_x8 >> 3) as i64;
+            let delta = rtt as i64 - srtt;
+            self.srtt_x8 = (self.srtt_x8 as i64 + delta).max(1) as u64;
+            let var = self.rttvar_x4 as i64;
+            self.rttvar_x4 = (var + delta.abs() - (var >> 2)).max(0) as u64;
+        }
+        let rto = (self.srtt_x8 >> 3).saturating_add(self.rttvar_x4.max(1));
+        self.rto = rto.clamp(RTO_MIN_TICKS, RTO_MAX_TICKS);
+    }
+
+    fn on_timeout(&mut self, now: u64, stats: &mut TcpStats) {
+        if self.snd_una == self.snd_max {
+            self.rtx_deadline = None;
+            return;
+        }
+        stats.timeouts = stats.timeouts.saturating_add(1);
+        self.retries = self.retries.saturating_add(1);
+        if self.retries > MAX_RETRIES {
+            self.set_abort(TcpAbort::TimedOut);
+            return;
+        }
+        let flight = self.snd_max.wrapping_sub(self.snd_una) as usize;
+        self.ssthresh = (flight / 2).max(2 * self.snd_mss);
+        self.cwnd = self.snd_mss;
+        self.snd_nxt = self.snd_una;
+        self.dup_acks = 0;
+        self.fast_retransmit = false;
+        // Karn: a retransmitted segment's ACK says nothing about the path RTT.
+        self.rtt_start = None;
+        self.rto = self.rto.saturating_mul(2).min(RTO_MAX_TICKS);
+        self.rtx_deadline = Some(now.saturating_add(self.rto));
+    }
+
+    fn output(&mut self, seq: u32, flags: u16, data_offset: usize, len: usize) -> TcpOutput {
+        let window = self.recv_window();
+        if flags & TCP_FLAG_ACK != 0 {
+            self.ack_now = false;
+            self.ack_deadline = None;
+            self.unacked_segments = 0;
+            self.last_window = window;
+        }
+        if len > 0 || flags & (TCP_FLAG_SYN | TCP_FLAG_FIN) != 0 {
+            let end = seq.wrapping_add(len as u32).wrapping_add(
+                u32::from(flags & TCP_FLAG_SYN != 0) + u32::from(flags & TCP_FLAG_FIN != 0),
+            );
+            if seq_lt(self.snd_max, end) {
+                self.snd_max = end;
+            }
+        }
+        TcpOutput {
+            seq,
+            ack: if flags & TCP_FLAG_ACK != 0 {
+                self.rcv_nxt
+            } else {
+                0
+            },
+            flags,
+            window,
+            data_offset,
+            len,
+            mss: self.snd_mss,
+        }
+    }
+
+    fn arm_retransmit(&mut self, now: u64) {
+        if self.rtx_deadline.is_none() {
+            self.rtx_deadline = Some(now.saturating_add(self.rto));
+        }
+    }
+
+    /// Next segment this connection wants on the wire, if any. Runs the retransmit, delayed-ACK,
+    /// TIME_WAIT and orphaned FIN_WAIT_2 timers, so the stack calls it on every poll as well as
+    /// after input.
+    /// `tso_max` allows one segment of up to that many bytes for the device to cut at the MSS.
+    fn poll_output(
+        &mut self,
+        now: u64,
+        tso_max: Option<usize>,
+        stats: &mut TcpStats,
+    ) -> Option<TcpOutput> {
+        match self.state {
+            TcpState::Closed => return None,
+            TcpState::TimeWait => {
+                if now >= self.time_wait_until {
+                    self.state = TcpState::Closed;
+                    return None;
+                }
+            }
+            TcpState::FinWait2 if !self.in_use => {
+                // Starts on the first poll that finds the slot both released and in FIN_WAIT_2.
+                let deadline = *self
+                    .fin_wait2_until
+                    .get_or_insert(now.saturating_add(FIN_WAIT2_TICKS));
+                if now >= deadline {
+                    self.state = TcpState::Closed;
+                    return None;
+                }
+            }
+            _ => {}
+        }
+        if let Some(deadline) = self.rtx_deadline
+            && now >= deadline
+        {
+            self.on_timeout(now, stats);
+            if self.state == TcpState::Closed {
+                return None;
+            }
+            stats.retransmits = stats.retransmits.saturating_add(1);
+        }
+
+        if self.state == TcpState::SynSent {
+            if self.snd_nxt != self.iss {
+                return None;
+            }
+            self.snd_nxt = self.iss.wrapping_add(1);
+            self.arm_retransmit(now);
+            if self.retries == 0 {
+                self.rtt_seq = self.snd_nxt;
+                self.rtt_start = Some(now);
+            }
+            return Some(self.output(self.iss, TCP_FLAG_SYN, 0, 0));
+        }
+
+        if self.fast_retransmit {
+            self.fast_retransmit = false;
+            let in_flight = self.snd_max.wrapping_sub(self.snd_una) as usize;
+            let len = self.send_len.min(self.snd_mss).min(in_flight);
+            if len > 0 {
+                self.rtt_start = None;
+                self.rtx_deadline = Some(now.saturating_add(self.rto));
+                return Some(self.output(self.snd_una, TCP_FLAG_ACK, 0, len));
+            }
+        }
+
+        let offset = self.snd_nxt.wrapping_sub(self.send_seq) as usize;
+        if offset < self.send_len {
+            let in_flight = self.snd_nxt.wrapping_sub(self.snd_una) as usize;
+            let remaining = self.send_len - offset;
+            // A closed peer window gets a one-byte probe, repeated with RTO backoff.
+            let allowed = if self.snd_wnd == 0 && in_flight == 0 {
+                1
+            } else {
+                (self.snd_wnd as usize)
+                    .min(self.cwnd)
+                    .saturating_sub(in_flight)
+            };
+            let segment_max = tso_max.map_or(self.snd_mss, |max| max.max(self.snd_mss));
+            let len = remaining.min(allowed).min(segment_max);
+            // Hold back runt segments while data is in flight (sender-side SWS avoidance).
+            if len > 0 && (len == remaining || len >= self.snd_mss || in_flight == 0) {
+                let seq = self.snd_nxt;
+                let fresh = seq == self.snd_max;
+                self.snd_nxt = seq.wrapping_add(len as u32);
+                self.arm_retransmit(now);
+                if fresh && self.rtt_start.is_none() {
+                    self.rtt_seq = self.snd_nxt;
+                    self.rtt_start = Some(now);
+                }
+                let mut flags = TCP_FLAG_ACK;
+                if len == remaining {
+                    flags |= TCP_FLAG_PSH;
+                }
+                return Some(self.output(seq, flags, offset, len));
+            }
+        }
+
+        if self.fin_queued && self.snd_nxt == self.fin_seq() {
+            let seq = self.snd_nxt;
+            self.snd_nxt = seq.wrapping_add(1);
+            self.arm_retransmit(now);
+            match self.state {
+                TcpState::Established => self.state = TcpState::FinWait1,
+                TcpState::CloseWait => self.state = TcpState::LastAck,
+                _ => {}
+            }
+            return Some(self.output(seq, TCP_FLAG_FIN | TCP_FLAG_ACK, 0, 0));
+        }
+
+        let delayed_due = self.ack_deadline.is_some_and(|deadline| now >= deadline);
+        // Tell the peer when reading reopened a window it may be waiting on.
+        let window_opened = usize::from(self.recv_window())
+            >= usize::from(self.last_window).saturating_add(2 * TCP_MSS);
+        if self.ack_now || delayed_due || window_opened {
+            if delayed_due && !self.ack_now {
+                stats.delayed_acks = stats.delayed_acks.saturating_add(1);
+            }
+            return Some(self.output(self.snd_nxt, TCP_FLAG_ACK, 0, 0));
+        }
+        None
+    }
+
+    fn on_segment(&mut self, seg: &TcpSegment, now: u64, stats: &mut TcpStats) {
+        if seg.flags & TCP_FLAG_RST != 0 {
+            let acceptable = if self.state == TcpState::SynSent {
+                seg.flags & TCP_FLAG_ACK != 0 && seg.ack == self.snd_nxt
+            } else {
+                seq_le(self.rcv_nxt, seg.seq)
+                    && seq_lt(seg.seq, self.rcv_nxt.wrapping_add(RECV_BUF_LEN as u32))
+            };
+            if acceptable && self.state != TcpState::Closed {
+                stats.resets = stats.resets.saturating_add(1);
+                self.set_abort(TcpAbort::Reset);
+            }
+            return;
+        }
+
+        match self.state {
+            TcpState::Closed => return,
+            TcpState::SynSent => {
+                let syn_ack = TCP_FLAG_SYN | TCP_FLAG_ACK;
+                if seg.flags & syn_ack == syn_ack && seg.ack == self.iss.wrapping_add(1) {
+                    self.rcv_nxt = seg.seq.wrapping_add(1);
+                    self.snd_una = seg.ack;
+                    self.snd_wnd = u32::from(seg.window);
+                    self.snd_mss = seg
+                        .mss
+                        .map(|mss| usize::from(mss).clamp(64, TCP_MSS))
+                        .unwrap_or(DEFAULT_MSS);
+                    self.cwnd = INITIAL_CWND_SEGMENTS * self.snd_mss;
+                    self.ssthresh = u16::MAX as usize;
+                    if let Some(start) = self.rtt_start.take() {
+                        self.sample_rtt(now.saturating_sub(start));
+                    }
+                    self.retries = 0;
+                    self.rtx_deadline = None;
+                    self.state = TcpState::Established;
+                    self.ack_now = true;
+                }
+                return;
+            }
+            _ => {}
+        }
+
+        if seg.flags & TCP_FLAG_SYN != 0 {
+            // Retransmitted SYN-ACK: our handshake ACK was lost.
+            self.ack_now = true;
+            return;
+        }
+        if seg.flags & TCP_FLAG_ACK != 0 {
+            let pure = seg.data.is_empty() && seg.flags & TCP_FLAG_FIN == 0;
+            self.on_ack(seg.ack, seg.window, pure, now, stats);
+            if self.state == TcpState::Closed {
+                return;
+            }
+        }
+
+        let accepts_data = matches!(
+            self.state,
+            TcpState::Established | TcpState::FinWait1 | TcpState::FinWait2
+        );
+        if accepts_data && !seg.data.is_empty() {
+            self.on_data(seg.seq, seg.data, now, stats);
+        }
+
+        if seg.flags & TCP_FLAG_FIN != 0 {
+            let fin_seq = seg.seq.wrapping_add(seg.data.len() as u32);
+            if self.fin_received {
+                self.ack_now = true;
+                if self.state == TcpState::TimeWait {
+                    self.enter_time_wait(now);
+                }
+            } else if accepts_data && fin_seq == self.rcv_nxt {
+                self.rcv_nxt = self.rcv_nxt.wrapping_add(1);
+                self.fin_received = true;
+                self.ack_now = true;
+                match self.state {
+                    TcpState::Established => self.state = TcpState::CloseWait,
+                    TcpState::FinWait1 => self.state = TcpState::Closing,
+                    TcpState::FinWait2 => self.enter_time_wait(now),
+                    _ => {}
+                }
+            }
+        }
+    }
+
+    fn on_ack(&mut self, ack: u32, window: u16, pure: bool, now: u64, stats: &mut TcpStats) {
+        if seq_lt(self.snd_max, ack) {
+            // ACK for data never sent: answer with our current state.
+            self.ack_now = true;
+            return;
+        }
+        if seq_lt(ack, self.snd_una) {
+            return;
+        }
+
+        if seq_lt(self.snd_una, ack) {
+            let data_acked = (ack.wrapping_sub(self.send_seq) as usize).min(self.send_len);
+            self.send.consume(data_acked);
+            self.send_len -= data_acked;
+            self.send_seq = self.send_seq.wrapping_add(data_acked as u32);
+            let acked = ack.wrapping_sub(self.snd_una) as usize;
+            self.snd_una = ack;
+            if seq_lt(self.snd_nxt, ack) {
+                self.snd_nxt = ack;
+            }
+            if let Some(start) = self.rtt_start
+                && seq_le(self.rtt_seq, ack)
+            {
+                self.rtt_start = None;
+                self.sample_rtt(now.saturating_sub(start));
+            }
+            if self.dup_acks >= DUP_ACK_THRESHOLD {
+                // Leaving fast recovery deflates the window back to the threshold.
+                self.cwnd = self.ssthresh;
+            } else if self.cwnd < self.ssthresh {
+                self.cwnd = self.cwnd.saturating_add(acked.min(self.snd_mss));
+            } else {
+                let step = (self.snd_mss * self.snd_mss / self.cwnd.max(1)).max(1);
+                self.cwnd = self.cwnd.saturating_add(step);
+            }
+            self.cwnd = self.cwnd.min(SEND_BUF_LEN);
+            self.retries = 0;
+            self.dup_acks = 0;
+            self.rtx_deadline = if self.snd_una == self.snd_max {
+                None
+            } else {
+                Some(now.saturating_add(self.rto))
+            };
+
+            if self.fin_queued && seq_lt(self.fin_seq(), self.snd_una) {
+                match self.state {
+                    TcpState::FinWait1 => self.state = TcpState::FinWait2,
+                    TcpState::Closing => self.enter_time_wait(now),
+                    TcpState::LastAck => self.state = TcpState::Closed,
+                    _ => {}
+                }
+            }
+        } else if pure && self.snd_una != self.snd_max && u32::from(window) == self.snd_wnd {
+            self.dup_acks = self.dup_acks.saturating_add(1);
+            if self.dup_acks == DUP_ACK_THRESHOLD {
+                let flight = self.snd_max.wrapping_sub(self.snd_una) as usize;
+                self.ssthresh = (flight / 2).max(2 * self.snd_mss);
+                self.cwnd = self.ssthresh + DUP_ACK_THRESHOLD as usize * self.snd_mss;
+                self.fast_retransmit = true;
+                stats.fast_retransmits = stats.fast_retransmits.saturating_add(1);
+            } else if self.dup_acks > DUP_ACK_THRESHOLD {
+                self.cwnd = self.cwnd.saturating_add(self.snd_mss).min(SEND_BUF_LEN);
+            }
+        }
+        if self.snd_wnd == 0 && window != 0 {
+            self.retries = 0;
+        }
+        self.snd_wnd = u32::from(window);
+    }
+
+    fn on_data(&mut self, seq: u32, data: &[u8], now: u64, stats: &mut TcpStats) {
+        let (seq, data) = if seq_lt(seq, self.rcv_nxt) {
+            let skip = self.rcv_nxt.wrapping_sub(seq) as usize;
+            if skip >= data.len() {
+                // Entirely old: the peer missed our ACK.
+                self.ack_now = true;
+                return;
+            }
+            (self.rcv_nxt, &data[skip..])
+        } else {
+            (seq, data)
+        };
+        let offset = seq.wrapping_sub(self.rcv_nxt) as usize;
+        let free = RECV_BUF_LEN - self.recv_len;
+        if offset >= free {
+            self.ack_now = true;
+            return;
+        }
+        let len = data.len().min(free - offset);
+        self.recv.write_at(self.recv_len + offset, &data[..len]);
+
+        if offset > 0 {
+            stats.ooo_segments = stats.ooo_segments.saturating_add(1);
+            self.insert_ooo(seq, seq.wrapping_add(len as u32));
+            // An immediate duplicate ACK drives the sender's fast retransmit.
+            self.ack_now = true;
+            return;
+        }
+
+        self.rcv_nxt = self.rcv_nxt.wrapping_add(len as u32);
+        self.recv_len += len;
+        if self.ooo_count > 0 {
+            self.drain_ooo();
+            self.ack_now = true;
+            return;
+        }
+        self.unacked_segments = self.unacked_segments.saturating_add(1);
+        if self.unacked_segments >= 2 {
+            self.ack_now = true;
+        } else if self.ack_deadline.is_none() {
+            self.ack_deadline = Some(now.saturating_add(DELAYED_ACK_TICKS));
+        }
+    }
+
+    /// Records `[start, end)` as buffered, merging overlapping ranges. When every slot is taken
+    /// the range is forgotten; its bytes are simply received again on retransmission.
+    fn insert_ooo(&mut self, mut start: u32, mut end: u32) {
+        let mut index = 0usize;
+        while index < self.ooo_count {
+            let (lo, hi) = self.ooo[index];
+            if seq_le(start, hi) && seq_le(lo, end) {
+                if seq_lt(lo, start) {
+                    start = lo;
+                }
+                if seq_lt(end, hi) {
+                    end = hi;
+                }
+                self.ooo_count -= 1;
+                self.ooo[index] = self.ooo[self.ooo_count];
+                index = 0;
+                continue;
+            }
+            index += 1;
+        }
+        if self.ooo_count < OOO_RANGES {
+            self.ooo[self.ooo_count] = (start, end);
+            self.ooo_count += 1;
+        }
+    }
+
+    /// Advances `rcv_nxt` over buffered ranges the new data made contiguous.
+    fn drain_ooo(&mut self) {
+        let mut index = 0usize;
+        while index < self.ooo_count {
+            let (start, end) = self.ooo[index];
+            if seq_le(start, self.rcv_nxt) {
+                if seq_lt(self.rcv_nxt, end) {
+                    self.recv_len += end.wrapping_sub(self.rcv_nxt) as usize;
+                    self.rcv_nxt = end;
+                }
+                self.ooo_count -= 1;
+                self.ooo[index] = self.ooo[self.ooo_count];
+                index = 0;
+                continue;
+            }
+            index += 1;
+        }
+    }
+}
+
+/// Fixed table of connections. This type only runs the protocol; `NetState` parses headers,
+/// resolves addresses, and puts `TcpOutput`s on the wire.
+pub struct TcpTable {
+    conns: [TcpConnection; TCP_MAX_CONNECTIONS],
+    pub stats: TcpStats,
+}
+
+impl TcpTable {
+    pub const fn new() -> Self {
+        Self {
+            conns: [const { TcpConnection::new() }; TCP_MAX_CONNECTIONS],
+            stats: TcpStats::new(),
+        }
+    }
+
+    /// Claims a closed, unowned slot for a new socket.
+    pub fn allocate(&mut self) -> Option<usize> {
+        let id = self
+            .conns
+            .iter()
+            .position(|conn| !conn.in_use && conn.state == TcpState::Closed)?;
+        let conn = &mut self.conns[id];
+        conn.reset();
+        conn.in_use = true;
+        Some(id)
+    }
+
+    /// Drops the socket's ownership; an open connection still sends its FIN and runs
+    /// TIME_WAIT, or the FIN_WAIT_2 timeout if the peer never closes, before the slot is reused.
+    pub fn release(&mut self, id: usize) {
+        if let Some(conn) = self.conns.get_mut(id) {
+            conn.close();
+            conn.in_use = false;
+        }
+    }
+
+    pub fn get(&self, id: usize) -> Option<&TcpConnection> {
+        self.conns.get(id).filter(|conn| conn.in_use)
+    }
+
+    pub fn get_mut(&mut self, id: usize) -> Option<&mut TcpConnection> {
+        self.conns.get_mut(id).filter(|conn| conn.in_use)
+    }
+
+    pub fn is_live(&self, id: usize) -> bool {
+        self.conns
+            .get(id)
+            .is_some_and(|conn| conn.state != TcpState::Closed)
+    }
+
+    pub fn live(&self) -> impl Iterator<Item = (usize, &TcpConnection)> {
+        self.conns
+            .iter()
+            .enumerate()
+            .filter(|(_, conn)| conn.state != TcpState::Closed)
+    }
+
+    pub fn peer(&self, id: usize) -> Option<([u8; 4], u16, u16)> {
+        let conn = self.conns.get(id)?;
+        Some((conn.remote_ip, conn.local_port, conn.remote_port))
+    }
+
+    pub fn copy_send(&self, id: usize, offset: usize, out: &mut [u8]) {
+        if let Some(conn) = self.conns.get(id) {
+            conn.copy_send(offset, out);
+        }
+    }
+
+    pub fn active(&self) -> usize {
+        self.conns
+            .iter()
+            .filter(|conn| conn.state != TcpState::Closed)
+            .count()
+    }
+
+    /// Starts an active open from an owned slot. `port_hint` seeds the ephemeral port, which
+    /// is bumped until no other live connection uses it.
+    pub fn connect(
+        &mut self,
+        id: usize,
+        remote_ip: [u8; 4],
+        remote_port: u16,
+        port_hint: u16,
+        iss: u32,
+    ) -> bool {
+        let mut local_port = port_hint.max(49152);
+        while self.conns.iter().enumerate().any(|(other, conn)| {
+            other != id && conn.state != TcpState::Closed && conn.local_port == local_port
+        }) {
+            local_port = local_port.checked_add(1).unwrap_or(49152);
+        }
+        let Some(conn) = self.get_mut(id) else {
+            return false;
+        };
+        if conn.state != TcpState::Closed {
+            return false;
+        }
+        conn.local_port = local_port;
+        conn.remote_ip = remote_ip;
+        conn.remote_port = remote_port;
+        conn.iss = iss;
+        conn.snd_una = iss;
+        conn.snd_nxt = iss;
+        conn.snd_max = iss;
+        conn.send_seq = iss.wrapping_add(1);
+        conn.state = TcpState::SynSent;
+        self.stats.opened = self.stats.opened.saturating_add(1);
+        true
+    }
+
+    /// Aborts a connection still in its handshake; established ones ride out the outage on
+    /// retransmissions.
+    pub fn unreachable(&mut self, id: usize) {
+        if let Some(conn) = self.conns.get_mut(id)
+            && conn.state == TcpState::SynSent
+        {
+            conn.set_abort(TcpAbort::Unreachable);
+        }
+    }
+
+    /// Live connection for an inbound segment's addresses, including released ones.
+    pub fn find(&self, remote_ip: [u8; 4], remote_port: u16, local_port: u16) -> Option<usize> {
+        self.conns.iter().position(|conn| {
+            conn.state != TcpState::Closed
+                && conn.local_port == local_port
+                && conn.remote_port == remote_port
+                && conn.remote_ip == remote_ip
+        })
+    }
+
+    pub fn on_segment(&mut self, id: usize, seg: &TcpSegment, now: u64) {
+        self.stats.segs_in = self.stats.segs_in.saturating_add(1);
+        if let Some(conn) = self.conns.get_mut(id) {
+            conn.on_segment(seg, now, &mut self.stats);
+        }
+    }
+
+    pub fn poll_output(
+        &mut self,
+        id: usize,
+        now: u64,
+        tso_max: Option<usize>,
+    ) -> Option<TcpOutput> {
+        let out = self
+            .conns
+            .get_mut(id)?
+            .poll_output(now, tso_max, &mut self.stats)?;
+        self.stats.segs_out = self.stats.segs_out.saturating_add(1);
+        Some(out)
+    }
+}
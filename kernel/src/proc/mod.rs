@@ -1,20 +1,27 @@
 // kernel/src/proc/mod.rs: M4 cooperative scheduler and syscall dispatch (same address space).
-use crate::{net, serial, time};
+pub mod sched;
+pub mod work;
+
+use crate::sync::SpinLock;
+use crate::{fs, gfx, net, serial, time};
 use arrostd::abi::{USERLAND_ABI_REVISION, USERLAND_INIT_APP};
 use arrostd::syscall::{
-    AF_INET, IPPROTO_UDP, SOCK_DGRAM, SYS_EXIT, SYS_READ, SYS_RECVFROM, SYS_SENDTO, SYS_SLEEP,
-    SYS_SOCKET, SYS_WRITE, SYS_YIELD, UDP_SOCKET_FD, UdpRecvReq, UdpSendReq,
+    AF_INET, FsReadReq, IPPROTO_TCP, IPPROTO_UDP, PresentReq, RingCqe, RingSqe, SOCK_DGRAM,
+    SOCK_STREAM, SYS_CLOSE, SYS_CONNECT, SYS_EXIT, SYS_FS_READ, SYS_PRESENT, SYS_READ, SYS_RECV,
+    SYS_RECVFROM, SYS_RING_ENTER, SYS_RING_SETUP, SYS_SEND, SYS_SENDTO, SYS_SLEEP, SYS_SOCKET,
+    SYS_WRITE, SYS_YIELD, SyscallRing, TCP_SOCKET_FD_BASE, TcpConnectReq, UDP_SOCKET_FD,
+    UdpRecvReq, UdpSendReq,
 };
 use core::cell::UnsafeCell;
-use core::hint::spin_loop;
-use core::mem::size_of;
-use core::sync::atomic::{AtomicBool, Ordering};
+use core::mem::{align_of, size_of};
 
 const MAX_TASKS: usize = 4;
 const MAX_LINE_LEN: usize = 96;
 const MAX_WRITE_BYTES: usize = 256;
 const USER_SHELL_SCRIPT: &[u8] = b"";
 
+const _: () = assert!(net::TCP_MAX_CONNECTIONS <= u32::BITS as usize);
+
 struct SchedulerCell(UnsafeCell<Scheduler>);
 
 // SAFETY: access is serialized through `SCHED_LOCK`.
@@ -22,6 +29,8 @@ unsafe impl Sync for SchedulerCell {}
 
 static SCHED_LOCK: SpinLock = SpinLock::new();
 static SCHEDULER: SchedulerCell = SchedulerCell(UnsafeCell::new(Scheduler::new()));
+/// Syscall ring the `sh` task registers when it starts.
+static SHELL_RING: SyscallRing = SyscallRing::new();
 
 #[derive(Clone, Copy)]
 pub struct ProcInitReport {
@@ -41,6 +50,18 @@ pub struct SyscallStats {
     pub socket: u64,
     pub sendto: u64,
     pub recvfrom: u64,
+    pub connect: u64,
+    pub send: u64,
+    pub recv: u64,
+    pub close: u64,
+    pub ring_setup: u64,
+    pub ring_enter: u64,
+    pub fs_read: u64,
+    pub present: u64,
+    /// Non-empty ring drains, from `ring_enter` or a scheduler pass, and the entries they ran.
+    pub ring_batches: u64,
+    pub ring_entries: u64,
+    pub ring_batch_max: u64,
     pub errors: u64,
 }
 
@@ -55,6 +76,17 @@ impl SyscallStats {
             socket: 0,
             sendto: 0,
             recvfrom: 0,
+            connect: 0,
+            send: 0,
+            recv: 0,
+            close: 0,
+            ring_setup: 0,
+            ring_enter: 0,
+            fs_read: 0,
+            present: 0,
+            ring_batches: 0,
+            ring_entries: 0,
+            ring_batch_max: 0,
             errors: 0,
         }
     }
@@ -83,6 +115,11 @@ struct Task {
     step: u8,
     line: [u8; MAX_LINE_LEN],
     line_len: usize,
+    /// Registered with `SYS_RING_SETUP`; dropped when the task exits.
+    ring: Option<&'static SyscallRing>,
+    /// One bit per TCP connection slot this task opened. Other tasks cannot use these fds,
+    /// and exit closes any still open.
+    tcp_sockets: u32,
 }
 
 impl Task {
@@ -96,6 +133,8 @@ impl Task {
             step: 0,
             line: [0; MAX_LINE_LEN],
             line_len: 0,
+            ring: None,
+            tcp_sockets: 0,
         }
     }
 }
@@ -164,6 +203,7 @@ impl Scheduler {
 
     fn run_once(&mut self, now_ticks: u64) {
         self.wake_sleeping(now_ticks);
+        self.poll_rings(now_ticks);
 
         for _ in 0..MAX_TASKS {
             let index = self.cursor % MAX_TASKS;
@@ -182,6 +222,20 @@ impl Scheduler {
         }
     }
 
+    /// Tick at which some task can next run: now if one is ready, else the earliest sleeper's
+    /// wake tick. `None` once every task has exited.
+    fn next_run_tick(&self, now_ticks: u64) -> Option<u64> {
+        self.tasks
+            .iter()
+            .flatten()
+            .filter_map(|task| match task.state {
+                TaskState::Ready => Some(now_ticks),
+                TaskState::Sleeping { until_tick } => Some(until_tick),
+                TaskState::Exited { .. } => None,
+            })
+            .min()
+    }
+
     fn run_task(&mut self, task: &mut Task, now_ticks: u64) {
         match task.kind {
             TaskKind::Init => self.run_init_task(task, now_ticks),
@@ -221,6 +275,14 @@ impl Scheduler {
     fn run_shell_task(&mut self, task: &mut Task, now_ticks: u64) {
         if !task.started {
             task.started = true;
+            let _ = self.dispatch_syscall(
+                task,
+                now_ticks,
+                SYS_RING_SETUP,
+                core::ptr::addr_of!(SHELL_RING) as u64,
+                size_of::<SyscallRing>() as u64,
+                0,
+            );
             if !self.input_script.data.is_empty() {
                 self.sys_write(task, "[sh] started (sys_read scripted input)\n", now_ticks);
                 self.sys_write(task, "arrost> ", now_ticks);
@@ -316,11 +378,23 @@ impl Scheduler {
             return;
         }
 
+        if let Some((dst_ip, dst_port, count, payload)) = parse_burst_command(command) {
+            let request = UdpSendReq::new(
+                dst_ip,
+                dst_port,
+                7777,
+                payload.as_ptr() as u64,
+                payload.len() as u64,
+            );
+            self.run_burst(task, &request, count, now_ticks);
+            return;
+        }
+
         match command {
             "help" => {
                 self.sys_write(
                     task,
-                    "sh(help): help | uptime | user | socket | send <ip> <port> <text> | recv\n",
+                    "sh(help): help | uptime | user | socket | send <ip> <port> <text> | burst <ip> <port> <count> <text> | recv\n",
                     now_ticks,
                 );
             }
@@ -390,6 +464,38 @@ impl Scheduler {
         }
     }
 
+    /// Queues `count` copies of `request` on the shell's ring and submits them with one
+    /// `ring_enter`.
+    fn run_burst(&mut self, task: &mut Task, request: &UdpSendReq, count: usize, now_ticks: u64) {
+        let args = [
+            UDP_SOCKET_FD,
+            core::ptr::from_ref(request) as u64,
+            size_of::<UdpSendReq>() as u64,
+        ];
+        let queued = (0..count)
+            .take_while(|&index| SHELL_RING.submit(RingSqe::new(SYS_SENDTO, args, index as u64)))
+            .count();
+        let entered = self.dispatch_syscall(task, now_ticks, SYS_RING_ENTER, 0, 0, 0);
+        let (mut sent, mut bytes, mut last_error) = (0usize, 0i64, 0i64);
+        while let Some(completion) = SHELL_RING.reap() {
+            if completion.result >= 0 {
+                sent += 1;
+                bytes += completion.result;
+            } else {
+                last_error = completion.result;
+            }
+        }
+        serial::write_fmt(format_args!(
+            "sh(burst): sent={}/{} bytes={} batch={} last_error={}\n",
+            sent, count, bytes, entered, last_error
+        ));
+        if queued < count {
+            serial::write_fmt(format_args!(
+                "sh(burst): ring held {queued} of {count} entries\n"
+            ));
+        }
+    }
+
     fn dispatch_syscall(
         &mut self,
         task: &mut Task,
@@ -411,6 +517,8 @@ impl Scheduler {
             SYS_EXIT => {
                 self.stats.exit = self.stats.exit.saturating_add(1);
                 task.state = TaskState::Exited { code: arg0 as i32 };
+                task.ring = None;
+                self.close_task_sockets(task);
                 0
             }
             SYS_YIELD => {
@@ -427,7 +535,7 @@ impl Scheduler {
             }
             SYS_SOCKET => {
                 self.stats.socket = self.stats.socket.saturating_add(1);
-                self.syscall_socket(arg0, arg1, arg2)
+                self.syscall_socket(task, arg0, arg1, arg2)
             }
             SYS_SENDTO => {
                 self.stats.sendto = self.stats.sendto.saturating_add(1);
@@ -437,6 +545,42 @@ impl Scheduler {
                 self.stats.recvfrom = self.stats.recvfrom.saturating_add(1);
                 self.syscall_recvfrom(arg0, arg1, arg2)
             }
+            SYS_CONNECT => {
+                self.stats.connect = self.stats.connect.saturating_add(1);
+                self.syscall_connect(task, arg0, arg1, arg2)
+            }
+            SYS_SEND => {
+                self.stats.send = self.stats.send.saturating_add(1);
+                self.syscall_send(task, arg0, arg1, arg2)
+            }
+            SYS_RECV => {
+                self.stats.recv = self.stats.recv.saturating_add(1);
+                self.syscall_recv(task, arg0, arg1, arg2)
+            }
+            SYS_CLOSE => {
+                self.stats.close = self.stats.close.saturating_add(1);
+                self.syscall_close(task, arg0)
+            }
+            SYS_RING_SETUP => {
+                self.stats.ring_setup = self.stats.ring_setup.saturating_add(1);
+                self.syscall_ring_setup(task, arg0, arg1)
+            }
+            SYS_RING_ENTER => {
+                self.stats.ring_enter = self.stats.ring_enter.saturating_add(1);
+                let Some(ring) = task.ring else {
+                    self.stats.errors = self.stats.errors.saturating_add(1);
+                    return -22;
+                };
+                self.drain_ring(task, ring, now_ticks) as isize
+            }
+            SYS_FS_READ => {
+                self.stats.fs_read = self.stats.fs_read.saturating_add(1);
+                self.syscall_fs_read(arg0, arg1)
+            }
+            SYS_PRESENT => {
+                self.stats.present = self.stats.present.saturating_add(1);
+                self.syscall_present(arg0, arg1)
+            }
             _ => {
                 self.stats.errors = self.stats.errors.saturating_add(1);
                 serial::write_fmt(format_args!(
@@ -486,16 +630,148 @@ impl Scheduler {
         1
     }
 
-    fn syscall_socket(&mut self, domain: u64, socket_type: u64, protocol: u64) -> isize {
-        if domain != AF_INET || socket_type != SOCK_DGRAM {
+    fn syscall_socket(
+        &mut self,
+        task: &mut Task,
+        domain: u64,
+        socket_type: u64,
+        protocol: u64,
+    ) -> isize {
+        if domain != AF_INET || (socket_type != SOCK_DGRAM && socket_type != SOCK_STREAM) {
             self.stats.errors = self.stats.errors.saturating_add(1);
             return -97;
         }
-        if protocol != 0 && protocol != IPPROTO_UDP {
+        if socket_type == SOCK_DGRAM {
+            if protocol != 0 && protocol != IPPROTO_UDP {
+                self.stats.errors = self.stats.errors.saturating_add(1);
+                return -93;
+            }
+            return UDP_SOCKET_FD as isize;
+        }
+        if protocol != 0 && protocol != IPPROTO_TCP {
             self.stats.errors = self.stats.errors.saturating_add(1);
             return -93;
         }
-        UDP_SOCKET_FD as isize
+        match net::tcp_open() {
+            Ok(socket) => {
+                task.tcp_sockets |= 1 << socket;
+                (TCP_SOCKET_FD_BASE as usize + socket) as isize
+            }
+            Err(err) => {
+                self.stats.errors = self.stats.errors.saturating_add(1);
+                map_net_error(err)
+            }
+        }
+    }
+
+    fn syscall_connect(&mut self, task: &Task, fd: u64, req_ptr: u64, req_len: u64) -> isize {
+        let Some(socket) = tcp_socket(task, fd) else {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -9;
+        };
+        if req_ptr == 0 || req_len != size_of::<TcpConnectReq>() as u64 {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        }
+
+        // SAFETY: M4/M7 cooperative tasks share the kernel address space.
+        let request = unsafe { (req_ptr as *const TcpConnectReq).read() };
+        match net::tcp_connect(socket, request.dst_ip, request.dst_port) {
+            Ok(()) => 0,
+            Err(err) => {
+                self.stats.errors = self.stats.errors.saturating_add(1);
+                map_net_error(err)
+            }
+        }
+    }
+
+    /// Non-blocking: queues what fits and returns `-11` (EAGAIN) when the send buffer is full.
+    fn syscall_send(&mut self, task: &Task, fd: u64, ptr: u64, len: u64) -> isize {
+        let Some(socket) = tcp_socket(task, fd) else {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -9;
+        };
+        let Some(len) = usize::try_from(len).ok() else {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        };
+        if ptr == 0 || len == 0 {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        }
+
+        // SAFETY: the data pointer is validated by the shared-address-space model.
+        let data = unsafe { core::slice::from_raw_parts(ptr as *const u8, len) };
+        match net::tcp_send(socket, data) {
+            Ok(0) => -11,
+            Ok(sent) => sent as isize,
+            Err(err) => {
+                self.stats.errors = self.stats.errors.saturating_add(1);
+                map_net_error(err)
+            }
+        }
+    }
+
+    /// Non-blocking: returns the bytes read, `0` at end of stream, or `-11` (EAGAIN).
+    fn syscall_recv(&mut self, task: &Task, fd: u64, ptr: u64, cap: u64) -> isize {
+        let Some(socket) = tcp_socket(task, fd) else {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -9;
+        };
+        let Some(cap) = usize::try_from(cap).ok() else {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        };
+        if ptr == 0 || cap == 0 {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        }
+
+        // SAFETY: the output pointer is writable in the shared address space.
+        let output = unsafe { core::slice::from_raw_parts_mut(ptr as *mut u8, cap) };
+        match net::tcp_recv(socket, output) {
+            Ok(net::TcpRecv::Data(read)) => read as isize,
+            Ok(net::TcpRecv::WouldBlock) => -11,
+            Ok(net::TcpRecv::Eof) => 0,
+            Err(err) => {
+                self.stats.errors = self.stats.errors.saturating_add(1);
+                map_net_error(err)
+            }
+        }
+    }
+
+    fn syscall_close(&mut self, task: &mut Task, fd: u64) -> isize {
+        if fd == UDP_SOCKET_FD {
+            return 0;
+        }
+        let Some(socket) = tcp_socket(task, fd) else {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -9;
+        };
+        task.tcp_sockets &= !(1 << socket);
+        match net::tcp_close(socket) {
+            Ok(()) => 0,
+            Err(err) => {
+                self.stats.errors = self.stats.errors.saturating_add(1);
+                map_net_error(err)
+            }
+        }
+    }
+
+    /// Exit path: releases the TCP sockets the task left open.
+    fn close_task_sockets(&mut self, task: &mut Task) {
+        while task.tcp_sockets != 0 {
+            let socket = task.tcp_sockets.trailing_zeros() as usize;
+            task.tcp_sockets &= task.tcp_sockets - 1;
+            if let Err(err) = net::tcp_close(socket) {
+                serial::write_fmt(format_args!(
+                    "syscall: pid={} close tcp socket {} on exit failed ({})\n",
+                    task.pid,
+                    socket,
+                    err.as_str()
+                ));
+            }
+        }
     }
 
     fn syscall_sendto(&mut self, fd: u64, req_ptr: u64, req_len: u64) -> isize {
@@ -574,6 +850,141 @@ impl Scheduler {
         }
     }
 
+    fn syscall_ring_setup(&mut self, task: &mut Task, ring_ptr: u64, ring_len: u64) -> isize {
+        if ring_ptr == 0
+            || ring_len != size_of::<SyscallRing>() as u64
+            || !ring_ptr.is_multiple_of(align_of::<SyscallRing>() as u64)
+        {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        }
+
+        // SAFETY: tasks share the kernel address space, and a task keeps its registered ring
+        // alive until it exits, which unregisters it.
+        task.ring = Some(unsafe { &*(ring_ptr as *const SyscallRing) });
+        0
+    }
+
+    /// Runs every submission the ring has a completion slot for, in order, and returns how
+    /// many. Submissions that park or end the task, or that touch rings, complete with `-22`.
+    fn drain_ring(&mut self, task: &mut Task, ring: &SyscallRing, now_ticks: u64) -> usize {
+        let mut batch = 0usize;
+        while let Some(RingSqe {
+            number,
+            args,
+            user_data,
+        }) = ring.next_submission()
+        {
+            let result = if matches!(
+                number,
+                SYS_EXIT | SYS_YIELD | SYS_SLEEP | SYS_RING_SETUP | SYS_RING_ENTER
+            ) {
+                self.stats.errors = self.stats.errors.saturating_add(1);
+                -22
+            } else {
+                self.dispatch_syscall(task, now_ticks, number, args[0], args[1], args[2])
+            };
+            ring.complete(RingCqe {
+                user_data,
+                result: result as i64,
+            });
+            batch += 1;
+        }
+        if batch > 0 {
+            self.stats.ring_batches = self.stats.ring_batches.saturating_add(1);
+            self.stats.ring_entries = self.stats.ring_entries.saturating_add(batch as u64);
+            self.stats.ring_batch_max = self.stats.ring_batch_max.max(batch as u64);
+        }
+        batch
+    }
+
+    /// Drains every live task's ring, so a task can publish submissions and poll for their
+    /// completions without entering the kernel at all.
+    fn poll_rings(&mut self, now_ticks: u64) {
+        for index in 0..MAX_TASKS {
+            let Some(mut task) = self.tasks[index] else {
+                continue;
+            };
+            let Some(ring) = task.ring else {
+                continue;
+            };
+            self.drain_ring(&mut task, ring, now_ticks);
+            self.tasks[index] = Some(task);
+        }
+    }
+
+    fn syscall_fs_read(&mut self, req_ptr: u64, req_len: u64) -> isize {
+        if req_ptr == 0 || req_len != size_of::<FsReadReq>() as u64 {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        }
+
+        // SAFETY: M4/M7 cooperative tasks share the kernel address space.
+        let request = unsafe { (req_ptr as *const FsReadReq).read() };
+        let (Ok(path_len), Ok(offset), Ok(buf_cap)) = (
+            usize::try_from(request.path_len),
+            usize::try_from(request.offset),
+            usize::try_from(request.buf_cap),
+        ) else {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        };
+        if request.path_ptr == 0 || path_len == 0 || request.buf_ptr == 0 || buf_cap == 0 {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        }
+
+        // SAFETY: the path pointer is validated by the shared-address-space model.
+        let path = unsafe { core::slice::from_raw_parts(request.path_ptr as *const u8, path_len) };
+        let Ok(path) = core::str::from_utf8(path) else {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        };
+        // SAFETY: the buffer pointer is writable in the shared address space.
+        let output =
+            unsafe { core::slice::from_raw_parts_mut(request.buf_ptr as *mut u8, buf_cap) };
+        match fs::open_file(path).and_then(|handle| fs::read_at(handle, offset, output)) {
+            Ok(read) => read as isize,
+            Err(err) => {
+                self.stats.errors = self.stats.errors.saturating_add(1);
+                map_fs_error(err)
+            }
+        }
+    }
+
+    /// Copies the frame into the Doom view, opening its window; returns `0`. Graphics takes
+    /// its own lock, so this is safe against the compositor on another CPU.
+    fn syscall_present(&mut self, req_ptr: u64, req_len: u64) -> isize {
+        if req_ptr == 0 || req_len != size_of::<PresentReq>() as u64 {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        }
+
+        // SAFETY: M4/M7 cooperative tasks share the kernel address space.
+        let request = unsafe { (req_ptr as *const PresentReq).read() };
+        let width = request.width as usize;
+        let height = request.height as usize;
+        let Some(pixels_len) = usize::try_from(request.pixels_len).ok() else {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        };
+        if request.pixels_ptr == 0
+            || !request.pixels_ptr.is_multiple_of(align_of::<u32>() as u64)
+            || !(1..=gfx::DOOM_VIEW_MAX_W).contains(&width)
+            || !(1..=gfx::DOOM_VIEW_MAX_H).contains(&height)
+            || pixels_len < width * height
+        {
+            self.stats.errors = self.stats.errors.saturating_add(1);
+            return -22;
+        }
+
+        // SAFETY: the pixel pointer is aligned and validated by the shared-address-space model.
+        let pixels =
+            unsafe { core::slice::from_raw_parts(request.pixels_ptr as *const u32, pixels_len) };
+        gfx::set_file_manager_doom_view(width, height, gfx::DoomFrame::Pixels(pixels));
+        0
+    }
+
     fn sys_write(&mut self, task: &mut Task, text: &str, now_ticks: u64) {
         let _ = self.dispatch_syscall(
             task,
@@ -664,7 +1075,7 @@ impl Scheduler {
 
     fn log_syscall_stats(&self) {
         serial::write_fmt(format_args!(
-            "syscalls: write={} read={} yield={} sleep={} exit={} socket={} sendto={} recvfrom={} errors={}\n",
+            "syscalls: write={} read={} yield={} sleep={} exit={} socket={} sendto={} recvfrom={} connect={} send={} recv={} close={} ring_setup={} ring_enter={} fs_read={} present={} errors={}\n",
             self.stats.write,
             self.stats.read,
             self.stats.yield_now,
@@ -673,8 +1084,26 @@ impl Scheduler {
             self.stats.socket,
             self.stats.sendto,
             self.stats.recvfrom,
+            self.stats.connect,
+            self.stats.send,
+            self.stats.recv,
+            self.stats.close,
+            self.stats.ring_setup,
+            self.stats.ring_enter,
+            self.stats.fs_read,
+            self.stats.present,
             self.stats.errors
         ));
+        serial::write_fmt(format_args!(
+            "syscalls: ring batches={} entries={} avg_batch={} max_batch={}\n",
+            self.stats.ring_batches,
+            self.stats.ring_entries,
+            self.stats
+                .ring_entries
+                .checked_div(self.stats.ring_batches)
+                .unwrap_or(0),
+            self.stats.ring_batch_max
+        ));
     }
 }
 
@@ -688,10 +1117,36 @@ fn map_net_error(error: net::NetError) -> isize {
         net::NetError::FrameTooLarge => -90,
         net::NetError::IoTimeout => -110,
         net::NetError::ArpTimeout => -113,
+        net::NetError::ArpQueueFull => -105,
+        net::NetError::DnsBusy => -16,
         net::NetError::UdpPayloadTooLarge => -90,
+        net::NetError::TcpNoSocket => -24,
+        net::NetError::TcpBadSocket => -9,
+        net::NetError::TcpNotConnected => -107,
+        net::NetError::TcpReset => -104,
+    }
+}
+
+fn map_fs_error(error: fs::FsError) -> isize {
+    match error {
+        fs::FsError::InvalidPath => -22,
+        fs::FsError::NameTooLong => -36,
+        fs::FsError::NotFound => -2,
+        fs::FsError::NoSpace | fs::FsError::StorageNoSpace => -28,
+        fs::FsError::FileTooLarge => -27,
+        fs::FsError::DiskCorrupt | fs::FsError::StorageIo => -5,
+        fs::FsError::StorageUnavailable => -19,
+        fs::FsError::StaleHandle => -116,
     }
 }
 
+/// Connection slot behind a TCP socket fd, if `task` opened it; the socket itself is
+/// validated by `net`.
+fn tcp_socket(task: &Task, fd: u64) -> Option<usize> {
+    let slot = usize::try_from(fd.checked_sub(TCP_SOCKET_FD_BASE)?).ok()?;
+    (slot < net::TCP_MAX_CONNECTIONS && task.tcp_sockets & (1 << slot) != 0).then_some(slot)
+}
+
 fn parse_send_command(command: &str) -> Option<([u8; 4], u16, &str)> {
     let rest = command.strip_prefix("send ")?;
     let mut parts = rest.splitn(3, ' ');
@@ -704,6 +1159,19 @@ fn parse_send_command(command: &str) -> Option<([u8; 4], u16, &str)> {
     Some((ip, port, payload))
 }
 
+fn parse_burst_command(command: &str) -> Option<([u8; 4], u16, usize, &str)> {
+    let rest = command.strip_prefix("burst ")?;
+    let mut parts = rest.splitn(4, ' ');
+    let ip = parse_ipv4(parts.next()?)?;
+    let port = parts.next()?.parse::<u16>().ok()?;
+    let count = parts.next()?.parse::<usize>().ok()?;
+    let payload = parts.next()?;
+    if count == 0 || payload.is_empty() {
+        return None;
+    }
+    Some((ip, port, count, payload))
+}
+
 fn parse_ipv4(text: &str) -> Option<[u8; 4]> {
     let mut ip = [0u8; 4];
     let mut count = 0usize;
@@ -724,12 +1192,18 @@ pub fn init() -> ProcInitReport {
     with_scheduler(|scheduler| scheduler.init())
 }
 
-pub fn run_once(now_ticks: u64) {
-    with_scheduler(|scheduler| scheduler.run_once(now_ticks));
+/// Runs one step of the next ready task and returns the tick to call again at (see
+/// `Scheduler::next_run_tick`).
+pub fn run_once(now_ticks: u64) -> Option<u64> {
+    with_scheduler(|scheduler| {
+        scheduler.run_once(now_ticks);
+        scheduler.next_run_tick(now_ticks)
+    })
 }
 
 pub fn log_process_table() {
     with_scheduler(|scheduler| scheduler.log_tasks());
+    sched::log_threads();
 }
 
 pub fn log_syscall_stats() {
@@ -741,32 +1215,3 @@ fn with_scheduler<R>(f: impl FnOnce(&mut Scheduler) -> R) -> R {
     // SAFETY: `SCHED_LOCK` serializes mutable access to scheduler state.
     unsafe { f(&mut *SCHEDULER.0.get()) }
 }
-
-struct SpinLock {
-    locked: AtomicBool,
-}
-
-impl SpinLock {
-    const fn new() -> Self {
-        Self {
-            locked: AtomicBool::new(false),
-        }
-    }
-
-    fn lock(&self) -> SpinLockGuard<'_> {
-        while self.locked.swap(true, Ordering::Acquire) {
-            spin_loop();
-        }
-        SpinLockGuard { lock: self }
-    }
-}
-
-struct SpinLockGuard<'a> {
-    lock: &'a SpinLock,
-}
-
-impl Drop for SpinLockGuard<'_> {
-    fn drop(&mut self) {
-        self.lock.locked.store(false, Ordering::Release);
-    }
-}
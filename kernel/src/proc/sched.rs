@@ -0,0 +1,605 @@
+// kernel/src/proc/sched.rs: preemptive kernel threads with priority run queues, switched on
+// timer deadlines and on explicit blocking. Threads run on the BSP only; application
+// processors take work through `proc::work`.
+use crate::arch::x86_64::{smp, switch};
+use crate::{profile, serial, time};
+use alloc::alloc::{Layout, alloc, dealloc};
+use core::cell::UnsafeCell;
+use core::hint::spin_loop;
+use core::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use x86_64::instructions::interrupts;
+
+pub const MAX_THREADS: usize = 8;
+/// Slot 0 is the boot context; it runs only when nothing else is ready.
+const IDLE: usize = 0;
+/// Time a thread may run before yielding to a ready peer of the same priority. The event
+/// timer is armed for the end of the slice whenever a thread other than idle runs, so an
+/// idle CPU takes no periodic interrupt.
+const SLICE_NS: u64 = 10_000_000;
+/// Deadline of a thread that only an event can wake.
+const NO_DEADLINE: u64 = u64::MAX;
+const STACK_ALIGN: usize = 16;
+const PRIORITY_LEVELS: usize = 3;
+
+/// Queue a runnable thread waits in; a ready thread always runs before any lower level.
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum Priority {
+    High,
+    Normal,
+    Low,
+}
+
+impl Priority {
+    pub const fn as_str(self) -> &'static str {
+        match self {
+            Self::High => "high",
+            Self::Normal => "normal",
+            Self::Low => "low",
+        }
+    }
+
+    const fn index(self) -> usize {
+        match self {
+            Self::High => 0,
+            Self::Normal => 1,
+            Self::Low => 2,
+        }
+    }
+}
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum SpawnError {
+    NotStarted,
+    TableFull,
+    OutOfMemory,
+}
+
+impl SpawnError {
+    pub const fn as_str(self) -> &'static str {
+        match self {
+            Self::NotStarted => "not_started",
+            Self::TableFull => "table_full",
+            Self::OutOfMemory => "out_of_memory",
+        }
+    }
+}
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum ThreadState {
+    Free,
+    Ready,
+    Running,
+    /// Runnable again once the event epoch moves past `epoch`, `deadline_ns` passes or
+    /// `unpark` sets the thread's wake token.
+    Blocked {
+        epoch: u64,
+        deadline_ns: u64,
+    },
+    /// Runnable again once `unpark` sets the thread's wake token.
+    Parked,
+}
+
+impl ThreadState {
+    const fn as_str(self) -> &'static str {
+        match self {
+            Self::Free => "free",
+            Self::Ready => "ready",
+            Self::Running => "running",
+            Self::Blocked {
+                deadline_ns: NO_DEADLINE,
+                ..
+            } => "wait_event",
+            Self::Blocked { .. } => "wait_until",
+            Self::Parked => "wait_wake",
+        }
+    }
+}
+
+#[derive(Clone, Copy)]
+struct Thread {
+    state: ThreadState,
+    priority: Priority,
+    name: &'static str,
+    entry: fn() -> !,
+    saved_rsp: u64,
+    stack_bytes: usize,
+    slice_end_ns: u64,
+    /// Monotonic time the thread last got the CPU, for `run_ns`.
+    dispatch_ns: u64,
+    /// Epoch the thread last woke at; `wait_event` returns at once if an event came since.
+    seen_epoch: u64,
+    /// TSC at which the thread became ready, for dispatch latency.
+    ready_tsc: u64,
+    switches: u64,
+    preemptions: u64,
+    run_ns: u64,
+    max_dispatch_cycles: u64,
+}
+
+impl Thread {
+    const fn free() -> Self {
+        Self {
+            state: ThreadState::Free,
+            priority: Priority::Low,
+            name: "",
+            entry: idle_entry,
+            saved_rsp: 0,
+            stack_bytes: 0,
+            slice_end_ns: 0,
+            dispatch_ns: 0,
+            seen_epoch: 0,
+            ready_tsc: 0,
+            switches: 0,
+            preemptions: 0,
+            run_ns: 0,
+            max_dispatch_cycles: 0,
+        }
+    }
+}
+
+/// FIFO of thread ids; each ready thread sits in exactly one queue.
+#[derive(Clone, Copy)]
+struct RunQueue {
+    ids: [u8; MAX_THREADS],
+    head: usize,
+    len: usize,
+}
+
+impl RunQueue {
+    const fn new() -> Self {
+        Self {
+            ids: [0; MAX_THREADS],
+            head: 0,
+            len: 0,
+        }
+    }
+
+    fn push(&mut self, id: usize) {
+        debug_assert!(self.len < MAX_THREADS);
+        self.ids[(self.head + self.len) % MAX_THREADS] = id as u8;
+        self.len += 1;
+    }
+
+    fn pop(&mut self) -> Option<usize> {
+        if self.len == 0 {
+            return None;
+        }
+        let id = usize::from(self.ids[self.head]);
+        self.head = (self.head + 1) % MAX_THREADS;
+        self.len -= 1;
+        Some(id)
+    }
+}
+
+struct Threads {
+    threads: [Thread; MAX_THREADS],
+    queues: [RunQueue; PRIORITY_LEVELS],
+    current: usize,
+}
+
+impl Threads {
+    const fn new() -> Self {
+        Self {
+            threads: [Thread::free(); MAX_THREADS],
+            queues: [RunQueue::new(); PRIORITY_LEVELS],
+            current: IDLE,
+        }
+    }
+
+    fn make_ready(&mut self, id: usize, tsc: u64) {
+        let thread = &mut self.threads[id];
+        thread.state = ThreadState::Ready;
+        thread.ready_tsc = tsc;
+        if id != IDLE {
+            self.queues[thread.priority.index()].push(id);
+        }
+    }
+
+    /// Moves every thread whose event has arrived or whose deadline has passed onto its run
+    /// queue, and returns the earliest deadline still pending.
+    fn wake(&mut self, epoch: u64, now_ns: u64) -> u64 {
+        let irq_tsc = LAST_IRQ_TSC.load(Ordering::Relaxed);
+        let mut next_deadline = NO_DEADLINE;
+        for (id, token) in WAKE_TOKENS.iter().enumerate() {
+            if self.threads[id].state == ThreadState::Parked {
+                if token.swap(false, Ordering::AcqRel) {
+                    self.make_ready(id, time::read_tsc());
+                }
+                continue;
+            }
+            let ThreadState::Blocked {
+                epoch: waited,
+                deadline_ns,
+            } = self.threads[id].state
+            else {
+                continue;
+            };
+            if waited != epoch {
+                self.threads[id].seen_epoch = epoch;
+                self.make_ready(id, irq_tsc);
+            } else if token.swap(false, Ordering::AcqRel) || now_ns >= deadline_ns {
+                self.make_ready(id, time::read_tsc());
+            } else {
+                next_deadline = next_deadline.min(deadline_ns);
+            }
+        }
+        next_deadline
+    }
+
+    fn highest_ready(&self) -> Option<Priority> {
+        [Priority::High, Priority::Normal, Priority::Low]
+            .into_iter()
+            .find(|priority| self.queues[priority.index()].len > 0)
+    }
+
+    /// Whether the running thread survives a timer interrupt: nothing ready outranks it and,
+    /// with a ready peer of equal priority, its slice is not over.
+    fn keep(&mut self, now_ns: u64) -> bool {
+        let current = self.current;
+        let own = self.threads[current].priority.index();
+        match self.highest_ready() {
+            None => {
+                self.threads[current].slice_end_ns = now_ns.saturating_add(SLICE_NS);
+                true
+            }
+            Some(_) if current == IDLE => false,
+            Some(ready) if ready.index() == own => now_ns < self.threads[current].slice_end_ns,
+            Some(ready) => ready.index() > own,
+        }
+    }
+
+    /// Saves `rsp` for the current thread and returns the stack pointer to resume. On a
+    /// timer interrupt (`preempt`) the current thread keeps the CPU unless its slice is spent
+    /// or a higher-priority thread is ready. Either way the event timer is re-armed for the
+    /// nearest sleeper deadline or the end of the running slice.
+    fn switch(&mut self, rsp: u64, preempt: bool) -> u64 {
+        let now_ns = time::monotonic_ns();
+        let next_deadline = self.wake(EVENT_EPOCH.load(Ordering::SeqCst), now_ns);
+
+        let current = self.current;
+        self.threads[current].saved_rsp = rsp;
+        let running = self.threads[current].state == ThreadState::Running;
+        let mut next = current;
+        if !(running && preempt && self.keep(now_ns)) {
+            if running {
+                if preempt {
+                    self.threads[current].preemptions =
+                        self.threads[current].preemptions.saturating_add(1);
+                }
+                self.make_ready(current, time::read_tsc());
+            }
+            next = self
+                .highest_ready()
+                .and_then(|priority| self.queues[priority.index()].pop())
+                .unwrap_or(IDLE);
+        }
+
+        if next != current {
+            let outgoing = &mut self.threads[current];
+            outgoing.run_ns = outgoing
+                .run_ns
+                .saturating_add(now_ns.saturating_sub(outgoing.dispatch_ns));
+            let now_tsc = time::read_tsc();
+            let thread = &mut self.threads[next];
+            thread.switches = thread.switches.saturating_add(1);
+            let waited = now_tsc.saturating_sub(thread.ready_tsc);
+            thread.max_dispatch_cycles = thread.max_dispatch_cycles.max(waited);
+            thread.dispatch_ns = now_ns;
+        }
+        let thread = &mut self.threads[next];
+        if thread.state != ThreadState::Running {
+            thread.state = ThreadState::Running;
+            thread.slice_end_ns = now_ns.saturating_add(SLICE_NS);
+        }
+        self.current = next;
+
+        let event = if next == IDLE {
+            next_deadline
+        } else {
+            next_deadline.min(self.threads[next].slice_end_ns)
+        }
+        .min(profile::next_sample_ns(now_ns));
+        time::set_next_event((event != NO_DEADLINE).then_some(event));
+        self.threads[next].saved_rsp
+    }
+}
+
+struct ThreadsCell(UnsafeCell<Threads>);
+
+// SAFETY: the scheduler runs on the BSP only and its state is only touched with interrupts
+// disabled (inside the switch stubs or under `without_interrupts`), so accesses never overlap.
+unsafe impl Sync for ThreadsCell {}
+
+static THREADS: ThreadsCell = ThreadsCell(UnsafeCell::new(Threads::new()));
+static STARTED: AtomicBool = AtomicBool::new(false);
+/// Bumped by device interrupts and `notify`; threads blocked in `wait_event` wake when it
+/// moves. Timer interrupts leave it alone so sleepers are not woken early.
+static EVENT_EPOCH: AtomicU64 = AtomicU64::new(0);
+static LAST_IRQ_TSC: AtomicU64 = AtomicU64::new(0);
+/// Set by `unpark` and consumed by `park` or the wake scan; one per thread, so waking a
+/// single waiter leaves every `wait_event` thread asleep.
+static WAKE_TOKENS: [AtomicBool; MAX_THREADS] = [const { AtomicBool::new(false) }; MAX_THREADS];
+
+#[derive(Clone, Copy)]
+struct ThreadReport {
+    id: usize,
+    name: &'static str,
+    priority: Priority,
+    state: &'static str,
+    stack_bytes: usize,
+    switches: u64,
+    preemptions: u64,
+    run_ns: u64,
+    max_dispatch_cycles: u64,
+}
+
+/// Adopts the boot context as the idle thread and enables switching. Interrupt vectors
+/// for the stubs must already be installed.
+pub fn start() {
+    interrupts::without_interrupts(|| {
+        with_threads(|threads| {
+            let idle = &mut threads.threads[IDLE];
+            idle.state = ThreadState::Running;
+            idle.name = "idle";
+        });
+        STARTED.store(true, Ordering::Release);
+    });
+}
+
+/// Creates a thread that starts in `entry` on a fresh heap stack of `stack_bytes`.
+pub fn spawn(
+    name: &'static str,
+    priority: Priority,
+    stack_bytes: usize,
+    entry: fn() -> !,
+) -> Result<usize, SpawnError> {
+    if !STARTED.load(Ordering::Acquire) {
+        return Err(SpawnError::NotStarted);
+    }
+    let layout = Layout::from_size_align(stack_bytes.max(4096), STACK_ALIGN)
+        .map_err(|_| SpawnError::OutOfMemory)?;
+    // SAFETY: the layout has a non-zero size. Threads never exit, so the stack is never freed.
+    let stack = unsafe { alloc(layout) };
+    if stack.is_null() {
+        return Err(SpawnError::OutOfMemory);
+    }
+    let stack_top = (stack as usize + layout.size()) as u64;
+
+    let spawned = interrupts::without_interrupts(|| {
+        with_threads(|threads| {
+            let id = (1..MAX_THREADS)
+                .find(|&id| threads.threads[id].state == ThreadState::Free)
+                .ok_or(SpawnError::TableFull)?;
+            // SAFETY: `stack` is a fresh, exclusively owned allocation ending at `stack_top`,
+            // which is 16-byte aligned because both the base and the size are.
+            let saved_rsp = unsafe { switch::initial_frame(stack_top, thread_entry, id) };
+            threads.threads[id] = Thread {
+                priority,
+                name,
+                entry,
+                saved_rsp,
+                stack_bytes: layout.size(),
+                ..Thread::free()
+            };
+            threads.make_ready(id, time::read_tsc());
+            Ok(id)
+        })
+    });
+    if spawned.is_err() {
+        // SAFETY: `stack` came from `alloc` with this layout and no thread references it.
+        unsafe { dealloc(stack, layout) };
+    }
+    spawned
+}
+
+/// Blocks the calling thread until the next event (a device interrupt or `notify`),
+/// returning at once if one has arrived since it last woke. Before `start`, or on the idle
+/// thread, this halts instead; on an application processor it spins once.
+pub fn wait_event() {
+    wait_until(NO_DEADLINE);
+}
+
+/// Like `wait_event`, but also returns once `time::monotonic_ns` reaches `deadline_ns`.
+pub fn wait_until(deadline_ns: u64) {
+    if !can_block() {
+        if smp::is_bsp() {
+            x86_64::instructions::hlt();
+        } else {
+            spin_loop();
+        }
+        return;
+    }
+    interrupts::disable();
+    let epoch = with_threads(|threads| threads.threads[threads.current].seen_epoch);
+    block(epoch, deadline_ns);
+}
+
+/// Id of the calling thread, for a waker to pass to `unpark`. The idle thread, and any
+/// context before `start`, reads as slot 0.
+pub fn current() -> usize {
+    interrupts::without_interrupts(|| with_threads(|threads| threads.current))
+}
+
+/// Blocks the calling thread until `unpark` targets it, returning at once if its wake token
+/// is already set. Wakeups may be stale, so callers re-check their condition. Where the
+/// thread cannot block this halts on the BSP, which `unpark` kicks, or spins once.
+pub fn park() {
+    if !can_block() {
+        if smp::is_bsp() {
+            x86_64::instructions::hlt();
+        } else {
+            spin_loop();
+        }
+        return;
+    }
+    interrupts::disable();
+    let current = with_threads(|threads| threads.current);
+    if WAKE_TOKENS[current].swap(false, Ordering::AcqRel) {
+        interrupts::enable();
+        return;
+    }
+    with_threads(|threads| threads.threads[current].state = ThreadState::Parked);
+    switch::yield_to_scheduler();
+    interrupts::enable();
+}
+
+/// Sets the wake token of thread `id`, readying it at the next switch if it is parked or
+/// blocked in `wait_event` or `wait_until`, without moving the event epoch. From an
+/// application processor this also kicks the BSP out of a halt; on the BSP the woken thread
+/// waits for the next switch.
+pub fn unpark(id: usize) {
+    WAKE_TOKENS[id].store(true, Ordering::Release);
+    if !smp::is_bsp() {
+        smp::kick(0);
+    }
+}
+
+/// Current event epoch, to pass to `wait_epoch_change` after re-checking a condition.
+pub fn event_epoch() -> u64 {
+    EVENT_EPOCH.load(Ordering::SeqCst)
+}
+
+/// Blocks until the event epoch differs from `epoch`, returning at once if it already does.
+/// Backs off contended locks this way so the holder, whatever its priority, gets the CPU;
+/// contexts that cannot block spin once instead.
+pub fn wait_epoch_change(epoch: u64) {
+    if !can_block() {
+        spin_loop();
+        return;
+    }
+    interrupts::disable();
+    block(epoch, NO_DEADLINE);
+}
+
+/// Gives the CPU to any ready thread of equal or higher priority. A no-op off the BSP.
+pub fn yield_now() {
+    if STARTED.load(Ordering::Acquire) && smp::is_bsp() {
+        switch::yield_to_scheduler();
+    }
+}
+
+/// Called from device interrupt handlers before their EOI.
+pub fn note_irq() {
+    LAST_IRQ_TSC.store(time::read_tsc(), Ordering::Relaxed);
+    EVENT_EPOCH.fetch_add(1, Ordering::SeqCst);
+}
+
+/// Wakes every thread blocked in `wait_event`: a software event such as a lock release or
+/// queued output. Waiters re-check their condition, so spurious wakeups are harmless. On an
+/// application processor this also sends the BSP a wake IPI, since it may be halted in idle.
+pub fn notify() {
+    EVENT_EPOCH.fetch_add(1, Ordering::SeqCst);
+    if !smp::is_bsp() {
+        smp::kick(0);
+    }
+}
+
+/// Timer half of the switch: runs from the timer stubs after the interrupt is acknowledged.
+pub fn preempt(rsp: u64) -> u64 {
+    if !STARTED.load(Ordering::Acquire) {
+        return rsp;
+    }
+    with_threads(|threads| threads.switch(rsp, true))
+}
+
+/// Target of the `YIELD_VECTOR` stub.
+pub extern "C" fn yield_switch(rsp: u64) -> u64 {
+    with_threads(|threads| threads.switch(rsp, false))
+}
+
+fn thread_reports(out: &mut [ThreadReport; MAX_THREADS]) -> usize {
+    interrupts::without_interrupts(|| {
+        with_threads(|threads| {
+            let mut count = 0;
+            for (id, thread) in threads.threads.iter().enumerate() {
+                if thread.state == ThreadState::Free {
+                    continue;
+                }
+                out[count] = ThreadReport {
+                    id,
+                    name: thread.name,
+                    priority: thread.priority,
+                    state: thread.state.as_str(),
+                    stack_bytes: thread.stack_bytes,
+                    switches: thread.switches,
+                    preemptions: thread.preemptions,
+                    run_ns: thread.run_ns,
+                    max_dispatch_cycles: thread.max_dispatch_cycles,
+                };
+                count += 1;
+            }
+            count
+        })
+    })
+}
+
+pub fn log_threads() {
+    let mut reports = [ThreadReport {
+        id: 0,
+        name: "",
+        priority: Priority::Low,
+        state: "",
+        stack_bytes: 0,
+        switches: 0,
+        preemptions: 0,
+        run_ns: 0,
+        max_dispatch_cycles: 0,
+    }; MAX_THREADS];
+    let count = thread_reports(&mut reports);
+    serial::write_fmt(format_args!(
+        "sched: threads={} timer_irqs={}\n",
+        count,
+        time::timer_events()
+    ));
+    for report in &reports[..count] {
+        serial::write_fmt(format_args!(
+            "sched: tid={} name={} prio={} state={} stack={} switches={} preempt={} run_ms={} max_dispatch_cycles={}\n",
+            report.id,
+            report.name,
+            report.priority.as_str(),
+            report.state,
+            report.stack_bytes,
+            report.switches,
+            report.preemptions,
+            report.run_ns / 1_000_000,
+            report.max_dispatch_cycles,
+        ));
+    }
+}
+
+fn can_block() -> bool {
+    smp::is_bsp()
+        && STARTED.load(Ordering::Acquire)
+        && interrupts::are_enabled()
+        && interrupts::without_interrupts(|| with_threads(|threads| threads.current != IDLE))
+}
+
+/// Parks the current thread until `EVENT_EPOCH != epoch` or `deadline_ns`. Must be entered
+/// with interrupts disabled so no timer can observe the half-updated state; re-enables them
+/// on return.
+fn block(epoch: u64, deadline_ns: u64) {
+    with_threads(|threads| {
+        let current = threads.current;
+        threads.threads[current].state = ThreadState::Blocked { epoch, deadline_ns };
+    });
+    switch::yield_to_scheduler();
+    interrupts::enable();
+}
+
+extern "C" fn thread_entry(id: usize) -> ! {
+    let entry =
+        interrupts::without_interrupts(|| with_threads(|threads| threads.threads[id].entry));
+    entry()
+}
+
+fn idle_entry() -> ! {
+    loop {
+        wait_event();
+    }
+}
+
+fn with_threads<R>(f: impl FnOnce(&mut Threads) -> R) -> R {
+    // SAFETY: callers run on the BSP with interrupts disabled (APs never reach the thread
+    // table), so this is the sole live reference to the thread table.
+    unsafe { f(&mut *THREADS.0.get()) }
+}
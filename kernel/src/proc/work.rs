@@ -0,0 +1,199 @@
+// kernel/src/proc/work.rs: per-CPU work queues that run kernel jobs on application processors.
+use crate::arch::x86_64::smp;
+use crate::proc::sched;
+use crate::serial;
+use crate::sync::SpinLock;
+use core::cell::UnsafeCell;
+use core::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use x86_64::instructions::interrupts;
+
+/// A unit of work. Jobs report results through their subsystem's own state or atomics.
+pub type Job = fn();
+
+const QUEUE_CAP: usize = 16;
+
+#[derive(Clone, Copy)]
+struct Task {
+    job: Job,
+    /// Pinned tasks run only on the queue's CPU; the rest may be stolen by an idle worker.
+    pinned: bool,
+    /// Jobs of the submitting batch still outstanding; the submitter waits for zero.
+    pending: *const AtomicUsize,
+    /// Thread that submitted the batch, unparked when the last of its jobs finishes.
+    waiter: usize,
+}
+
+/// FIFO of tasks: the owner takes the oldest, thieves the newest.
+struct Ring {
+    tasks: [Option<Task>; QUEUE_CAP],
+    head: usize,
+    len: usize,
+}
+
+impl Ring {
+    const fn new() -> Self {
+        Self {
+            tasks: [None; QUEUE_CAP],
+            head: 0,
+            len: 0,
+        }
+    }
+
+    fn push(&mut self, task: Task) -> bool {
+        if self.len == QUEUE_CAP {
+            return false;
+        }
+        self.tasks[(self.head + self.len) % QUEUE_CAP] = Some(task);
+        self.len += 1;
+        true
+    }
+
+    fn pop_front(&mut self) -> Option<Task> {
+        if self.len == 0 {
+            return None;
+        }
+        let task = self.tasks[self.head].take();
+        self.head = (self.head + 1) % QUEUE_CAP;
+        self.len -= 1;
+        task
+    }
+
+    fn steal_back(&mut self) -> Option<Task> {
+        let tail = (self.head + self.len + QUEUE_CAP - 1) % QUEUE_CAP;
+        if self.len == 0 || self.tasks[tail].is_none_or(|task| task.pinned) {
+            return None;
+        }
+        self.len -= 1;
+        self.tasks[tail].take()
+    }
+}
+
+struct WorkQueue {
+    lock: SpinLock,
+    ring: UnsafeCell<Ring>,
+    jobs_run: AtomicU64,
+    steals: AtomicU64,
+    halts: AtomicU64,
+}
+
+// SAFETY: `ring` is only accessed under `lock`; a task's `pending` pointer stays valid until
+// the submitter, which waits for the count to reach zero, has seen every job finish.
+unsafe impl Sync for WorkQueue {}
+
+impl WorkQueue {
+    const fn new() -> Self {
+        Self {
+            lock: SpinLock::new(),
+            ring: UnsafeCell::new(Ring::new()),
+            jobs_run: AtomicU64::new(0),
+            steals: AtomicU64::new(0),
+            halts: AtomicU64::new(0),
+        }
+    }
+
+    fn with_ring<R>(&self, f: impl FnOnce(&mut Ring) -> R) -> R {
+        let _guard = self.lock.lock();
+        // SAFETY: holding `lock` makes this the only reference to the ring.
+        unsafe { f(&mut *self.ring.get()) }
+    }
+}
+
+static QUEUES: [WorkQueue; smp::MAX_CPUS] = [const { WorkQueue::new() }; smp::MAX_CPUS];
+
+/// Runs `job` on `cpu` and waits for it to finish, or runs it inline when that CPU is the
+/// BSP, not online, or has a full queue. Used to keep a subsystem on a core of its own.
+pub fn run_pinned(cpu: usize, job: Job) {
+    let pending = AtomicUsize::new(1);
+    let task = Task {
+        job,
+        pinned: true,
+        pending: &pending,
+        waiter: sched::current(),
+    };
+    if cpu == 0 || !smp::online(cpu) || !QUEUES[cpu].with_ring(|ring| ring.push(task)) {
+        job();
+        return;
+    }
+    smp::kick(cpu);
+    wait_done(&pending);
+}
+
+/// Runs every job in `jobs` to completion, spread round-robin over the online workers, any
+/// of which may steal from a busier peer. Without workers the jobs run inline, in order.
+pub fn run_all(jobs: &[Job]) {
+    let pending = AtomicUsize::new(jobs.len());
+    let mut workers = (1..smp::MAX_CPUS).filter(|&cpu| smp::online(cpu)).cycle();
+    let waiter = sched::current();
+    for &job in jobs {
+        let task = Task {
+            job,
+            pinned: false,
+            pending: &pending,
+            waiter,
+        };
+        let queued = workers
+            .next()
+            .is_some_and(|cpu| QUEUES[cpu].with_ring(|ring| ring.push(task)));
+        if !queued {
+            job();
+            pending.fetch_sub(1, Ordering::Release);
+        }
+    }
+    (1..smp::MAX_CPUS).for_each(smp::kick);
+    wait_done(&pending);
+}
+
+fn wait_done(pending: &AtomicUsize) {
+    while pending.load(Ordering::Acquire) != 0 {
+        sched::park();
+    }
+}
+
+/// Main loop of an application processor: run its own queue, else steal, else halt until a
+/// wake IPI. Interrupts are off while it checks for work, so a kick that lands between the
+/// check and `hlt` still ends the halt.
+pub fn run_worker(cpu: usize) -> ! {
+    let queue = &QUEUES[cpu];
+    loop {
+        interrupts::disable();
+        let task = queue.with_ring(Ring::pop_front).or_else(|| steal(cpu));
+        let Some(task) = task else {
+            queue.halts.fetch_add(1, Ordering::Relaxed);
+            interrupts::enable_and_hlt();
+            continue;
+        };
+        interrupts::enable();
+        (task.job)();
+        queue.jobs_run.fetch_add(1, Ordering::Relaxed);
+        // SAFETY: the submitter keeps the counter alive until it reads zero, which cannot
+        // happen before this decrement. The counter is not touched after it.
+        let left = unsafe { (*task.pending).fetch_sub(1, Ordering::Release) };
+        if left == 1 {
+            sched::unpark(task.waiter);
+        }
+    }
+}
+
+fn steal(thief: usize) -> Option<Task> {
+    let task = (1..smp::MAX_CPUS)
+        .filter(|&cpu| cpu != thief && smp::online(cpu))
+        .find_map(|cpu| QUEUES[cpu].with_ring(Ring::steal_back))?;
+    QUEUES[thief].steals.fetch_add(1, Ordering::Relaxed);
+    Some(task)
+}
+
+pub fn log_stats() {
+    for (cpu, queue) in QUEUES.iter().enumerate().skip(1) {
+        if !smp::online(cpu) {
+            continue;
+        }
+        serial::write_fmt(format_args!(
+            "work: cpu={} queued={} jobs={} steals={} halts={}\n",
+            cpu,
+            queue.with_ring(|ring| ring.len),
+            queue.jobs_run.load(Ordering::Relaxed),
+            queue.steals.load(Ordering::Relaxed),
+            queue.halts.load(Ordering::Relaxed)
+        ));
+    }
+}
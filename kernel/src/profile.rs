@@ -0,0 +1,216 @@
+// kernel/src/profile.rs: timer-driven sampling profiler with frame-pointer stacks per CPU.
+use crate::arch::x86_64::smp::{self, MAX_CPUS};
+use crate::arch::x86_64::switch;
+use crate::{mem, serial, time};
+use alloc::alloc::{Layout, alloc};
+use alloc::string::String;
+use core::fmt::Write;
+use core::sync::atomic::{AtomicBool, AtomicPtr, AtomicU64, AtomicUsize, Ordering};
+
+pub const DEFAULT_HZ: u64 = 250;
+pub const MIN_HZ: u64 = 10;
+pub const MAX_HZ: u64 = 1000;
+/// Interrupted RIP plus return addresses kept per sample.
+const MAX_DEPTH: usize = 12;
+const SAMPLES_PER_CPU: usize = 4096;
+/// Largest step from one frame to its caller's the walk follows; a bigger jump means RBP no
+/// longer holds a frame pointer.
+const MAX_FRAME_BYTES: u64 = 64 * 1024;
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum ProfileError {
+    BadRate,
+    OutOfMemory,
+}
+
+impl ProfileError {
+    pub const fn as_str(self) -> &'static str {
+        match self {
+            Self::BadRate => "bad_rate",
+            Self::OutOfMemory => "out_of_memory",
+        }
+    }
+}
+
+/// Leaf first; unused frames stay zero so equal stacks compare equal.
+#[derive(Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+struct Sample {
+    depth: usize,
+    frames: [u64; MAX_DEPTH],
+}
+
+/// Filled only by interrupt handlers on its own CPU, which never nest, so `len` has one
+/// writer. The buffer is allocated on the first `start` and kept for reuse.
+struct CpuSamples {
+    buffer: AtomicPtr<Sample>,
+    len: AtomicUsize,
+    dropped: AtomicU64,
+}
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+static PERIOD_NS: AtomicU64 = AtomicU64::new(1_000_000_000 / DEFAULT_HZ);
+static CPUS: [CpuSamples; MAX_CPUS] = [const {
+    CpuSamples {
+        buffer: AtomicPtr::new(core::ptr::null_mut()),
+        len: AtomicUsize::new(0),
+        dropped: AtomicU64::new(0),
+    }
+}; MAX_CPUS];
+
+/// Discards earlier samples and starts sampling every online CPU `hz` times a second. With
+/// the periodic PIT fallback the rate is the PIT's instead.
+pub fn start(hz: u64) -> Result<(), ProfileError> {
+    if !(MIN_HZ..=MAX_HZ).contains(&hz) {
+        return Err(ProfileError::BadRate);
+    }
+    ENABLED.store(false, Ordering::SeqCst);
+    let layout = Layout::array::<Sample>(SAMPLES_PER_CPU).map_err(|_| ProfileError::OutOfMemory)?;
+    for (cpu, samples) in CPUS.iter().enumerate() {
+        if !smp::online(cpu) {
+            continue;
+        }
+        if samples.buffer.load(Ordering::Acquire).is_null() {
+            // SAFETY: `layout` has a non-zero size.
+            let buffer = unsafe { alloc(layout) }.cast::<Sample>();
+            if buffer.is_null() {
+                return Err(ProfileError::OutOfMemory);
+            }
+            samples.buffer.store(buffer, Ordering::Release);
+        }
+        samples.len.store(0, Ordering::Relaxed);
+        samples.dropped.store(0, Ordering::Relaxed);
+    }
+    PERIOD_NS.store(1_000_000_000 / hz, Ordering::Relaxed);
+    ENABLED.store(true, Ordering::SeqCst);
+    Ok(())
+}
+
+pub fn stop() {
+    ENABLED.store(false, Ordering::SeqCst);
+}
+
+/// Latest time the scheduler may arm the one-shot timer for, so samples keep coming while
+/// the BSP would otherwise sleep; `u64::MAX` while stopped.
+pub fn next_sample_ns(now_ns: u64) -> u64 {
+    if ENABLED.load(Ordering::Relaxed) {
+        now_ns.saturating_add(PERIOD_NS.load(Ordering::Relaxed))
+    } else {
+        u64::MAX
+    }
+}
+
+/// BSP timer interrupt: samples the interrupted context and has every AP sample its own.
+pub fn on_timer(rsp: u64) {
+    if !ENABLED.load(Ordering::Relaxed) {
+        return;
+    }
+    sample(rsp);
+    smp::broadcast(smp::PROFILE_VECTOR);
+}
+
+/// Records the context a switch stub interrupted on this CPU. `rsp` is the stub's frame.
+pub fn sample(rsp: u64) {
+    if !ENABLED.load(Ordering::Relaxed) {
+        return;
+    }
+    let samples = &CPUS[smp::cpu_index()];
+    let buffer = samples.buffer.load(Ordering::Acquire);
+    let index = samples.len.load(Ordering::Relaxed);
+    if buffer.is_null() || index >= SAMPLES_PER_CPU {
+        samples.dropped.fetch_add(1, Ordering::Relaxed);
+        return;
+    }
+    // SAFETY: the caller passes the frame pointer a switch stub handed to Rust.
+    let (rip, rbp) = unsafe { switch::interrupted_context(rsp) };
+    let mut sample = Sample {
+        depth: 1,
+        frames: [0; MAX_DEPTH],
+    };
+    sample.frames[0] = rip;
+    walk_frames(rbp, &mut sample);
+    // SAFETY: `index` is within the buffer, and only this CPU's interrupt handlers, which
+    // do not nest, write to it.
+    unsafe { buffer.add(index).write(sample) };
+    samples.len.store(index + 1, Ordering::Release);
+}
+
+/// Follows the saved-RBP chain. Each frame must be 16-byte aligned (so both words share a
+/// page), canonical and mapped, and above the last one; anything else ends the walk, which also covers
+/// code that uses RBP as a general register.
+fn walk_frames(mut frame: u64, sample: &mut Sample) {
+    while sample.depth < MAX_DEPTH {
+        if frame == 0 || !frame.is_multiple_of(16) || mem::virt_to_phys(frame as usize).is_none() {
+            return;
+        }
+        let words = frame as *const u64;
+        // SAFETY: `frame` is mapped and 16-byte aligned, so both words lie in that page.
+        let (caller_frame, return_addr) = unsafe { (words.read(), words.add(1).read()) };
+        if return_addr == 0 {
+            return;
+        }
+        sample.frames[sample.depth] = return_addr;
+        sample.depth += 1;
+        if caller_frame <= frame || caller_frame - frame > MAX_FRAME_BYTES {
+            return;
+        }
+        frame = caller_frame;
+    }
+}
+
+fn rate_hz() -> u64 {
+    if time::one_shot() {
+        1_000_000_000 / PERIOD_NS.load(Ordering::Relaxed)
+    } else {
+        u64::from(time::PIT_HZ)
+    }
+}
+
+pub fn log_status() {
+    let (samples, dropped) = CPUS.iter().fold((0usize, 0u64), |(samples, dropped), cpu| {
+        (
+            samples + cpu.len.load(Ordering::Relaxed),
+            dropped + cpu.dropped.load(Ordering::Relaxed),
+        )
+    });
+    serial::write_fmt(format_args!(
+        "profile: enabled={} rate_hz={} samples={} dropped={} capacity={}/cpu depth={}\n",
+        ENABLED.load(Ordering::Relaxed),
+        rate_hz(),
+        samples,
+        dropped,
+        SAMPLES_PER_CPU,
+        MAX_DEPTH
+    ));
+}
+
+/// Stops sampling and writes one folded stack per distinct sample between `profile: dump
+/// begin` and `profile: dump end` lines: `cpuN;0x<outermost>;...;0x<leaf> <count>`.
+/// `cargo xtask symbolize-profile` turns them into function names for a flamegraph.
+pub fn dump() {
+    stop();
+    serial::write_fmt(format_args!("profile: dump begin rate_hz={}\n", rate_hz()));
+    let mut stacks = 0usize;
+    let mut line = String::new();
+    for (cpu, samples) in CPUS.iter().enumerate() {
+        let buffer = samples.buffer.load(Ordering::Acquire);
+        let len = samples.len.load(Ordering::Acquire);
+        if buffer.is_null() || len == 0 {
+            continue;
+        }
+        // SAFETY: the first `len` samples were written before `len` was published. Sampling
+        // is stopped, and a handler that raced the stop only writes past `len`.
+        let recorded = unsafe { core::slice::from_raw_parts_mut(buffer, len) };
+        recorded.sort_unstable();
+        for run in recorded.chunk_by(|a, b| a == b) {
+            let sample = &run[0];
+            line.clear();
+            let _ = write!(line, "cpu{cpu}");
+            for frame in sample.frames[..sample.depth].iter().rev() {
+                let _ = write!(line, ";{frame:#x}");
+            }
+            serial::write_fmt(format_args!("{} {}\n", line, run.len()));
+            stacks += 1;
+        }
+    }
+    serial::write_fmt(format_args!("profile: dump end stacks={}\n", stacks));
+}
@@ -1,60 +1,36 @@
 // kernel/src/serial.rs: early-boot COM1 serial output (0x3F8).
+use crate::proc::sched;
+use crate::sync::SpinLock;
+use crate::sync::spsc::SpscRing;
 use core::arch::asm;
 use core::cell::UnsafeCell;
 use core::fmt::{self, Write};
 use core::hint::spin_loop;
-use core::sync::atomic::{AtomicBool, Ordering};
 
 const COM1_BASE: u16 = 0x3F8;
 const MIRROR_CAPACITY: usize = 16384;
 
-struct SpinLock {
-    locked: AtomicBool,
-}
-
-impl SpinLock {
-    const fn new() -> Self {
-        Self {
-            locked: AtomicBool::new(false),
-        }
-    }
-
-    fn lock(&self) -> SpinLockGuard<'_> {
-        while self.locked.swap(true, Ordering::Acquire) {
-            spin_loop();
-        }
-        SpinLockGuard { lock: self }
-    }
-}
-
-struct SpinLockGuard<'a> {
-    lock: &'a SpinLock,
-}
-
-impl Drop for SpinLockGuard<'_> {
-    fn drop(&mut self) {
-        self.lock.locked.store(false, Ordering::Release);
-    }
-}
-
 struct SerialCell(UnsafeCell<SerialPort>);
 
 // SAFETY: access is serialized through `SERIAL_LOCK`, so interior mutation is synchronized.
 unsafe impl Sync for SerialCell {}
 
-struct MirrorCell(UnsafeCell<MirrorQueue>);
-
-// SAFETY: access is serialized through `SERIAL_LOCK`, so interior mutation is synchronized.
-unsafe impl Sync for MirrorCell {}
-
 static SERIAL_LOCK: SpinLock = SpinLock::new();
 static SERIAL1: SerialCell = SerialCell(UnsafeCell::new(SerialPort::new(COM1_BASE)));
-static MIRROR_QUEUE: MirrorCell = MirrorCell(UnsafeCell::new(MirrorQueue::new()));
+/// Copy of the output for the compositor's shell window. Writers push under `SERIAL_LOCK`,
+/// so there is one producer at a time; the compositor drains it without the lock.
+static MIRROR: SpscRing<u8, MIRROR_CAPACITY> = SpscRing::new();
 
 pub fn init() {
     with_serial(|serial| serial.init());
 }
 
+/// Enables the COM1 received-data interrupt (IRQ4) so input wakes the shell instead of
+/// being polled for. Returns false when no UART answers at COM1.
+pub fn enable_rx_interrupt() -> bool {
+    with_serial(|serial| serial.enable_rx_interrupt())
+}
+
 pub fn write_line(message: &str) {
     let _ = with_serial(|serial| writeln!(serial, "{message}"));
 }
@@ -75,16 +51,13 @@ pub fn try_read_byte() -> Option<u8> {
     with_serial(|serial| serial.read_byte())
 }
 
-pub fn pop_mirror_byte() -> Option<u8> {
-    let _guard = SERIAL_LOCK.lock();
-    // SAFETY: `SERIAL_LOCK` serializes mutable access to the mirror queue.
-    unsafe { (&mut *MIRROR_QUEUE.0.get()).pop() }
+/// Moves up to `out.len()` mirrored bytes into `out`; returns how many.
+pub fn pop_mirror_bytes(out: &mut [u8]) -> usize {
+    MIRROR.pop_slice(out)
 }
 
 pub fn mirror_dropped() -> u64 {
-    let _guard = SERIAL_LOCK.lock();
-    // SAFETY: `SERIAL_LOCK` serializes mutable access to the mirror queue.
-    unsafe { (&*MIRROR_QUEUE.0.get()).dropped }
+    MIRROR.dropped()
 }
 
 fn with_serial<R>(f: impl FnOnce(&mut SerialPort) -> R) -> R {
@@ -93,43 +66,6 @@ fn with_serial<R>(f: impl FnOnce(&mut SerialPort) -> R) -> R {
     unsafe { f(&mut *SERIAL1.0.get()) }
 }
 
-struct MirrorQueue {
-    bytes: [u8; MIRROR_CAPACITY],
-    head: usize,
-    tail: usize,
-    dropped: u64,
-}
-
-impl MirrorQueue {
-    const fn new() -> Self {
-        Self {
-            bytes: [0; MIRROR_CAPACITY],
-            head: 0,
-            tail: 0,
-            dropped: 0,
-        }
-    }
-
-    fn push(&mut self, byte: u8) {
-        let next_head = (self.head + 1) % MIRROR_CAPACITY;
-        if next_head == self.tail {
-            self.dropped = self.dropped.saturating_add(1);
-            return;
-        }
-        self.bytes[self.head] = byte;
-        self.head = next_head;
-    }
-
-    fn pop(&mut self) -> Option<u8> {
-        if self.tail == self.head {
-            return None;
-        }
-        let byte = self.bytes[self.tail];
-        self.tail = (self.tail + 1) % MIRROR_CAPACITY;
-        Some(byte)
-    }
-}
-
 struct SerialPort {
     base: u16,
 }
@@ -152,6 +88,18 @@ impl SerialPort {
         }
     }
 
+    fn enable_rx_interrupt(&mut self) -> bool {
+        // SAFETY: line-status and interrupt-enable are standard 16550A registers; a floating
+        // bus reads the line status as 0xFF.
+        unsafe {
+            if inb(self.base + 5) == 0xFF {
+                return false;
+            }
+            outb(self.base + 1, 0x01); // Received-data-available interrupt only
+        }
+        true
+    }
+
     fn can_transmit(&self) -> bool {
         // SAFETY: reading line-status register is required to poll transmitter readiness.
         unsafe { (inb(self.base + 5) & 0x20) != 0 }
@@ -171,9 +119,10 @@ impl SerialPort {
         unsafe {
             outb(self.base, byte);
         }
-        // SAFETY: caller executes under `SERIAL_LOCK`, so queue mutation is serialized.
-        unsafe {
-            (&mut *MIRROR_QUEUE.0.get()).push(byte);
+        if MIRROR.push(byte) && MIRROR.len() == 1 {
+            // The compositor drains the mirror until empty; wake it for the first byte of a
+            // burst. Any later byte finds an earlier one still queued, so the drain sees it.
+            sched::notify();
         }
     }
 
@@ -1,15 +1,19 @@
 // kernel/src/shell.rs: line-based in-kernel shell driven by keyboard events.
+use crate::arch::x86_64::smp;
 use crate::audio;
 use crate::doom;
 use crate::fs;
 use crate::gfx;
 use crate::keyboard;
+use crate::mem;
 use crate::mouse;
 use crate::net;
 use crate::proc;
+use crate::profile;
 use crate::serial;
 use crate::storage;
 use crate::time;
+use crate::trace;
 use alloc::string::String;
 use arrostd::abi::{USERLAND_ABI_REVISION, USERLAND_INIT_APP, shell_prompt};
 use core::cell::UnsafeCell;
@@ -23,6 +27,8 @@ const SERIAL_CAPTURE_HOLD_TICKS_MOVE: u64 = 12;
 const SERIAL_CAPTURE_HOLD_TICKS_ACTION: u64 = 14;
 const FILE_MANAGER_LIST_LINES: usize = 5;
 const FILE_MANAGER_PREVIEW_BYTES: usize = 180;
+/// Scratch-file size for a bare `fs bench`; far larger than the 64 KiB block cache.
+const FS_BENCH_DEFAULT_KIB: usize = 1024;
 const VERSION_MAJOR: &str = match option_env!("ARROST_VERSION_MAJOR") {
     Some(value) => value,
     None => "0",
@@ -38,7 +44,8 @@ const VERSION_BUILD: &str = match option_env!("ARROST_BUILD_COUNT") {
 
 struct ShellCell(UnsafeCell<ShellState>);
 
-// SAFETY: shell state is accessed only on the main loop thread.
+// SAFETY: shell state is touched only by `init`, before threads start, and then only by the
+// shell thread's `poll`, so accesses never overlap.
 unsafe impl Sync for ShellCell {}
 
 static SHELL_STATE: ShellCell = ShellCell(UnsafeCell::new(ShellState::new()));
@@ -155,13 +162,17 @@ fn serial_capture_hold_ticks(byte: u8) -> u64 {
 
 pub fn init() {
     serial::write_line(
-        "Shell: line mode ready (commands: help, version, ticks, uptime, user, ps, syscalls, ls, cat, echo >, disk, ui, fm, doom, mouse, net, ping, udp send, udp last, curl, sync, reload, watch on|off; ui subcmd: redraw|next|minimize; doom subcmd: status|play|run|stop|ui|key|keyup|capture|view|mouse|audio|reset|source|doctor)",
+        "Shell: line mode ready (commands: help, version, ticks, uptime, mem, user, ps, syscalls, ls, cat, echo >, echo >>, disk, ui, fm, doom, mouse, net, ping, udp send, udp last, curl, sync, reload, watch on|off; ui subcmd: redraw|next|minimize; doom subcmd: status|play|run|stop|ui|key|keyup|capture|view|mouse|audio|reset|source|doctor)",
     );
     refresh_file_manager_list_view();
     print_prompt();
 }
 
-pub fn poll() {
+/// Handles queued keyboard and serial input. Returns whether the shell needs polling again
+/// next tick even without input: Doom capture releases serial-driven keys after a timeout.
+/// Only the shell thread calls this. Keys go to Doom through its short input lock, and no
+/// lock is held around the shell's own state.
+pub fn poll() -> bool {
     while let Some(event) = keyboard::pop_key_event() {
         process_keyboard_event(event);
     }
@@ -176,15 +187,16 @@ pub fn poll() {
         process_byte(byte);
     }
 
-    // SAFETY: shell state is accessed on the main loop thread.
+    // SAFETY: only the shell thread touches shell state, and no other reference is live.
     let shell = unsafe { &mut *SHELL_STATE.0.get() };
     if shell.doom_capture {
         shell.release_expired_serial_capture_keys(time::ticks());
     }
+    shell.doom_capture
 }
 
 fn process_keyboard_event(event: keyboard::KeyEvent) {
-    // SAFETY: shell is single-threaded and only mutated from main loop.
+    // SAFETY: only the shell thread touches shell state, and no other reference is live.
     let shell = unsafe { &mut *SHELL_STATE.0.get() };
     if !shell.doom_capture {
         return;
@@ -220,13 +232,13 @@ fn map_doom_capture_key(code: keyboard::KeyCode) -> Option<u8> {
 }
 
 fn doom_capture_enabled() -> bool {
-    // SAFETY: shell state is read on the main loop thread.
+    // SAFETY: only the shell thread touches shell state, and no other reference is live.
     let shell = unsafe { &*SHELL_STATE.0.get() };
     shell.doom_capture
 }
 
 fn process_byte(byte: u8) {
-    // SAFETY: shell is single-threaded and only mutated from main loop.
+    // SAFETY: only the shell thread touches shell state, and no other reference is live.
     let shell = unsafe { &mut *SHELL_STATE.0.get() };
     if shell.doom_capture {
         if byte == 0x1b {
@@ -303,13 +315,18 @@ fn run_command(shell: &mut ShellState) {
         return;
     }
 
+    if let Some((text, path)) = parse_echo_append(input) {
+        fs::append_from_echo(path, text);
+        refresh_file_manager_list_view();
+        return;
+    }
     if let Some((text, path)) = parse_echo_redirect(input) {
         fs::write_from_echo(path, text);
         refresh_file_manager_list_view();
         return;
     }
     if input.starts_with("echo ") || input == "echo" {
-        serial::write_line("usage: echo <text> > <file>");
+        serial::write_line("usage: echo <text> > <file> | echo <text> >> <file>");
         return;
     }
 
@@ -334,6 +351,41 @@ fn run_command(shell: &mut ShellState) {
         }
         return;
     }
+    if let Some(rest) = input.strip_prefix("net bench udp ") {
+        let mut parts = rest.split_whitespace();
+        let ip = parts.next();
+        let port = parts.next().and_then(|value| value.parse::<u16>().ok());
+        let count = parts.next().and_then(|value| value.parse::<u32>().ok());
+        match (ip, port, count) {
+            (Some(ip), Some(port), Some(count)) if count > 0 => {
+                net::bench_udp_to_serial(ip, port, count)
+            }
+            _ => serial::write_line("usage: net bench udp <a.b.c.d> <port> <count>"),
+        }
+        return;
+    }
+    if let Some(rest) = input.strip_prefix("net bench http ") {
+        let mut parts = rest.split_whitespace();
+        let ip = parts.next();
+        let port = parts.next().and_then(|value| value.parse::<u16>().ok());
+        let path = parts.next().unwrap_or("/");
+        match (ip, port) {
+            (Some(ip), Some(port)) => net::bench_http_to_serial(ip, port, path),
+            _ => serial::write_line("usage: net bench http <a.b.c.d> <port> [path]"),
+        }
+        return;
+    }
+    if input == "fs bench" || input.starts_with("fs bench ") {
+        let max_kib = fs::max_file_bytes() / 1024;
+        match input["fs bench".len()..].trim() {
+            "" => fs::bench_to_serial(FS_BENCH_DEFAULT_KIB.min(max_kib)),
+            value => match value.parse::<usize>() {
+                Ok(kib) if (1..=max_kib).contains(&kib) => fs::bench_to_serial(kib),
+                _ => serial::write_fmt(format_args!("usage: fs bench [1..{}]\n", max_kib)),
+            },
+        }
+        return;
+    }
     if let Some(rest) = input.strip_prefix("curl ") {
         net::curl_to_serial(rest.trim());
         return;
@@ -359,7 +411,7 @@ fn run_command(shell: &mut ShellState) {
     }
     if input == "doom view" {
         serial::write_fmt(format_args!(
-            "doom: viewport filter={} (usage: doom view <bilinear|nearest>)\n",
+            "doom: viewport filter={} (usage: doom view <bilinear|nearest|integer>)\n",
             gfx::file_manager_doom_filter().as_str()
         ));
         return;
@@ -369,7 +421,9 @@ fn run_command(shell: &mut ShellState) {
         return;
     }
     if input == "doom audio" {
-        serial::write_line("usage: doom audio <on|off|virtio|pcspk|status|test>");
+        serial::write_line(
+            "usage: doom audio <on|off|virtio|pcspk|status|test|buffer <frames> <periods>>",
+        );
         return;
     }
     if input == "doom audio status" {
@@ -468,6 +522,24 @@ fn run_command(shell: &mut ShellState) {
         }
         return;
     }
+    if let Some(rest) = input.strip_prefix("doom audio buffer ") {
+        let mut args = rest.split_whitespace();
+        let period = args.next().and_then(|value| value.parse::<u16>().ok());
+        let periods = args.next().and_then(|value| value.parse::<u8>().ok());
+        match (period, periods, args.next()) {
+            (Some(period), Some(periods), None) => match audio::set_buffering(period, periods) {
+                Ok(()) => serial::write_fmt(format_args!(
+                    "doom: audio buffer set to {} frames x {} periods\n",
+                    period, periods
+                )),
+                Err(reason) => {
+                    serial::write_fmt(format_args!("doom: audio buffer failed: {}\n", reason))
+                }
+            },
+            _ => serial::write_line("usage: doom audio buffer <64..1024> <2..10>"),
+        }
+        return;
+    }
     if let Some(rest) = input.strip_prefix("doom audio ") {
         match rest.trim() {
             "off" => {
@@ -494,7 +566,9 @@ fn run_command(shell: &mut ShellState) {
                     serial::write_line("doom: audio test unavailable (mode=off)");
                 }
             }
-            _ => serial::write_line("usage: doom audio <on|off|virtio|pcspk|status|test>"),
+            _ => serial::write_line(
+                "usage: doom audio <on|off|virtio|pcspk|status|test|buffer <frames> <periods>>",
+            ),
         }
         return;
     }
@@ -505,8 +579,9 @@ fn run_command(shell: &mut ShellState) {
                 gfx::set_file_manager_doom_filter(gfx::DoomViewFilter::Bilinear)
             }
             "nearest" | "fast" => gfx::set_file_manager_doom_filter(gfx::DoomViewFilter::Nearest),
+            "integer" | "pixel" => gfx::set_file_manager_doom_filter(gfx::DoomViewFilter::Integer),
             _ => {
-                serial::write_line("usage: doom view <bilinear|nearest>");
+                serial::write_line("usage: doom view <bilinear|nearest|integer>");
                 return;
             }
         };
@@ -518,6 +593,17 @@ fn run_command(shell: &mut ShellState) {
         doom::render_ui_status();
         return;
     }
+    if let Some(rest) = input.strip_prefix("profile start ") {
+        match rest.trim().parse::<u64>() {
+            Ok(hz) => start_profile(hz),
+            Err(_) => serial::write_fmt(format_args!(
+                "usage: profile start [{}..{}]\n",
+                profile::MIN_HZ,
+                profile::MAX_HZ
+            )),
+        }
+        return;
+    }
     if handle_file_manager_command(input) {
         return;
     }
@@ -525,7 +611,7 @@ fn run_command(shell: &mut ShellState) {
     match input {
         "help" => {
             serial::write_line(
-                "help: help | version | ticks | uptime | user | ps | syscalls | ls | cat <file> | echo <text> > <file> | disk | ui | ui redraw | ui next | ui minimize | fm | fm list | fm open <file> | fm copy <src> <dst> | fm delete <file> | doom | doom status | doom source | doom doctor | doom play | doom run | doom stop | doom ui | doom key <dir> | doom keyup <dir> | doom capture [on|off] | doom view <bilinear|nearest> | doom mouse | doom mouse y <on|off> | doom mouse turn <1..64> | doom mouse move <1..64> | doom audio <on|off|virtio|pcspk|status|test> | doom reset | mouse | net | ping <ip> | udp send <ip> <port> <text> | udp last | curl <ip> <port> <text> | curl udp://<ip>:<port>/<payload> | curl http://<host|ip>[:port]/<path> | sync | reload | watch on | watch off",
+                "help: help | version | ticks | uptime | mem | mem bench | fs bench [kib] | user | ps | smp | syscalls | trace [start|stop|status|dump] | profile [start [hz]|stop|status|dump] | ls | cat <file> | echo <text> > <file> | echo <text> >> <file> | disk | ui | ui redraw | ui next | ui minimize | fm | fm list | fm open <file> | fm copy <src> <dst> | fm delete <file> | doom | doom status | doom source | doom doctor | doom play | doom run | doom stop | doom ui | doom key <dir> | doom keyup <dir> | doom capture [on|off] | doom view <bilinear|nearest|integer> | doom mouse | doom mouse y <on|off> | doom mouse turn <1..64> | doom mouse move <1..64> | doom audio <on|off|virtio|pcspk|status|test|buffer <frames> <periods>> | doom reset | mouse | net | ping <ip> | udp send <ip> <port> <text> | net bench udp <ip> <port> <count> | net bench http <ip> <port> [path] | udp last | curl <ip> <port> <text> | curl udp://<ip>:<port>/<payload> | curl http://<host|ip>[:port]/<path> | sync | reload | watch on | watch off",
             );
         }
         "version" => {
@@ -535,7 +621,18 @@ fn run_command(shell: &mut ShellState) {
             ));
         }
         "ticks" => {
-            serial::write_fmt(format_args!("ticks: {}\n", time::ticks()));
+            serial::write_fmt(format_args!(
+                "ticks: {} monotonic_ns={} tsc_hz={} timer_irqs={} event_timer={}\n",
+                time::ticks(),
+                time::monotonic_ns(),
+                time::tsc_hz(),
+                time::timer_events(),
+                if time::one_shot() {
+                    "lapic-oneshot"
+                } else {
+                    "pit-periodic"
+                }
+            ));
         }
         "uptime" => {
             let millis = time::uptime_millis();
@@ -545,6 +642,12 @@ fn run_command(shell: &mut ShellState) {
                 millis / 1000
             ));
         }
+        "mem" => {
+            mem::log_info();
+        }
+        "mem bench" => {
+            mem::log_benchmark();
+        }
         "user" => {
             serial::write_fmt(format_args!(
                 "userland: app={} abi=v{} status=cooperative runtime (ring3 pending)\n",
@@ -554,9 +657,27 @@ fn run_command(shell: &mut ShellState) {
         "ps" => {
             proc::log_process_table();
         }
+        "smp" => smp::log_info(),
         "syscalls" => {
             proc::log_syscall_stats();
         }
+        "trace" | "trace status" => trace::log_status(),
+        "trace start" => match trace::start() {
+            Ok(()) => serial::write_line("trace: recording"),
+            Err(err) => serial::write_fmt(format_args!("trace: start failed: {}\n", err.as_str())),
+        },
+        "trace stop" => {
+            trace::stop();
+            serial::write_line("trace: stopped");
+        }
+        "trace dump" => trace::dump(),
+        "profile" | "profile status" => profile::log_status(),
+        "profile start" => start_profile(profile::DEFAULT_HZ),
+        "profile stop" => {
+            profile::stop();
+            serial::write_line("profile: stopped");
+        }
+        "profile dump" => profile::dump(),
         "disk" => {
             storage::log_info();
         }
@@ -661,7 +782,7 @@ fn run_command(shell: &mut ShellState) {
 fn log_doom_audio_status() {
     let status = audio::status();
     serial::write_fmt(format_args!(
-        "doom: audio mode={} backend={} active={} hz={} pcm_evt={} pcm_samples={} pcm_sw={} pcm_min={} pcm_max={} pcm_q={} pcm_buf={} pcm_tx={} pcm_done={} pcm_drop={} pcm_frames={} pcm_drop_frames={} pcm_rate={} pcm_ch={} pcm_stream={} pcm_ctrl={:#x}\n",
+        "doom: audio mode={} backend={} active={} hz={} pcm_evt={} pcm_samples={} pcm_sw={} pcm_min={} pcm_max={} pcm_q={} pcm_buf={} pcm_tx={} pcm_done={} pcm_drop={} pcm_frames={} pcm_drop_frames={} pcm_rate={} pcm_resampler={} pcm_ch={} pcm_stream={} pcm_ctrl={:#x}\n",
         status.mode.as_str(),
         status.pcm_backend,
         status.active,
@@ -679,10 +800,31 @@ fn log_doom_audio_status() {
         status.pcm_frames_completed,
         status.pcm_frames_dropped,
         status.pcm_rate_hz,
+        status.pcm_resampler,
         status.pcm_channels,
         status.pcm_stream_id,
         status.pcm_last_ctrl_status
     ));
+    serial::write_fmt(format_args!(
+        "doom: audio period={} periods={} irq={} irqs={} latency_us={} latency_max_us={} underruns={} xruns={}\n",
+        status.pcm_period_frames,
+        status.pcm_buffer_periods,
+        status.pcm_irq_driven,
+        status.pcm_irqs,
+        status.pcm_latency_us,
+        status.pcm_latency_max_us,
+        status.pcm_underruns,
+        status.pcm_xruns
+    ));
+}
+
+fn parse_echo_append(input: &str) -> Option<(&str, &str)> {
+    let (left, right) = input.strip_prefix("echo ")?.split_once(">>")?;
+    let path = right.trim();
+    if path.is_empty() {
+        return None;
+    }
+    Some((left.trim_end(), path))
 }
 
 fn parse_echo_redirect(input: &str) -> Option<(&str, &str)> {
@@ -761,6 +903,13 @@ fn parse_file_manager_copy(input: &str) -> Option<(&str, &str)> {
     Some((source, destination))
 }
 
+fn start_profile(hz: u64) {
+    match profile::start(hz) {
+        Ok(()) => serial::write_fmt(format_args!("profile: sampling at {} Hz\n", hz)),
+        Err(err) => serial::write_fmt(format_args!("profile: start failed: {}\n", err.as_str())),
+    }
+}
+
 fn handle_file_manager_command(input: &str) -> bool {
     match input {
         "fm" | "fm list" => {
@@ -786,11 +935,16 @@ fn handle_file_manager_command(input: &str) -> bool {
                 if path.is_empty() {
                     serial::write_line("usage: fm open <file>");
                 } else {
-                    let mut buffer = [0u8; fs::MAX_FILE_BYTES];
-                    match fs::read_file(path, &mut buffer) {
-                        Ok(len) => {
+                    let mut preview = [0u8; FILE_MANAGER_PREVIEW_BYTES];
+                    let opened = fs::open_file(path).and_then(|handle| {
+                        let size = fs::file_size(handle)?;
+                        let len = fs::read_at(handle, 0, &mut preview)?;
+                        Ok((size, len))
+                    });
+                    match opened {
+                        Ok((size, len)) => {
                             fs::cat_to_serial(path);
-                            refresh_file_manager_preview_view(path, &buffer[..len]);
+                            refresh_file_manager_preview_view(path, size, &preview[..len]);
                         }
                         Err(err) => serial::write_fmt(format_args!(
                             "fm: open {} ({})\n",
@@ -849,10 +1003,11 @@ fn refresh_file_manager_list_view() {
     gfx::set_file_manager_text(&view);
 }
 
-fn refresh_file_manager_preview_view(path: &str, bytes: &[u8]) {
+/// `bytes` holds at most the first `FILE_MANAGER_PREVIEW_BYTES` of a file of `size` bytes.
+fn refresh_file_manager_preview_view(path: &str, size: usize, bytes: &[u8]) {
     let mut view = String::new();
     let _ = writeln!(view, "OPEN {}", path.trim());
-    let _ = writeln!(view, "{} bytes", bytes.len());
+    let _ = writeln!(view, "{} bytes", size);
     let _ = writeln!(view, "----------------");
 
     for &byte in bytes.iter().take(FILE_MANAGER_PREVIEW_BYTES) {
@@ -863,7 +1018,7 @@ fn refresh_file_manager_preview_view(path: &str, bytes: &[u8]) {
             _ => view.push('.'),
         }
     }
-    if bytes.len() > FILE_MANAGER_PREVIEW_BYTES {
+    if size > bytes.len() {
         let _ = writeln!(view, "\n...truncated...");
     }
     let _ = writeln!(view, "\nfm list");
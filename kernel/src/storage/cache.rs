@@ -0,0 +1,241 @@
+// kernel/src/storage/cache.rs: write-back LRU sector cache in front of the virtio-blk queue.
+use super::SECTOR_SIZE;
+use crate::time::PIT_HZ;
+
+pub const CACHE_BLOCKS: usize = 128;
+/// Requests longer than this bypass cache fill so one large read cannot evict the working set.
+pub const CACHE_FILL_MAX_SECTORS: usize = 16;
+/// Dirty blocks are written back as soon as this many accumulate.
+pub const DIRTY_HIGH_WATERMARK: usize = CACHE_BLOCKS * 3 / 4;
+/// Dirty blocks older than this are written back from `storage::poll`.
+pub const WRITEBACK_AGE_TICKS: u64 = 2 * PIT_HZ as u64;
+
+// Page alignment keeps every 512-byte block inside one physical page, so each block is one
+// DMA-contiguous segment.
+#[repr(C, align(4096))]
+struct CacheData {
+    blocks: [[u8; SECTOR_SIZE]; CACHE_BLOCKS],
+}
+
+#[derive(Clone, Copy)]
+struct CacheTag {
+    valid: bool,
+    dirty: bool,
+    sector: u64,
+    last_use: u64,
+    dirty_since: u64,
+}
+
+impl CacheTag {
+    const fn empty() -> Self {
+        Self {
+            valid: false,
+            dirty: false,
+            sector: 0,
+            last_use: 0,
+            dirty_since: 0,
+        }
+    }
+}
+
+#[derive(Clone, Copy)]
+pub struct CacheStats {
+    pub hits: u64,
+    pub misses: u64,
+    pub bypassed: u64,
+    pub evictions: u64,
+    pub writebacks: u64,
+    pub flushes: u64,
+    pub writeback_errors: u64,
+    pub resident: usize,
+    pub dirty: usize,
+    pub capacity: usize,
+}
+
+impl CacheStats {
+    const fn new() -> Self {
+        Self {
+            hits: 0,
+            misses: 0,
+            bypassed: 0,
+            evictions: 0,
+            writebacks: 0,
+            flushes: 0,
+            writeback_errors: 0,
+            resident: 0,
+            dirty: 0,
+            capacity: CACHE_BLOCKS,
+        }
+    }
+
+    pub fn hit_rate_pct(&self) -> u64 {
+        let lookups = self.hits.saturating_add(self.misses);
+        if lookups == 0 {
+            return 0;
+        }
+        self.hits.saturating_mul(100) / lookups
+    }
+}
+
+/// Fixed pool of sector-sized blocks with LRU replacement. This type only tracks contents;
+/// `StorageState` moves blocks to and from the device.
+pub struct BlockCache {
+    tags: [CacheTag; CACHE_BLOCKS],
+    data: CacheData,
+    clock: u64,
+    pub stats: CacheStats,
+}
+
+impl BlockCache {
+    pub const fn new() -> Self {
+        Self {
+            tags: [CacheTag::empty(); CACHE_BLOCKS],
+            data: CacheData {
+                blocks: [[0; SECTOR_SIZE]; CACHE_BLOCKS],
+            },
+            clock: 0,
+            stats: CacheStats::new(),
+        }
+    }
+
+    pub fn find(&self, sector: u64) -> Option<usize> {
+        self.tags
+            .iter()
+            .position(|tag| tag.valid && tag.sector == sector)
+    }
+
+    pub fn touch(&mut self, index: usize) {
+        self.clock = self.clock.wrapping_add(1);
+        self.tags[index].last_use = self.clock;
+    }
+
+    pub fn block(&self, index: usize) -> &[u8; SECTOR_SIZE] {
+        &self.data.blocks[index]
+    }
+
+    pub fn block_mut(&mut self, index: usize) -> &mut [u8; SECTOR_SIZE] {
+        &mut self.data.blocks[index]
+    }
+
+    pub fn block_addr(&self, index: usize) -> usize {
+        self.data.blocks[index].as_ptr() as usize
+    }
+
+    pub fn sector(&self, index: usize) -> u64 {
+        self.tags[index].sector
+    }
+
+    pub fn resident_sector(&self, index: usize) -> Option<u64> {
+        let tag = self.tags[index];
+        tag.valid.then_some(tag.sector)
+    }
+
+    pub fn is_dirty(&self, index: usize) -> bool {
+        self.tags[index].dirty
+    }
+
+    /// Returns the block to reuse next: an empty one if any, otherwise the least recently used.
+    pub fn victim(&self) -> usize {
+        if let Some(index) = self.tags.iter().position(|tag| !tag.valid) {
+            return index;
+        }
+        let mut victim = 0usize;
+        for (index, tag) in self.tags.iter().enumerate() {
+            if tag.last_use < self.tags[victim].last_use {
+                victim = index;
+            }
+        }
+        victim
+    }
+
+    /// Retags a clean block for `sector`; the caller fills its contents.
+    pub fn install(&mut self, index: usize, sector: u64) {
+        let tag = self.tags[index];
+        if tag.valid {
+            self.stats.evictions = self.stats.evictions.saturating_add(1);
+        } else {
+            self.stats.resident = self.stats.resident.saturating_add(1);
+        }
+        if tag.dirty {
+            self.stats.dirty = self.stats.dirty.saturating_sub(1);
+        }
+        self.tags[index] = CacheTag {
+            valid: true,
+            dirty: false,
+            sector,
+            last_use: 0,
+            dirty_since: 0,
+        };
+        self.touch(index);
+    }
+
+    pub fn invalidate(&mut self, index: usize) {
+        let tag = self.tags[index];
+        if !tag.valid {
+            return;
+        }
+        if tag.dirty {
+            self.stats.dirty = self.stats.dirty.saturating_sub(1);
+        }
+        self.stats.resident = self.stats.resident.saturating_sub(1);
+        self.tags[index] = CacheTag::empty();
+    }
+
+    /// Drops every block caching a sector in `[start, end)`.
+    pub fn invalidate_range(&mut self, start: u64, end: u64) {
+        for index in 0..CACHE_BLOCKS {
+            let tag = self.tags[index];
+            if tag.valid && tag.sector >= start && tag.sector < end {
+                self.invalidate(index);
+            }
+        }
+    }
+
+    pub fn mark_dirty(&mut self, index: usize, now_ticks: u64) {
+        let tag = &mut self.tags[index];
+        if !tag.dirty {
+            tag.dirty = true;
+            tag.dirty_since = now_ticks;
+            self.stats.dirty = self.stats.dirty.saturating_add(1);
+        }
+    }
+
+    pub fn mark_clean(&mut self, index: usize) {
+        let tag = &mut self.tags[index];
+        if tag.dirty {
+            tag.dirty = false;
+            self.stats.dirty = self.stats.dirty.saturating_sub(1);
+        }
+    }
+
+    pub fn dirty_count(&self) -> usize {
+        self.stats.dirty
+    }
+
+    /// Tick at which the oldest dirty block was first written, if any block is dirty.
+    pub fn oldest_dirty(&self) -> Option<u64> {
+        self.tags
+            .iter()
+            .filter(|tag| tag.valid && tag.dirty)
+            .map(|tag| tag.dirty_since)
+            .min()
+    }
+
+    /// Collects dirty block indices ordered by sector so adjacent sectors can be coalesced.
+    pub fn dirty_blocks(&self, out: &mut [usize; CACHE_BLOCKS]) -> usize {
+        let mut count = 0usize;
+        for (index, tag) in self.tags.iter().enumerate() {
+            if !(tag.valid && tag.dirty) {
+                continue;
+            }
+            let mut pos = count;
+            while pos > 0 && self.tags[out[pos - 1]].sector > tag.sector {
+                out[pos] = out[pos - 1];
+                pos -= 1;
+            }
+            out[pos] = index;
+            count += 1;
+        }
+        count
+    }
+}
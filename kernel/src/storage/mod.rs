@@ -1,12 +1,22 @@
 // kernel/src/storage/mod.rs: M6 virtio-blk (legacy PCI) storage backend for QEMU.
+mod cache;
+
 use crate::arch::x86_64::port;
 use crate::mem;
 use crate::serial;
+use crate::sync::SpinLock;
+use crate::time;
+use crate::trace::{self, Span};
+use cache::{
+    BlockCache, CACHE_BLOCKS, CACHE_FILL_MAX_SECTORS, DIRTY_HIGH_WATERMARK, WRITEBACK_AGE_TICKS,
+};
 use core::cell::UnsafeCell;
 use core::hint::spin_loop;
 use core::mem::size_of;
 use core::ptr::{addr_of, addr_of_mut, read_volatile, write_volatile};
-use core::sync::atomic::{AtomicBool, Ordering, fence};
+use core::sync::atomic::{Ordering, fence};
+
+pub use cache::CacheStats;
 
 pub const SECTOR_SIZE: usize = 512;
 const MAX_QUEUE_SIZE: u16 = 256;
@@ -41,6 +51,17 @@ const VIRTQ_DESC_F_WRITE: u16 = 2;
 const VIRTIO_BLK_T_IN: u32 = 0;
 const VIRTIO_BLK_T_OUT: u32 = 1;
 
+const REQUEST_SLOTS: usize = 16;
+const MAX_REQUEST_SECTORS: usize = 8;
+const REQUEST_DATA_BYTES: usize = MAX_REQUEST_SECTORS * SECTOR_SIZE;
+const MAX_DIRECT_SECTORS: usize = 32;
+const MAX_DIRECT_BYTES: usize = MAX_DIRECT_SECTORS * SECTOR_SIZE;
+const PAGE_BYTES: usize = 4096;
+// A direct transfer spans at most `MAX_DIRECT_BYTES / PAGE_BYTES + 1` pages.
+const MAX_DATA_SEGMENTS: usize = MAX_DIRECT_BYTES / PAGE_BYTES + 1;
+const DESCS_PER_REQUEST: usize = MAX_DATA_SEGMENTS + 2;
+const STATUS_PENDING: u8 = 0xFF;
+
 const fn align_up(value: usize, align: usize) -> usize {
     (value + (align - 1)) & !(align - 1)
 }
@@ -96,14 +117,28 @@ struct VirtioBlkReqHeader {
     sector: u64,
 }
 
-#[repr(C, align(16))]
-struct RequestMemory {
+// 32-byte alignment matches the struct size, so a control block never straddles a page.
+#[repr(C, align(32))]
+#[derive(Clone, Copy)]
+struct RequestControl {
     header: VirtioBlkReqHeader,
-    data: [u8; SECTOR_SIZE],
     status: u8,
     _pad: [u8; 15],
 }
 
+// Page alignment keeps each data buffer inside one physical page, so it is DMA-contiguous.
+#[repr(C, align(4096))]
+#[derive(Clone, Copy)]
+struct RequestData {
+    bytes: [u8; REQUEST_DATA_BYTES],
+}
+
+#[repr(C)]
+struct RequestMemory {
+    control: [RequestControl; REQUEST_SLOTS],
+    data: [RequestData; REQUEST_SLOTS],
+}
+
 struct QueueMemoryCell(UnsafeCell<QueueMemory>);
 struct RequestMemoryCell(UnsafeCell<RequestMemory>);
 
@@ -117,14 +152,18 @@ static QUEUE_MEMORY: QueueMemoryCell = QueueMemoryCell(UnsafeCell::new(QueueMemo
 }));
 
 static REQUEST_MEMORY: RequestMemoryCell = RequestMemoryCell(UnsafeCell::new(RequestMemory {
-    header: VirtioBlkReqHeader {
-        req_type: 0,
-        reserved: 0,
-        sector: 0,
-    },
-    data: [0; SECTOR_SIZE],
-    status: 0,
-    _pad: [0; 15],
+    control: [RequestControl {
+        header: VirtioBlkReqHeader {
+            req_type: 0,
+            reserved: 0,
+            sector: 0,
+        },
+        status: 0,
+        _pad: [0; 15],
+    }; REQUEST_SLOTS],
+    data: [RequestData {
+        bytes: [0; REQUEST_DATA_BYTES],
+    }; REQUEST_SLOTS],
 }));
 
 #[derive(Clone, Copy)]
@@ -150,6 +189,8 @@ pub enum StorageError {
     OutOfRange,
     IoTimeout,
     DeviceFailure,
+    Busy,
+    InvalidRequest,
 }
 
 impl StorageError {
@@ -163,6 +204,124 @@ impl StorageError {
             Self::OutOfRange => "out_of_range",
             Self::IoTimeout => "io_timeout",
             Self::DeviceFailure => "device_failure",
+            Self::Busy => "busy",
+            Self::InvalidRequest => "invalid_request",
+        }
+    }
+}
+
+#[derive(Clone, Copy)]
+struct DmaSegment {
+    phys: u64,
+    len: usize,
+}
+
+impl DmaSegment {
+    const fn empty() -> Self {
+        Self { phys: 0, len: 0 }
+    }
+}
+
+/// Data half of a request: either the slot's bounce buffer or caller memory for DMA.
+#[derive(Clone, Copy)]
+enum RequestPayload<'a> {
+    Bounce(Option<&'a [u8]>),
+    Direct(&'a [DmaSegment]),
+}
+
+/// Handle for an in-flight request; the generation rejects tickets for recycled slots.
+#[derive(Clone, Copy, Eq, PartialEq)]
+struct IoTicket {
+    slot: usize,
+    generation: u32,
+}
+
+#[derive(Clone, Copy)]
+pub struct StorageStats {
+    pub requests_submitted: u64,
+    pub requests_completed: u64,
+    pub requests_failed: u64,
+    pub timeouts: u64,
+    pub batches: u64,
+    pub notifies: u64,
+    pub sectors_read: u64,
+    pub sectors_written: u64,
+    pub direct_requests: u64,
+    pub bounce_requests: u64,
+    pub in_flight: usize,
+    pub peak_in_flight: usize,
+    pub slot_limit: usize,
+}
+
+impl StorageStats {
+    const fn new() -> Self {
+        Self {
+            requests_submitted: 0,
+            requests_completed: 0,
+            requests_failed: 0,
+            timeouts: 0,
+            batches: 0,
+            notifies: 0,
+            sectors_read: 0,
+            sectors_written: 0,
+            direct_requests: 0,
+            bounce_requests: 0,
+            in_flight: 0,
+            peak_in_flight: 0,
+            slot_limit: 0,
+        }
+    }
+}
+
+#[derive(Clone, Copy, Eq, PartialEq)]
+enum SlotState {
+    Free,
+    InFlight,
+    Done,
+    /// Timed out while waiting; recycled once the device finally reports it used.
+    Abandoned,
+}
+
+#[derive(Clone, Copy)]
+struct RequestSlot {
+    state: SlotState,
+    generation: u32,
+    request_type: u32,
+    sector_count: usize,
+    bounced: bool,
+    status: u8,
+}
+
+impl RequestSlot {
+    const fn new() -> Self {
+        Self {
+            state: SlotState::Free,
+            generation: 0,
+            request_type: 0,
+            sector_count: 0,
+            bounced: false,
+            status: STATUS_PENDING,
+        }
+    }
+}
+
+enum IoBuffer<'a> {
+    Read(&'a mut [u8]),
+    Write(&'a [u8]),
+}
+
+impl IoBuffer<'_> {
+    fn len(&self) -> usize {
+        match self {
+            Self::Read(out) => out.len(),
+            Self::Write(data) => data.len(),
+        }
+    }
+
+    fn request_type(&self) -> u32 {
+        match self {
+            Self::Read(_) => VIRTIO_BLK_T_IN,
+            Self::Write(_) => VIRTIO_BLK_T_OUT,
         }
     }
 }
@@ -195,6 +354,15 @@ struct StorageState {
     queue_size: u16,
     last_used_idx: u16,
     ready: bool,
+    slots: [RequestSlot; REQUEST_SLOTS],
+    slot_limit: usize,
+    control_phys: [u64; REQUEST_SLOTS],
+    bounce_phys: [u64; REQUEST_SLOTS],
+    notify_pending: bool,
+    stats: StorageStats,
+    cache: BlockCache,
+    cache_phys: [u64; CACHE_BLOCKS],
+    next_writeback_tick: u64,
 }
 
 impl StorageState {
@@ -210,6 +378,15 @@ impl StorageState {
             queue_size: 0,
             last_used_idx: 0,
             ready: false,
+            slots: [RequestSlot::new(); REQUEST_SLOTS],
+            slot_limit: 0,
+            control_phys: [0; REQUEST_SLOTS],
+            bounce_phys: [0; REQUEST_SLOTS],
+            notify_pending: false,
+            stats: StorageStats::new(),
+            cache: BlockCache::new(),
+            cache_phys: [0; CACHE_BLOCKS],
+            next_writeback_tick: 0,
         }
     }
 
@@ -279,6 +456,26 @@ impl StorageState {
             return Err(StorageError::QueueTooSmall);
         }
         self.queue_size = queue_size;
+        self.slot_limit = REQUEST_SLOTS.min(queue_size as usize / DESCS_PER_REQUEST);
+        if self.slot_limit == 0 {
+            self.virtio_write_status(VIRTIO_STATUS_FAILED);
+            return Err(StorageError::QueueTooSmall);
+        }
+        self.stats.slot_limit = self.slot_limit;
+
+        // Control blocks never straddle a page and bounce buffers are page-aligned, so one
+        // translation per slot stays valid for the lifetime of the static request memory.
+        for slot in 0..self.slot_limit {
+            self.control_phys[slot] = mem::virt_to_phys(request_control_ptr(slot) as usize)
+                .ok_or(StorageError::AddressTranslationFailed)?;
+            self.bounce_phys[slot] = mem::virt_to_phys(request_data_ptr(slot) as usize)
+                .ok_or(StorageError::AddressTranslationFailed)?;
+        }
+        // Cache blocks live in the static storage state, so their translations are stable too.
+        for block in 0..CACHE_BLOCKS {
+            self.cache_phys[block] = mem::virt_to_phys(self.cache.block_addr(block))
+                .ok_or(StorageError::AddressTranslationFailed)?;
+        }
 
         // SAFETY: serialized by `STORAGE_LOCK`; queue memory is dedicated to this driver.
         unsafe {
@@ -311,92 +508,448 @@ impl StorageState {
         Ok(())
     }
 
-    fn read_sector(
-        &mut self,
-        sector: u64,
-        out: &mut [u8; SECTOR_SIZE],
-    ) -> Result<(), StorageError> {
-        if !self.ready {
-            return Err(StorageError::NotReady);
+    /// Serves short reads through the cache, filling missing blocks from the device in one
+    /// batch. Longer reads go straight into `out` and are then overlaid with cached blocks,
+    /// which may be newer than the disk.
+    fn read_sectors(&mut self, sector: u64, out: &mut [u8]) -> Result<(), StorageError> {
+        let sector_count = out.len().div_ceil(SECTOR_SIZE);
+        self.check_range(sector, sector_count)?;
+        if sector_count > CACHE_FILL_MAX_SECTORS {
+            self.cache.stats.bypassed = self.cache.stats.bypassed.saturating_add(1);
+            self.transfer(sector, IoBuffer::Read(out))?;
+            self.overlay_cached(sector, out);
+            return Ok(());
         }
-        if sector >= self.capacity_sectors {
-            return Err(StorageError::OutOfRange);
+
+        let mut blocks = [0usize; CACHE_FILL_MAX_SECTORS];
+        let mut missing = [0usize; CACHE_FILL_MAX_SECTORS];
+        let mut missing_count = 0usize;
+        let mut result = Ok(());
+        for (index, slot) in blocks[..sector_count].iter_mut().enumerate() {
+            let target = sector + index as u64;
+            let block = match self.cache.find(target) {
+                Some(block) => {
+                    self.cache.stats.hits = self.cache.stats.hits.saturating_add(1);
+                    block
+                }
+                None => match self.claim_block() {
+                    Ok(block) => {
+                        self.cache.stats.misses = self.cache.stats.misses.saturating_add(1);
+                        self.cache.install(block, target);
+                        missing[missing_count] = block;
+                        missing_count += 1;
+                        block
+                    }
+                    Err(error) => {
+                        result = Err(error);
+                        break;
+                    }
+                },
+            };
+            self.cache.touch(block);
+            *slot = block;
+        }
+        if result.is_ok() && missing_count > 0 {
+            result = self.cache_io(VIRTIO_BLK_T_IN, &missing[..missing_count]);
+        }
+        if let Err(error) = result {
+            for &block in &missing[..missing_count] {
+                self.cache.invalidate(block);
+            }
+            return Err(error);
+        }
+
+        for (chunk, &block) in out.chunks_mut(SECTOR_SIZE).zip(&blocks[..sector_count]) {
+            chunk.copy_from_slice(&self.cache.block(block)[..chunk.len()]);
+        }
+        Ok(())
+    }
+
+    /// Short writes only dirty cache blocks; they reach the disk on flush, age-out or when the
+    /// dirty watermark is hit. Longer writes go straight to the device and drop cached copies.
+    fn write_sectors(&mut self, sector: u64, data: &[u8]) -> Result<(), StorageError> {
+        let sector_count = data.len().div_ceil(SECTOR_SIZE);
+        self.check_range(sector, sector_count)?;
+        if sector_count > CACHE_FILL_MAX_SECTORS {
+            self.cache.stats.bypassed = self.cache.stats.bypassed.saturating_add(1);
+            self.cache
+                .invalidate_range(sector, sector + sector_count as u64);
+            return self.transfer(sector, IoBuffer::Write(data));
+        }
+
+        let now_ticks = time::ticks();
+        for (index, chunk) in data.chunks(SECTOR_SIZE).enumerate() {
+            let target = sector + index as u64;
+            let block = match self.cache.find(target) {
+                Some(block) => block,
+                None => {
+                    let block = self.claim_block()?;
+                    self.cache.install(block, target);
+                    block
+                }
+            };
+            let bytes = self.cache.block_mut(block);
+            bytes[..chunk.len()].copy_from_slice(chunk);
+            bytes[chunk.len()..].fill(0);
+            self.cache.touch(block);
+            self.cache.mark_dirty(block, now_ticks);
+        }
+
+        if self.cache.dirty_count() >= DIRTY_HIGH_WATERMARK {
+            self.flush_cache()?;
+        }
+        Ok(())
+    }
+
+    /// Picks a block to reuse; an LRU victim that is still dirty triggers a full write-back.
+    fn claim_block(&mut self) -> Result<usize, StorageError> {
+        let victim = self.cache.victim();
+        if self.cache.is_dirty(victim) {
+            self.flush_cache()?;
+        }
+        Ok(victim)
+    }
+
+    fn overlay_cached(&self, sector: u64, out: &mut [u8]) {
+        let end = sector + out.len().div_ceil(SECTOR_SIZE) as u64;
+        for block in 0..CACHE_BLOCKS {
+            let Some(cached) = self.cache.resident_sector(block) else {
+                continue;
+            };
+            if cached < sector || cached >= end {
+                continue;
+            }
+            let start = (cached - sector) as usize * SECTOR_SIZE;
+            let len = (out.len() - start).min(SECTOR_SIZE);
+            out[start..start + len].copy_from_slice(&self.cache.block(block)[..len]);
+        }
+    }
+
+    /// Writes every dirty block back in sector order. Returns the number of sectors written.
+    fn flush_cache(&mut self) -> Result<usize, StorageError> {
+        let mut dirty = [0usize; CACHE_BLOCKS];
+        let count = self.cache.dirty_blocks(&mut dirty);
+        if count == 0 {
+            return Ok(0);
+        }
+        self.cache.stats.flushes = self.cache.stats.flushes.saturating_add(1);
+        if let Err(error) = self.cache_io(VIRTIO_BLK_T_OUT, &dirty[..count]) {
+            self.cache.stats.writeback_errors = self.cache.stats.writeback_errors.saturating_add(1);
+            return Err(error);
+        }
+        Ok(count)
+    }
+
+    /// Writes back dirty blocks once the oldest has aged past `WRITEBACK_AGE_TICKS`.
+    fn poll(&mut self, now_ticks: u64) {
+        if !self.ready || self.cache.dirty_count() == 0 || now_ticks < self.next_writeback_tick {
+            return;
+        }
+        let Some(oldest) = self.cache.oldest_dirty() else {
+            return;
+        };
+        if now_ticks.saturating_sub(oldest) < WRITEBACK_AGE_TICKS {
+            return;
+        }
+        if self.flush_cache().is_err() {
+            // Back off instead of hammering a failing device from every loop iteration.
+            self.next_writeback_tick = now_ticks.saturating_add(WRITEBACK_AGE_TICKS);
         }
-        self.submit_io(VIRTIO_BLK_T_IN, sector, Some(out))
     }
 
-    fn write_sector(&mut self, sector: u64, data: &[u8; SECTOR_SIZE]) -> Result<(), StorageError> {
+    /// DMAs cache blocks to or from the device. Blocks holding consecutive sectors share one
+    /// request and up to `slot_limit` requests are posted per notification. Written blocks are
+    /// marked clean as their request completes.
+    fn cache_io(&mut self, request_type: u32, blocks: &[usize]) -> Result<(), StorageError> {
+        let _span = trace::span(Span::StorageCacheIo);
+        let mut next = 0usize;
+        while next < blocks.len() {
+            let mut batch = [(
+                IoTicket {
+                    slot: 0,
+                    generation: 0,
+                },
+                0usize,
+                0usize,
+            ); REQUEST_SLOTS];
+            let mut batch_len = 0usize;
+            let mut result = Ok(());
+            while batch_len < self.slot_limit && next < blocks.len() {
+                let first_sector = self.cache.sector(blocks[next]);
+                let mut segments = [DmaSegment::empty(); MAX_DATA_SEGMENTS];
+                let mut segment_count = 0usize;
+                let mut run = 0usize;
+                while next + run < blocks.len() && run < MAX_DIRECT_SECTORS {
+                    let block = blocks[next + run];
+                    if self.cache.sector(block) != first_sector + run as u64 {
+                        break;
+                    }
+                    let phys = self.cache_phys[block];
+                    if segment_count > 0
+                        && segments[segment_count - 1].phys + segments[segment_count - 1].len as u64
+                            == phys
+                    {
+                        segments[segment_count - 1].len += SECTOR_SIZE;
+                    } else if segment_count < MAX_DATA_SEGMENTS {
+                        segments[segment_count] = DmaSegment {
+                            phys,
+                            len: SECTOR_SIZE,
+                        };
+                        segment_count += 1;
+                    } else {
+                        break;
+                    }
+                    run += 1;
+                }
+
+                match self.enqueue(
+                    request_type,
+                    first_sector,
+                    run,
+                    RequestPayload::Direct(&segments[..segment_count]),
+                ) {
+                    Ok(ticket) => {
+                        batch[batch_len] = (ticket, next, run);
+                        batch_len += 1;
+                        next += run;
+                    }
+                    Err(error) => {
+                        result = Err(error);
+                        break;
+                    }
+                }
+            }
+
+            self.notify();
+            self.stats.batches = self.stats.batches.saturating_add(1);
+            for &(ticket, first, run) in &batch[..batch_len] {
+                let completed = self.wait(ticket).and_then(|()| self.finish(ticket, None));
+                if completed.is_ok() && request_type == VIRTIO_BLK_T_OUT {
+                    for &block in &blocks[first..first + run] {
+                        self.cache.mark_clean(block);
+                    }
+                    self.cache.stats.writebacks =
+                        self.cache.stats.writebacks.saturating_add(run as u64);
+                }
+                if result.is_ok() {
+                    result = completed;
+                }
+            }
+            result?;
+        }
+        Ok(())
+    }
+
+    /// Splits `buffer` into requests and keeps up to `slot_limit` of them in flight, notifying
+    /// the device once per batch. Whole sectors are DMA'd straight into/out of `buffer`; the
+    /// slot bounce buffers are only used for a partial tail sector or untranslatable memory.
+    fn transfer(&mut self, sector: u64, mut buffer: IoBuffer<'_>) -> Result<(), StorageError> {
+        let _span = trace::span(Span::StorageTransfer);
+        let total = buffer.len();
+        self.check_range(sector, total.div_ceil(SECTOR_SIZE))?;
+        let request_type = buffer.request_type();
+        let base_addr = match &buffer {
+            IoBuffer::Read(out) => out.as_ptr() as usize,
+            IoBuffer::Write(data) => data.as_ptr() as usize,
+        };
+
+        let mut offset = 0usize;
+        while offset < total {
+            let mut batch = [(
+                IoTicket {
+                    slot: 0,
+                    generation: 0,
+                },
+                0usize,
+                0usize,
+            ); REQUEST_SLOTS];
+            let mut batch_len = 0usize;
+            let mut result = Ok(());
+            while batch_len < self.slot_limit && offset < total {
+                let remaining = total - offset;
+                let request_sector = sector + (offset / SECTOR_SIZE) as u64;
+                let mut segments = [DmaSegment::empty(); MAX_DATA_SEGMENTS];
+                let direct_len = (remaining - remaining % SECTOR_SIZE).min(MAX_DIRECT_BYTES);
+                let direct_segments = if direct_len > 0 {
+                    dma_segments(base_addr + offset, direct_len, &mut segments)
+                } else {
+                    None
+                };
+
+                let (len, payload) = match direct_segments {
+                    Some(count) => (direct_len, RequestPayload::Direct(&segments[..count])),
+                    None => {
+                        let len = remaining.min(REQUEST_DATA_BYTES);
+                        let data = match &buffer {
+                            IoBuffer::Write(data) => Some(&data[offset..offset + len]),
+                            IoBuffer::Read(_) => None,
+                        };
+                        (len, RequestPayload::Bounce(data))
+                    }
+                };
+                match self.enqueue(
+                    request_type,
+                    request_sector,
+                    len.div_ceil(SECTOR_SIZE),
+                    payload,
+                ) {
+                    Ok(ticket) => {
+                        batch[batch_len] = (ticket, offset, len);
+                        batch_len += 1;
+                        offset += len;
+                    }
+                    Err(error) => {
+                        result = Err(error);
+                        break;
+                    }
+                }
+            }
+
+            self.notify();
+            self.stats.batches = self.stats.batches.saturating_add(1);
+            for &(ticket, start, len) in &batch[..batch_len] {
+                let out = match &mut buffer {
+                    IoBuffer::Read(out) => Some(&mut out[start..start + len]),
+                    IoBuffer::Write(_) => None,
+                };
+                let completed = self.wait(ticket).and_then(|()| self.finish(ticket, out));
+                if result.is_ok() {
+                    result = completed;
+                }
+            }
+            result?;
+        }
+        Ok(())
+    }
+
+    fn check_range(&self, sector: u64, sector_count: usize) -> Result<(), StorageError> {
         if !self.ready {
             return Err(StorageError::NotReady);
         }
-        if sector >= self.capacity_sectors {
+        if sector_count == 0 {
+            return Err(StorageError::InvalidRequest);
+        }
+        let end = sector
+            .checked_add(sector_count as u64)
+            .ok_or(StorageError::OutOfRange)?;
+        if end > self.capacity_sectors {
             return Err(StorageError::OutOfRange);
         }
-        let mut scratch = [0u8; SECTOR_SIZE];
-        scratch.copy_from_slice(data);
-        self.submit_io(VIRTIO_BLK_T_OUT, sector, Some(&mut scratch))
+        Ok(())
     }
 
-    fn submit_io(
+    /// Places one request on the available ring without notifying the device.
+    ///
+    /// For `RequestPayload::Direct`, the caller keeps the segment memory alive and untouched
+    /// until the request is finished or abandoned.
+    fn enqueue(
         &mut self,
         request_type: u32,
         sector: u64,
-        data: Option<&mut [u8; SECTOR_SIZE]>,
-    ) -> Result<(), StorageError> {
-        let Some(data_buf) = data else {
-            return Err(StorageError::DeviceFailure);
+        sector_count: usize,
+        payload: RequestPayload<'_>,
+    ) -> Result<IoTicket, StorageError> {
+        self.check_range(sector, sector_count)?;
+        let data_len = sector_count * SECTOR_SIZE;
+        match payload {
+            RequestPayload::Bounce(data) => {
+                if sector_count > MAX_REQUEST_SECTORS || data.is_some_and(|d| d.len() > data_len) {
+                    return Err(StorageError::InvalidRequest);
+                }
+            }
+            RequestPayload::Direct(segments) => {
+                let segment_bytes: usize = segments.iter().map(|segment| segment.len).sum();
+                if segments.is_empty()
+                    || segments.len() > MAX_DATA_SEGMENTS
+                    || segment_bytes != data_len
+                {
+                    return Err(StorageError::InvalidRequest);
+                }
+            }
+        }
+
+        let slot = match self.find_free_slot() {
+            Some(slot) => slot,
+            None => {
+                self.reap();
+                self.find_free_slot().ok_or(StorageError::Busy)?
+            }
         };
 
-        // SAFETY: serialized by `STORAGE_LOCK`; request memory is single-owner here.
+        // SAFETY: serialized by `STORAGE_LOCK`; a free slot's request memory is not visible to
+        // the device until its head descriptor is published on the available ring.
         unsafe {
-            let req = &mut *REQUEST_MEMORY.0.get();
-            req.header.req_type = request_type;
-            req.header.reserved = 0;
-            req.header.sector = sector;
-            req.status = 0xFF;
-            if request_type == VIRTIO_BLK_T_OUT {
-                req.data.copy_from_slice(data_buf);
+            let control = request_control_ptr(slot);
+            (*control).header = VirtioBlkReqHeader {
+                req_type: request_type,
+                reserved: 0,
+                sector,
+            };
+            write_volatile(addr_of_mut!((*control).status), STATUS_PENDING);
+            if let RequestPayload::Bounce(Some(bytes)) = payload {
+                let slot_bytes = &mut (*request_data_ptr(slot)).bytes;
+                let buffer = &mut slot_bytes[..data_len];
+                buffer[..bytes.len()].copy_from_slice(bytes);
+                buffer[bytes.len()..].fill(0);
             }
         }
 
-        let header_phys = mem::virt_to_phys(request_header_ptr() as usize)
-            .ok_or(StorageError::AddressTranslationFailed)?;
-        let data_phys = mem::virt_to_phys(request_data_ptr() as usize)
-            .ok_or(StorageError::AddressTranslationFailed)?;
-        let status_phys = mem::virt_to_phys(request_status_ptr() as usize)
-            .ok_or(StorageError::AddressTranslationFailed)?;
+        let mut segments = [DmaSegment::empty(); MAX_DATA_SEGMENTS];
+        let (segment_count, bounced) = match payload {
+            RequestPayload::Bounce(_) => {
+                segments[0] = DmaSegment {
+                    phys: self.bounce_phys[slot],
+                    len: data_len,
+                };
+                (1, true)
+            }
+            RequestPayload::Direct(direct) => {
+                segments[..direct.len()].copy_from_slice(direct);
+                (direct.len(), false)
+            }
+        };
+        let header_phys =
+            self.control_phys[slot] + core::mem::offset_of!(RequestControl, header) as u64;
+        let status_phys =
+            self.control_phys[slot] + core::mem::offset_of!(RequestControl, status) as u64;
+
+        let head = (slot * DESCS_PER_REQUEST) as u16;
+        let data_flags = if request_type == VIRTIO_BLK_T_IN {
+            VIRTQ_DESC_F_NEXT | VIRTQ_DESC_F_WRITE
+        } else {
+            VIRTQ_DESC_F_NEXT
+        };
 
-        // SAFETY: serialized by `STORAGE_LOCK`; queue memory is exclusively owned by this driver.
+        // SAFETY: serialized by `STORAGE_LOCK`; descriptors `head..head + DESCS_PER_REQUEST`
+        // belong to `slot`.
         unsafe {
             let desc = queue_desc_ptr();
             let avail = queue_avail_ptr();
-            let used = queue_used_ptr();
 
             write_volatile(
-                desc.add(0),
+                desc.add(head as usize),
                 VirtqDesc {
                     addr: header_phys,
                     len: size_of::<VirtioBlkReqHeader>() as u32,
                     flags: VIRTQ_DESC_F_NEXT,
-                    next: 1,
-                },
-            );
-            let data_flags = if request_type == VIRTIO_BLK_T_IN {
-                VIRTQ_DESC_F_NEXT | VIRTQ_DESC_F_WRITE
-            } else {
-                VIRTQ_DESC_F_NEXT
-            };
-            write_volatile(
-                desc.add(1),
-                VirtqDesc {
-                    addr: data_phys,
-                    len: SECTOR_SIZE as u32,
-                    flags: data_flags,
-                    next: 2,
+                    next: head + 1,
                 },
             );
+            for (index, segment) in segments[..segment_count].iter().enumerate() {
+                let desc_index = head + 1 + index as u16;
+                write_volatile(
+                    desc.add(desc_index as usize),
+                    VirtqDesc {
+                        addr: segment.phys,
+                        len: segment.len as u32,
+                        flags: data_flags,
+                        next: desc_index + 1,
+                    },
+                );
+            }
+            let status_index = head + 1 + segment_count as u16;
             write_volatile(
-                desc.add(2),
+                desc.add(status_index as usize),
                 VirtqDesc {
                     addr: status_phys,
                     len: 1,
@@ -406,47 +959,170 @@ impl StorageState {
             );
 
             let avail_idx = read_volatile(addr_of!((*avail).idx));
-            let slot = (avail_idx % self.queue_size) as usize;
-            write_volatile(addr_of_mut!((*avail).ring[slot]), 0);
+            let ring_slot = (avail_idx % self.queue_size) as usize;
+            write_volatile(addr_of_mut!((*avail).ring[ring_slot]), head);
             fence(Ordering::SeqCst);
             write_volatile(addr_of_mut!((*avail).idx), avail_idx.wrapping_add(1));
             fence(Ordering::SeqCst);
+        }
+
+        if bounced {
+            self.stats.bounce_requests = self.stats.bounce_requests.saturating_add(1);
+        } else {
+            self.stats.direct_requests = self.stats.direct_requests.saturating_add(1);
+        }
+
+        let entry = &mut self.slots[slot];
+        entry.state = SlotState::InFlight;
+        entry.generation = entry.generation.wrapping_add(1);
+        entry.request_type = request_type;
+        entry.sector_count = sector_count;
+        entry.bounced = bounced;
+        entry.status = STATUS_PENDING;
+        self.notify_pending = true;
+
+        self.stats.requests_submitted = self.stats.requests_submitted.saturating_add(1);
+        self.stats.in_flight = self.stats.in_flight.saturating_add(1);
+        self.stats.peak_in_flight = self.stats.peak_in_flight.max(self.stats.in_flight);
+
+        Ok(IoTicket {
+            slot,
+            generation: entry.generation,
+        })
+    }
 
-            self.virtio_write_u16(VIRTIO_PCI_QUEUE_NOTIFY, 0);
+    fn find_free_slot(&self) -> Option<usize> {
+        self.slots[..self.slot_limit]
+            .iter()
+            .position(|slot| slot.state == SlotState::Free)
+    }
+
+    fn notify(&mut self) {
+        if !self.notify_pending {
+            return;
+        }
+        self.notify_pending = false;
+        self.stats.notifies = self.stats.notifies.saturating_add(1);
+        self.virtio_write_u16(VIRTIO_PCI_QUEUE_NOTIFY, 0);
+    }
+
+    /// Drains the used ring, marking finished requests as done. Returns completions observed.
+    fn reap(&mut self) -> usize {
+        if !self.ready {
+            return 0;
+        }
 
-            let expected_used = self.last_used_idx.wrapping_add(1);
-            let mut spins = 0usize;
+        let mut completed = 0usize;
+        // SAFETY: serialized by `STORAGE_LOCK`; used ring entries below `used.idx` are final.
+        unsafe {
+            let used = queue_used_ptr();
             loop {
                 let observed = read_volatile(addr_of!((*used).idx));
-                if observed == expected_used {
+                if observed == self.last_used_idx {
                     break;
                 }
-                if spins >= MAX_POLL_SPINS {
-                    let _ = self.virtio_read_u8(VIRTIO_PCI_ISR);
-                    return Err(StorageError::IoTimeout);
+                fence(Ordering::SeqCst);
+                let used_slot = (self.last_used_idx % self.queue_size) as usize;
+                let head_id = read_volatile(addr_of!((*used).ring[used_slot].id)) as usize;
+                self.last_used_idx = self.last_used_idx.wrapping_add(1);
+
+                let slot = head_id / DESCS_PER_REQUEST;
+                if slot >= self.slot_limit {
+                    continue;
+                }
+                let status = read_volatile(request_status_ptr(slot));
+                let entry = &mut self.slots[slot];
+                match entry.state {
+                    SlotState::InFlight => {
+                        entry.state = SlotState::Done;
+                        entry.status = status;
+                    }
+                    SlotState::Abandoned => {
+                        entry.state = SlotState::Free;
+                    }
+                    SlotState::Free | SlotState::Done => continue,
                 }
-                spins = spins.saturating_add(1);
-                spin_loop();
+                self.stats.in_flight = self.stats.in_flight.saturating_sub(1);
+                completed += 1;
             }
-            self.last_used_idx = expected_used;
-            let used_slot = (expected_used.wrapping_sub(1) % self.queue_size) as usize;
-            let _head_id = read_volatile(addr_of!((*used).ring[used_slot].id));
         }
+        completed
+    }
 
-        // SAFETY: serialized by `STORAGE_LOCK`; request memory belongs to this driver.
-        let status = unsafe { (*REQUEST_MEMORY.0.get()).status };
-        if status != 0 {
-            return Err(StorageError::DeviceFailure);
+    fn slot_for(&self, ticket: IoTicket) -> Result<usize, StorageError> {
+        let slot = self
+            .slots
+            .get(ticket.slot)
+            .ok_or(StorageError::InvalidRequest)?;
+        if slot.generation != ticket.generation
+            || matches!(slot.state, SlotState::Free | SlotState::Abandoned)
+        {
+            return Err(StorageError::InvalidRequest);
         }
+        Ok(ticket.slot)
+    }
 
-        if request_type == VIRTIO_BLK_T_IN {
-            // SAFETY: serialized by `STORAGE_LOCK`; request data just filled by device.
-            unsafe {
-                let req = &*REQUEST_MEMORY.0.get();
-                data_buf.copy_from_slice(&req.data);
+    fn wait(&mut self, ticket: IoTicket) -> Result<(), StorageError> {
+        let slot = self.slot_for(ticket)?;
+        self.notify();
+        let mut spins = 0usize;
+        while self.slots[slot].state == SlotState::InFlight {
+            if self.reap() > 0 {
+                continue;
+            }
+            if spins >= MAX_POLL_SPINS {
+                let _ = self.virtio_read_u8(VIRTIO_PCI_ISR);
+                self.slots[slot].state = SlotState::Abandoned;
+                self.stats.timeouts = self.stats.timeouts.saturating_add(1);
+                if !self.slots[slot].bounced {
+                    // The device may still DMA into caller memory that is about to go out of
+                    // scope; a reset is the only way to revoke a posted direct transfer.
+                    self.virtio_write_status(0);
+                    self.ready = false;
+                }
+                return Err(StorageError::IoTimeout);
             }
+            spins = spins.saturating_add(1);
+            spin_loop();
+        }
+        Ok(())
+    }
+
+    /// Releases a completed slot, copying read data into `out` when provided.
+    fn finish(&mut self, ticket: IoTicket, out: Option<&mut [u8]>) -> Result<(), StorageError> {
+        let slot = self.slot_for(ticket)?;
+        let entry = self.slots[slot];
+        if entry.state != SlotState::Done {
+            return Err(StorageError::Busy);
         }
+        self.slots[slot].state = SlotState::Free;
 
+        if entry.status != 0 {
+            self.stats.requests_failed = self.stats.requests_failed.saturating_add(1);
+            return Err(StorageError::DeviceFailure);
+        }
+        self.stats.requests_completed = self.stats.requests_completed.saturating_add(1);
+        if entry.request_type == VIRTIO_BLK_T_IN {
+            self.stats.sectors_read = self
+                .stats
+                .sectors_read
+                .saturating_add(entry.sector_count as u64);
+            if entry.bounced
+                && let Some(out) = out
+            {
+                let len = out.len().min(entry.sector_count * SECTOR_SIZE);
+                // SAFETY: serialized by `STORAGE_LOCK`; the device finished writing this slot.
+                unsafe {
+                    let slot_bytes = &(*request_data_ptr(slot)).bytes;
+                    out[..len].copy_from_slice(&slot_bytes[..len]);
+                }
+            }
+        } else {
+            self.stats.sectors_written = self
+                .stats
+                .sectors_written
+                .saturating_add(entry.sector_count as u64);
+        }
         Ok(())
     }
 
@@ -498,11 +1174,40 @@ pub fn capacity_sectors() -> u64 {
 }
 
 pub fn read_sector(sector: u64, out: &mut [u8; SECTOR_SIZE]) -> Result<(), StorageError> {
-    with_storage_mut(|state| state.read_sector(sector, out))
+    read_sectors(sector, out)
 }
 
 pub fn write_sector(sector: u64, data: &[u8; SECTOR_SIZE]) -> Result<(), StorageError> {
-    with_storage_mut(|state| state.write_sector(sector, data))
+    write_sectors(sector, data)
+}
+
+/// Reads `out.len().div_ceil(SECTOR_SIZE)` sectors starting at `sector`; a partial final
+/// sector is truncated to fit `out`.
+pub fn read_sectors(sector: u64, out: &mut [u8]) -> Result<(), StorageError> {
+    with_storage_mut(|state| state.read_sectors(sector, out))
+}
+
+/// Writes `data` starting at `sector`; a partial final sector is zero-padded.
+pub fn write_sectors(sector: u64, data: &[u8]) -> Result<(), StorageError> {
+    with_storage_mut(|state| state.write_sectors(sector, data))
+}
+
+/// Writes every dirty cached sector back to the device. Returns the number of sectors written.
+pub fn flush() -> Result<usize, StorageError> {
+    with_storage_mut(|state| state.flush_cache())
+}
+
+/// Periodic write-back hook for the main loop.
+pub fn poll(now_ticks: u64) {
+    with_storage_mut(|state| state.poll(now_ticks));
+}
+
+pub fn stats() -> StorageStats {
+    with_storage(|state| state.stats)
+}
+
+pub fn cache_stats() -> CacheStats {
+    with_storage(|state| state.cache.stats)
 }
 
 pub fn log_info() {
@@ -519,6 +1224,38 @@ pub fn log_info() {
             report.capacity_sectors,
             report.capacity_bytes
         ));
+        let stats = stats();
+        serial::write_fmt(format_args!(
+            "disk: io slots={} in_flight={} peak={} submitted={} completed={} failed={} timeouts={} batches={} notifies={} direct={} bounce={} read_sectors={} write_sectors={}\n",
+            stats.slot_limit,
+            stats.in_flight,
+            stats.peak_in_flight,
+            stats.requests_submitted,
+            stats.requests_completed,
+            stats.requests_failed,
+            stats.timeouts,
+            stats.batches,
+            stats.notifies,
+            stats.direct_requests,
+            stats.bounce_requests,
+            stats.sectors_read,
+            stats.sectors_written
+        ));
+        let cache = cache_stats();
+        serial::write_fmt(format_args!(
+            "disk: cache blocks={} resident={} dirty={} hits={} misses={} hit_rate={}% bypass={} evictions={} writebacks={} flushes={} writeback_errors={}\n",
+            cache.capacity,
+            cache.resident,
+            cache.dirty,
+            cache.hits,
+            cache.misses,
+            cache.hit_rate_pct(),
+            cache.bypassed,
+            cache.evictions,
+            cache.writebacks,
+            cache.flushes,
+            cache.writeback_errors
+        ));
     } else {
         serial::write_line("disk: backend=none status=unavailable");
     }
@@ -555,19 +1292,48 @@ unsafe fn queue_used_ptr() -> *mut VirtqUsed {
     unsafe { queue_memory_base().add(USED_OFFSET) as *mut VirtqUsed }
 }
 
-fn request_header_ptr() -> *mut VirtioBlkReqHeader {
-    // SAFETY: caller ensures serialized access to request memory.
-    unsafe { addr_of_mut!((*REQUEST_MEMORY.0.get()).header) }
+fn request_control_ptr(slot: usize) -> *mut RequestControl {
+    // SAFETY: only computes an address; indexing is bounds-checked against `REQUEST_SLOTS`.
+    unsafe { addr_of_mut!((*REQUEST_MEMORY.0.get()).control[slot]) }
 }
 
-fn request_data_ptr() -> *mut u8 {
-    // SAFETY: caller ensures serialized access to request memory.
-    unsafe { (*REQUEST_MEMORY.0.get()).data.as_mut_ptr() }
+fn request_data_ptr(slot: usize) -> *mut RequestData {
+    // SAFETY: only computes an address; indexing is bounds-checked against `REQUEST_SLOTS`.
+    unsafe { addr_of_mut!((*REQUEST_MEMORY.0.get()).data[slot]) }
 }
 
-fn request_status_ptr() -> *mut u8 {
-    // SAFETY: caller ensures serialized access to request memory.
-    unsafe { addr_of_mut!((*REQUEST_MEMORY.0.get()).status) }
+fn request_status_ptr(slot: usize) -> *mut u8 {
+    // SAFETY: only computes an address inside the slot's control block.
+    unsafe { addr_of_mut!((*request_control_ptr(slot)).status) }
+}
+
+/// Splits `[addr, addr + len)` into physically contiguous runs. Returns `None` when a page is
+/// unmapped or the range needs more than `MAX_DATA_SEGMENTS` descriptors.
+fn dma_segments(
+    addr: usize,
+    len: usize,
+    out: &mut [DmaSegment; MAX_DATA_SEGMENTS],
+) -> Option<usize> {
+    let end = addr.checked_add(len)?;
+    let mut cursor = addr;
+    let mut count = 0usize;
+    while cursor < end {
+        let page_end = (cursor & !(PAGE_BYTES - 1)).saturating_add(PAGE_BYTES);
+        let run_end = page_end.min(end);
+        let phys = mem::virt_to_phys(cursor)?;
+        let run_len = run_end - cursor;
+        if count > 0 && out[count - 1].phys + out[count - 1].len as u64 == phys {
+            out[count - 1].len += run_len;
+        } else {
+            if count == MAX_DATA_SEGMENTS {
+                return None;
+            }
+            out[count] = DmaSegment { phys, len: run_len };
+            count += 1;
+        }
+        cursor = run_end;
+    }
+    Some(count)
 }
 
 fn find_virtio_blk_pci() -> Option<PciLocation> {
@@ -652,32 +1418,3 @@ fn pci_write_u16(bus: u8, device: u8, function: u8, offset: u8, value: u16) {
     dword |= (value as u32) << shift;
     pci_write_u32(bus, device, function, aligned_offset, dword);
 }
-
-struct SpinLock {
-    locked: AtomicBool,
-}
-
-impl SpinLock {
-    const fn new() -> Self {
-        Self {
-            locked: AtomicBool::new(false),
-        }
-    }
-
-    fn lock(&self) -> SpinLockGuard<'_> {
-        while self.locked.swap(true, Ordering::Acquire) {
-            spin_loop();
-        }
-        SpinLockGuard { lock: self }
-    }
-}
-
-struct SpinLockGuard<'a> {
-    lock: &'a SpinLock,
-}
-
-impl Drop for SpinLockGuard<'_> {
-    fn drop(&mut self) {
-        self.lock.locked.store(false, Ordering::Release);
-    }
-}
@@ -0,0 +1,54 @@
+// kernel/src/sync.rs: spinlock and lock-free ring shared by kernel subsystems.
+pub mod spsc;
+
+use crate::proc::sched;
+use core::sync::atomic::{AtomicBool, AtomicU32, Ordering};
+
+/// Mutual exclusion between kernel threads and CPUs. A ticket lock, so CPUs get it in
+/// arrival order and none starves. A contended `lock` on the BSP blocks in the scheduler
+/// until the holder releases it, so a preempted lower-priority holder gets to run; on an
+/// application processor it spins.
+pub struct SpinLock {
+    next_ticket: AtomicU32,
+    now_serving: AtomicU32,
+    /// Set by a waiter before it blocks; the releasing holder then bumps the event epoch.
+    contended: AtomicBool,
+}
+
+impl SpinLock {
+    pub const fn new() -> Self {
+        Self {
+            next_ticket: AtomicU32::new(0),
+            now_serving: AtomicU32::new(0),
+            contended: AtomicBool::new(false),
+        }
+    }
+
+    pub fn lock(&self) -> SpinLockGuard<'_> {
+        let ticket = self.next_ticket.fetch_add(1, Ordering::Relaxed);
+        while self.now_serving.load(Ordering::Acquire) != ticket {
+            // Snapshot the epoch before announcing contention: a release after the check
+            // below notifies and moves the epoch past the snapshot, so the wait cannot miss it.
+            let epoch = sched::event_epoch();
+            self.contended.store(true, Ordering::SeqCst);
+            if self.now_serving.load(Ordering::SeqCst) == ticket {
+                break;
+            }
+            sched::wait_epoch_change(epoch);
+        }
+        SpinLockGuard { lock: self }
+    }
+}
+
+pub struct SpinLockGuard<'a> {
+    lock: &'a SpinLock,
+}
+
+impl Drop for SpinLockGuard<'_> {
+    fn drop(&mut self) {
+        self.lock.now_serving.fetch_add(1, Ordering::SeqCst);
+        if self.lock.contended.swap(false, Ordering::SeqCst) {
+            sched::notify();
+        }
+    }
+}
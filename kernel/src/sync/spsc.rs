@@ -0,0 +1,180 @@
+// kernel/src/sync/spsc.rs: lock-free single-producer/single-consumer ring shared by the input,
+// console and audio paths.
+use core::cell::UnsafeCell;
+use core::mem::MaybeUninit;
+use core::ptr::copy_nonoverlapping;
+use core::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+
+/// Keeps the producer and consumer indices on separate cache lines, so the two sides do not
+/// bounce one line between CPUs.
+#[repr(align(64))]
+struct CachePadded<T>(T);
+
+/// Bounded FIFO with one producer and one consumer. Either side may be an interrupt handler
+/// or another CPU; neither ever blocks or takes a lock. A push that finds the ring full drops
+/// the values and counts them in `dropped`.
+///
+/// Positions run over `0..2 * N`, so all `N` slots are usable and a full ring is still
+/// distinct from an empty one for any `N`. Callers must keep to one producer (`push*`) and
+/// one consumer (`pop*`, `peek_slice`, `skip`, `clear`) at a time, whether by context (an IRQ
+/// handler feeding one thread) or by a lock held on that side.
+pub struct SpscRing<T: Copy, const N: usize> {
+    /// Next position to write; advanced only by the producer.
+    head: CachePadded<AtomicUsize>,
+    /// Next position to read; advanced only by the consumer.
+    tail: CachePadded<AtomicUsize>,
+    dropped: AtomicU64,
+    slots: UnsafeCell<[MaybeUninit<T>; N]>,
+}
+
+// SAFETY: a slot is written only by the producer while outside `tail..head` and read only by
+// the consumer while inside it; the Release store of `head` (or `tail`) hands it over to the
+// other side's Acquire load.
+unsafe impl<T: Copy + Send, const N: usize> Sync for SpscRing<T, N> {}
+
+impl<T: Copy, const N: usize> SpscRing<T, N> {
+    pub const fn new() -> Self {
+        Self {
+            head: CachePadded(AtomicUsize::new(0)),
+            tail: CachePadded(AtomicUsize::new(0)),
+            dropped: AtomicU64::new(0),
+            slots: UnsafeCell::new([const { MaybeUninit::uninit() }; N]),
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        let tail = self.tail.0.load(Ordering::Acquire);
+        let head = self.head.0.load(Ordering::Acquire);
+        Self::distance(head, tail)
+    }
+
+    /// Values pushed while the ring was full.
+    pub fn dropped(&self) -> u64 {
+        self.dropped.load(Ordering::Relaxed)
+    }
+
+    /// Producer: appends `value`, or drops it and returns false when the ring is full.
+    pub fn push(&self, value: T) -> bool {
+        self.push_slice(core::slice::from_ref(&value)) == 1
+    }
+
+    /// Producer: appends as many of `values` as fit, in order, and drops the rest. Returns
+    /// how many were queued.
+    pub fn push_slice(&self, values: &[T]) -> usize {
+        let head = self.head.0.load(Ordering::Relaxed);
+        let tail = self.tail.0.load(Ordering::Acquire);
+        let count = values.len().min(N - Self::distance(head, tail));
+        let start = head % N;
+        let first = count.min(N - start);
+        let slots = self.slots.get().cast::<T>();
+        // SAFETY: the `count` slots from `start` (wrapping) lie outside `tail..head`, so the
+        // consumer does not touch them until the store below publishes them.
+        unsafe {
+            copy_nonoverlapping(values.as_ptr(), slots.add(start), first);
+            copy_nonoverlapping(values.as_ptr().add(first), slots, count - first);
+        }
+        self.head
+            .0
+            .store(Self::advance(head, count), Ordering::Release);
+        if count < values.len() {
+            self.dropped
+                .fetch_add((values.len() - count) as u64, Ordering::Relaxed);
+        }
+        count
+    }
+
+    /// Producer: lets `fill` write values straight into up to `max` free slots, handed over
+    /// as at most two contiguous runs in ring order. `fill` returns how many values it wrote
+    /// at the front of each run; a short run ends the push. Returns how many were queued.
+    pub fn push_with(
+        &self,
+        max: usize,
+        mut fill: impl FnMut(&mut [MaybeUninit<T>]) -> usize,
+    ) -> usize {
+        let head = self.head.0.load(Ordering::Relaxed);
+        let tail = self.tail.0.load(Ordering::Acquire);
+        let free = max.min(N - Self::distance(head, tail));
+        let start = head % N;
+        let first = free.min(N - start);
+        let slots = self.slots.get().cast::<MaybeUninit<T>>();
+        let mut count = 0usize;
+        for (offset, len) in [(start, first), (0, free - first)] {
+            if len == 0 {
+                break;
+            }
+            // SAFETY: the run lies within the `free` slots from `start` (wrapping), outside
+            // `tail..head`, so the consumer does not touch it until the store below.
+            let run = unsafe { core::slice::from_raw_parts_mut(slots.add(offset), len) };
+            let written = fill(run).min(len);
+            count += written;
+            if written < len {
+                break;
+            }
+        }
+        self.head
+            .0
+            .store(Self::advance(head, count), Ordering::Release);
+        count
+    }
+
+    /// Consumer: removes and returns the oldest value.
+    pub fn pop(&self) -> Option<T> {
+        let tail = self.tail.0.load(Ordering::Relaxed);
+        if Self::distance(self.head.0.load(Ordering::Acquire), tail) == 0 {
+            return None;
+        }
+        // SAFETY: the ring is not empty, so the slot at `tail` holds a published value.
+        let value = unsafe { self.slots.get().cast::<T>().add(tail % N).read() };
+        self.tail.0.store(Self::advance(tail, 1), Ordering::Release);
+        Some(value)
+    }
+
+    /// Consumer: moves up to `out.len()` of the oldest values into `out`; returns how many.
+    pub fn pop_slice(&self, out: &mut [T]) -> usize {
+        let count = self.peek_slice(out);
+        self.skip(count)
+    }
+
+    /// Consumer: copies up to `out.len()` of the oldest values into `out` without removing
+    /// them; returns how many.
+    pub fn peek_slice(&self, out: &mut [T]) -> usize {
+        let tail = self.tail.0.load(Ordering::Relaxed);
+        let head = self.head.0.load(Ordering::Acquire);
+        let count = out.len().min(Self::distance(head, tail));
+        let start = tail % N;
+        let first = count.min(N - start);
+        let slots = self.slots.get().cast::<T>();
+        // SAFETY: the `count` slots from `start` (wrapping) lie inside `tail..head`, so they
+        // hold published values the producer will not overwrite until `tail` moves past them.
+        unsafe {
+            copy_nonoverlapping(slots.add(start), out.as_mut_ptr(), first);
+            copy_nonoverlapping(slots, out.as_mut_ptr().add(first), count - first);
+        }
+        count
+    }
+
+    /// Consumer: discards up to `count` of the oldest values; returns how many.
+    pub fn skip(&self, count: usize) -> usize {
+        let tail = self.tail.0.load(Ordering::Relaxed);
+        let head = self.head.0.load(Ordering::Acquire);
+        let count = count.min(Self::distance(head, tail));
+        self.tail
+            .0
+            .store(Self::advance(tail, count), Ordering::Release);
+        count
+    }
+
+    /// Consumer: discards everything queued.
+    pub fn clear(&self) {
+        let head = self.head.0.load(Ordering::Acquire);
+        self.tail.0.store(head, Ordering::Release);
+    }
+
+    const fn advance(position: usize, count: usize) -> usize {
+        (position + count) % (2 * N)
+    }
+
+    const fn distance(head: usize, tail: usize) -> usize {
+        (head + 2 * N - tail) % (2 * N)
+    }
+}
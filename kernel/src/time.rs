@@ -1,22 +1,156 @@
-// kernel/src/time.rs: timer tick accounting for IRQ0.
+// kernel/src/time.rs: TSC clocksource, tick accounting and the next-event timer.
+use crate::arch::x86_64::{lapic, pit};
 use core::sync::atomic::{AtomicBool, AtomicU64, Ordering};
 
+/// Tick unit for every timeout in the kernel. With a one-shot event timer nothing interrupts
+/// at this rate any more; `ticks()` is derived from the clocksource instead.
 pub const PIT_HZ: u32 = 100;
+pub const TICK_NS: u64 = 1_000_000_000 / PIT_HZ as u64;
+/// Shortest delay the one-shot timer is armed for, so a late deadline still fires promptly
+/// without an interrupt storm.
+const MIN_EVENT_NS: u64 = 20_000;
+const CPUID_INVARIANT_TSC: u32 = 1 << 8;
 
 static TIMER_TICKS: AtomicU64 = AtomicU64::new(0);
+static TIMER_EVENTS: AtomicU64 = AtomicU64::new(0);
 static LAST_REPORTED_SECOND: AtomicU64 = AtomicU64::new(0);
 static HEARTBEAT_ENABLED: AtomicBool = AtomicBool::new(false);
+static TSC_HZ: AtomicU64 = AtomicU64::new(0);
+static TSC_BASE: AtomicU64 = AtomicU64::new(0);
+/// Nanoseconds per TSC cycle in 32.32 fixed point; 0 until calibrated.
+static TSC_NS_MULT: AtomicU64 = AtomicU64::new(0);
+static ONE_SHOT: AtomicBool = AtomicBool::new(false);
+
+#[derive(Clone, Copy)]
+pub struct ClockReport {
+    pub clocksource: &'static str,
+    pub tsc_hz: u64,
+    pub invariant_tsc: bool,
+    pub event_timer: &'static str,
+    pub event_timer_hz: u64,
+    pub event_detail: &'static str,
+}
+
+/// Calibrates the TSC against the PIT and, when that works, switches the event timer to the
+/// local APIC in one-shot mode. Runs once from interrupt setup, before IRQs are enabled.
+pub fn init_clocksource() -> ClockReport {
+    // SAFETY: CPUID leaf 0x8000_0000 exists on every x86_64 CPU; 0x8000_0007 is only read
+    // when it reports that leaf.
+    let invariant_tsc = unsafe {
+        core::arch::x86_64::__cpuid(0x8000_0000).eax >= 0x8000_0007
+            && core::arch::x86_64::__cpuid(0x8000_0007).edx & CPUID_INVARIANT_TSC != 0
+    };
+    let Some(tsc_hz) = pit::calibrate_tsc_hz() else {
+        return ClockReport {
+            clocksource: "pit",
+            tsc_hz: 0,
+            invariant_tsc,
+            event_timer: "pit-periodic",
+            event_timer_hz: u64::from(PIT_HZ),
+            event_detail: "tsc_calibration_failed",
+        };
+    };
+    TSC_HZ.store(tsc_hz, Ordering::Relaxed);
+    TSC_NS_MULT.store(
+        ((1_000_000_000u128 << 32) / u128::from(tsc_hz)) as u64,
+        Ordering::Relaxed,
+    );
+    TSC_BASE.store(
+        read_tsc().saturating_sub(TIMER_TICKS.load(Ordering::Relaxed) * tsc_hz / u64::from(PIT_HZ)),
+        Ordering::Release,
+    );
+
+    match lapic::init(tsc_hz) {
+        Ok(timer_hz) => {
+            ONE_SHOT.store(true, Ordering::Release);
+            ClockReport {
+                clocksource: "tsc",
+                tsc_hz,
+                invariant_tsc,
+                event_timer: "lapic-oneshot",
+                event_timer_hz: timer_hz,
+                event_detail: "ok",
+            }
+        }
+        Err(err) => ClockReport {
+            clocksource: "tsc",
+            tsc_hz,
+            invariant_tsc,
+            event_timer: "pit-periodic",
+            event_timer_hz: u64::from(PIT_HZ),
+            event_detail: err.as_str(),
+        },
+    }
+}
+
+/// True once the periodic PIT tick has been replaced by the one-shot timer.
+pub fn one_shot() -> bool {
+    ONE_SHOT.load(Ordering::Acquire)
+}
+
+/// Asks for a timer interrupt at `deadline_ns` (monotonic), or none at all. With the periodic
+/// PIT fallback the next tick comes regardless and this does nothing.
+pub fn set_next_event(deadline_ns: Option<u64>) {
+    if !one_shot() {
+        return;
+    }
+    match deadline_ns {
+        Some(deadline) => {
+            lapic::arm(deadline.saturating_sub(monotonic_ns()).max(MIN_EVENT_NS));
+        }
+        None => lapic::disarm(),
+    }
+}
 
 pub fn on_timer_tick() -> u64 {
+    TIMER_EVENTS.fetch_add(1, Ordering::Relaxed);
     TIMER_TICKS.fetch_add(1, Ordering::Relaxed) + 1
 }
 
+pub fn on_timer_event() {
+    TIMER_EVENTS.fetch_add(1, Ordering::Relaxed);
+}
+
+/// Timer interrupts taken so far, periodic or one-shot.
+pub fn timer_events() -> u64 {
+    TIMER_EVENTS.load(Ordering::Relaxed)
+}
+
+/// Nanoseconds since boot: from the TSC once calibrated, else from counted PIT ticks.
+pub fn monotonic_ns() -> u64 {
+    if TSC_NS_MULT.load(Ordering::Relaxed) == 0 {
+        return TIMER_TICKS.load(Ordering::Relaxed).saturating_mul(TICK_NS);
+    }
+    tsc_to_ns(read_tsc())
+}
+
+/// Monotonic nanoseconds at time-stamp counter value `tsc`; 0 before calibration.
+pub fn tsc_to_ns(tsc: u64) -> u64 {
+    cycles_to_ns(tsc.saturating_sub(TSC_BASE.load(Ordering::Acquire)))
+}
+
+/// Length of `cycles` TSC cycles in nanoseconds; 0 before calibration.
+pub fn cycles_to_ns(cycles: u64) -> u64 {
+    let mult = TSC_NS_MULT.load(Ordering::Relaxed);
+    ((u128::from(cycles) * u128::from(mult)) >> 32) as u64
+}
+
+pub fn tsc_hz() -> u64 {
+    TSC_HZ.load(Ordering::Relaxed)
+}
+
 pub fn ticks() -> u64 {
-    TIMER_TICKS.load(Ordering::Relaxed)
+    monotonic_ns() / TICK_NS
+}
+
+/// Raw time-stamp counter, for measuring short code paths in cycles.
+pub fn read_tsc() -> u64 {
+    // SAFETY: RDTSC is unprivileged and has no side effects.
+    unsafe { core::arch::x86_64::_rdtsc() }
 }
 
 pub fn uptime_millis() -> u64 {
-    ticks().saturating_mul(1000) / PIT_HZ as u64
+    monotonic_ns() / 1_000_000
 }
 
 pub fn set_heartbeat(enabled: bool) {
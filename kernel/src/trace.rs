@@ -0,0 +1,259 @@
+// kernel/src/trace.rs: TSC-stamped span rings per CPU, exported as Chrome trace JSON.
+use crate::arch::x86_64::smp::{self, MAX_CPUS};
+use crate::{serial, time};
+use core::sync::atomic::{AtomicBool, AtomicU64, Ordering, fence};
+
+/// Spans kept per CPU; older ones are overwritten once a ring wraps.
+const RING_SPANS: usize = 1024;
+
+/// Instrumented code paths. The name's prefix before the dot is the trace category.
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum Span {
+    AudioPoll,
+    ShellPoll,
+    GfxPoll,
+    NetPoll,
+    FsPoll,
+    StoragePoll,
+    UserPoll,
+    DoomPoll,
+    StorageTransfer,
+    StorageCacheIo,
+    NetTransmit,
+    GfxRedrawRegion,
+    DoomDrawFrame,
+    DoomMixAudio,
+}
+
+impl Span {
+    const ALL: [Self; 14] = [
+        Self::AudioPoll,
+        Self::ShellPoll,
+        Self::GfxPoll,
+        Self::NetPoll,
+        Self::FsPoll,
+        Self::StoragePoll,
+        Self::UserPoll,
+        Self::DoomPoll,
+        Self::StorageTransfer,
+        Self::StorageCacheIo,
+        Self::NetTransmit,
+        Self::GfxRedrawRegion,
+        Self::DoomDrawFrame,
+        Self::DoomMixAudio,
+    ];
+
+    pub const fn as_str(self) -> &'static str {
+        match self {
+            Self::AudioPoll => "audio.poll",
+            Self::ShellPoll => "shell.poll",
+            Self::GfxPoll => "gfx.poll",
+            Self::NetPoll => "net.poll",
+            Self::FsPoll => "fs.poll",
+            Self::StoragePoll => "storage.poll",
+            Self::UserPoll => "proc.run_once",
+            Self::DoomPoll => "doom.poll",
+            Self::StorageTransfer => "storage.transfer",
+            Self::StorageCacheIo => "storage.cache_io",
+            Self::NetTransmit => "net.transmit",
+            Self::GfxRedrawRegion => "gfx.redraw_region",
+            Self::DoomDrawFrame => "doom.draw_frame",
+            Self::DoomMixAudio => "doom.mix_audio_slice",
+        }
+    }
+}
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum TraceError {
+    NoTsc,
+}
+
+impl TraceError {
+    pub const fn as_str(self) -> &'static str {
+        match self {
+            Self::NoTsc => "tsc_not_calibrated",
+        }
+    }
+}
+
+/// One finished span. `stamp` is 0 while the slot is being written and the span's sequence
+/// number plus one afterwards, so a dump can tell a torn slot from a whole one.
+struct Slot {
+    stamp: AtomicU64,
+    start_tsc: AtomicU64,
+    cycles: AtomicU64,
+    span: AtomicU64,
+}
+
+impl Slot {
+    const fn new() -> Self {
+        Self {
+            stamp: AtomicU64::new(0),
+            start_tsc: AtomicU64::new(0),
+            cycles: AtomicU64::new(0),
+            span: AtomicU64::new(0),
+        }
+    }
+}
+
+/// Written only by its own CPU; threads preempted on the BSP each claim a distinct slot
+/// through `next`, so no lock is needed.
+struct CpuRing {
+    next: AtomicU64,
+    slots: [Slot; RING_SPANS],
+}
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+static RINGS: [CpuRing; MAX_CPUS] = [const {
+    CpuRing {
+        next: AtomicU64::new(0),
+        slots: [const { Slot::new() }; RING_SPANS],
+    }
+}; MAX_CPUS];
+
+/// Open span; records itself when dropped. Costs one relaxed load while tracing is off.
+pub struct SpanGuard {
+    span: Span,
+    start_tsc: u64,
+}
+
+impl Drop for SpanGuard {
+    fn drop(&mut self) {
+        if self.start_tsc != 0 {
+            record(self.span, self.start_tsc, time::read_tsc());
+        }
+    }
+}
+
+pub fn span(span: Span) -> SpanGuard {
+    SpanGuard {
+        span,
+        start_tsc: begin(),
+    }
+}
+
+/// Start stamp for a span closed later with `record`; 0 while tracing is off.
+pub fn begin() -> u64 {
+    if ENABLED.load(Ordering::Relaxed) {
+        time::read_tsc()
+    } else {
+        0
+    }
+}
+
+/// Appends a span that ran from `start_tsc` to `end_tsc` on the calling CPU, unless it was
+/// begun with tracing off.
+pub fn record(span: Span, start_tsc: u64, end_tsc: u64) {
+    if start_tsc == 0 {
+        return;
+    }
+    let ring = &RINGS[smp::cpu_index()];
+    let seq = ring.next.fetch_add(1, Ordering::Relaxed);
+    let slot = &ring.slots[(seq % RING_SPANS as u64) as usize];
+    slot.stamp.store(0, Ordering::Relaxed);
+    fence(Ordering::Release);
+    slot.start_tsc.store(start_tsc, Ordering::Relaxed);
+    slot.cycles
+        .store(end_tsc.saturating_sub(start_tsc), Ordering::Relaxed);
+    slot.span.store(span as u64, Ordering::Relaxed);
+    slot.stamp.store(seq + 1, Ordering::Release);
+}
+
+/// Clears every ring and starts recording. Needs the TSC clocksource to convert stamps.
+pub fn start() -> Result<(), TraceError> {
+    if time::tsc_hz() == 0 {
+        return Err(TraceError::NoTsc);
+    }
+    ENABLED.store(false, Ordering::Relaxed);
+    for ring in &RINGS {
+        ring.next.store(0, Ordering::Relaxed);
+        for slot in &ring.slots {
+            slot.stamp.store(0, Ordering::Relaxed);
+        }
+    }
+    ENABLED.store(true, Ordering::Release);
+    Ok(())
+}
+
+pub fn stop() {
+    ENABLED.store(false, Ordering::Relaxed);
+}
+
+pub fn log_status() {
+    let (recorded, kept) = RINGS.iter().fold((0u64, 0u64), |(recorded, kept), ring| {
+        let next = ring.next.load(Ordering::Relaxed);
+        (recorded + next, kept + next.min(RING_SPANS as u64))
+    });
+    serial::write_fmt(format_args!(
+        "trace: enabled={} recorded={} kept={} overwritten={} ring={}x{}\n",
+        ENABLED.load(Ordering::Relaxed),
+        recorded,
+        kept,
+        recorded - kept,
+        MAX_CPUS,
+        RING_SPANS
+    ));
+}
+
+/// Writes the kept spans as one Chrome trace JSON object between `trace: dump begin` and
+/// `trace: dump end` lines; load the text in between into Perfetto or chrome://tracing.
+/// Each CPU is one track; spans of threads preempted on the BSP may overlap there.
+pub fn dump() {
+    serial::write_fmt(format_args!(
+        "trace: dump begin tsc_hz={}\n",
+        time::tsc_hz()
+    ));
+    serial::write_line("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    let mut written = 0u64;
+    for (cpu, ring) in RINGS.iter().enumerate() {
+        if !smp::online(cpu) && ring.next.load(Ordering::Relaxed) == 0 {
+            continue;
+        }
+        serial::write_fmt(format_args!(
+            "{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":{},\"args\":{{\"name\":\"cpu{}\"}}}}\n",
+            if written == 0 { "" } else { "," },
+            cpu,
+            cpu
+        ));
+        written += 1;
+        let next = ring.next.load(Ordering::Acquire);
+        for seq in next.saturating_sub(RING_SPANS as u64)..next {
+            let Some((span, start_tsc, cycles)) = read_slot(ring, seq) else {
+                continue;
+            };
+            let start_ns = time::tsc_to_ns(start_tsc);
+            let dur_ns = time::cycles_to_ns(cycles);
+            let name = span.as_str();
+            let category = name.split('.').next().unwrap_or(name);
+            serial::write_fmt(format_args!(
+                ",{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\",\"pid\":0,\"tid\":{},\"ts\":{}.{:03},\"dur\":{}.{:03}}}\n",
+                name,
+                category,
+                cpu,
+                start_ns / 1000,
+                start_ns % 1000,
+                dur_ns / 1000,
+                dur_ns % 1000
+            ));
+            written += 1;
+        }
+    }
+    serial::write_line("]}");
+    serial::write_fmt(format_args!("trace: dump end records={}\n", written));
+}
+
+/// Reads slot `seq` whole, or None when it was overwritten or is still being written.
+fn read_slot(ring: &CpuRing, seq: u64) -> Option<(Span, u64, u64)> {
+    let slot = &ring.slots[(seq % RING_SPANS as u64) as usize];
+    let stamp = slot.stamp.load(Ordering::Acquire);
+    let start_tsc = slot.start_tsc.load(Ordering::Relaxed);
+    let cycles = slot.cycles.load(Ordering::Relaxed);
+    let span = slot.span.load(Ordering::Relaxed);
+    fence(Ordering::Acquire);
+    if stamp != seq + 1 || slot.stamp.load(Ordering::Relaxed) != stamp {
+        return None;
+    }
+    Span::ALL
+        .get(span as usize)
+        .map(|&span| (span, start_tsc, cycles))
+}
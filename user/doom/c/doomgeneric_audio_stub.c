@@ -1,4 +1,5 @@
 /* user/doom/c/doomgeneric_audio_stub.c: ArrOSt DoomGeneric audio backend with PCM SFX mixing. */
+#include <emmintrin.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,6 +14,7 @@
 #define ARR_AUDIO_OUTPUT_RATE 44100u
 #define ARR_AUDIO_OUTPUT_CHANNELS 2u
 #define ARR_AUDIO_SLICE_FRAMES 512u
+#define ARR_AUDIO_SLICE_SAMPLES (ARR_AUDIO_SLICE_FRAMES * ARR_AUDIO_OUTPUT_CHANNELS)
 #define ARR_AUDIO_MASTER_GAIN_NUM 9
 #define ARR_AUDIO_MASTER_GAIN_DEN 8
 #define ARR_AUDIO_LIMIT_TARGET 28500u
@@ -45,6 +47,12 @@
 #define ARR_MUSIC_SEMITONE_DEN 1000000u
 #define ARR_MUSIC_PARSE_GUARD 2048u
 #define ARR_MUSIC_FILTER_SHIFT 1
+#define ARR_MUSIC_WAVETABLE_BITS 11u
+#define ARR_MUSIC_WAVETABLE_SIZE (1u << ARR_MUSIC_WAVETABLE_BITS)
+/* Pitch wheel bends reach two semitones either way; the step table covers every note plus
+   that range on both sides. */
+#define ARR_MUSIC_BEND_SEMITONES 2
+#define ARR_MUSIC_STEP_TABLE_SIZE (128 + 2 * ARR_MUSIC_BEND_SEMITONES)
 
 typedef struct {
     int16_t *samples;
@@ -101,6 +109,8 @@ extern void arr_dg_audio_pcm16(const int16_t *samples,
                                uint32_t sample_rate);
 extern uint32_t arr_dg_get_ticks_ms(void);
 extern uint32_t arr_dg_get_realtime_ms(void);
+extern uint64_t arr_dg_trace_begin(void);
+extern void arr_dg_trace_audio_mix(uint64_t start_tsc);
 
 int use_libsamplerate = 0;
 float libsamplerate_scale = 1.0f;
@@ -118,8 +128,8 @@ static uint32_t g_audio_last_update_ms = 0u;
 static uint32_t g_audio_credit_frames = 0u;
 static uint32_t g_limiter_gain_q15 = 32767u;
 static arr_mix_channel_t g_channels[ARR_AUDIO_CHANNELS];
-static int32_t g_mix_buffer[ARR_AUDIO_SLICE_FRAMES * ARR_AUDIO_OUTPUT_CHANNELS];
-static int16_t g_pcm_buffer[ARR_AUDIO_SLICE_FRAMES * ARR_AUDIO_OUTPUT_CHANNELS];
+static int32_t g_mix_buffer[ARR_AUDIO_SLICE_SAMPLES];
+static int16_t g_pcm_buffer[ARR_AUDIO_SLICE_SAMPLES];
 static arr_music_song_t *g_music_song = NULL;
 static uint32_t g_music_cursor = 0u;
 static uint32_t g_music_delay_ticks = 0u;
@@ -127,6 +137,16 @@ static uint32_t g_music_tick_phase = 0u;
 static uint32_t g_music_voice_age = 1u;
 static arr_music_channel_t g_music_channels[ARR_MUSIC_CHANNELS];
 static arr_music_voice_t g_music_voices[ARR_MUSIC_VOICES];
+/* Block scratch: one voice or channel rendered mono before it is panned into a mix. */
+static int16_t g_voice_block[ARR_AUDIO_SLICE_FRAMES];
+static int32_t g_music_mix[ARR_AUDIO_SLICE_SAMPLES];
+/* One period of each pitched waveform, indexed by the top bits of a voice's phase. The
+   triangle spans twice full scale, so it is stored at half height and played at twice the
+   level. */
+static int16_t g_music_wavetables[3][ARR_MUSIC_WAVETABLE_SIZE];
+/* Phase step per effective semitone (note plus pitch-wheel bend). */
+static uint32_t g_music_note_steps[ARR_MUSIC_STEP_TABLE_SIZE];
+static uint8_t g_music_tables_ready = 0u;
 
 static snddevice_t g_sound_devices[] = {
     SNDDEVICE_NONE,
@@ -175,23 +195,60 @@ static uint16_t read_le16(const uint8_t *ptr) {
     return (uint16_t)((uint16_t)ptr[0] | ((uint16_t)ptr[1] << 8));
 }
 
-static int32_t soft_clip_sample(int32_t sample) {
-    int64_t abs_sample = sample < 0 ? -(int64_t)sample : (int64_t)sample;
-    int64_t compressed;
-    int64_t extra;
-
-    if (abs_sample <= (int64_t)ARR_AUDIO_SOFT_CLIP_THRESHOLD) {
-        return sample;
+/* Adds `mono` into the interleaved stereo `mix` with Q15 gains, eight frames per step. */
+static void mix_mono_block(int32_t *mix,
+                           const int16_t *mono,
+                           uint32_t frames,
+                           int16_t left_q15,
+                           int16_t right_q15) {
+    const __m128i gains = _mm_set_epi16(right_q15, left_q15, right_q15, left_q15,
+                                        right_q15, left_q15, right_q15, left_q15);
+    uint32_t i = 0u;
+
+    for (; i + 8u <= frames; i += 8u) {
+        __m128i samples = _mm_loadu_si128((const __m128i *)(mono + i));
+        __m128i halves[2];
+        int half;
+
+        halves[0] = _mm_unpacklo_epi16(samples, samples);
+        halves[1] = _mm_unpackhi_epi16(samples, samples);
+        for (half = 0; half < 2; ++half) {
+            __m128i lo = _mm_mullo_epi16(halves[half], gains);
+            __m128i hi = _mm_mulhi_epi16(halves[half], gains);
+            __m128i *out = (__m128i *)(mix + (i + (uint32_t)half * 4u) * 2u);
+            __m128i first = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 15);
+            __m128i second = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 15);
+            _mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out), first));
+            _mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), second));
+        }
     }
+    for (; i < frames; ++i) {
+        mix[i * 2u] += ((int32_t)mono[i] * left_q15) >> 15;
+        mix[i * 2u + 1u] += ((int32_t)mono[i] * right_q15) >> 15;
+    }
+}
 
-    extra = abs_sample - (int64_t)ARR_AUDIO_SOFT_CLIP_THRESHOLD;
-    compressed = (int64_t)ARR_AUDIO_SOFT_CLIP_THRESHOLD
-        + (extra * (int64_t)ARR_AUDIO_SOFT_CLIP_KNEE)
-            / (extra + (int64_t)ARR_AUDIO_SOFT_CLIP_KNEE);
-    if (compressed > 32767) {
-        compressed = 32767;
+/* Scales raw waveform samples by `level` / 32768 and a Q15 envelope that starts at `env` on
+   the first frame and falls by `step` per frame. The caller keeps the envelope positive. */
+static void shape_block(int16_t *block, uint32_t frames, int32_t env, int32_t step, int16_t level) {
+    const __m128i levels = _mm_set1_epi16(level);
+    __m128i envs = _mm_set_epi16((int16_t)(env - 7 * step), (int16_t)(env - 6 * step),
+                                 (int16_t)(env - 5 * step), (int16_t)(env - 4 * step),
+                                 (int16_t)(env - 3 * step), (int16_t)(env - 2 * step),
+                                 (int16_t)(env - step), (int16_t)env);
+    const __m128i envs_step = _mm_set1_epi16((int16_t)(8 * step));
+    uint32_t i = 0u;
+
+    for (; i + 8u <= frames; i += 8u) {
+        __m128i wave = _mm_loadu_si128((const __m128i *)(block + i));
+        __m128i amp = _mm_slli_epi16(_mm_mulhi_epi16(envs, levels), 1);
+        _mm_storeu_si128((__m128i *)(block + i), _mm_slli_epi16(_mm_mulhi_epi16(wave, amp), 1));
+        envs = _mm_sub_epi16(envs, envs_step);
+    }
+    for (; i < frames; ++i) {
+        int32_t amp = (((env - (int32_t)i * step) * level) >> 16) * 2;
+        block[i] = (int16_t)((((int32_t)block[i] * amp) >> 16) * 2);
     }
-    return sample < 0 ? -(int32_t)compressed : (int32_t)compressed;
 }
 
 static void music_reset_filter(void) {
@@ -247,13 +304,10 @@ static uint8_t music_waveform_for_channel(uint8_t channel, uint8_t program) {
     }
 }
 
-static uint32_t music_note_step_fp(uint8_t note, int16_t pitch) {
-    int semitones = (int)note - 69;
-    int pitch_semitones = (int)(pitch / 4096);
+static uint32_t music_compute_step_fp(int semitones) {
     uint64_t freq_milli_hz = 440000u;
     int i;
 
-    semitones += pitch_semitones;
     if (semitones > 0) {
         for (i = 0; i < semitones; ++i) {
             freq_milli_hz = (freq_milli_hz * ARR_MUSIC_SEMITONE_NUM) / ARR_MUSIC_SEMITONE_DEN;
@@ -279,6 +333,37 @@ static uint32_t music_note_step_fp(uint8_t note, int16_t pitch) {
     }
 }
 
+/* Fills the wavetables and the per-semitone step cache once; both depend only on the
+   output rate. */
+static void music_build_tables(void) {
+    uint32_t i;
+
+    if (g_music_tables_ready != 0u) {
+        return;
+    }
+    for (i = 0u; i < ARR_MUSIC_WAVETABLE_SIZE; ++i) {
+        uint32_t phase = i << (32u - ARR_MUSIC_WAVETABLE_BITS);
+        int32_t tri = (int32_t)((phase >> 15) & 0x1FFFFu);
+        if ((tri & 0x10000) != 0) {
+            tri = 0x1FFFF - tri;
+        }
+        g_music_wavetables[ARR_MUSIC_WAVE_SQUARE][i] =
+            (int16_t)(((phase & 0x80000000u) != 0u) ? -32767 : 32767);
+        g_music_wavetables[ARR_MUSIC_WAVE_SAW][i] =
+            (int16_t)((int32_t)((phase >> 16) & 0xFFFFu) - 32768);
+        g_music_wavetables[ARR_MUSIC_WAVE_TRIANGLE][i] = (int16_t)(tri - 0x8000);
+    }
+    for (i = 0u; i < ARR_MUSIC_STEP_TABLE_SIZE; ++i) {
+        g_music_note_steps[i] = music_compute_step_fp((int)i - ARR_MUSIC_BEND_SEMITONES - 69);
+    }
+    g_music_tables_ready = 1u;
+}
+
+static uint32_t music_note_step_fp(uint8_t note, int16_t pitch) {
+    int index = (int)note + (int)(pitch / 4096) + ARR_MUSIC_BEND_SEMITONES;
+    return g_music_note_steps[clamp_int(index, 0, ARR_MUSIC_STEP_TABLE_SIZE - 1)];
+}
+
 static void music_release_channel(uint8_t channel) {
     uint32_t i;
     for (i = 0u; i < ARR_MUSIC_VOICES; ++i) {
@@ -627,57 +712,113 @@ static void music_advance_timeline(void) {
     }
 }
 
-static int32_t music_voice_sample(arr_music_voice_t *voice) {
-    int32_t wave;
-    int32_t gain;
-    int32_t sample;
+/* Runs the music clock over up to `max_frames` frames and returns how many it covered. Events
+   only fire on the first of them, so the voices hold still for the rest of the span. */
+static uint32_t music_timeline_span(uint32_t max_frames) {
+    uint32_t frames = 1u;
 
-    if (voice == NULL || voice->active == 0u) {
-        return 0;
+    music_advance_timeline();
+    if (g_music_playing == 0u || g_music_paused != 0u) {
+        return max_frames;
     }
+    while (frames < max_frames) {
+        uint32_t phase = g_music_tick_phase + ARR_MUSIC_TICKS_PER_SEC;
+        if (phase >= ARR_AUDIO_OUTPUT_RATE) {
+            if (g_music_delay_ticks <= 1u) {
+                break;
+            }
+            phase -= ARR_AUDIO_OUTPUT_RATE;
+            g_music_delay_ticks -= 1u;
+        }
+        g_music_tick_phase = phase;
+        frames += 1u;
+    }
+    return frames;
+}
 
+static void music_render_wave(arr_music_voice_t *voice, int16_t *block, uint32_t frames) {
+    uint32_t phase = voice->phase_fp;
+    uint32_t i;
+
+    if (voice->waveform == ARR_MUSIC_WAVE_NOISE) {
+        uint32_t state = voice->noise_state;
+        for (i = 0u; i < frames; ++i) {
+            state = state * 1664525u + 1013904223u;
+            block[i] = (int16_t)((int32_t)((state >> 16) & 0xFFFFu) - 32768);
+        }
+        voice->noise_state = state;
+    } else {
+        const int16_t *table = g_music_wavetables[voice->waveform <= ARR_MUSIC_WAVE_TRIANGLE
+                                                      ? voice->waveform
+                                                      : ARR_MUSIC_WAVE_SQUARE];
+        for (i = 0u; i < frames; ++i) {
+            block[i] = table[phase >> (32u - ARR_MUSIC_WAVETABLE_BITS)];
+            phase += voice->step_fp;
+        }
+    }
+    voice->phase_fp = phase;
+}
+
+/* Renders `frames` frames of one voice into the stereo `mix`, retiring it when its release
+   envelope runs out inside the span. */
+static void mix_music_voice(arr_music_voice_t *voice, int32_t *mix, uint32_t frames) {
+    uint32_t alive = frames;
+    int32_t env = (int32_t)voice->env_q15;
+    int32_t step = 0;
+    int gain;
+    int level;
+    int pan;
+
+    if (voice->active == 0u) {
+        return;
+    }
     if (voice->releasing != 0u) {
-        if (voice->env_q15 <= voice->release_step) {
+        step = (int32_t)voice->release_step;
+        if (env <= step) {
+            alive = 0u;
+        } else if ((uint32_t)((env - 1) / step) < frames) {
+            alive = (uint32_t)((env - 1) / step);
+        }
+        if (alive < frames) {
             voice->active = 0u;
             voice->env_q15 = 0u;
-            return 0;
+        } else {
+            voice->env_q15 = (uint16_t)(env - (int32_t)frames * step);
         }
-        voice->env_q15 = (uint16_t)(voice->env_q15 - voice->release_step);
+        env -= step;
+    }
+    if (alive == 0u) {
+        return;
     }
 
-    switch (voice->waveform) {
-        case ARR_MUSIC_WAVE_SAW:
-            wave = (int32_t)((voice->phase_fp >> 16) & 0xFFFFu) - 32768;
-            break;
-        case ARR_MUSIC_WAVE_TRIANGLE: {
-            int32_t tri = (int32_t)((voice->phase_fp >> 15) & 0x1FFFFu);
-            if ((tri & 0x10000) != 0) {
-                tri = 0x1FFFF - tri;
-            }
-            wave = (tri - 0x8000) * 2;
-            break;
-        }
-        case ARR_MUSIC_WAVE_NOISE:
-            voice->noise_state = voice->noise_state * 1664525u + 1013904223u;
-            wave = (int32_t)((voice->noise_state >> 16) & 0xFFFFu) - 32768;
-            break;
-        case ARR_MUSIC_WAVE_SQUARE:
-        default:
-            wave = ((voice->phase_fp & 0x80000000u) != 0u) ? -32767 : 32767;
-            break;
+    gain = (int)voice->velocity;
+    gain = (gain * (int)g_music_channels[voice->channel].volume) / 127;
+    gain = (gain * (int)g_music_volume) / 127;
+    if (gain <= 0) {
+        voice->phase_fp += alive * voice->step_fp;
+        return;
     }
 
-    voice->phase_fp += voice->step_fp;
-    gain = (ARR_MUSIC_BASE_AMPLITUDE * (int32_t)voice->env_q15) / (int32_t)ARR_MUSIC_ENVELOPE_MAX;
-    sample = (wave * gain) / 32768;
-    return sample;
+    level = (ARR_MUSIC_BASE_AMPLITUDE * gain) / 127;
+    if (voice->waveform == ARR_MUSIC_WAVE_TRIANGLE) {
+        level *= 2;
+    }
+    music_render_wave(voice, g_voice_block, alive);
+    shape_block(g_voice_block, alive, env, step, (int16_t)level);
+    pan = clamp_int((int)voice->pan, 0, 127);
+    mix_mono_block(mix,
+                   g_voice_block,
+                   alive,
+                   (int16_t)(((127 - pan) * 32767) / 127),
+                   (int16_t)((pan * 32767) / 127));
 }
 
 static int mix_music_slice(int32_t *mix_buffer, uint32_t frames) {
     uint32_t frame_index;
+    uint32_t span;
     int has_signal = 0;
 
-    if (mix_buffer == NULL || frames == 0u) {
+    if (mix_buffer == NULL || frames == 0u || frames > ARR_AUDIO_SLICE_FRAMES) {
         return 0;
     }
     if (g_music_paused != 0u) {
@@ -690,34 +831,21 @@ static int mix_music_slice(int32_t *mix_buffer, uint32_t frames) {
         music_process_events_until_delay();
     }
 
-    for (frame_index = 0u; frame_index < frames; ++frame_index) {
+    memset(g_music_mix, 0, sizeof(int32_t) * frames * ARR_AUDIO_OUTPUT_CHANNELS);
+    for (frame_index = 0u; frame_index < frames; frame_index += span) {
         uint32_t voice_index;
-        int32_t left = 0;
-        int32_t right = 0;
 
-        music_advance_timeline();
+        span = music_timeline_span(frames - frame_index);
         for (voice_index = 0u; voice_index < ARR_MUSIC_VOICES; ++voice_index) {
-            arr_music_voice_t *voice = &g_music_voices[voice_index];
-            int32_t sample = music_voice_sample(voice);
-            int gain;
-            int pan;
-
-            if (sample == 0 || voice->active == 0u) {
-                continue;
-            }
-
-            gain = (int)voice->velocity;
-            gain = (gain * (int)g_music_channels[voice->channel].volume) / 127;
-            gain = (gain * (int)g_music_volume) / 127;
-            if (gain <= 0) {
-                continue;
-            }
-
-            sample = (sample * gain) / 127;
-            pan = clamp_int((int)voice->pan, 0, 127);
-            left += (sample * (127 - pan)) / 127;
-            right += (sample * pan) / 127;
+            mix_music_voice(&g_music_voices[voice_index],
+                            g_music_mix + frame_index * ARR_AUDIO_OUTPUT_CHANNELS,
+                            span);
         }
+    }
+
+    for (frame_index = 0u; frame_index < frames; ++frame_index) {
+        int32_t left = g_music_mix[frame_index * 2u];
+        int32_t right = g_music_mix[frame_index * 2u + 1u];
 
         g_music_filter_l += (left - g_music_filter_l) >> ARR_MUSIC_FILTER_SHIFT;
         g_music_filter_r += (right - g_music_filter_r) >> ARR_MUSIC_FILTER_SHIFT;
@@ -840,76 +968,67 @@ static arr_cached_sfx_t *cache_sfx(sfxinfo_t *sfxinfo) {
     return cached;
 }
 
-static int32_t sample_channel_frame(const arr_mix_channel_t *channel) {
-    uint32_t index;
-    uint32_t frac;
-    int32_t s0;
-    int32_t s1;
-
-    if (channel == NULL || channel->sfx == NULL || channel->sfx->len == 0u) {
-        return 0;
-    }
-
-    index = channel->position_fp >> 16;
-    if (index >= channel->sfx->len) {
-        return 0;
-    }
-
-    frac = channel->position_fp & 0xFFFFu;
-    s0 = (int32_t)channel->sfx->samples[index];
-    if (frac == 0u || (index + 1u) >= channel->sfx->len) {
-        return s0;
-    }
-
-    s1 = (int32_t)channel->sfx->samples[index + 1u];
-    return s0 + (((s1 - s0) * (int32_t)frac) >> 16);
-}
-
 static void mix_channel(arr_mix_channel_t *channel) {
-    uint32_t frame_index;
+    const int16_t *samples;
+    uint64_t end_fp;
+    uint32_t position;
+    uint32_t step;
+    uint32_t frames;
+    uint32_t i;
     int separation;
-    int left_weight;
-    int right_weight;
     int gain;
 
     if (channel == NULL || channel->active == 0u || channel->sfx == NULL) {
         return;
     }
 
-    gain = clamp_int(channel->volume, 0, 127);
-    separation = clamp_int(channel->separation, 0, 254);
-    left_weight = 254 - separation;
-    right_weight = separation;
+    /* Positions are 16.16 in 32 bits, so a sound longer than that ends where they saturate. */
+    samples = channel->sfx->samples;
+    end_fp = (uint64_t)channel->sfx->len << 16;
+    if (end_fp > UINT32_MAX) {
+        end_fp = UINT32_MAX;
+    }
+    position = channel->position_fp;
+    step = channel->step_fp != 0u ? channel->step_fp : 1u;
+    if ((uint64_t)position >= end_fp) {
+        channel->active = 0u;
+        return;
+    }
+    frames = ARR_AUDIO_SLICE_FRAMES;
+    if ((end_fp - position + step - 1u) / step < frames) {
+        frames = (uint32_t)((end_fp - position + step - 1u) / step);
+    }
 
-    for (frame_index = 0u; frame_index < ARR_AUDIO_SLICE_FRAMES; ++frame_index) {
-        uint32_t sample_index = channel->position_fp >> 16;
-        int32_t sample;
-        int32_t left;
-        int32_t right;
+    for (i = 0u; i < frames; ++i) {
+        uint32_t index = position >> 16;
+        int32_t sample = (int32_t)samples[index];
+        uint32_t frac = position & 0xFFFFu;
 
-        if (sample_index >= channel->sfx->len) {
-            channel->active = 0u;
-            break;
+        if (frac != 0u && (index + 1u) < channel->sfx->len) {
+            sample += (((int32_t)samples[index + 1u] - sample) * (int32_t)(frac >> 1)) >> 15;
         }
+        g_voice_block[i] = (int16_t)sample;
+        position += step;
+    }
 
-        sample = sample_channel_frame(channel);
-        left = (sample * gain * left_weight) / ARR_AUDIO_PAN_DEN;
-        right = (sample * gain * right_weight) / ARR_AUDIO_PAN_DEN;
-        g_mix_buffer[frame_index * 2u] += left;
-        g_mix_buffer[frame_index * 2u + 1u] += right;
-        if (channel->position_fp > UINT32_MAX - channel->step_fp) {
-            channel->position_fp = UINT32_MAX;
-        } else {
-            channel->position_fp += channel->step_fp;
-        }
+    if (frames < ARR_AUDIO_SLICE_FRAMES || (uint64_t)position >= end_fp) {
+        channel->active = 0u;
     }
+    channel->position_fp = position;
+
+    gain = clamp_int(channel->volume, 0, 127);
+    separation = clamp_int(channel->separation, 0, 254);
+    mix_mono_block(g_mix_buffer,
+                   g_voice_block,
+                   frames,
+                   (int16_t)((gain * (254 - separation) * 32767) / ARR_AUDIO_PAN_DEN),
+                   (int16_t)((gain * separation * 32767) / ARR_AUDIO_PAN_DEN));
 }
 
 static int mix_and_submit_audio_slice(void) {
     int channel;
-    uint32_t frame_index;
     uint32_t sample_index;
-    uint64_t abs_sum = 0u;
+    int silent;
     int has_active = 0;
     uint32_t target_gain_q15 = 32767u;
     int64_t peak = 0;
@@ -934,21 +1053,20 @@ static int mix_and_submit_audio_slice(void) {
         return 0;
     }
 
-    for (sample_index = 0u;
-         sample_index < ARR_AUDIO_SLICE_FRAMES * ARR_AUDIO_OUTPUT_CHANNELS;
-         ++sample_index) {
-        int64_t scaled = ((int64_t)g_mix_buffer[sample_index] * (int64_t)ARR_AUDIO_MASTER_GAIN_NUM)
-            / (int64_t)ARR_AUDIO_MASTER_GAIN_DEN;
-        int64_t abs_scaled = scaled < 0 ? -scaled : scaled;
-        if (scaled > 2147483647LL) {
-            scaled = 2147483647LL;
-        } else if (scaled < -2147483648LL) {
-            scaled = -2147483648LL;
-        }
-        g_mix_buffer[sample_index] = (int32_t)scaled;
-        if (abs_scaled > peak) {
-            peak = abs_scaled;
+    /* Peak of the mix after master gain; the limiter below reacts to it once per slice. */
+    {
+        const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        __m128 peaks = _mm_setzero_ps();
+
+        for (sample_index = 0u; sample_index < ARR_AUDIO_SLICE_SAMPLES; sample_index += 4u) {
+            __m128 mixed =
+                _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(g_mix_buffer + sample_index)));
+            peaks = _mm_max_ps(peaks, _mm_and_ps(mixed, abs_mask));
         }
+        peaks = _mm_max_ps(peaks, _mm_movehl_ps(peaks, peaks));
+        peaks = _mm_max_ss(peaks, _mm_shuffle_ps(peaks, peaks, 1));
+        peak = (int64_t)(_mm_cvtss_f32(peaks) * (float)ARR_AUDIO_MASTER_GAIN_NUM
+                         / (float)ARR_AUDIO_MASTER_GAIN_DEN);
     }
     if (peak > (int64_t)ARR_AUDIO_LIMIT_TARGET && peak > 0) {
         target_gain_q15 =
@@ -971,38 +1089,46 @@ static int mix_and_submit_audio_slice(void) {
         g_limiter_gain_q15 = 32767u;
     }
 
-    for (frame_index = 0u; frame_index < ARR_AUDIO_SLICE_FRAMES; ++frame_index) {
-        int32_t mixed_left = g_mix_buffer[frame_index * 2u];
-        int32_t mixed_right = g_mix_buffer[frame_index * 2u + 1u];
-
-        if (g_limiter_gain_q15 < 32767u) {
-            mixed_left =
-                (int32_t)(((int64_t)mixed_left * (int64_t)g_limiter_gain_q15) / 32767LL);
-            mixed_right =
-                (int32_t)(((int64_t)mixed_right * (int64_t)g_limiter_gain_q15) / 32767LL);
-        }
-
-        mixed_left = soft_clip_sample(mixed_left);
-        mixed_right = soft_clip_sample(mixed_right);
-
-        if (mixed_left > 32767) {
-            mixed_left = 32767;
-        } else if (mixed_left < -32768) {
-            mixed_left = -32768;
-        }
-        if (mixed_right > 32767) {
-            mixed_right = 32767;
-        } else if (mixed_right < -32768) {
-            mixed_right = -32768;
+    /* Master gain, limiter gain and the soft knee over the whole slice, eight samples per
+       step; packing to int16 saturates what the knee still leaves above full scale. */
+    {
+        const float gain = (float)ARR_AUDIO_MASTER_GAIN_NUM / (float)ARR_AUDIO_MASTER_GAIN_DEN
+            * (g_limiter_gain_q15 < 32767u ? (float)g_limiter_gain_q15 / 32767.0f : 1.0f);
+        const __m128 scale = _mm_set1_ps(gain);
+        const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000u));
+        const __m128 threshold = _mm_set1_ps((float)ARR_AUDIO_SOFT_CLIP_THRESHOLD);
+        const __m128 knee = _mm_set1_ps((float)ARR_AUDIO_SOFT_CLIP_KNEE);
+        const __m128 full_scale = _mm_set1_ps(32767.0f);
+        __m128i any = _mm_setzero_si128();
+
+        for (sample_index = 0u; sample_index < ARR_AUDIO_SLICE_SAMPLES; sample_index += 8u) {
+            __m128i packed[2];
+            int half;
+
+            for (half = 0; half < 2; ++half) {
+                __m128 mixed = _mm_mul_ps(
+                    _mm_cvtepi32_ps(_mm_loadu_si128(
+                        (const __m128i *)(g_mix_buffer + sample_index + (uint32_t)half * 4u))),
+                    scale);
+                __m128 sign = _mm_and_ps(mixed, sign_mask);
+                __m128 magnitude = _mm_andnot_ps(sign_mask, mixed);
+                __m128 extra = _mm_sub_ps(magnitude, threshold);
+                __m128 knee_out = _mm_min_ps(
+                    _mm_add_ps(threshold,
+                               _mm_div_ps(_mm_mul_ps(extra, knee), _mm_add_ps(extra, knee))),
+                    full_scale);
+                __m128 over = _mm_cmpgt_ps(magnitude, threshold);
+                magnitude = _mm_or_ps(_mm_and_ps(over, knee_out), _mm_andnot_ps(over, magnitude));
+                packed[half] = _mm_cvttps_epi32(_mm_or_ps(magnitude, sign));
+            }
+            packed[0] = _mm_packs_epi32(packed[0], packed[1]);
+            _mm_storeu_si128((__m128i *)(g_pcm_buffer + sample_index), packed[0]);
+            any = _mm_or_si128(any, packed[0]);
         }
-
-        g_pcm_buffer[frame_index * 2u] = (int16_t)mixed_left;
-        g_pcm_buffer[frame_index * 2u + 1u] = (int16_t)mixed_right;
-        abs_sum += (uint64_t)(mixed_left < 0 ? -mixed_left : mixed_left);
-        abs_sum += (uint64_t)(mixed_right < 0 ? -mixed_right : mixed_right);
+        silent = _mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) == 0xFFFF;
     }
 
-    if (abs_sum == 0u) {
+    if (silent) {
         return has_active;
     }
 
@@ -1072,7 +1198,9 @@ static void I_ARR_UpdateSound(void) {
 
     while (g_audio_credit_frames >= ARR_AUDIO_SLICE_FRAMES
            && produced < ARR_AUDIO_MAX_MIX_SLICES_PER_UPDATE) {
+        uint64_t trace_start = arr_dg_trace_begin();
         int has_active = mix_and_submit_audio_slice();
+        arr_dg_trace_audio_mix(trace_start);
         if (has_active == 0) {
             g_audio_credit_frames = 0u;
             break;
@@ -1160,6 +1288,7 @@ static boolean I_ARR_InitMusic(void) {
     g_music_cursor = 0u;
     g_music_voice_age = 1u;
     g_music_score_end_event = 0u;
+    music_build_tables();
     music_reset_channels();
     music_stop_all_voices();
     music_reset_filter();
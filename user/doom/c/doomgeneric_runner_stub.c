@@ -12,3 +12,22 @@ void doomgeneric_Tick(void) {}
 uint32_t arr_doomgeneric_frame_counter(void) {
     return 0u;
 }
+
+/* Mirrors `struct arr_heap_stats` in freestanding_libc.c; the stub build has no Doom heap. */
+struct arr_heap_stats {
+    uint64_t capacity;
+    uint64_t used;
+    uint64_t peak;
+    uint64_t free_bytes;
+    uint64_t largest_free;
+    uint64_t free_blocks;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t failed;
+};
+
+void arr_freestd_heap_stats(struct arr_heap_stats *out) {
+    if (out != 0) {
+        *out = (struct arr_heap_stats){0};
+    }
+}
@@ -0,0 +1,114 @@
+/* user/doom/c/doomgeneric_wad_arrost.c: zero-copy WAD file class for DoomGeneric in ArrOSt. */
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "m_misc.h"
+#include "w_file.h"
+#include "z_zone.h"
+
+/*
+ * Replaces DoomGeneric's w_file_stdc.c (build.rs drops it from the core list) and keeps its
+ * `stdc_wad_file` symbol so W_OpenFile needs no patching. WADs that mmap() cleanly get
+ * `wad.mapped` set, which makes W_CacheLumpNum hand out pointers straight into the embedded
+ * image instead of Z_Malloc'ing and copying every lump. Anything else falls back to stdio.
+ */
+typedef struct {
+    wad_file_t wad;
+    FILE *fstream;
+    int fd;
+} arr_wad_file_t;
+
+extern wad_file_class_t stdc_wad_file;
+
+static wad_file_t *W_Arr_OpenMapped(char *path) {
+    arr_wad_file_t *result;
+    struct stat st;
+    void *mapped;
+    int fd;
+
+    if (stat(path, &st) != 0 || st.st_size <= 0) {
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    result = Z_Malloc(sizeof(arr_wad_file_t), PU_STATIC, 0);
+    result->wad.file_class = &stdc_wad_file;
+    result->wad.mapped = mapped;
+    result->wad.length = (unsigned int)st.st_size;
+    result->fstream = NULL;
+    result->fd = fd;
+    printf("W_OpenFile: mapped %s zero-copy (%u bytes)\n", path, result->wad.length);
+    return &result->wad;
+}
+
+static wad_file_t *W_Arr_OpenFile(char *path) {
+    arr_wad_file_t *result;
+    wad_file_t *mapped;
+    FILE *fstream;
+
+    mapped = W_Arr_OpenMapped(path);
+    if (mapped != NULL) {
+        return mapped;
+    }
+
+    fstream = fopen(path, "rb");
+    if (fstream == NULL) {
+        return NULL;
+    }
+
+    result = Z_Malloc(sizeof(arr_wad_file_t), PU_STATIC, 0);
+    result->wad.file_class = &stdc_wad_file;
+    result->wad.mapped = NULL;
+    result->wad.length = M_FileLength(fstream);
+    result->fstream = fstream;
+    result->fd = -1;
+    return &result->wad;
+}
+
+static void W_Arr_CloseFile(wad_file_t *wad) {
+    arr_wad_file_t *arr_wad = (arr_wad_file_t *)wad;
+
+    if (arr_wad->wad.mapped != NULL) {
+        munmap(arr_wad->wad.mapped, arr_wad->wad.length);
+        close(arr_wad->fd);
+    } else {
+        fclose(arr_wad->fstream);
+    }
+    Z_Free(arr_wad);
+}
+
+static size_t W_Arr_Read(wad_file_t *wad, unsigned int offset, void *buffer, size_t buffer_len) {
+    arr_wad_file_t *arr_wad = (arr_wad_file_t *)wad;
+
+    if (arr_wad->wad.mapped != NULL) {
+        if (offset >= arr_wad->wad.length) {
+            return 0;
+        }
+        if (buffer_len > arr_wad->wad.length - offset) {
+            buffer_len = arr_wad->wad.length - offset;
+        }
+        memcpy(buffer, arr_wad->wad.mapped + offset, buffer_len);
+        return buffer_len;
+    }
+
+    fseek(arr_wad->fstream, offset, SEEK_SET);
+    return fread(buffer, 1, buffer_len, arr_wad->fstream);
+}
+
+wad_file_class_t stdc_wad_file = {
+    W_Arr_OpenFile,
+    W_Arr_CloseFile,
+    W_Arr_Read,
+};
@@ -0,0 +1,20 @@
+/* user/doom/c/freestanding_include/sys/mman.h: minimal freestanding sys/mman shim. */
+#ifndef ARROST_FREESTD_SYS_MMAN_H
+#define ARROST_FREESTD_SYS_MMAN_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define PROT_NONE 0
+#define PROT_READ 1
+#define PROT_WRITE 2
+
+#define MAP_SHARED 1
+#define MAP_PRIVATE 2
+
+#define MAP_FAILED ((void *)-1)
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+int munmap(void *addr, size_t len);
+
+#endif
@@ -9,6 +9,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <time.h>
@@ -20,10 +22,8 @@ int errno = 0;
 #define ARROST_FILE_POOL_SIZE 8u
 #define ARROST_PRINTF_BUF_SIZE 1024u
 #define ARROST_CFG_CAPACITY (32u * 1024u)
-
-typedef struct {
-    size_t size;
-} alloc_header_t;
+/* The embedded WAD is the only file reachable through open(); it gets a fixed descriptor. */
+#define ARROST_WAD_FD 3
 
 struct arr_freestd_file {
     int kind;
@@ -49,8 +49,6 @@ extern void arr_dg_log(const char *bytes, size_t len);
 extern size_t arr_dg_cfg_load(uint8_t *out, size_t cap);
 extern int arr_dg_cfg_store(const uint8_t *data, size_t len);
 
-static unsigned char g_heap[ARROST_LIBC_HEAP_SIZE];
-static size_t g_heap_top = 0;
 static struct arr_freestd_file g_file_pool[ARROST_FILE_POOL_SIZE];
 static struct arr_freestd_file g_stdin = {ARR_FILE_SINK, 0, 0, 0, 0, 0};
 static struct arr_freestd_file g_stdout = {ARR_FILE_SINK, 0, 0, 0, 0, 0};
@@ -58,6 +56,8 @@ static struct arr_freestd_file g_stderr = {ARR_FILE_SINK, 0, 0, 0, 0, 0};
 static unsigned char g_cfg_data[ARROST_CFG_CAPACITY];
 static size_t g_cfg_len = 0;
 static int g_cfg_initialized = 0;
+static size_t g_wad_fd_pos = 0;
+static int g_wad_fd_open = 0;
 static const char g_cfg_default[] =
     "mouse_sensitivity 5\n"
     "sfx_volume 8\n"
@@ -225,29 +225,278 @@ static void reset_file(struct arr_freestd_file *file) {
     file->eof = 0;
 }
 
+/*
+ * Heap: boundary-tagged blocks in `g_heap` with segregated free lists. Every block starts with
+ * a header holding its own size (bit 0 = in use) and the size of the block physically before
+ * it, so free() can coalesce with both neighbours in O(1). Free blocks are kept in one list
+ * per power-of-two size class; `g_heap_bin_mask` marks the non-empty classes.
+ */
+typedef struct heap_block {
+    size_t size;
+    size_t prev_size;
+} heap_block_t;
+
+typedef struct heap_free_block {
+    heap_block_t header;
+    struct heap_free_block *next;
+    struct heap_free_block *prev;
+} heap_free_block_t;
+
+/* Mirrors `HeapStats` in kernel/src/doom_bridge.rs. */
+struct arr_heap_stats {
+    uint64_t capacity;
+    uint64_t used;
+    uint64_t peak;
+    uint64_t free_bytes;
+    uint64_t largest_free;
+    uint64_t free_blocks;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t failed;
+};
+
+#define HEAP_ALIGN 16u
+#define HEAP_HEADER_SIZE sizeof(heap_block_t)
+#define HEAP_MIN_BLOCK sizeof(heap_free_block_t)
+#define HEAP_USED 1u
+#define HEAP_BINS 32u
+
+static _Alignas(HEAP_ALIGN) unsigned char g_heap[ARROST_LIBC_HEAP_SIZE];
+static heap_free_block_t *g_heap_bins[HEAP_BINS];
+static uint32_t g_heap_bin_mask = 0;
+static int g_heap_ready = 0;
+static struct arr_heap_stats g_heap_stats;
+
+static size_t heap_block_size(const heap_block_t *block) {
+    return block->size & ~(size_t)HEAP_USED;
+}
+
+static int heap_block_used(const heap_block_t *block) {
+    return (block->size & HEAP_USED) != 0;
+}
+
+static heap_block_t *heap_next_block(heap_block_t *block) {
+    return (heap_block_t *)(void *)((unsigned char *)block + heap_block_size(block));
+}
+
+static heap_block_t *heap_prev_block(heap_block_t *block) {
+    return (heap_block_t *)(void *)((unsigned char *)block - block->prev_size);
+}
+
+static unsigned int heap_bin_for(size_t size) {
+    unsigned int bin = 0;
+    size >>= 5;
+    while (size > 1u && bin + 1u < HEAP_BINS) {
+        size >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+static void heap_bin_insert(heap_block_t *block) {
+    heap_free_block_t *free_block = (heap_free_block_t *)block;
+    unsigned int bin = heap_bin_for(heap_block_size(block));
+
+    free_block->prev = 0;
+    free_block->next = g_heap_bins[bin];
+    if (free_block->next != 0) {
+        free_block->next->prev = free_block;
+    }
+    g_heap_bins[bin] = free_block;
+    g_heap_bin_mask |= 1u << bin;
+    g_heap_stats.free_bytes += heap_block_size(block);
+    g_heap_stats.free_blocks++;
+}
+
+static void heap_bin_remove(heap_block_t *block) {
+    heap_free_block_t *free_block = (heap_free_block_t *)block;
+    unsigned int bin = heap_bin_for(heap_block_size(block));
+
+    if (free_block->prev != 0) {
+        free_block->prev->next = free_block->next;
+    } else {
+        g_heap_bins[bin] = free_block->next;
+        if (free_block->next == 0) {
+            g_heap_bin_mask &= ~(1u << bin);
+        }
+    }
+    if (free_block->next != 0) {
+        free_block->next->prev = free_block->prev;
+    }
+    g_heap_stats.free_bytes -= heap_block_size(block);
+    g_heap_stats.free_blocks--;
+}
+
+/* Resizes `block` in place and links the new following block back to it. */
+static void heap_set_size(heap_block_t *block, size_t size, int used) {
+    block->size = size | (used ? HEAP_USED : 0u);
+    heap_next_block(block)->prev_size = size;
+}
+
+static void heap_init(void) {
+    size_t span = ARROST_LIBC_HEAP_SIZE - HEAP_HEADER_SIZE;
+    heap_block_t *first = (heap_block_t *)(void *)g_heap;
+    heap_block_t *end = (heap_block_t *)(void *)(g_heap + span);
+
+    /* A zero-sized in-use block at the end stops forward coalescing. */
+    end->size = HEAP_USED;
+    first->prev_size = 0;
+    heap_set_size(first, span, 0);
+    g_heap_stats.capacity = span;
+    heap_bin_insert(first);
+    g_heap_ready = 1;
+}
+
+static void heap_release(heap_block_t *block) {
+    heap_block_t *next = heap_next_block(block);
+    size_t size = heap_block_size(block);
+
+    if (!heap_block_used(next)) {
+        heap_bin_remove(next);
+        size += heap_block_size(next);
+    }
+    if (block->prev_size != 0) {
+        heap_block_t *prev = heap_prev_block(block);
+        if (!heap_block_used(prev)) {
+            heap_bin_remove(prev);
+            size += heap_block_size(prev);
+            block = prev;
+        }
+    }
+    heap_set_size(block, size, 0);
+    heap_bin_insert(block);
+}
+
+/* Splits the tail of an in-use block off into a free block when it is big enough to reuse. */
+static void heap_trim(heap_block_t *block, size_t size) {
+    size_t current = heap_block_size(block);
+    heap_block_t *rest;
+
+    if (current - size < HEAP_MIN_BLOCK) {
+        return;
+    }
+    heap_set_size(block, size, 1);
+    rest = heap_next_block(block);
+    rest->size = (current - size) | HEAP_USED;
+    heap_release(rest);
+}
+
+static heap_block_t *heap_find_fit(size_t size) {
+    unsigned int bin = heap_bin_for(size);
+    heap_free_block_t *candidate;
+    uint32_t larger;
+
+    /* Blocks in the request's own class may still be too small; any larger class fits. */
+    for (candidate = g_heap_bins[bin]; candidate != 0; candidate = candidate->next) {
+        if (heap_block_size(&candidate->header) >= size) {
+            return &candidate->header;
+        }
+    }
+    larger = bin + 1u < HEAP_BINS ? g_heap_bin_mask & ~((2u << bin) - 1u) : 0u;
+    if (larger == 0) {
+        return 0;
+    }
+    return &g_heap_bins[__builtin_ctz(larger)]->header;
+}
+
+static size_t heap_request_size(size_t size) {
+    if (size > ARROST_LIBC_HEAP_SIZE) {
+        return 0;
+    }
+    size = align_up(size + HEAP_HEADER_SIZE, HEAP_ALIGN);
+    return size < HEAP_MIN_BLOCK ? HEAP_MIN_BLOCK : size;
+}
+
+static void heap_account_used(void) {
+    size_t used = g_heap_stats.capacity - g_heap_stats.free_bytes;
+    g_heap_stats.used = used;
+    if (used > g_heap_stats.peak) {
+        g_heap_stats.peak = used;
+    }
+}
+
+static uint64_t heap_largest_free(void) {
+    heap_free_block_t *candidate;
+    uint64_t largest = 0;
+
+    if (g_heap_bin_mask == 0) {
+        return 0;
+    }
+    for (candidate = g_heap_bins[31u - (unsigned int)__builtin_clz(g_heap_bin_mask)]; candidate != 0;
+         candidate = candidate->next) {
+        if (heap_block_size(&candidate->header) > largest) {
+            largest = heap_block_size(&candidate->header);
+        }
+    }
+    return largest;
+}
+
+static void heap_report_failure(size_t size) {
+    char line[160];
+    int len;
+
+    g_heap_stats.failed++;
+    len = snprintf(line, sizeof(line),
+                   "libc: malloc(%lu) failed used=%lu free=%lu largest_free=%lu free_blocks=%lu\n",
+                   (unsigned long)size, (unsigned long)g_heap_stats.used,
+                   (unsigned long)g_heap_stats.free_bytes, (unsigned long)heap_largest_free(),
+                   (unsigned long)g_heap_stats.free_blocks);
+    if (len > 0) {
+        arr_dg_log(line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1u);
+    }
+}
+
+void arr_freestd_heap_stats(struct arr_heap_stats *out) {
+    if (out == 0) {
+        return;
+    }
+    if (!g_heap_ready) {
+        heap_init();
+    }
+    *out = g_heap_stats;
+    out->largest_free = heap_largest_free();
+}
+
 void *malloc(size_t size) {
     size_t total;
-    alloc_header_t *header;
+    heap_block_t *block;
 
+    if (!g_heap_ready) {
+        heap_init();
+    }
     if (size == 0) {
         size = 1;
     }
 
-    total = align_up(sizeof(alloc_header_t) + size, 8u);
-    if (g_heap_top > ARROST_LIBC_HEAP_SIZE || total > (ARROST_LIBC_HEAP_SIZE - g_heap_top)) {
+    total = heap_request_size(size);
+    block = total == 0 ? 0 : heap_find_fit(total);
+    if (block == 0) {
+        heap_report_failure(size);
         errno = ENOMEM;
         return 0;
     }
 
-    header = (alloc_header_t *)(void *)(g_heap + g_heap_top);
-    header->size = size;
-    g_heap_top += total;
-    return (void *)(header + 1);
+    heap_bin_remove(block);
+    heap_set_size(block, heap_block_size(block), 1);
+    heap_trim(block, total);
+    g_heap_stats.allocs++;
+    heap_account_used();
+    return (void *)(block + 1);
 }
 
 void free(void *ptr) {
-    (void)ptr;
-    /* Bump allocator: no-op free by design for milestone runtime. */
+    heap_block_t *block;
+
+    if (ptr == 0) {
+        return;
+    }
+    block = ((heap_block_t *)ptr) - 1;
+    if (!heap_block_used(block)) {
+        return;
+    }
+    g_heap_stats.frees++;
+    heap_release(block);
+    heap_account_used();
 }
 
 void *calloc(size_t count, size_t size) {
@@ -267,9 +516,11 @@ void *calloc(size_t count, size_t size) {
 }
 
 void *realloc(void *ptr, size_t size) {
-    alloc_header_t *header;
-    size_t old_size;
-    void *next;
+    heap_block_t *block;
+    heap_block_t *next;
+    size_t total;
+    size_t current;
+    void *moved;
 
     if (ptr == 0) {
         return malloc(size);
@@ -279,15 +530,37 @@ void *realloc(void *ptr, size_t size) {
         return 0;
     }
 
-    header = ((alloc_header_t *)ptr) - 1;
-    old_size = header->size;
+    block = ((heap_block_t *)ptr) - 1;
+    current = heap_block_size(block);
+    total = heap_request_size(size);
+    if (total == 0) {
+        heap_report_failure(size);
+        errno = ENOMEM;
+        return 0;
+    }
 
-    next = malloc(size);
-    if (next == 0) {
+    /* Shrink in place, or grow into a free neighbour, before falling back to a copy. */
+    if (total <= current) {
+        heap_trim(block, total);
+        heap_account_used();
+        return ptr;
+    }
+    next = heap_next_block(block);
+    if (!heap_block_used(next) && current + heap_block_size(next) >= total) {
+        heap_bin_remove(next);
+        heap_set_size(block, current + heap_block_size(next), 1);
+        heap_trim(block, total);
+        heap_account_used();
+        return ptr;
+    }
+
+    moved = malloc(size);
+    if (moved == 0) {
         return 0;
     }
-    memcpy(next, ptr, old_size < size ? old_size : size);
-    return next;
+    memcpy(moved, ptr, current - HEAP_HEADER_SIZE);
+    free(ptr);
+    return moved;
 }
 
 int abs(int value) {
@@ -1385,15 +1658,33 @@ int mkdir(const char *path, int mode) {
 }
 
 int close(int fd) {
-    (void)fd;
+    if (fd == ARROST_WAD_FD) {
+        g_wad_fd_open = 0;
+        g_wad_fd_pos = 0;
+    }
     return 0;
 }
 
 ssize_t read(int fd, void *buf, size_t count) {
-    (void)fd;
-    (void)buf;
-    (void)count;
-    return 0;
+    const uint8_t *wad;
+    size_t wad_len;
+    size_t available;
+
+    if (fd != ARROST_WAD_FD || !g_wad_fd_open || buf == 0) {
+        return 0;
+    }
+    wad = arr_dg_wad_ptr();
+    wad_len = arr_dg_wad_len();
+    if (wad == 0 || g_wad_fd_pos >= wad_len) {
+        return 0;
+    }
+    available = wad_len - g_wad_fd_pos;
+    if (count > available) {
+        count = available;
+    }
+    memcpy(buf, wad + g_wad_fd_pos, count);
+    g_wad_fd_pos += count;
+    return (ssize_t)count;
 }
 
 ssize_t write(int fd, const void *buf, size_t count) {
@@ -1415,12 +1706,51 @@ int usleep(unsigned int usec) {
 }
 
 int open(const char *path, int flags, ...) {
-    (void)path;
-    (void)flags;
+    if (path_is_wad(path) && (flags & (O_WRONLY | O_RDWR)) == 0) {
+        if (arr_dg_wad_ptr() == 0 || arr_dg_wad_len() == 0) {
+            errno = ENOENT;
+            return -1;
+        }
+        g_wad_fd_open = 1;
+        g_wad_fd_pos = 0;
+        return ARROST_WAD_FD;
+    }
     errno = ENOENT;
     return -1;
 }
 
+/*
+ * Maps part of the embedded WAD read-only. The image already lives in kernel memory, so the
+ * mapping is just a pointer into it: no copy, no heap. Writable mappings are refused because
+ * the image sits in read-only kernel data.
+ */
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset) {
+    const uint8_t *wad = arr_dg_wad_ptr();
+    size_t wad_len = arr_dg_wad_len();
+    (void)addr;
+    (void)flags;
+
+    if (fd != ARROST_WAD_FD || !g_wad_fd_open || wad == 0) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    if ((prot & PROT_WRITE) != 0) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    if (offset < 0 || (size_t)offset > wad_len || len > wad_len - (size_t)offset) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    return (void *)(uintptr_t)(wad + (size_t)offset);
+}
+
+int munmap(void *addr, size_t len) {
+    (void)addr;
+    (void)len;
+    return 0;
+}
+
 int gettimeofday(struct timeval *tv, struct timezone *tz) {
     uint32_t ms = arr_dg_get_ticks_ms();
     if (tv != 0) {
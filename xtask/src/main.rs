@@ -1,8 +1,11 @@
 use anyhow::{Context, Result, bail};
 use bootloader::DiskImageBuilder;
+use std::collections::BTreeMap;
 use std::io::{Read, Write};
+use std::net::{TcpListener, UdpSocket};
 use std::path::PathBuf;
-use std::process::{ChildStdin, Command, Stdio};
+use std::process::{Child, ChildStdin, Command, Stdio};
+use std::sync::atomic::{AtomicU64, Ordering};
 use std::sync::{Arc, Mutex};
 use std::thread;
 use std::time::{Duration, Instant};
@@ -25,6 +28,15 @@ const DOOM_GENERIC_INCLUDE_DIR: &str = "user/doom/third_party/doomgeneric/doomge
 const DOOM_GENERIC_PORT_SOURCE: &str = "user/doom/c/doomgeneric_arrost.c";
 const DOOM_WAD_HINT: &str = "user/doom/wad/doom1.wad";
 const DOOM_FORCE_FALLBACK_ENV: &str = "ARROST_DOOM_FORCE_FALLBACK";
+const BENCH_DEFAULT_THRESHOLDS: &str = "xtask/bench-thresholds.txt";
+/// Overrides the length of the Doom frame-rate and audio window, in seconds.
+const BENCH_SECONDS_ENV: &str = "ARROST_BENCH_SECONDS";
+const BENCH_DEFAULT_SECONDS: u64 = 20;
+/// Guest-side address of the host under QEMU user networking.
+const BENCH_HOST_IP: &str = "10.0.2.2";
+const BENCH_DISK_KIB: usize = 2048;
+const BENCH_UDP_PACKETS: u64 = 5000;
+const BENCH_HTTP_BODY_BYTES: usize = 4 * 1024 * 1024;
 
 struct UserArtifact {
     hint: PathBuf,
@@ -60,9 +72,11 @@ fn main() -> Result<()> {
         Some("smoke-doom-long") => smoke_doom_long(),
         Some("smoke-doom-virtio") => smoke_doom_virtio(),
         Some("smoke-doom-fallback") => smoke_doom_fallback(),
+        Some("bench") => bench(args.next(), args.next()),
+        Some("symbolize-profile") => symbolize_profile(args.next(), args.next()),
         _ => {
             eprintln!(
-                "Usage: cargo xtask <build|run|smoke-doom|smoke-doom-long|smoke-doom-virtio|smoke-doom-fallback>"
+                "Usage: cargo xtask <build|run|smoke-doom|smoke-doom-long|smoke-doom-virtio|smoke-doom-fallback|bench [out.json] [thresholds]|symbolize-profile <serial-log> [out]>"
             );
             Ok(())
         }
@@ -561,70 +575,15 @@ fn smoke_doom_impl(long_run: bool, force_fallback: bool, strict_virtio: bool) ->
         "smoke-doom"
     };
 
-    let kernel_image = PathBuf::from(format!(
-        "target/{KERNEL_TARGET}/debug/bootimage-{KERNEL_PACKAGE}.bin"
-    ));
-    if !kernel_image.exists() {
-        bail!(
-            "missing kernel image at {}; run `cargo xtask build` first",
-            kernel_image.display()
-        );
-    }
-
-    let data_image = PathBuf::from(format!("target/{KERNEL_TARGET}/debug/m6-disk.img"));
-    if !data_image.exists() {
-        bail!(
-            "missing storage image at {}; run `cargo xtask build` first",
-            data_image.display()
-        );
-    }
-
-    let mut qemu_cmd = Command::new("bash");
-    qemu_cmd
-        .args(["scripts/qemu.sh"])
-        .env("QEMU_DISPLAY", "none");
-    if strict_virtio {
-        qemu_cmd.env("QEMU_VIRTIO_SND", "on");
-        qemu_cmd.env("QEMU_PCSPK", "off");
-    }
-    if std::env::var_os("QEMU_AUDIO").is_none() {
-        qemu_cmd.env("QEMU_AUDIO", "wav");
-    }
-    if std::env::var_os("QEMU_AUDIO_WAV_PATH").is_none() {
-        qemu_cmd.env(
-            "QEMU_AUDIO_WAV_PATH",
-            format!("target/{KERNEL_TARGET}/debug/{smoke_name}.wav"),
-        );
-    }
-    let mut child = qemu_cmd
-        .stdin(Stdio::piped())
-        .stdout(Stdio::piped())
-        .stderr(Stdio::piped())
-        .spawn()
-        .with_context(|| format!("failed to start qemu run for {smoke_name}"))?;
-
-    let stdout = child
-        .stdout
-        .take()
-        .context("failed to capture qemu stdout")?;
-    let stderr = child
-        .stderr
-        .take()
-        .context("failed to capture qemu stderr")?;
-
-    let log = Arc::new(Mutex::new(Vec::<u8>::new()));
-    let stdout_reader = spawn_log_reader(stdout, Arc::clone(&log));
-    let stderr_reader = spawn_log_reader(stderr, Arc::clone(&log));
+    let mut qemu = QemuSession::start(smoke_name, strict_virtio)?;
+    let log = Arc::clone(&qemu.log);
 
     let smoke_result = (|| -> Result<()> {
         wait_for_log(&log, "arrost> ", Duration::from_secs(40), "shell prompt")?;
         let startup_snapshot = snapshot_log(&log);
         let software_accel_mode = startup_snapshot.contains("Using QEMU acceleration: tcg")
             || startup_snapshot.contains("Using QEMU acceleration: none");
-        let stdin = child
-            .stdin
-            .as_mut()
-            .context("failed to capture qemu stdin")?;
+        let stdin = qemu.stdin()?;
 
         send_serial_command(stdin, "versionx\u{7f}\n")?;
         wait_for_log(
@@ -1173,18 +1132,7 @@ fn smoke_doom_impl(long_run: bool, force_fallback: bool, strict_virtio: bool) ->
         Ok(())
     })();
 
-    if child
-        .try_wait()
-        .context("failed to query qemu process status")?
-        .is_none()
-    {
-        let _ = child.kill();
-    }
-    let _ = child.wait();
-    let _ = stdout_reader.join();
-    let _ = stderr_reader.join();
-
-    let log_snapshot = snapshot_log(&log);
+    let log_snapshot = qemu.stop()?;
     if let Err(error) = smoke_result {
         eprintln!("{smoke_name} failed: {error}");
         eprintln!("----- serial tail -----");
@@ -1220,6 +1168,549 @@ fn smoke_doom_impl(long_run: bool, force_fallback: bool, strict_virtio: bool) ->
     Ok(())
 }
 
+/// Measures Doom frame rate, compositor redraw time, diskfs throughput, UDP send rate, HTTP
+/// download rate and audio underruns in one headless boot. Writes the numbers as JSON and
+/// fails when any metric crosses its threshold.
+fn bench(out_path: Option<String>, thresholds_path: Option<String>) -> Result<()> {
+    let out_path = out_path.map_or_else(
+        || PathBuf::from(format!("target/{KERNEL_TARGET}/debug/bench.json")),
+        PathBuf::from,
+    );
+    let thresholds_path =
+        thresholds_path.map_or_else(|| PathBuf::from(BENCH_DEFAULT_THRESHOLDS), PathBuf::from);
+    let thresholds = load_bench_thresholds(&thresholds_path)?;
+    let window = Duration::from_secs(
+        std::env::var(BENCH_SECONDS_ENV)
+            .ok()
+            .and_then(|value| value.parse::<u64>().ok())
+            .filter(|&seconds| seconds > 0)
+            .unwrap_or(BENCH_DEFAULT_SECONDS),
+    );
+
+    let udp_sink = UdpSocket::bind("127.0.0.1:0").context("failed to bind UDP sink")?;
+    let udp_port = udp_sink.local_addr()?.port();
+    let udp_received = spawn_udp_sink(udp_sink)?;
+    let http_listener = TcpListener::bind("127.0.0.1:0").context("failed to bind HTTP peer")?;
+    let http_port = http_listener.local_addr()?.port();
+    spawn_http_peer(http_listener);
+
+    let mut qemu = QemuSession::start("bench", false)?;
+    let log = Arc::clone(&qemu.log);
+    let bench_result = (|| -> Result<BenchReport> {
+        wait_for_log(&log, "arrost> ", Duration::from_secs(40), "shell prompt")?;
+        let accel = last_matching_line(&snapshot_log(&log), "Using QEMU acceleration: ")
+            .and_then(|line| line.split("Using QEMU acceleration: ").nth(1))
+            .unwrap_or("unknown")
+            .trim()
+            .to_string();
+        let stdin = qemu.stdin()?;
+        if !snapshot_log(&log).contains("DoomGeneric: ready=true") {
+            bail!("doomgeneric ready=false; run `cargo xtask build` with the WAD present");
+        }
+        let ticks = command_output(&log, stdin, "ticks", "ticks: ", Duration::from_secs(8))?;
+        let tsc_hz = metric(&ticks, "tsc_hz=")?;
+        let mut metrics = Vec::new();
+
+        let disk = command_output(
+            &log,
+            stdin,
+            &format!("fs bench {BENCH_DISK_KIB}"),
+            "fs: bench",
+            Duration::from_secs(60),
+        )?;
+        if !disk.contains("backend=diskfs") {
+            bail!("fs bench did not run on diskfs: {disk}");
+        }
+        metrics.push(BenchMetric::new(
+            "disk_write_mb_s",
+            "MB/s",
+            kib_to_mb(metric(&disk, "write_kib_s=")?),
+        ));
+        metrics.push(BenchMetric::new(
+            "disk_read_mb_s",
+            "MB/s",
+            kib_to_mb(metric(&disk, "read_kib_s=")?),
+        ));
+
+        let udp = command_output(
+            &log,
+            stdin,
+            &format!("net bench udp {BENCH_HOST_IP} {udp_port} {BENCH_UDP_PACKETS}"),
+            "net: bench udp",
+            Duration::from_secs(30),
+        )?;
+        metrics.push(BenchMetric::new(
+            "udp_pps",
+            "packets/s",
+            metric(&udp, "pps=")? as f64,
+        ));
+        thread::sleep(Duration::from_millis(500));
+        let udp_delivered = udp_received.load(Ordering::Relaxed);
+
+        let http = command_output(
+            &log,
+            stdin,
+            &format!("net bench http {BENCH_HOST_IP} {http_port} /bench"),
+            "net: bench http",
+            Duration::from_secs(60),
+        )?;
+        if metric(&http, "status=")? != 200
+            || (metric(&http, "bytes=")? as usize) < BENCH_HTTP_BODY_BYTES
+        {
+            bail!("HTTP bench download incomplete: {http}");
+        }
+        metrics.push(BenchMetric::new(
+            "http_mb_s",
+            "MB/s",
+            kib_to_mb(metric(&http, "kib_s=")?),
+        ));
+
+        send_serial_command(stdin, "doom play\n")?;
+        wait_for_log(
+            &log,
+            "doom: play mode started (doomgeneric)",
+            Duration::from_secs(12),
+            "doom play confirmation",
+        )?;
+        wait_for_log(
+            &log,
+            "doom: capture enabled (press ESC to exit)",
+            Duration::from_secs(8),
+            "doom auto-capture enabled",
+        )?;
+        send_serial_command(stdin, "\u{1b}")?;
+        wait_for_log(
+            &log,
+            "doom: capture disabled",
+            Duration::from_secs(8),
+            "doom auto-capture escape",
+        )?;
+        thread::sleep(Duration::from_secs(2));
+
+        let before = DoomSample::take(&log, stdin)?;
+        thread::sleep(window);
+        let after = DoomSample::take(&log, stdin)?;
+        let elapsed_s = after.monotonic_ns.saturating_sub(before.monotonic_ns) as f64 / 1e9;
+        if elapsed_s <= 0.0 {
+            bail!("kernel clock did not advance during the Doom window");
+        }
+        metrics.push(BenchMetric::new(
+            "doom_fps",
+            "frames/s",
+            after.frames.saturating_sub(before.frames) as f64 / elapsed_s,
+        ));
+        metrics.push(BenchMetric::new(
+            "audio_underruns_per_min",
+            "events/min",
+            after.audio_underruns.saturating_sub(before.audio_underruns) as f64 * 60.0 / elapsed_s,
+        ));
+
+        let ui = command_output(
+            &log,
+            stdin,
+            "ui",
+            "ui: backend=uefi-gop ready=true",
+            Duration::from_secs(8),
+        )?;
+        let cycles_to_us = |cycles: u64| cycles as f64 * 1e6 / tsc_hz.max(1) as f64;
+        metrics.push(BenchMetric::new(
+            "compositor_redraw_avg_us",
+            "us",
+            cycles_to_us(metric(&ui, "redraw_cycles_avg=")?),
+        ));
+        metrics.push(BenchMetric::new(
+            "compositor_redraw_max_us",
+            "us",
+            cycles_to_us(metric(&ui, "redraw_cycles_max=")?),
+        ));
+
+        send_serial_command(stdin, "doom stop\n")?;
+        wait_for_log(
+            &log,
+            "doom: runtime stopped",
+            Duration::from_secs(8),
+            "doom stop confirmation",
+        )?;
+        Ok(BenchReport {
+            accel,
+            window_s: elapsed_s,
+            udp_sent: BENCH_UDP_PACKETS,
+            udp_delivered,
+            metrics,
+        })
+    })();
+    let log_snapshot = qemu.stop()?;
+    let report = match bench_result {
+        Ok(report) => report,
+        Err(error) => {
+            eprintln!("bench failed: {error}");
+            eprintln!("----- serial tail -----");
+            eprintln!("{}", log_tail(&log_snapshot, 80));
+            return Err(error);
+        }
+    };
+
+    let mut regressions = 0usize;
+    for metric in &report.metrics {
+        let verdict = match thresholds.iter().find(|limit| limit.metric == metric.name) {
+            Some(limit) if !limit.accepts(metric.value) => {
+                regressions += 1;
+                format!("REGRESSION ({} {})", limit.bound.as_str(), limit.value)
+            }
+            Some(limit) => format!("ok ({} {})", limit.bound.as_str(), limit.value),
+            None => "no threshold".to_string(),
+        };
+        println!(
+            "bench: {:<26} {:>12.2} {:<10} {verdict}",
+            metric.name, metric.value, metric.unit
+        );
+    }
+    std::fs::write(&out_path, report.to_json(&thresholds, regressions))
+        .with_context(|| format!("failed to write {}", out_path.display()))?;
+    println!(
+        "bench: accel={} window={:.1}s udp_delivered={}/{} results={}",
+        report.accel,
+        report.window_s,
+        report.udp_delivered,
+        report.udp_sent,
+        out_path.display()
+    );
+    if regressions > 0 {
+        bail!(
+            "{regressions} benchmark regression(s) against {}",
+            thresholds_path.display()
+        );
+    }
+    Ok(())
+}
+
+struct BenchMetric {
+    name: &'static str,
+    unit: &'static str,
+    value: f64,
+}
+
+impl BenchMetric {
+    fn new(name: &'static str, unit: &'static str, value: f64) -> Self {
+        Self { name, unit, value }
+    }
+}
+
+struct BenchReport {
+    accel: String,
+    window_s: f64,
+    udp_sent: u64,
+    udp_delivered: u64,
+    metrics: Vec<BenchMetric>,
+}
+
+impl BenchReport {
+    fn to_json(&self, thresholds: &[BenchThreshold], regressions: usize) -> String {
+        let metrics: Vec<String> = self
+            .metrics
+            .iter()
+            .map(|metric| {
+                let limit = thresholds.iter().find(|limit| limit.metric == metric.name);
+                let threshold = limit.map_or_else(
+                    || "null".to_string(),
+                    |limit| format!("{{\"{}\": {}}}", limit.bound.as_str(), limit.value),
+                );
+                let pass = limit.is_none_or(|limit| limit.accepts(metric.value));
+                format!(
+                    "    \"{}\": {{\"value\": {:.3}, \"unit\": \"{}\", \"threshold\": {threshold}, \"pass\": {pass}}}",
+                    metric.name, metric.value, metric.unit
+                )
+            })
+            .collect();
+        format!(
+            "{{\n  \"accel\": \"{}\",\n  \"window_s\": {:.3},\n  \"udp_sent\": {},\n  \"udp_delivered\": {},\n  \"metrics\": {{\n{}\n  }},\n  \"regressions\": {regressions}\n}}\n",
+            self.accel,
+            self.window_s,
+            self.udp_sent,
+            self.udp_delivered,
+            metrics.join(",\n")
+        )
+    }
+}
+
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+enum BenchBound {
+    Min,
+    Max,
+}
+
+impl BenchBound {
+    const fn as_str(self) -> &'static str {
+        match self {
+            Self::Min => "min",
+            Self::Max => "max",
+        }
+    }
+}
+
+#[derive(Debug, PartialEq)]
+struct BenchThreshold {
+    metric: String,
+    bound: BenchBound,
+    value: f64,
+}
+
+impl BenchThreshold {
+    fn accepts(&self, value: f64) -> bool {
+        match self.bound {
+            BenchBound::Min => value >= self.value,
+            BenchBound::Max => value <= self.value,
+        }
+    }
+}
+
+/// Reads `<metric> <min|max> <value>` lines; `#` starts a comment. A missing file means no
+/// thresholds, so a local run still reports numbers.
+fn load_bench_thresholds(path: &PathBuf) -> Result<Vec<BenchThreshold>> {
+    let Ok(text) = std::fs::read_to_string(path) else {
+        println!("bench: no thresholds at {}", path.display());
+        return Ok(Vec::new());
+    };
+    parse_bench_thresholds(&text).with_context(|| format!("invalid {}", path.display()))
+}
+
+fn parse_bench_thresholds(text: &str) -> Result<Vec<BenchThreshold>> {
+    let mut thresholds = Vec::new();
+    for (index, line) in text.lines().enumerate() {
+        let line = line.split('#').next().unwrap_or_default().trim();
+        if line.is_empty() {
+            continue;
+        }
+        let fields: Vec<&str> = line.split_whitespace().collect();
+        let &[metric, bound, value] = fields.as_slice() else {
+            bail!("line {}: expected `<metric> <min|max> <value>`", index + 1);
+        };
+        let bound = match bound {
+            "min" => BenchBound::Min,
+            "max" => BenchBound::Max,
+            _ => bail!("line {}: bound must be min or max", index + 1),
+        };
+        let value = value
+            .parse::<f64>()
+            .with_context(|| format!("line {}: bad value `{value}`", index + 1))?;
+        thresholds.push(BenchThreshold {
+            metric: metric.to_string(),
+            bound,
+            value,
+        });
+    }
+    Ok(thresholds)
+}
+
+/// Counters read at each end of the Doom measurement window.
+struct DoomSample {
+    monotonic_ns: u64,
+    frames: u64,
+    audio_underruns: u64,
+}
+
+impl DoomSample {
+    fn take(log: &Arc<Mutex<Vec<u8>>>, stdin: &mut ChildStdin) -> Result<Self> {
+        let ticks = command_output(log, stdin, "ticks", "ticks: ", Duration::from_secs(8))?;
+        let status = command_output(
+            log,
+            stdin,
+            "doom status",
+            "doom: app=doom engine=",
+            Duration::from_secs(8),
+        )?;
+        let audio = command_output(
+            log,
+            stdin,
+            "doom audio status",
+            "doom: audio period=",
+            Duration::from_secs(8),
+        )?;
+        Ok(Self {
+            monotonic_ns: metric(&ticks, "monotonic_ns=")?,
+            frames: metric(&status, "dg_frames=")?,
+            audio_underruns: metric(&audio, "underruns=")?,
+        })
+    }
+}
+
+/// Sends `command` and returns the first complete line containing `marker` that arrives
+/// after it, so a repeated command never matches an earlier answer.
+fn command_output(
+    log: &Arc<Mutex<Vec<u8>>>,
+    stdin: &mut ChildStdin,
+    command: &str,
+    marker: &str,
+    timeout: Duration,
+) -> Result<String> {
+    let seen = snapshot_log(log).len();
+    send_serial_command(stdin, &format!("{command}\n"))?;
+    let deadline = Instant::now() + timeout;
+    loop {
+        let snapshot = snapshot_log(log);
+        let fresh = snapshot.get(seen..).unwrap_or_default();
+        let complete = &fresh[..fresh.rfind('\n').map_or(0, |end| end + 1)];
+        if let Some(line) = complete.lines().find(|line| line.contains(marker)) {
+            return Ok(line.trim_end().to_string());
+        }
+        if Instant::now() >= deadline {
+            bail!("timeout waiting for `{marker}` after `{command}`");
+        }
+        thread::sleep(Duration::from_millis(50));
+    }
+}
+
+fn metric(line: &str, key: &str) -> Result<u64> {
+    parse_metric_value(line, key).with_context(|| format!("missing {key} in `{line}`"))
+}
+
+fn kib_to_mb(kib_per_s: u64) -> f64 {
+    kib_per_s as f64 * 1024.0 / 1e6
+}
+
+/// Counts datagrams from `net bench udp` until the process exits.
+fn spawn_udp_sink(socket: UdpSocket) -> Result<Arc<AtomicU64>> {
+    let received = Arc::new(AtomicU64::new(0));
+    let counter = Arc::clone(&received);
+    let mut buffer = [0u8; 2048];
+    thread::Builder::new()
+        .name("bench-udp-sink".to_string())
+        .spawn(move || {
+            while socket.recv(&mut buffer).is_ok() {
+                counter.fetch_add(1, Ordering::Relaxed);
+            }
+        })
+        .context("failed to start UDP sink")?;
+    Ok(received)
+}
+
+/// Answers every connection with a fixed `BENCH_HTTP_BODY_BYTES` body, then closes it.
+fn spawn_http_peer(listener: TcpListener) {
+    thread::spawn(move || {
+        let body = vec![b'a'; BENCH_HTTP_BODY_BYTES];
+        for stream in listener.incoming() {
+            let Ok(mut stream) = stream else {
+                continue;
+            };
+            let mut request = Vec::new();
+            let mut chunk = [0u8; 512];
+            while !request.windows(4).any(|window| window == b"\r\n\r\n") {
+                match stream.read(&mut chunk) {
+                    Ok(0) | Err(_) => break,
+                    Ok(len) => request.extend_from_slice(&chunk[..len]),
+                }
+            }
+            let header = format!(
+                "HTTP/1.0 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: {}\r\nConnection: close\r\n\r\n",
+                body.len()
+            );
+            let _ = stream
+                .write_all(header.as_bytes())
+                .and_then(|()| stream.write_all(&body));
+        }
+    });
+}
+
+/// Headless QEMU started through `scripts/qemu.sh`, with stdout and stderr (the serial
+/// console) collected into `log`.
+struct QemuSession {
+    child: Child,
+    log: Arc<Mutex<Vec<u8>>>,
+    readers: Vec<thread::JoinHandle<()>>,
+}
+
+impl QemuSession {
+    /// Boots the last `cargo xtask build`. `name` labels errors and the captured WAV file;
+    /// `strict_virtio` forces virtio-sound with the PC speaker off.
+    fn start(name: &str, strict_virtio: bool) -> Result<Self> {
+        let kernel_image = PathBuf::from(format!(
+            "target/{KERNEL_TARGET}/debug/bootimage-{KERNEL_PACKAGE}.bin"
+        ));
+        if !kernel_image.exists() {
+            bail!(
+                "missing kernel image at {}; run `cargo xtask build` first",
+                kernel_image.display()
+            );
+        }
+
+        let data_image = PathBuf::from(format!("target/{KERNEL_TARGET}/debug/m6-disk.img"));
+        if !data_image.exists() {
+            bail!(
+                "missing storage image at {}; run `cargo xtask build` first",
+                data_image.display()
+            );
+        }
+
+        let mut qemu_cmd = Command::new("bash");
+        qemu_cmd
+            .args(["scripts/qemu.sh"])
+            .env("QEMU_DISPLAY", "none");
+        if strict_virtio {
+            qemu_cmd.env("QEMU_VIRTIO_SND", "on");
+            qemu_cmd.env("QEMU_PCSPK", "off");
+        }
+        if std::env::var_os("QEMU_AUDIO").is_none() {
+            qemu_cmd.env("QEMU_AUDIO", "wav");
+        }
+        if std::env::var_os("QEMU_AUDIO_WAV_PATH").is_none() {
+            qemu_cmd.env(
+                "QEMU_AUDIO_WAV_PATH",
+                format!("target/{KERNEL_TARGET}/debug/{name}.wav"),
+            );
+        }
+        let mut child = qemu_cmd
+            .stdin(Stdio::piped())
+            .stdout(Stdio::piped())
+            .stderr(Stdio::piped())
+            .spawn()
+            .with_context(|| format!("failed to start qemu run for {name}"))?;
+
+        let stdout = child
+            .stdout
+            .take()
+            .context("failed to capture qemu stdout")?;
+        let stderr = child
+            .stderr
+            .take()
+            .context("failed to capture qemu stderr")?;
+
+        let log = Arc::new(Mutex::new(Vec::<u8>::new()));
+        let readers = vec![
+            spawn_log_reader(stdout, Arc::clone(&log)),
+            spawn_log_reader(stderr, Arc::clone(&log)),
+        ];
+        Ok(Self {
+            child,
+            log,
+            readers,
+        })
+    }
+
+    fn stdin(&mut self) -> Result<&mut ChildStdin> {
+        self.child
+            .stdin
+            .as_mut()
+            .context("failed to capture qemu stdin")
+    }
+
+    /// Kills QEMU if it still runs and returns everything it printed.
+    fn stop(mut self) -> Result<String> {
+        if self
+            .child
+            .try_wait()
+            .context("failed to query qemu process status")?
+            .is_none()
+        {
+            let _ = self.child.kill();
+        }
+        let _ = self.child.wait();
+        for reader in self.readers.drain(..) {
+            let _ = reader.join();
+        }
+        Ok(snapshot_log(&self.log))
+    }
+}
+
 fn env_truthy(name: &str) -> bool {
     matches!(
         std::env::var(name).ok().as_deref(),
@@ -1406,3 +1897,170 @@ fn ensure_storage_disk_image() -> Result<PathBuf> {
         .with_context(|| format!("failed to size {}", disk_path.display()))?;
     Ok(disk_path)
 }
+
+/// Turns the last `profile dump` in a serial log into folded stacks with function names, one
+/// `frame;frame;... count` line each, ready for flamegraph.pl or inferno-flamegraph.
+fn symbolize_profile(log_path: Option<String>, out_path: Option<String>) -> Result<()> {
+    let log_path =
+        log_path.context("usage: cargo xtask symbolize-profile <serial-log> [out.folded]")?;
+    // Same rule as kernel/build.rs, which writes the map: `CARGO_TARGET_DIR`, else `target`.
+    let target_dir =
+        std::env::var_os("CARGO_TARGET_DIR").map_or_else(|| PathBuf::from("target"), PathBuf::from);
+    let map_path = target_dir.join(format!("{KERNEL_TARGET}/debug/{KERNEL_PACKAGE}.map"));
+    let map = std::fs::read_to_string(&map_path).with_context(|| {
+        format!(
+            "failed to read {} (run cargo xtask build first)",
+            map_path.display()
+        )
+    })?;
+    let mut symbols: Vec<(u64, u64, String)> = map.lines().filter_map(parse_map_symbol).collect();
+    symbols.sort_by_key(|symbol| symbol.0);
+    let log =
+        std::fs::read_to_string(&log_path).with_context(|| format!("failed to read {log_path}"))?;
+
+    let mut dump = None;
+    let mut current: Option<Vec<&str>> = None;
+    for line in log.lines().map(str::trim_end) {
+        if line.starts_with("profile: dump begin") {
+            current = Some(Vec::new());
+        } else if line.starts_with("profile: dump end") {
+            dump = current.take().or(dump);
+        } else if let Some(lines) = current.as_mut() {
+            lines.push(line);
+        }
+    }
+    let dump = dump.with_context(|| format!("no complete profile dump in {log_path}"))?;
+
+    let mut folded: BTreeMap<String, u64> = BTreeMap::new();
+    for line in dump {
+        let Some((stack, count)) = line.rsplit_once(' ') else {
+            continue;
+        };
+        let Ok(count) = count.parse::<u64>() else {
+            continue;
+        };
+        let frames: Vec<&str> = stack.split(';').collect();
+        let leaf = frames.len() - 1;
+        let names: Vec<String> = frames
+            .iter()
+            .enumerate()
+            .map(|(index, frame)| {
+                let Some(addr) = frame
+                    .strip_prefix("0x")
+                    .and_then(|hex| u64::from_str_radix(hex, 16).ok())
+                else {
+                    return (*frame).to_string();
+                };
+                // Callers' frames hold return addresses; step back into the call instruction so
+                // a call at the very end of a function is not charged to the next one.
+                let lookup = if index == leaf { addr } else { addr - 1 };
+                symbol_for(&symbols, lookup).map_or_else(|| format!("{addr:#x}"), str::to_string)
+            })
+            .collect();
+        *folded.entry(names.join(";")).or_default() += count;
+    }
+
+    let output: String = folded
+        .iter()
+        .map(|(stack, count)| format!("{stack} {count}\n"))
+        .collect();
+    match out_path {
+        Some(path) => {
+            std::fs::write(&path, output).with_context(|| format!("failed to write {path}"))?;
+            println!(
+                "profile: wrote {} stacks to {path}; render with flamegraph.pl {path} > profile.svg",
+                folded.len()
+            );
+        }
+        None => print!("{output}"),
+    }
+    Ok(())
+}
+
+/// One symbol line of an lld map: VMA, LMA, size and alignment columns, then the name
+/// indented 16 columns (output sections sit at 0, input sections at 8). Assignments such as
+/// `__bss_start = .` are skipped.
+fn parse_map_symbol(line: &str) -> Option<(u64, u64, String)> {
+    let mut rest = line;
+    let mut fields = [""; 4];
+    for field in &mut fields {
+        rest = rest.trim_start();
+        let end = rest.find(' ')?;
+        *field = &rest[..end];
+        rest = &rest[end + 1..];
+    }
+    let name = rest.strip_prefix("                ")?;
+    if name.is_empty() || name.starts_with(' ') || name.contains(" = ") {
+        return None;
+    }
+    let addr = u64::from_str_radix(fields[0], 16).ok()?;
+    let size = u64::from_str_radix(fields[2], 16).ok()?;
+    (addr != 0).then(|| (addr, size, name.to_string()))
+}
+
+/// Nearest symbol at or below `addr`, unless `addr` lies past that symbol's known size.
+fn symbol_for(symbols: &[(u64, u64, String)], addr: u64) -> Option<&str> {
+    let index = symbols
+        .partition_point(|symbol| symbol.0 <= addr)
+        .checked_sub(1)?;
+    let (start, size, name) = &symbols[index];
+    (*size == 0 || addr < start + size).then_some(name.as_str())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn bench_thresholds_parse_and_apply() {
+        let thresholds = parse_bench_thresholds(
+            "# comment\ndoom_fps min 20\n\naudio_underruns_per_min max 2.5 # trailing\n",
+        )
+        .expect("valid thresholds");
+        assert_eq!(
+            thresholds,
+            [
+                BenchThreshold {
+                    metric: "doom_fps".to_string(),
+                    bound: BenchBound::Min,
+                    value: 20.0,
+                },
+                BenchThreshold {
+                    metric: "audio_underruns_per_min".to_string(),
+                    bound: BenchBound::Max,
+                    value: 2.5,
+                },
+            ]
+        );
+        assert!(thresholds[0].accepts(20.0));
+        assert!(!thresholds[0].accepts(19.9));
+        assert!(!thresholds[1].accepts(3.0));
+        assert!(parse_bench_thresholds("doom_fps above 20\n").is_err());
+        assert!(parse_bench_thresholds("doom_fps min\n").is_err());
+    }
+
+    #[test]
+    fn map_symbols_resolve_addresses() {
+        let map = "\
+             VMA              LMA     Size Align Out     In      Symbol
+ffffffff80000000 ffffffff80000000     1000  4096 .text
+ffffffff80000000 ffffffff80000000      120    16         kernel.o:(.text.foo)
+ffffffff80000000 ffffffff80000000      120     1                 arrost_kernel::foo
+ffffffff80000120 ffffffff80000120      200     1                 arrost_kernel::bar
+ffffffff80001000 ffffffff80001000        0     1                 __bss_start = .
+";
+        let mut symbols: Vec<_> = map.lines().filter_map(parse_map_symbol).collect();
+        symbols.sort_by_key(|symbol| symbol.0);
+        assert_eq!(symbols.len(), 2);
+        assert_eq!(
+            symbol_for(&symbols, 0xffff_ffff_8000_0010),
+            Some("arrost_kernel::foo")
+        );
+        assert_eq!(
+            symbol_for(&symbols, 0xffff_ffff_8000_0120),
+            Some("arrost_kernel::bar")
+        );
+        assert_eq!(symbol_for(&symbols, 0xffff_ffff_8000_0400), None);
+        assert_eq!(symbol_for(&symbols, 0x10), None);
+    }
+}